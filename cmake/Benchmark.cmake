@@ -0,0 +1,41 @@
+# Benchmarks are opt-in and require Google Benchmark to be installed
+# Configure with -DHL_BUILD_BENCHMARKS=ON to build them
+find_package (benchmark REQUIRED)
+find_package (Threads REQUIRED)
+
+# Benchmarks should always be measured with optimizations on
+if (NOT CMAKE_BUILD_TYPE MATCHES "Release")
+    message (STATUS "Benchmarks are being built in ${CMAKE_BUILD_TYPE} mode. Results will not be representative.")
+endif ()
+
+# Include directories needed for benchmarking
+include_directories (
+    ${PROJECT_SOURCE_DIR}/src/libs/portaudio/include
+    ${PROJECT_SOURCE_DIR}/src/libs/portaudio/src/common
+)
+
+function (create_benchmark _bench_file _src_files)
+
+    get_filename_component (_bench_name ${_bench_file} NAME_WE)
+    add_executable (${_bench_name} ${_bench_file} ${_src_files})
+    target_link_libraries (${_bench_name} ${HL_LIBRARIES} benchmark::benchmark ${CMAKE_THREAD_LIBS_INIT})
+
+    # Output benchmark executables to bin/bench
+    set_target_properties (${_bench_name} PROPERTIES
+        RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bin/bench
+    )
+
+endfunction ()
+
+# Build several benchmark files into one executable named _suite_name.
+# _bench_files must include a file that provides main().
+function (create_benchmark_suite _suite_name _bench_files _src_files)
+
+    add_executable (${_suite_name} ${_bench_files} ${_src_files})
+    target_link_libraries (${_suite_name} ${HL_LIBRARIES} benchmark::benchmark ${CMAKE_THREAD_LIBS_INIT})
+
+    set_target_properties (${_suite_name} PROPERTIES
+        RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bin/bench
+    )
+
+endfunction ()
@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "hlaudio/internal/Controller.h"
+#include "hlaudio/internal/FileAudio.h"
 #include "hlaudio/internal/HulaAudioError.h"
 #include "hlaudio/internal/HulaAudioSettings.h"
 
@@ -19,9 +20,18 @@ using namespace hula;
 /**
  * Construct an instance of Controller class.
  * Acts as a bridge between the higher levels and OS level functions
+ *
+ * The backend is picked by HulaAudioSettings::getAudioBackend().
  */
 Controller::Controller()
 {
+    HulaAudioSettings *settings = HulaAudioSettings::getInstance();
+    if (settings->getAudioBackend() == FILE_AUDIO)
+    {
+        audio = new FileAudio(settings->getFileAudioPath(), settings->getFileAudioSpeed());
+        return;
+    }
+
     // Initialize OSAudio based on host OS
     #if defined(__unix__)
     audio = new LinuxAudio();
@@ -38,6 +48,23 @@ Controller::Controller()
     }
 }
 
+/**
+ * Construct a Controller around an existing backend.
+ * Lets tests and benchmarks keep a handle to a FileAudio.
+ *
+ * @param audio Backend to use. The Controller takes ownership of it.
+ */
+Controller::Controller(OSAudio *audio)
+{
+    if (audio == nullptr)
+    {
+        hlDebug() << HL_OS_INIT_MSG << std::endl;
+        throw AudioException(HL_OS_INIT_CODE, HL_OS_INIT_MSG);
+    }
+
+    this->audio = audio;
+}
+
 /**
  * Add an initialized buffer to the list of buffers that receive audio data.
  * As soon as the buffer is added, it should begin receiving data.
@@ -56,16 +83,20 @@ void Controller::addBuffer(HulaRingBuffer *rb)
 /**
  * @ingroup memory_management
  *
- * Allocate and initialize a HulaRingBuffer that can be added to
- * the OSAudio ring buffer list via Controller::addBuffer.
+ * Allocate a reader handle into the shared capture buffer.
+ * All readers share one block of storage that the capture thread
+ * writes once, so adding readers does not add copies.
+ *
+ * The reader starts receiving data once added via Controller::addReader.
  *
- * @return Newly allocated ring buffer
+ * @param duration The maximum length in seconds that the reader may fall behind.
+ * @return Newly allocated reader
  */
-HulaRingBuffer *Controller::createBuffer(float duration)
+HulaBroadcastReader *Controller::createBuffer(float duration)
 {
     try
     {
-        return new HulaRingBuffer(duration);
+        return audio->createReader(duration);
     }
     catch(const AudioException &ae)
     {
@@ -76,22 +107,55 @@ HulaRingBuffer *Controller::createBuffer(float duration)
 /**
  * @ingroup memory_management
  *
- * Allocate and initialize a HulaRingBuffer and automatically
- * add it to the OSAudio ring buffer list.
+ * Allocate a reader handle into the shared capture buffer
+ * and automatically add it to the OSAudio reader list.
+ *
+ * @param duration The maximum length in seconds that the reader may fall behind.
+ * @return Newly allocated reader
  */
-HulaRingBuffer *Controller::createAndAddBuffer(float duration)
+HulaBroadcastReader *Controller::createAndAddBuffer(float duration)
 {
-    HulaRingBuffer *rb = nullptr;
+    HulaBroadcastReader *reader = nullptr;
     try
     {
-        rb = new HulaRingBuffer(duration);
+        reader = audio->createReader(duration);
     }
     catch(const AudioException &ae)
     {
         throw;
     }
-    addBuffer(rb);
-    return rb;
+    addReader(reader);
+    return reader;
+}
+
+/**
+ * Add a reader to the list of readers that receive audio data.
+ * As soon as the reader is added, it should begin receiving data.
+ *
+ * If already present, the reader will not be duplicated.
+ *
+ * This is a publicly exposed wrapper for the OSAudio method.
+ *
+ * @param reader Reader returned by Controller::createBuffer
+ */
+void Controller::addReader(HulaBroadcastReader *reader)
+{
+    audio->addReader(reader);
+}
+
+/**
+ * @ingroup memory_management
+ *
+ * Remove a reader from the list of readers that receive audio data.
+ * The removed reader is not deleted and must be deleted by the user.
+ *
+ * This is a publicly exposed wrapper for the OSAudio method.
+ *
+ * @param reader Reader to remove from the list.
+ */
+void Controller::removeReader(HulaBroadcastReader *reader)
+{
+    audio->removeReader(reader);
 }
 
 /**
@@ -204,6 +268,46 @@ ring_buffer_size_t Controller::playbackCopyToBuffers(const float *samples, ring_
     return audio->playbackCopyToBuffers(samples, sampleCount);
 }
 
+/**
+ * Block the playback feeder until the playback buffer
+ * has room for sampleCount samples.
+ *
+ * Waiting for a refill of
+ * \code (HL_PLAYBACK_RB_DURATION - HL_PLAYBACK_LOW_WATER_DURATION) \endcode
+ * seconds wakes the feeder whenever the buffer drops below the low-water mark.
+ *
+ * @param sampleCount Number of samples the caller wants to write
+ * @param timeoutMs Longest time to wait in milliseconds
+ * @return True if the samples fit, false on timeout
+ */
+bool Controller::waitForPlaybackSpace(ring_buffer_size_t sampleCount, uint32_t timeoutMs)
+{
+    return audio->waitForPlaybackSpace(sampleCount, timeoutMs);
+}
+
+/**
+ * Block until the device has played everything
+ * written to the playback buffer.
+ *
+ * @param timeoutMs Longest time to wait in milliseconds
+ * @return True if the buffer is empty, false on timeout
+ */
+bool Controller::waitForPlaybackDrain(uint32_t timeoutMs)
+{
+    return audio->waitForPlaybackDrain(timeoutMs);
+}
+
+/**
+ * Get the number of samples written to the playback
+ * buffer that the device has not played yet.
+ *
+ * @return Number of buffered samples
+ */
+ring_buffer_size_t Controller::getPlaybackReadAvailable() const
+{
+    return audio->getPlaybackReadAvailable();
+}
+
 /**
  * @ingroup memory_management
  *
@@ -215,20 +319,93 @@ ring_buffer_size_t Controller::playbackCopyToBuffers(const float *samples, ring_
  * getDevices((DeviceType)(DeviceType::RECORD | DeviceType::LOOPBACK))
  * \endcode
  *
+ * The devices are copied from the current device snapshot so this
+ * does not go to the OS unless the device list changed.
+ *
  * @param type DeviceType that is combination from the DeviceType enum
  *
  * @return std::vector<Device*> A list of Device instances that carry the necessary device information
  */
 std::vector<Device *> Controller::getDevices(DeviceType type) const
 {
+    std::vector<Device *> devices;
+
     try
     {
-        return audio->getDevices(type);
+        std::shared_ptr<const DeviceSnapshot> snapshot = audio->getDeviceSnapshot();
+        for (const Device &device : snapshot->devices)
+        {
+            if ((device.getType() & type) != 0)
+            {
+                devices.push_back(new Device(device));
+            }
+        }
     }
     catch(const AudioException &ae)
     {
+        Device::deleteDevices(devices);
         throw;
     }
+
+    return devices;
+}
+
+/**
+ * Get every known device without allocating.
+ *
+ * Unlike getDevices(), the snapshot can be kept around.
+ * It never changes and is freed once the last holder lets go.
+ * Compare its generation against getDeviceGeneration() to
+ * tell whether it is out of date.
+ *
+ * @return Current device snapshot
+ */
+std::shared_ptr<const DeviceSnapshot> Controller::getDeviceSnapshot() const
+{
+    return audio->getDeviceSnapshot();
+}
+
+/**
+ * Get the generation of the device list.
+ * It is incremented every time a device is added, removed or changed.
+ *
+ * @return Current device generation
+ */
+uint64_t Controller::getDeviceGeneration() const
+{
+    return audio->getDeviceGeneration();
+}
+
+/**
+ * Re-enumerate the devices right away instead of waiting
+ * for a change notification.
+ *
+ * @return True if the device list changed
+ */
+bool Controller::refreshDevices() const
+{
+    return audio->refreshDevices();
+}
+
+/**
+ * Register a listener that is notified when the device list changes.
+ *
+ * @param listener Listener to add
+ */
+void Controller::addDeviceListener(IDeviceListener *listener)
+{
+    audio->addDeviceListener(listener);
+}
+
+/**
+ * Remove a device listener.
+ * The listener is never called again once this returns.
+ *
+ * @param listener Listener to remove
+ */
+void Controller::removeDeviceListener(IDeviceListener *listener)
+{
+    audio->removeDeviceListener(listener);
 }
 
 /**
@@ -279,6 +456,56 @@ bool Controller::setActiveOutputDevice(Device *device) const
     }
 }
 
+/**
+ * Get the time between audio entering the active input device
+ * and being delivered to buffers and callbacks.
+ *
+ * Only meaningful while capture is running.
+ *
+ * @return Latency in seconds or -1 if unknown.
+ */
+double Controller::getInputLatency() const
+{
+    return audio->getInputLatency();
+}
+
+/**
+ * Get the live pipeline statistics so that consumers outside
+ * of the audio backend can add their own measurements.
+ *
+ * Only ever updated with relaxed atomics, so it is safe to
+ * use from the audio and encoder threads.
+ *
+ * @return Statistics owned by the backend
+ */
+PipelineStats *Controller::getStats() const
+{
+    return audio->getStats();
+}
+
+/**
+ * Take a copy of the pipeline statistics: xruns, fill levels and
+ * high-water marks of every attached buffer, the capture interval
+ * histogram, time spent in consumers and capture-to-disk latency.
+ *
+ * Works in any build, including those without debug output.
+ *
+ * @return Snapshot of the statistics
+ */
+PipelineStatsSnapshot Controller::getStatsSnapshot() const
+{
+    return audio->getStatsSnapshot();
+}
+
+/**
+ * Set the pipeline counters back to zero.
+ * The counters kept by each buffer are not affected.
+ */
+void Controller::resetStats() const
+{
+    audio->getStats()->reset();
+}
+
 /**
  * Deconstructs the current instance of the Controller class
  */
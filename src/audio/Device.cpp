@@ -21,7 +21,7 @@ Device::Device(DeviceID id, std::string name, DeviceType t)
  *
  * @return id Pointer to a integer
  */
-DeviceID Device::getID()
+DeviceID Device::getID() const
 {
     return deviceID;
 }
@@ -31,7 +31,7 @@ DeviceID Device::getID()
  *
  * @return name String representing the name of the device
  */
-std::string Device::getName()
+std::string Device::getName() const
 {
     return deviceName;
 }
@@ -41,7 +41,7 @@ std::string Device::getName()
  *
  * @return type DeviceType enum value
  */
-DeviceType Device::getType()
+DeviceType Device::getType() const
 {
     return type;
 }
@@ -0,0 +1,260 @@
+#include "hlaudio/internal/FftPlan.h"
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "hlaudio/internal/HulaAudioError.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define HL_FFT_SSE
+    #include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define HL_FFT_NEON
+    #include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+using namespace hula;
+
+/**
+ * Construct a plan for transforms of the given size.
+ *
+ * @param size Number of real input samples. Must be a power of 2 and at least 4.
+ */
+FftPlan::FftPlan(size_t size)
+{
+    if (size < 4 || (size & (size - 1)) != 0)
+    {
+        throw AudioException(HL_FFT_SIZE_CODE, HL_FFT_SIZE_MSG);
+    }
+
+    this->size = size;
+    this->half = size / 2;
+
+    int levels = 0;
+    while ((1ULL << levels) < this->half)
+    {
+        levels++;
+    }
+
+    this->bitReverse.resize(this->half);
+    for (size_t i = 0; i < this->half; i++)
+    {
+        uint32_t reversed = 0;
+        for (int bit = 0; bit < levels; bit++)
+        {
+            reversed |= ((i >> bit) & 1) << (levels - 1 - bit);
+        }
+        this->bitReverse[i] = reversed;
+    }
+
+    // Computed in double so large sizes don't accumulate error
+    this->twiddleRe.resize(this->half);
+    this->twiddleIm.resize(this->half);
+    for (size_t h = 1; h < this->half; h *= 2)
+    {
+        for (size_t j = 0; j < h; j++)
+        {
+            double angle = M_PI * j / h;
+            this->twiddleRe[h - 1 + j] = (float)std::cos(angle);
+            this->twiddleIm[h - 1 + j] = (float)-std::sin(angle);
+        }
+    }
+
+    this->splitRe.resize(this->half + 1);
+    this->splitIm.resize(this->half + 1);
+    for (size_t k = 0; k <= this->half; k++)
+    {
+        double angle = 2 * M_PI * k / this->size;
+        this->splitRe[k] = (float)std::cos(angle);
+        this->splitIm[k] = (float)std::sin(angle);
+    }
+
+    this->workRe.resize(this->half);
+    this->workIm.resize(this->half);
+    this->binRe.resize(this->half + 1);
+    this->binIm.resize(this->half + 1);
+}
+
+/**
+ * Get the number of real input samples per transform.
+ *
+ * @return Transform size
+ */
+size_t FftPlan::getSize() const
+{
+    return this->size;
+}
+
+/**
+ * Get the number of frequency bins produced by a transform.
+ *
+ * @return size / 2 + 1
+ */
+size_t FftPlan::getBinCount() const
+{
+    return this->half + 1;
+}
+
+/**
+ * Run the radix-2 butterflies over the packed work buffers,
+ * which must already be in bit-reversed order.
+ */
+void FftPlan::transformPacked()
+{
+    float *re = this->workRe.data();
+    float *im = this->workIm.data();
+    size_t n = this->half;
+
+    // First two stages only need trivial twiddles (1 and -i)
+    for (size_t i = 0; i < n; i += 2)
+    {
+        float ar = re[i], ai = im[i];
+        re[i] = ar + re[i + 1];
+        im[i] = ai + im[i + 1];
+        re[i + 1] = ar - re[i + 1];
+        im[i + 1] = ai - im[i + 1];
+    }
+
+    if (n >= 4)
+    {
+        for (size_t i = 0; i < n; i += 4)
+        {
+            float ar = re[i], ai = im[i];
+            re[i] = ar + re[i + 2];
+            im[i] = ai + im[i + 2];
+            re[i + 2] = ar - re[i + 2];
+            im[i + 2] = ai - im[i + 2];
+
+            // Multiply by -i
+            float br = im[i + 3], bi = -re[i + 3];
+            ar = re[i + 1];
+            ai = im[i + 1];
+            re[i + 1] = ar + br;
+            im[i + 1] = ai + bi;
+            re[i + 3] = ar - br;
+            im[i + 3] = ai - bi;
+        }
+    }
+
+    // Remaining stages have at least 4 butterflies per group
+    for (size_t h = 4; h < n; h *= 2)
+    {
+        const float *wRe = this->twiddleRe.data() + h - 1;
+        const float *wIm = this->twiddleIm.data() + h - 1;
+
+        for (size_t i = 0; i < n; i += 2 * h)
+        {
+            float *aRe = re + i;
+            float *aIm = im + i;
+            float *bRe = re + i + h;
+            float *bIm = im + i + h;
+
+            for (size_t j = 0; j < h; j += 4)
+            {
+#if defined(HL_FFT_SSE)
+                __m128 wr = _mm_loadu_ps(wRe + j);
+                __m128 wi = _mm_loadu_ps(wIm + j);
+                __m128 br = _mm_loadu_ps(bRe + j);
+                __m128 bi = _mm_loadu_ps(bIm + j);
+                __m128 ar = _mm_loadu_ps(aRe + j);
+                __m128 ai = _mm_loadu_ps(aIm + j);
+
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+
+                _mm_storeu_ps(aRe + j, _mm_add_ps(ar, tr));
+                _mm_storeu_ps(aIm + j, _mm_add_ps(ai, ti));
+                _mm_storeu_ps(bRe + j, _mm_sub_ps(ar, tr));
+                _mm_storeu_ps(bIm + j, _mm_sub_ps(ai, ti));
+#elif defined(HL_FFT_NEON)
+                float32x4_t wr = vld1q_f32(wRe + j);
+                float32x4_t wi = vld1q_f32(wIm + j);
+                float32x4_t br = vld1q_f32(bRe + j);
+                float32x4_t bi = vld1q_f32(bIm + j);
+                float32x4_t ar = vld1q_f32(aRe + j);
+                float32x4_t ai = vld1q_f32(aIm + j);
+
+                float32x4_t tr = vsubq_f32(vmulq_f32(br, wr), vmulq_f32(bi, wi));
+                float32x4_t ti = vaddq_f32(vmulq_f32(br, wi), vmulq_f32(bi, wr));
+
+                vst1q_f32(aRe + j, vaddq_f32(ar, tr));
+                vst1q_f32(aIm + j, vaddq_f32(ai, ti));
+                vst1q_f32(bRe + j, vsubq_f32(ar, tr));
+                vst1q_f32(bIm + j, vsubq_f32(ai, ti));
+#else
+                for (size_t k = j; k < j + 4; k++)
+                {
+                    float tr = bRe[k] * wRe[k] - bIm[k] * wIm[k];
+                    float ti = bRe[k] * wIm[k] + bIm[k] * wRe[k];
+                    bRe[k] = aRe[k] - tr;
+                    bIm[k] = aIm[k] - ti;
+                    aRe[k] += tr;
+                    aIm[k] += ti;
+                }
+#endif
+            }
+        }
+    }
+}
+
+/**
+ * Compute the spectrum of a block of real samples.
+ *
+ * The output is not scaled. A full scale sine that lands exactly
+ * on a bin has a magnitude of size / 2 there.
+ *
+ * @param input getSize() samples
+ * @param real Receives getBinCount() real parts
+ * @param imag Receives getBinCount() imaginary parts
+ */
+void FftPlan::transform(const float *input, float *real, float *imag)
+{
+    // Even samples become the real part, odd samples the imaginary part
+    for (size_t i = 0; i < this->half; i++)
+    {
+        uint32_t j = this->bitReverse[i];
+        this->workRe[j] = input[2 * i];
+        this->workIm[j] = input[2 * i + 1];
+    }
+
+    transformPacked();
+
+    // Untangle the spectra of the even and odd samples and combine them
+    const float *re = this->workRe.data();
+    const float *im = this->workIm.data();
+    for (size_t k = 0; k <= this->half; k++)
+    {
+        size_t a = (k == this->half) ? 0 : k;
+        size_t b = (k == 0) ? 0 : this->half - k;
+
+        float evenRe = 0.5f * (re[a] + re[b]);
+        float evenIm = 0.5f * (im[a] - im[b]);
+        float oddRe = 0.5f * (im[a] + im[b]);
+        float oddIm = -0.5f * (re[a] - re[b]);
+
+        float c = this->splitRe[k];
+        float s = this->splitIm[k];
+        real[k] = evenRe + c * oddRe + s * oddIm;
+        imag[k] = evenIm + c * oddIm - s * oddRe;
+    }
+}
+
+/**
+ * Compute the magnitude of every bin of a block of real samples.
+ *
+ * @param input getSize() samples
+ * @param magnitudes Receives getBinCount() magnitudes
+ */
+void FftPlan::getMagnitudes(const float *input, float *magnitudes)
+{
+    transform(input, this->binRe.data(), this->binIm.data());
+
+    for (size_t k = 0; k <= this->half; k++)
+    {
+        magnitudes[k] = std::sqrt(this->binRe[k] * this->binRe[k] + this->binIm[k] * this->binIm[k]);
+    }
+}
@@ -0,0 +1,391 @@
+#include "hlaudio/internal/FileAudio.h"
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include "hlaudio/internal/HulaAudioError.h"
+#include "hlaudio/internal/HulaAudioSettings.h"
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * WAVE_FORMAT_* tags of the fmt chunk.
+ */
+#define HL_WAV_FORMAT_PCM 1
+#define HL_WAV_FORMAT_FLOAT 3
+#define HL_WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+using namespace hula;
+
+/**
+ * Construct a new instance of FileAudio.
+ *
+ * The whole input file is read here so that capture never touches the disk.
+ *
+ * @param path WAV file to deliver as captured audio. The tone is generated if empty.
+ * @param speed Playback speed relative to real time. 0 runs as fast as possible.
+ */
+FileAudio::FileAudio(const std::string &path, double speed)
+{
+    this->path = path;
+    this->speed = std::max(0.0, speed);
+    this->sourcePos = 0;
+    this->capturedSamples.store(0);
+    this->playedSamples.store(0);
+
+    if (!path.empty())
+    {
+        loadWav(path);
+    }
+}
+
+/**
+ * Read a RIFF WAVE file into the source buffer.
+ *
+ * Supports 8, 16, 24 and 32-bit PCM as well as 32-bit float.
+ * Channels are mapped onto NUM_CHANNELS by repeating the last one,
+ * so mono files play on every channel. The sample rate is not
+ * converted.
+ *
+ * @param path WAV file to read
+ */
+void FileAudio::loadWav(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        hlDebug() << "Could not open audio input file " << path << std::endl;
+        throw AudioException(HL_FILE_AUDIO_OPEN_CODE, HL_FILE_AUDIO_OPEN_MSG);
+    }
+
+    char riff[12];
+    if (!in.read(riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0)
+    {
+        throw AudioException(HL_FILE_AUDIO_FORMAT_CODE, HL_FILE_AUDIO_FORMAT_MSG);
+    }
+
+    uint16_t formatTag = 0;
+    uint16_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint16_t bitsPerSample = 0;
+    std::vector<uint8_t> data;
+
+    // Walk the chunks until both fmt and data were seen
+    char header[8];
+    while (data.empty() && in.read(header, sizeof(header)))
+    {
+        uint32_t size;
+        memcpy(&size, header + 4, 4);
+
+        if (memcmp(header, "fmt ", 4) == 0 && size >= 16)
+        {
+            std::vector<uint8_t> fmt(size);
+            in.read((char *)fmt.data(), size);
+            memcpy(&formatTag, fmt.data(), 2);
+            memcpy(&channels, fmt.data() + 2, 2);
+            memcpy(&sampleRate, fmt.data() + 4, 4);
+            memcpy(&bitsPerSample, fmt.data() + 14, 2);
+
+            // The real format is the start of the sub format GUID
+            if (formatTag == HL_WAV_FORMAT_EXTENSIBLE && size >= 26)
+            {
+                memcpy(&formatTag, fmt.data() + 24, 2);
+            }
+        }
+        else if (memcmp(header, "data", 4) == 0)
+        {
+            data.resize(size);
+            in.read((char *)data.data(), size);
+            data.resize((size_t)in.gcount());
+        }
+        else
+        {
+            in.seekg(size, std::ios::cur);
+        }
+
+        // Chunks are padded to an even size
+        if (size % 2 == 1)
+        {
+            in.seekg(1, std::ios::cur);
+        }
+    }
+
+    bool pcm = formatTag == HL_WAV_FORMAT_PCM && (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32);
+    bool ieee = formatTag == HL_WAV_FORMAT_FLOAT && bitsPerSample == 32;
+    if (channels == 0 || !(pcm || ieee))
+    {
+        hlDebug() << "Unsupported WAV format " << formatTag << " with " << bitsPerSample << " bits per sample." << std::endl;
+        throw AudioException(HL_FILE_AUDIO_FORMAT_CODE, HL_FILE_AUDIO_FORMAT_MSG);
+    }
+
+    int sampleSize = bitsPerSample / 8;
+    size_t frames = data.size() / ((size_t)sampleSize * channels);
+    if (frames == 0)
+    {
+        throw AudioException(HL_FILE_AUDIO_FORMAT_CODE, HL_FILE_AUDIO_FORMAT_MSG);
+    }
+
+    if ((int)sampleRate != HulaAudioSettings::getInstance()->getSampleRate())
+    {
+        hlDebug() << "Audio input file is " << sampleRate << " Hz. It will play at the wrong speed." << std::endl;
+    }
+
+    std::vector<SAMPLE> samples(frames * channels);
+    if (ieee)
+    {
+        convertToFloat(data.data(), FLOAT_32, samples.data(), samples.size());
+    }
+    else if (bitsPerSample == 16)
+    {
+        convertToFloat(data.data(), INT_16, samples.data(), samples.size());
+    }
+    else if (bitsPerSample == 24)
+    {
+        convertToFloat(data.data(), INT_24, samples.data(), samples.size());
+    }
+    else
+    {
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            if (bitsPerSample == 8)
+            {
+                samples[i] = (data[i] - 128) / 128.0f;
+            }
+            else
+            {
+                int32_t val;
+                memcpy(&val, data.data() + i * 4, 4);
+                samples[i] = val / 2147483648.0f;
+            }
+        }
+    }
+
+    this->source.resize(frames * NUM_CHANNELS);
+    for (size_t f = 0; f < frames; f++)
+    {
+        for (int c = 0; c < NUM_CHANNELS; c++)
+        {
+            this->source[f * NUM_CHANNELS + c] = samples[f * channels + std::min(c, channels - 1)];
+        }
+    }
+
+    hlDebug() << "Loaded " << frames << " frames from " << path << std::endl;
+}
+
+/**
+ * Fill a block with the next frames of the file or the tone.
+ * The file starts over once it reaches the end.
+ *
+ * @param block Room for frames * NUM_CHANNELS samples
+ * @param frames Number of frames
+ */
+void FileAudio::fillBlock(SAMPLE *block, size_t frames)
+{
+    if (!this->source.empty())
+    {
+        size_t sourceFrames = this->source.size() / NUM_CHANNELS;
+        size_t done = 0;
+        while (done < frames)
+        {
+            size_t pos = (size_t)(this->sourcePos % sourceFrames);
+            size_t count = std::min(frames - done, sourceFrames - pos);
+            std::copy(this->source.begin() + pos * NUM_CHANNELS, this->source.begin() + (pos + count) * NUM_CHANNELS, block + done * NUM_CHANNELS);
+
+            done += count;
+            this->sourcePos += count;
+        }
+        return;
+    }
+
+    // The tone repeats every second, so the phase never loses precision
+    int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+    for (size_t f = 0; f < frames; f++, this->sourcePos++)
+    {
+        double phase = 2 * M_PI * HL_FILE_AUDIO_TONE_FREQ * (double)(this->sourcePos % sampleRate) / sampleRate;
+        float value = (float)(HL_FILE_AUDIO_TONE_AMPLITUDE * std::sin(phase));
+        for (int c = 0; c < NUM_CHANNELS; c++)
+        {
+            block[f * NUM_CHANNELS + c] = value;
+        }
+    }
+}
+
+/**
+ * Sleep until the given number of frames is due at the configured speed.
+ *
+ * @param start Time at which the first frame was due
+ * @param frames Number of frames delivered since start
+ */
+void FileAudio::pace(std::chrono::steady_clock::time_point start, uint64_t frames)
+{
+    if (this->speed <= 0)
+    {
+        return;
+    }
+
+    double seconds = frames / (HulaAudioSettings::getInstance()->getSampleRate() * this->speed);
+    std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)));
+}
+
+/**
+ * Capture loop for FileAudio.
+ *
+ * Delivers one block of HulaAudioSettings::getCaptureFragmentSize()
+ * frames at a time to every consumer until told to stop.
+ */
+void FileAudio::capture()
+{
+    int frames = HulaAudioSettings::getInstance()->getCaptureFragmentSize();
+    if (frames <= 0)
+    {
+        frames = HL_FILE_AUDIO_FRAMES_PER_BUFFER;
+    }
+
+    // A block can never be larger than what the broadcast buffer accepts at once
+    frames = std::min(frames, (int)(this->broadcastBuffer->getMaxWindow() / NUM_CHANNELS));
+    this->captureBlock.resize(frames * NUM_CHANNELS);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t framesDelivered = 0;
+
+    while (!this->endCapture.load())
+    {
+        fillBlock(this->captureBlock.data(), frames);
+
+        getStats()->addCaptureBlock();
+        copyToBuffers(this->captureBlock.data(), (ring_buffer_size_t)this->captureBlock.size());
+        doCallbacks(this->captureBlock.data(), (ring_buffer_size_t)this->captureBlock.size());
+
+        this->capturedSamples.fetch_add(this->captureBlock.size());
+        framesDelivered += frames;
+
+        pace(start, framesDelivered);
+    }
+}
+
+/**
+ * Playback loop for FileAudio.
+ *
+ * Drains the playback buffer at the configured speed
+ * and counts what it consumed.
+ */
+void FileAudio::playback()
+{
+    ring_buffer_size_t elementsToRead = HL_FILE_AUDIO_FRAMES_PER_BUFFER * NUM_CHANNELS;
+    this->playBlock.resize(elementsToRead);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t framesPlayed = 0;
+
+    while (!this->endPlay.load())
+    {
+        ring_buffer_size_t samplesRead = this->playbackBuffer->read(this->playBlock.data(), elementsToRead);
+        if (samplesRead == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(HL_FILE_AUDIO_IDLE_MS));
+
+            // A real device doesn't catch up on time spent starved
+            start = std::chrono::steady_clock::now();
+            framesPlayed = 0;
+            continue;
+        }
+
+        this->playedSamples.fetch_add(samplesRead);
+        framesPlayed += samplesRead / NUM_CHANNELS;
+
+        pace(start, framesPlayed);
+    }
+}
+
+/**
+ * Get the devices that FileAudio offers: one loopback input
+ * and one playback output.
+ * These devices must be deleted by the caller using the
+ * Device::deleteDevices() method.
+ *
+ * @param type DeviceType that is combination from the DeviceType enum
+ * @return List of Device objects
+ */
+std::vector<Device *> FileAudio::getDevices(DeviceType type)
+{
+    std::vector<Device *> devices;
+
+    if (type & DeviceType::LOOPBACK)
+    {
+        DeviceID id;
+        id.linuxID = this->path;
+        devices.push_back(new Device(id, HL_FILE_AUDIO_INPUT_NAME, DeviceType::LOOPBACK));
+    }
+
+    if (type & DeviceType::PLAYBACK)
+    {
+        DeviceID id;
+        devices.push_back(new Device(id, HL_FILE_AUDIO_OUTPUT_NAME, DeviceType::PLAYBACK));
+    }
+
+    return devices;
+}
+
+/**
+ * Any settings work since nothing is opened.
+ *
+ * @param device Device to check against
+ * @return True
+ */
+bool FileAudio::checkDeviceParams(Device *device)
+{
+    (void)device;
+    return true;
+}
+
+/**
+ * Get the number of samples delivered by capture so far.
+ *
+ * @return Interleaved sample count
+ */
+uint64_t FileAudio::getCapturedSampleCount() const
+{
+    return this->capturedSamples.load();
+}
+
+/**
+ * Get the number of samples the playback sink consumed so far.
+ *
+ * @return Interleaved sample count
+ */
+uint64_t FileAudio::getPlayedSampleCount() const
+{
+    return this->playedSamples.load();
+}
+
+/**
+ * Destructor for FileAudio.
+ */
+FileAudio::~FileAudio()
+{
+    hlDebugf("FileAudio destructor called\n");
+
+    stopDeviceWatcher();
+
+    // Both loops use members of this class, so they have to
+    // finish before the OSAudio destructor would join them
+    this->endCapture.store(true);
+    this->endPlay.store(true);
+    for (std::vector<std::thread> *threads : { &inThreads, &outThreads })
+    {
+        for (auto &t : *threads)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+        threads->clear();
+    }
+}
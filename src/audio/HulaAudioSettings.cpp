@@ -17,7 +17,16 @@ HulaAudioSettings::HulaAudioSettings()
     // Audio data
     this->numberOfChannels = 2;
     this->sampleRate = 44100;
-    this->sampleSize = sizeof(float);
+    this->sampleFormat = FLOAT_32;
+    this->sampleSize = getSampleFormatSize(this->sampleFormat);
+
+    // Latency
+    this->captureFragmentSize = 512;
+    this->playbackTargetLength = 0;
+
+    // Backend
+    this->audioBackend = OS_AUDIO;
+    this->fileAudioSpeed = 1.0;
 }
 
 /**
@@ -86,6 +95,73 @@ int HulaAudioSettings::getSampleSize()
     return getInstance()->sampleSize;
 }
 
+/**
+ * Get the sample format for the current global device
+ * configuration. This is the format that captured audio is stored
+ * in from the backend to the temporary record files.
+ * Changing it mid-anything may break stuff.
+ *
+ * @return Sample format that the application is currently configured for
+ */
+SampleFormat HulaAudioSettings::getSampleFormat()
+{
+    return getInstance()->sampleFormat;
+}
+
+/**
+ * Get the number of frames that the backend should deliver per capture
+ * wakeup. Smaller values lower latency at the cost of more wakeups per second.
+ *
+ * Backends that can't control this ignore it.
+ *
+ * @return Capture fragment size in frames
+ */
+int HulaAudioSettings::getCaptureFragmentSize()
+{
+    return getInstance()->captureFragmentSize;
+}
+
+/**
+ * Get the number of frames that the backend should keep queued
+ * on the output device during playback.
+ *
+ * @return Playback target length in frames. 0 lets the backend decide.
+ */
+int HulaAudioSettings::getPlaybackTargetLength()
+{
+    return getInstance()->playbackTargetLength;
+}
+
+/**
+ * Get the audio backend that new Controllers use.
+ *
+ * @return Selected backend
+ */
+AudioBackend HulaAudioSettings::getAudioBackend()
+{
+    return getInstance()->audioBackend;
+}
+
+/**
+ * Get the WAV file that FileAudio captures from.
+ *
+ * @return Path to the file. Empty if a tone is generated instead.
+ */
+std::string HulaAudioSettings::getFileAudioPath()
+{
+    return getInstance()->fileAudioPath;
+}
+
+/**
+ * Get the speed at which FileAudio runs relative to real time.
+ *
+ * @return Speed factor. 0 means as fast as possible.
+ */
+double HulaAudioSettings::getFileAudioSpeed()
+{
+    return getInstance()->fileAudioSpeed;
+}
+
 /**
  * Set whether or not true record devices (i.e. microphones)
  * should be displayed in the device lists.
@@ -136,6 +212,76 @@ void HulaAudioSettings::setSampleSize(int val)
     getInstance()->sampleSize = val;
 }
 
+/**
+ * Set the sample format for the current global device
+ * configuration. This also updates the sample size.
+ * It must be set before the Controller is created since the
+ * shared capture buffer is sized from it.
+ *
+ * @param val Sample format that the application is currently configured for
+ */
+void HulaAudioSettings::setSampleFormat(SampleFormat val)
+{
+    getInstance()->sampleFormat = val;
+    getInstance()->sampleSize = getSampleFormatSize(val);
+}
+
+/**
+ * Set the number of frames that the backend should deliver per capture wakeup.
+ * Takes effect the next time capture starts.
+ *
+ * @param val Capture fragment size in frames
+ */
+void HulaAudioSettings::setCaptureFragmentSize(int val)
+{
+    getInstance()->captureFragmentSize = val;
+}
+
+/**
+ * Set the number of frames that the backend should keep queued
+ * on the output device during playback.
+ * Takes effect the next time playback starts.
+ *
+ * @param val Playback target length in frames. 0 lets the backend decide.
+ */
+void HulaAudioSettings::setPlaybackTargetLength(int val)
+{
+    getInstance()->playbackTargetLength = val;
+}
+
+/**
+ * Set the audio backend that new Controllers use.
+ * Controllers that already exist keep their backend.
+ *
+ * @param val Backend to use
+ */
+void HulaAudioSettings::setAudioBackend(AudioBackend val)
+{
+    getInstance()->audioBackend = val;
+}
+
+/**
+ * Set the WAV file that FileAudio captures from.
+ * Takes effect when the next Controller is created.
+ *
+ * @param val Path to the file. Empty to generate a tone instead.
+ */
+void HulaAudioSettings::setFileAudioPath(const std::string &val)
+{
+    getInstance()->fileAudioPath = val;
+}
+
+/**
+ * Set the speed at which FileAudio runs relative to real time.
+ * Takes effect when the next Controller is created.
+ *
+ * @param val Speed factor. 0 runs as fast as possible.
+ */
+void HulaAudioSettings::setFileAudioSpeed(double val)
+{
+    getInstance()->fileAudioSpeed = val;
+}
+
 /**
  * Destructor for HulaAudioSettings.
  */
@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <unistd.h>
+#include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
 #include <pulse/error.h>
 
@@ -17,6 +18,10 @@ using namespace hula;
  */
 LinuxAudio::LinuxAudio()
 {
+    this->mainloop = nullptr;
+    this->context = nullptr;
+    this->captureStream = nullptr;
+    this->deviceCacheValid.store(false);
 }
 
 /**
@@ -29,6 +34,9 @@ LinuxAudio::LinuxAudio()
  *
  * DO NOT STORE THIS as it may become out-of-date.
  *
+ * Devices are served from a table that is only re-fetched from
+ * the PulseAudio server after it reports a source or sink change.
+ *
  * @return List of Device objects
  */
 std::vector<Device *> LinuxAudio::getDevices(DeviceType type)
@@ -43,25 +51,34 @@ std::vector<Device *> LinuxAudio::getDevices(DeviceType type)
 
     HulaAudioSettings *s = HulaAudioSettings::getInstance();
 
-    // Fetch from pactl
-    if (loopSet || recSet || playSet)
+    if (!(loopSet || recSet || playSet))
     {
-        std::vector<Device *> newDevices = parsePulseAudioDevices();
+        return devices;
+    }
+
+    // Only go to the server if something changed since the last call
+    if (!this->deviceCacheValid.load() && !refreshDeviceCache())
+    {
+        hlDebug() << "Could not fetch PulseAudio devices." << std::endl;
+        return devices;
+    }
 
-        for (int i = 0; i < newDevices.size(); i++)
+    std::lock_guard<std::mutex> lock(this->deviceCacheMutex);
+    for (size_t i = 0; i < this->deviceCache.size(); i++)
+    {
+        Device &device = this->deviceCache[i];
+
+        if (loopSet && device.getType() == DeviceType::LOOPBACK)
         {
-            if (loopSet && newDevices[i]->getType() == DeviceType::LOOPBACK)
-            {
-                devices.push_back(newDevices[i]);
-            }
-            else if (recSet && s->getShowRecordDevices() && newDevices[i]->getType() == DeviceType::RECORD)
-            {
-                devices.push_back(newDevices[i]);
-            }
-            else if (playSet && newDevices[i]->getType() == DeviceType::PLAYBACK)
-            {
-                devices.push_back(newDevices[i]);
-            }
+            devices.push_back(new Device(device));
+        }
+        else if (recSet && s->getShowRecordDevices() && device.getType() == DeviceType::RECORD)
+        {
+            devices.push_back(new Device(device));
+        }
+        else if (playSet && device.getType() == DeviceType::PLAYBACK)
+        {
+            devices.push_back(new Device(device));
         }
     }
 
@@ -69,108 +86,144 @@ std::vector<Device *> LinuxAudio::getDevices(DeviceType type)
 }
 
 /**
- * Helper function to open a pipe, run a command,
- * and return the output.
- *
- * Only works on POSIX compliant systems.
+ * Collects the results of one introspection request.
  */
-std::string pipeAndReadOutput(const char *command)
+struct PulseDeviceQuery
 {
-    std::string output = "";
+    pa_threaded_mainloop *mainloop;
+    std::vector<Device> devices;
+};
 
-    // Open a pipe
-    FILE *pipe = popen(command, "r");
-    if (!pipe)
+/**
+ * Called on the mainloop thread for every source and once more at the end of the list.
+ */
+static void sourceInfoCallback(pa_context *c, const pa_source_info *info, int eol, void *userdata)
+{
+    PulseDeviceQuery *query = (PulseDeviceQuery *)userdata;
+
+    if (eol != 0 || info == nullptr)
     {
-        hlDebug() << "Could not open pipe to execute command: " << command << std::endl;
-        return "";
+        pa_threaded_mainloop_signal(query->mainloop, 0);
+        return;
     }
 
-    char c;
-    while (!feof(pipe) && (c = fgetc(pipe)))
+    DeviceID id;
+    id.linuxID = info->name;
+
+    // Monitors of a sink capture what that sink plays
+    DeviceType type = info->monitor_of_sink != PA_INVALID_INDEX ? DeviceType::LOOPBACK : DeviceType::RECORD;
+
+    query->devices.push_back(Device(id, info->description ? info->description : info->name, type));
+}
+
+/**
+ * Called on the mainloop thread for every sink and once more at the end of the list.
+ */
+static void sinkInfoCallback(pa_context *c, const pa_sink_info *info, int eol, void *userdata)
+{
+    PulseDeviceQuery *query = (PulseDeviceQuery *)userdata;
+
+    if (eol != 0 || info == nullptr)
     {
-        output += c;
+        pa_threaded_mainloop_signal(query->mainloop, 0);
+        return;
     }
 
-    pclose(pipe);
+    DeviceID id;
+    id.linuxID = info->name;
 
-    return output;
+    query->devices.push_back(Device(id, info->description ? info->description : info->name, DeviceType::PLAYBACK));
 }
 
 /**
- * Call pactl list and parse the PulseAudio devices from it.
+ * Called on the mainloop thread when a source or sink is added, removed or changed.
+ */
+static void subscribeCallback(pa_context *c, pa_subscription_event_type_t type, uint32_t idx, void *userdata)
+{
+    LinuxAudio *obj = (LinuxAudio *)userdata;
+    obj->markDevicesChanged();
+}
+
+/**
+ * Drop the cached device table and let device listeners know.
+ * Safe to call from the mainloop thread.
+ */
+void LinuxAudio::markDevicesChanged()
+{
+    this->deviceCacheValid.store(false);
+    OSAudio::markDevicesChanged();
+}
+
+/**
+ * Block until an introspection request has finished.
+ * Must be called with the mainloop locked.
  *
- * This should eventually be replaced by the introspection abilities of
- * the PulseAudio async API. Since we're using the simple API, this will
- * do for now.
+ * @return True if the request completed.
  */
-std::vector<Device *> LinuxAudio::parsePulseAudioDevices()
+static bool waitForOperation(pa_threaded_mainloop *mainloop, pa_operation *op)
 {
-    // If keywords are changed, must update type conditions below
-    std::vector<std::string> keywords = {"Source #", "Sink #"};
-    std::vector<Device *> devices;
-    std::string output;
-    size_t pos;
-    size_t endPos;
+    if (op == nullptr)
+    {
+        return false;
+    }
 
-    output = pipeAndReadOutput("pactl list");
+    while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
+    {
+        pa_threaded_mainloop_wait(mainloop);
+    }
 
-    for (int i = 0; i < keywords.size(); i++)
+    bool done = pa_operation_get_state(op) == PA_OPERATION_DONE;
+    pa_operation_unref(op);
+
+    return done;
+}
+
+/**
+ * Ask the PulseAudio server for all sources and sinks
+ * and replace the cached device table.
+ *
+ * @return True if the cache was refreshed.
+ */
+bool LinuxAudio::refreshDeviceCache()
+{
+    if (!connectContext())
     {
-        endPos = 0;
+        return false;
+    }
 
-        // Split output by keyword
-        while ((pos = output.find(keywords[i], endPos)) != std::string::npos)
-        {
-            DeviceID id;
-            std::string name;
-            DeviceType type;
-            std::string sub;
-            size_t subPos;
-            size_t subEndPos;
-
-            // Search for next identifier to split at
-            endPos = output.find(keywords[i], pos + 1);
-            if (endPos == std::string::npos)
-                sub = output.substr(pos);
-            else
-                sub = output.substr(pos, endPos - pos);
-
-            // Collect id
-            subPos = sub.find("Name: ") + 6;
-            subEndPos = sub.find("\n", subPos);
-            id.linuxID = sub.substr(subPos, subEndPos - subPos);
-
-            // Collect name
-            // TODO: Could decide to strip "Monitor of"
-            subPos = sub.find("Description: ") + 13;
-            subEndPos = sub.find("\n", subPos);
-            name = sub.substr(subPos, subEndPos - subPos);
-
-            if (i == 0 && id.linuxID.find(".monitor", id.linuxID.length() - 8) != std::string::npos)
-            {
-                type = DeviceType::LOOPBACK;
-            }
-            else if (i == 0)
-            {
-                type = DeviceType::RECORD;
-            }
-            else if (i == 1)
-            {
-                type = DeviceType::PLAYBACK;
-            }
+    // Only one refresh at a time. Waiting on the mainloop
+    // releases its lock, so that alone is not enough.
+    std::lock_guard<std::mutex> lock(this->deviceCacheMutex);
 
-#if 0
-            hlDebug() << "Creating device from pactl:" << std::endl;
-            hlDebug() << "    ID: " << id.linuxID << std::endl;
-            hlDebug() << "    Name: " << name << std::endl;
-#endif
+    // Another thread may have just refreshed it
+    if (this->deviceCacheValid.load())
+    {
+        return true;
+    }
 
-            devices.push_back(new Device(id, name, type));
-        }
+    PulseDeviceQuery query;
+    query.mainloop = this->mainloop;
+
+    pa_threaded_mainloop_lock(this->mainloop);
+
+    // Mark valid before asking so that an event arriving
+    // during the request invalidates it again
+    this->deviceCacheValid.store(true);
+
+    bool ok = waitForOperation(this->mainloop, pa_context_get_source_info_list(this->context, &sourceInfoCallback, &query));
+    ok = ok && waitForOperation(this->mainloop, pa_context_get_sink_info_list(this->context, &sinkInfoCallback, &query));
+
+    pa_threaded_mainloop_unlock(this->mainloop);
+
+    if (!ok)
+    {
+        this->deviceCacheValid.store(false);
+        return false;
     }
 
-    return devices;
+    this->deviceCache.swap(query.devices);
+
+    return true;
 }
 
 /**
@@ -270,74 +323,411 @@ void LinuxAudio::startPAVUControl()
    Device * recordingDevice is already formatted as hw:(int),(int)
    if Device is nullptr then it chooses the default
    */
+/**
+ * Map a SampleFormat to the matching PulseAudio format.
+ *
+ * @param format Sample format.
+ * @return PulseAudio sample format.
+ */
+static pa_sample_format_t getPulseSampleFormat(SampleFormat format)
+{
+    switch (format)
+    {
+        case INT_16:
+            return PA_SAMPLE_S16LE;
+        case INT_24:
+            return PA_SAMPLE_S24LE;
+        case FLOAT_32:
+        default:
+            return PA_SAMPLE_FLOAT32LE;
+    }
+}
+
+/**
+ * Start the PulseAudio mainloop thread and connect to the server.
+ * Does nothing if already connected. Reconnects if the server went away.
+ *
+ * @return True if the context is ready.
+ */
+bool LinuxAudio::connectContext()
+{
+    std::lock_guard<std::mutex> lock(this->contextMutex);
+
+    if (this->context != nullptr)
+    {
+        pa_threaded_mainloop_lock(this->mainloop);
+        bool good = PA_CONTEXT_IS_GOOD(pa_context_get_state(this->context));
+        bool capturing = this->captureStream != nullptr;
+        pa_threaded_mainloop_unlock(this->mainloop);
+
+        if (good)
+        {
+            return true;
+        }
+
+        // The server went away. Reconnect unless a stream still needs cleaning up.
+        if (capturing)
+        {
+            return false;
+        }
+
+        disconnectContext();
+    }
+
+    this->mainloop = pa_threaded_mainloop_new();
+    if (this->mainloop == nullptr)
+    {
+        return false;
+    }
+
+    this->context = pa_context_new(pa_threaded_mainloop_get_api(this->mainloop), "HulaLoop");
+    if (this->context == nullptr)
+    {
+        disconnectContext();
+        return false;
+    }
+
+    pa_context_set_state_callback(this->context, &LinuxAudio::contextStateCallback, this);
+
+    if (pa_threaded_mainloop_start(this->mainloop) < 0)
+    {
+        disconnectContext();
+        return false;
+    }
+
+    pa_threaded_mainloop_lock(this->mainloop);
+
+    if (pa_context_connect(this->context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+    {
+        pa_threaded_mainloop_unlock(this->mainloop);
+        disconnectContext();
+        return false;
+    }
+
+    // Wait for contextStateCallback to report the outcome
+    while (true)
+    {
+        pa_context_state_t state = pa_context_get_state(this->context);
+        if (state == PA_CONTEXT_READY)
+        {
+            break;
+        }
+
+        if (!PA_CONTEXT_IS_GOOD(state))
+        {
+            hlDebugf("PulseAudio context failed: %s\n", pa_strerror(pa_context_errno(this->context)));
+            pa_threaded_mainloop_unlock(this->mainloop);
+            disconnectContext();
+            return false;
+        }
+
+        pa_threaded_mainloop_wait(this->mainloop);
+    }
+
+    // Keep the device table up to date
+    pa_context_set_subscribe_callback(this->context, &subscribeCallback, this);
+    pa_operation *op = pa_context_subscribe(this->context, (pa_subscription_mask_t)(PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE), NULL, NULL);
+    if (op != nullptr)
+    {
+        pa_operation_unref(op);
+    }
+
+    pa_threaded_mainloop_unlock(this->mainloop);
+
+    return true;
+}
+
+/**
+ * Disconnect from the PulseAudio server and stop the mainloop thread.
+ * No stream may be open. Must be called with contextMutex held.
+ */
+void LinuxAudio::disconnectContext()
+{
+    if (this->context != nullptr)
+    {
+        pa_threaded_mainloop_lock(this->mainloop);
+        pa_context_set_state_callback(this->context, NULL, NULL);
+        pa_context_disconnect(this->context);
+        pa_context_unref(this->context);
+        pa_threaded_mainloop_unlock(this->mainloop);
+
+        this->context = nullptr;
+    }
+
+    if (this->mainloop != nullptr)
+    {
+        pa_threaded_mainloop_stop(this->mainloop);
+        pa_threaded_mainloop_free(this->mainloop);
+
+        this->mainloop = nullptr;
+    }
+}
+
+/**
+ * Wake up whoever is waiting on the mainloop for a context state change.
+ */
+void LinuxAudio::contextStateCallback(pa_context *c, void *userdata)
+{
+    LinuxAudio *obj = (LinuxAudio *)userdata;
+
+    // Nothing more will be heard from the server so the table can't be trusted
+    if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(c)))
+    {
+        obj->markDevicesChanged();
+    }
+
+    pa_threaded_mainloop_signal(obj->mainloop, 0);
+}
+
+/**
+ * Wake up whoever is waiting on the mainloop for a stream state change.
+ */
+void LinuxAudio::streamStateCallback(pa_stream *s, void *userdata)
+{
+    LinuxAudio *obj = (LinuxAudio *)userdata;
+    pa_threaded_mainloop_signal(obj->mainloop, 0);
+}
+
+/**
+ * Called on the mainloop thread whenever captured audio is ready.
+ * Drains every fragment that PulseAudio has queued.
+ */
+void LinuxAudio::streamReadCallback(pa_stream *s, size_t nbytes, void *userdata)
+{
+    LinuxAudio *obj = (LinuxAudio *)userdata;
+
+    while (pa_stream_readable_size(s) > 0)
+    {
+        const void *data = nullptr;
+        size_t bytes = 0;
+
+        if (pa_stream_peek(s, &data, &bytes) < 0)
+        {
+            hlDebugf("PulseAudio peek failed: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            return;
+        }
+
+        // Nothing queued
+        if (bytes == 0)
+        {
+            break;
+        }
+
+        // A hole means the server dropped data. Skip over it.
+        if (data == nullptr)
+        {
+            hlDebug() << "PulseAudio capture hole of " << bytes << " bytes." << std::endl;
+        }
+        else
+        {
+            obj->deliverCapturedData(data, bytes);
+        }
+
+        pa_stream_drop(s);
+    }
+}
+
+/**
+ * Copy a captured fragment into the shared broadcast buffer
+ * and pass it on to the ring buffers and callbacks.
+ *
+ * @param data Samples in the capture format.
+ * @param bytes Size of data in bytes.
+ */
+void LinuxAudio::deliverCapturedData(const void *data, size_t bytes)
+{
+    SampleFormat format = this->broadcastBuffer->getSampleFormat();
+    int sampleSize = getSampleFormatSize(format);
+
+    getStats()->addCaptureBlock();
+
+    const uint8_t *in = (const uint8_t *)data;
+    ring_buffer_size_t samplesLeft = (ring_buffer_size_t)(bytes / sampleSize);
+
+    while (samplesLeft > 0)
+    {
+        void *ptr[2] = {0};
+        ring_buffer_size_t sizes[2] = {0};
+        ring_buffer_size_t samplesReserved = this->broadcastBuffer->beginWrite(samplesLeft, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+
+        for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
+        {
+            memcpy(ptr[i], in, (size_t)sizes[i] * sampleSize);
+            in += (size_t)sizes[i] * sampleSize;
+        }
+
+        this->broadcastBuffer->commitWrite(samplesReserved);
+
+        // Regions stay valid until the next beginWrite on this thread
+        for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
+        {
+            const SAMPLE *block = (SAMPLE *)ptr[i];
+            if (format != FLOAT_32)
+            {
+                convertToFloat(ptr[i], format, this->floatBlock.data(), sizes[i]);
+                block = this->floatBlock.data();
+            }
+
+            copyToRingBuffers(block, sizes[i]);
+            doCallbacks(block, sizes[i]);
+        }
+
+        samplesLeft -= samplesReserved;
+    }
+}
+
 /**
  * Capture loop for LinuxAudio.
+ *
+ * Opens an async PulseAudio record stream. Captured audio is delivered
+ * from the stream read callback on the mainloop thread, so this thread
+ * only waits for the signal to stop.
+ *
+ * The fragment size is taken from HulaAudioSettings::getCaptureFragmentSize().
  */
 void LinuxAudio::capture()
 {
-    int err = 0, ret = 0;           // return for commands that might return an error
-    int audioBufferSize;            // size of the buffer for the audio
-    float *audioBuffer = nullptr;   // buffer for the audio
+    HulaAudioSettings *settings = HulaAudioSettings::getInstance();
 
-    // PulseAudio variables
-    pa_simple *s;
-    pa_sample_spec ss;
-    std::string deviceName;
+    // Let PulseAudio deliver the storage format so there is no conversion here
+    SampleFormat format = this->broadcastBuffer->getSampleFormat();
+    int sampleSize = getSampleFormatSize(format);
 
-    ss.format = PA_SAMPLE_FLOAT32;
+    pa_sample_spec ss;
+    ss.format = getPulseSampleFormat(format);
     ss.channels = NUM_CHANNELS;
-    ss.rate = HulaAudioSettings::getInstance()->getSampleRate();
+    ss.rate = settings->getSampleRate();
+
+    // Only the fragment size matters for record streams
+    pa_buffer_attr attr;
+    attr.maxlength = (uint32_t)-1;
+    attr.tlength = (uint32_t)-1;
+    attr.prebuf = (uint32_t)-1;
+    attr.minreq = (uint32_t)-1;
+    attr.fragsize = (uint32_t)-1;
+    if (settings->getCaptureFragmentSize() > 0)
+    {
+        attr.fragsize = (uint32_t)(settings->getCaptureFragmentSize() * NUM_CHANNELS * sampleSize);
+    }
 
-    // Allocate memory for the buffer
-    audioBufferSize = HL_LINUX_FRAMES_PER_BUFFER * NUM_CHANNELS * sizeof(SAMPLE);
-    audioBuffer = new float[audioBufferSize];
+    // A block can never be larger than what the broadcast buffer accepts at once
+    this->floatBlock.resize(this->broadcastBuffer->getMaxWindow());
 
     // Grab device name
-    deviceName = this->activeInputDevice->getID().linuxID;
+    std::string deviceName = this->activeInputDevice->getID().linuxID;
 
-    s = pa_simple_new(
-        NULL,
-        "HulaLoop",
-        PA_STREAM_RECORD,
-        deviceName.c_str(),
-        "HulaLoop Record",
-        &ss,
-        NULL,
-        NULL,
-        NULL
-    );
+    if (!connectContext())
+    {
+        hlDebug() << "Could not connect to PulseAudio server." << std::endl;
+        throw AudioException(HL_LINUX_CONNECT_CODE, HL_LINUX_CONNECT_MSG);
+    }
 
-    if (!s)
+    pa_threaded_mainloop_lock(this->mainloop);
+
+    this->captureStream = pa_stream_new(this->context, "HulaLoop Record", &ss, NULL);
+    if (this->captureStream == nullptr)
     {
-        hlDebug() << "Could not open PulseAudio input stream to " << deviceName << std::endl;
-        pa_simple_free(s);
+        pa_threaded_mainloop_unlock(this->mainloop);
 
+        hlDebug() << "Could not create PulseAudio input stream to " << deviceName << std::endl;
         throw AudioException(HL_LINUX_OPEN_DEVICE_CODE, HL_LINUX_OPEN_DEVICE_MSG);
     }
 
-    while (!this->endCapture.load())
+    pa_stream_set_state_callback(this->captureStream, &LinuxAudio::streamStateCallback, this);
+    pa_stream_set_read_callback(this->captureStream, &LinuxAudio::streamReadCallback, this);
+
+    pa_stream_flags_t flags = (pa_stream_flags_t)(PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE);
+    int ret = pa_stream_connect_record(this->captureStream, deviceName.empty() ? NULL : deviceName.c_str(), &attr, flags);
+
+    // Wait for streamStateCallback to report the outcome
+    while (ret >= 0)
     {
-        // This will block until bytes are available
-        ret = pa_simple_read(s, (void *)audioBuffer, audioBufferSize, &err);
+        pa_stream_state_t state = pa_stream_get_state(this->captureStream);
+        if (state == PA_STREAM_READY)
+        {
+            break;
+        }
 
-        if (ret < 0)
+        if (!PA_STREAM_IS_GOOD(state))
         {
-            hlDebugf("PulseAudio read on device %s failed: %s\n", deviceName.c_str(), pa_strerror(err));
-            // TODO: cleanup and throw error?
+            ret = -1;
+            break;
         }
 
-        copyToBuffers((float *)audioBuffer, HL_LINUX_FRAMES_PER_BUFFER * NUM_CHANNELS);
-        doCallbacks((float *)audioBuffer, HL_LINUX_FRAMES_PER_BUFFER * NUM_CHANNELS);
+        pa_threaded_mainloop_wait(this->mainloop);
     }
 
+    if (ret < 0)
+    {
+        hlDebugf("Could not open PulseAudio input stream to %s: %s\n", deviceName.c_str(), pa_strerror(pa_context_errno(this->context)));
+
+        pa_stream_set_state_callback(this->captureStream, NULL, NULL);
+        pa_stream_set_read_callback(this->captureStream, NULL, NULL);
+        pa_stream_unref(this->captureStream);
+        this->captureStream = nullptr;
+
+        pa_threaded_mainloop_unlock(this->mainloop);
+
+        throw AudioException(HL_LINUX_OPEN_DEVICE_CODE, HL_LINUX_OPEN_DEVICE_MSG);
+    }
+
+    const pa_buffer_attr *actual = pa_stream_get_buffer_attr(this->captureStream);
+    if (actual)
+    {
+        hlDebug() << "PulseAudio capture fragment size: " << actual->fragsize << " bytes." << std::endl;
+    }
+
+    pa_threaded_mainloop_unlock(this->mainloop);
+
+    // Data is delivered by streamReadCallback until we are told to stop
+    waitForEndCapture();
+
     // cleanup stuff
-    if (s)
+    pa_threaded_mainloop_lock(this->mainloop);
+
+    pa_stream_set_state_callback(this->captureStream, NULL, NULL);
+    pa_stream_set_read_callback(this->captureStream, NULL, NULL);
+    pa_stream_disconnect(this->captureStream);
+    pa_stream_unref(this->captureStream);
+    this->captureStream = nullptr;
+
+    pa_threaded_mainloop_unlock(this->mainloop);
+
+    hlDebug() << "Freed PulseAudio stream." << std::endl;
+}
+
+/**
+ * Query the current latency of the capture stream.
+ *
+ * @return Latency in seconds or -1 if not capturing or unknown.
+ */
+double LinuxAudio::getInputLatency()
+{
+    // The mainloop is replaced when the context reconnects
+    std::lock_guard<std::mutex> lock(this->contextMutex);
+
+    if (this->mainloop == nullptr)
     {
-        pa_simple_free(s);
-        hlDebug() << "Freed PulseAudio stream." << std::endl;
+        return -1;
+    }
+
+    double latency = -1;
+
+    pa_threaded_mainloop_lock(this->mainloop);
+
+    if (this->captureStream != nullptr)
+    {
+        pa_usec_t usec = 0;
+        int negative = 0;
+        if (pa_stream_get_latency(this->captureStream, &usec, &negative) == 0)
+        {
+            latency = negative ? 0 : usec / 1000000.0;
+        }
     }
 
-    delete [] audioBuffer;
+    pa_threaded_mainloop_unlock(this->mainloop);
+
+    return latency;
 }
 
 /**
@@ -352,9 +742,9 @@ void LinuxAudio::playback()
         return;
     }
 
+    HulaAudioSettings *settings = HulaAudioSettings::getInstance();
+
     int err = 0, ret = 0;
-    int audioBufferSize;
-    float *audioBuffer = nullptr;
 
     // PulseAudio variables
     pa_simple *s;
@@ -369,13 +759,24 @@ void LinuxAudio::playback()
     ring_buffer_size_t samplesRead;
     ring_buffer_size_t elementsToRead = (ring_buffer_size_t)(HL_LINUX_FRAMES_PER_BUFFER * NUM_CHANNELS);
 
+    std::vector<SAMPLE> audioBuffer(elementsToRead);
+    size_t audioBufferSize = audioBuffer.size() * sizeof(SAMPLE);
+
     ss.format = PA_SAMPLE_FLOAT32;
     ss.channels = NUM_CHANNELS;
-    ss.rate = HulaAudioSettings::getInstance()->getSampleRate();
-
-    // Allocate memory for the buffer
-    audioBufferSize = HL_LINUX_FRAMES_PER_BUFFER * NUM_CHANNELS * sizeof(SAMPLE);
-    audioBuffer = new float[audioBufferSize];
+    ss.rate = settings->getSampleRate();
+
+    // Let PulseAudio pick everything except the target length, if one was set
+    pa_buffer_attr attr;
+    attr.maxlength = (uint32_t)-1;
+    attr.tlength = (uint32_t)-1;
+    attr.prebuf = (uint32_t)-1;
+    attr.minreq = (uint32_t)-1;
+    attr.fragsize = (uint32_t)-1;
+    if (settings->getPlaybackTargetLength() > 0)
+    {
+        attr.tlength = (uint32_t)(settings->getPlaybackTargetLength() * NUM_CHANNELS * sizeof(SAMPLE));
+    }
 
     // Grab device name
     deviceName = this->activeOutputDevice->getID().linuxID;
@@ -390,7 +791,7 @@ void LinuxAudio::playback()
         "HulaLoop Playback",
         &ss,
         NULL,
-        NULL,
+        &attr,
         NULL
     );
 
@@ -405,7 +806,7 @@ void LinuxAudio::playback()
     while (!this->endPlay.load())
     {
         // Don't use direct read since number of bytes must be proper multiple of frame size
-        samplesRead = this->playbackBuffer->read(audioBuffer, elementsToRead);
+        samplesRead = this->playbackBuffer->read(audioBuffer.data(), elementsToRead);
 
         // Fill with silence if we don't have enough data ready
         if (samplesRead < elementsToRead)
@@ -417,6 +818,8 @@ void LinuxAudio::playback()
                 continue;
             }
 
+            this->playbackBuffer->reportUnderrun();
+
             hlDebug() << "Playback: Ring buffer underrun. Received " << samplesRead << " of " << elementsToRead << std::endl;
             hlDebug() << "Writing " << elementsToRead - samplesRead << " samples of silence." << std::endl;
             for (int i = samplesRead; i < elementsToRead; i++)
@@ -425,7 +828,7 @@ void LinuxAudio::playback()
             }
         }
 
-        ret = pa_simple_write(s, (void *)audioBuffer, audioBufferSize, &err);
+        ret = pa_simple_write(s, (void *)audioBuffer.data(), audioBufferSize, &err);
         if (ret < 0)
         {
             hlDebugf("PulseAudio write on device %s failed: %s\n", deviceName.c_str(), pa_strerror(err));
@@ -442,8 +845,6 @@ void LinuxAudio::playback()
         pa_simple_free(s);
         hlDebug() << "Freed PulseAudio stream." << std::endl;
     }
-
-    delete [] audioBuffer;
 }
 
 /**
@@ -453,5 +854,22 @@ LinuxAudio::~LinuxAudio()
 {
     hlDebugf("LinuxAudio destructor called\n");
 
+    stopDeviceWatcher();
+
+    // The capture thread uses the mainloop, so it has to
+    // finish before the OSAudio destructor would join it
+    signalEndCapture();
+    for (auto &t : inThreads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    inThreads.clear();
+
+    std::lock_guard<std::mutex> lock(this->contextMutex);
+    disconnectContext();
+
     system("pkill pavucontrol");
 }
@@ -2,7 +2,9 @@
 #define HL_LINUX_AUDIO_H
 
 #include <stdlib.h>
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -11,6 +13,11 @@
 
 #define HL_LINUX_FRAMES_PER_BUFFER 512
 
+// Forward declare PulseAudio types so that pulse headers stay out of this file
+struct pa_context;
+struct pa_stream;
+struct pa_threaded_mainloop;
+
 namespace hula
 {
     /**
@@ -23,7 +30,56 @@ namespace hula
             std::vector<Device *> iDevices;
             std::vector<Device *> oDevices;
 
-            std::vector<Device *> parsePulseAudioDevices();
+            /**
+             * Thread that runs all PulseAudio async callbacks.
+             */
+            pa_threaded_mainloop *mainloop;
+
+            /**
+             * Connection to the PulseAudio server.
+             */
+            pa_context *context;
+
+            /**
+             * Stream that is currently capturing.
+             * Only accessed with the mainloop locked.
+             */
+            pa_stream *captureStream;
+
+            /**
+             * Guards creation and teardown of the mainloop and context,
+             * and their use by threads other than the capture thread.
+             */
+            std::mutex contextMutex;
+
+            /**
+             * Sources and sinks last reported by the server.
+             * Only accessed with deviceCacheMutex held.
+             */
+            std::vector<Device> deviceCache;
+            std::mutex deviceCacheMutex;
+
+            /**
+             * Cleared by subscribeCallback whenever a source or sink
+             * is added, removed or changed.
+             */
+            std::atomic<bool> deviceCacheValid;
+
+            /**
+             * Float copy of each captured block for the ring buffers and callbacks
+             * when the capture format is not float.
+             */
+            std::vector<SAMPLE> floatBlock;
+
+            bool connectContext();
+            void disconnectContext();
+            void deliverCapturedData(const void *data, size_t bytes);
+
+            bool refreshDeviceCache();
+
+            static void contextStateCallback(pa_context *c, void *userdata);
+            static void streamStateCallback(pa_stream *s, void *userdata);
+            static void streamReadCallback(pa_stream *s, size_t nbytes, void *userdata);
 
         public:
             LinuxAudio();
@@ -38,6 +94,10 @@ namespace hula
             std::vector<Device *> getDevices(DeviceType type);
 
             bool checkDeviceParams(Device *device);
+
+            double getInputLatency();
+
+            void markDevicesChanged();
     };
 }
 
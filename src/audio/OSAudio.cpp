@@ -1,6 +1,10 @@
 #include <algorithm>
 #include <iostream>
 
+#ifndef __unix__
+    #include <portaudio.h>
+#endif
+
 #include "hlaudio/internal/HulaAudioError.h"
 #include "hlaudio/internal/HulaAudioSettings.h"
 #include "hlaudio/internal/OSAudio.h"
@@ -21,13 +25,16 @@ void OSAudio::addBuffer(HulaRingBuffer *rb)
         return;
     }
 
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
     // Prevent duplicate buffers in list
     if (find(rbs.begin(), rbs.end(), rb) == rbs.end())
     {
         this->rbs.push_back(rb);
+        publishConsumers(false);
 
-        // Start record thread if only one buffer or callback exists
-        if (rbs.size() == 1 && cbs.size() == 0)
+        // Start record thread if this is the only consumer
+        if (getConsumerCount() == 1)
         {
             startRecord();
         }
@@ -35,7 +42,9 @@ void OSAudio::addBuffer(HulaRingBuffer *rb)
 }
 
 /**
- * Internal function for managing record thread creation
+ * Internal function for managing record thread creation.
+ * Returns once the capture thread has confirmed that it started
+ * (or gave up), so callers never need to wait for it themselves.
  */
 void OSAudio::startRecord()
 {
@@ -48,6 +57,10 @@ void OSAudio::startRecord()
         // Mutex will be unlocked by backgroundCapture once
         // thread creation is complete
         inThreads.emplace_back(std::thread(&OSAudio::backgroundCapture, this));
+
+        // Wait for that confirmation
+        this->stateSem.wait();
+        this->stateSem.notify();
     }
     else
     {
@@ -57,18 +70,48 @@ void OSAudio::startRecord()
 }
 
 /**
- * Write to each of the buffers contained in rbs.
+ * Publish samples to every consumer.
+ * The broadcast buffer is written once no matter how many readers
+ * are attached, followed by each of the buffers contained in rbs.
+ *
+ * Only one thread may write at a time. Capture and playback
+ * never run together so this holds for the backends.
  *
  * @param samples Buffer of interleaved float samples
  * @param sampleCount Number of samples in the buffer
  */
 void OSAudio::copyToBuffers(const float *samples, ring_buffer_size_t sampleCount)
 {
-    std::vector<HulaRingBuffer *>::iterator it;
-    for (it = rbs.begin(); it != rbs.end(); it++)
+    this->broadcastBuffer->write(samples, sampleCount);
+
+    copyToRingBuffers(samples, sampleCount);
+}
+
+/**
+ * Write to each of the buffers contained in rbs.
+ * Used by backends that already filled the broadcast buffer in place.
+ *
+ * @param samples Buffer of interleaved float samples
+ * @param sampleCount Number of samples in the buffer
+ */
+void OSAudio::copyToRingBuffers(const float *samples, ring_buffer_size_t sampleCount)
+{
+    const ConsumerList *list = acquireConsumers();
+
+    if (!list->rbs.empty())
     {
-        (*it)->write(samples, sampleCount);
+        uint64_t start = PipelineStats::now();
+
+        std::vector<HulaRingBuffer *>::const_iterator it;
+        for (it = list->rbs.begin(); it != list->rbs.end(); it++)
+        {
+            (*it)->write(samples, sampleCount);
+        }
+
+        this->stats.addBufferTime(start);
     }
+
+    releaseConsumers();
 }
 
 /**
@@ -82,18 +125,163 @@ void OSAudio::copyToBuffers(const float *samples, ring_buffer_size_t sampleCount
 */
 void OSAudio::removeBuffer(HulaRingBuffer *rb)
 {
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
     std::vector<HulaRingBuffer *>::iterator it = find(rbs.begin(), rbs.end(), rb);
     if (it != rbs.end())
     {
-        // Stop the capture thread if there will be no buffers left
-        if (rbs.size() == 1 && cbs.size() == 0)
+        // Stop the capture thread if there will be no consumers left
+        if (getConsumerCount() == 1)
         {
             endRecord();
         }
 
-        // Prevent invalid iterator for copyToBuffers
+        // Wait until the capture thread has let go of the old list
+        // so that the caller can safely delete the buffer
         this->rbs.erase(it);
+        publishConsumers(true);
+    }
+}
+
+/**
+ * Allocate a reader attached to the shared broadcast buffer.
+ * The reader does not receive data until it is added with addReader().
+ *
+ * @param duration The maximum length in seconds that the reader may fall behind.
+ * @return Newly allocated reader
+ */
+HulaBroadcastReader *OSAudio::createReader(float duration)
+{
+    return new HulaBroadcastReader(this->broadcastBuffer, duration);
+}
+
+/**
+ * Add a reader to the list of readers that receive audio data.
+ * If already present, the reader will not be duplicated.
+ *
+ * Anything published before the reader was added is skipped.
+ *
+ * @param reader Reader created with createReader().
+ */
+void OSAudio::addReader(HulaBroadcastReader *reader)
+{
+    // Guard against NULL
+    if (!reader)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
+    if (std::find(readers.begin(), readers.end(), reader) == readers.end())
+    {
+        reader->clear();
+        this->readers.push_back(reader);
+        publishConsumers(false);
+
+        if (getConsumerCount() == 1)
+        {
+            startRecord();
+        }
+    }
+}
+
+/**
+ * Remove a reader from the list of readers that receive audio data.
+ * The removed reader is not deleted and must be deleted by the user.
+ *
+ * @param reader Reader to remove from the list.
+ */
+void OSAudio::removeReader(HulaBroadcastReader *reader)
+{
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
+    std::vector<HulaBroadcastReader *>::iterator it = std::find(readers.begin(), readers.end(), reader);
+    if (it != readers.end())
+    {
+        // Stop the capture thread if there will be no consumers left
+        if (getConsumerCount() == 1)
+        {
+            endRecord();
+        }
+
+        // Readers are never touched by the capture thread
+        this->readers.erase(it);
+        publishConsumers(false);
+    }
+}
+
+/**
+ * Get the number of buffers, readers and callbacks that receive audio data.
+ * The capture thread only runs while this is non-zero.
+ * Must be called with consumerMutex held.
+ *
+ * @return Number of registered consumers.
+ */
+size_t OSAudio::getConsumerCount() const
+{
+    return rbs.size() + readers.size() + cbs.size();
+}
+
+/**
+ * Publish a fresh copy of rbs, cbs and readers for the capture thread.
+ * Must be called with consumerMutex held.
+ *
+ * The previous list is retired rather than freed, since the capture thread
+ * may still be iterating it. Retired lists are freed the next time no thread
+ * is inside acquireConsumers()/releaseConsumers().
+ *
+ * @param waitForReaders Block until every retired list is freed.
+ *                       Needed before a removed consumer can be deleted.
+ */
+void OSAudio::publishConsumers(bool waitForReaders)
+{
+    ConsumerList *list = new ConsumerList();
+    list->rbs = this->rbs;
+    list->cbs = this->cbs;
+    list->readerCount = this->readers.size();
+
+    this->retiredConsumers.push_back(this->consumers.exchange(list));
+
+    // Any thread that enters after the exchange sees the new list,
+    // so an idle moment means nobody can hold a retired one.
+    // The capture thread spends most of its time blocked on the
+    // device between blocks, so this does not spin for long.
+    while (this->activeConsumerReaders.load() != 0)
+    {
+        if (!waitForReaders)
+        {
+            return;
+        }
+
+        std::this_thread::yield();
+    }
+
+    for (ConsumerList *retired : this->retiredConsumers)
+    {
+        delete retired;
     }
+    this->retiredConsumers.clear();
+}
+
+/**
+ * Enter a read-side section and fetch the current consumer list.
+ * Wait-free. Every call must be paired with releaseConsumers().
+ *
+ * @return Consumer list that stays valid until releaseConsumers().
+ */
+const OSAudio::ConsumerList *OSAudio::acquireConsumers()
+{
+    this->activeConsumerReaders.fetch_add(1);
+    return this->consumers.load();
+}
+
+/**
+ * Leave a read-side section entered by acquireConsumers().
+ */
+void OSAudio::releaseConsumers()
+{
+    this->activeConsumerReaders.fetch_sub(1);
 }
 
 /**
@@ -105,12 +293,34 @@ void OSAudio::endRecord()
 
     this->stateSem.wait();
 
-    this->endCapture.store(true);
+    signalEndCapture();
     joinAndKillThreads(inThreads);
 
     this->stateSem.notify();
 }
 
+/**
+ * Tell the capture thread to stop and wake it
+ * if it is sleeping in waitForEndCapture().
+ */
+void OSAudio::signalEndCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->captureEndMutex);
+        this->endCapture.store(true);
+    }
+    this->captureEndCond.notify_all();
+}
+
+/**
+ * Block the capture thread until signalEndCapture() is called.
+ */
+void OSAudio::waitForEndCapture()
+{
+    std::unique_lock<std::mutex> lock(this->captureEndMutex);
+    this->captureEndCond.wait(lock, [this] { return this->endCapture.load(); });
+}
+
 /**
  * Add a callback to the list of callbacks that receive audio data.
  * If already present, the callback will not be duplicated.
@@ -125,11 +335,14 @@ void OSAudio::addCallback(ICallback *obj)
         return;
     }
 
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
     if(std::find(cbs.begin(), cbs.end(), obj) == cbs.end())
     {
         this->cbs.push_back(obj);
+        publishConsumers(false);
 
-        if(cbs.size() == 1 && rbs.size() == 0)
+        if(getConsumerCount() == 1)
         {
             startRecord();
         }
@@ -144,11 +357,80 @@ void OSAudio::addCallback(ICallback *obj)
  */
 void OSAudio::doCallbacks(const float *samples, ring_buffer_size_t sampleCount)
 {
-    std::vector<ICallback *>::iterator it;
-    for (it = cbs.begin(); it != cbs.end(); it++)
+    const ConsumerList *list = acquireConsumers();
+
+    if (!list->cbs.empty())
     {
-        (*it)->handleData(samples, sampleCount);
+        uint64_t start = PipelineStats::now();
+
+        std::vector<ICallback *>::const_iterator it;
+        for (it = list->cbs.begin(); it != list->cbs.end(); it++)
+        {
+            (*it)->handleData(samples, sampleCount);
+        }
+
+        this->stats.addCallbackTime(start);
     }
+
+    releaseConsumers();
+}
+
+/**
+ * Get the counters that backends and consumers update.
+ * Recording paths outside of hlaudio, such as Record, add
+ * their own measurements through this.
+ *
+ * @return Statistics owned by this instance
+ */
+PipelineStats *OSAudio::getStats()
+{
+    return &this->stats;
+}
+
+/**
+ * Take a copy of the pipeline statistics along with the
+ * state of every buffer that currently receives audio.
+ *
+ * Never blocks the capture thread.
+ *
+ * @return Snapshot of the statistics
+ */
+PipelineStatsSnapshot OSAudio::getStatsSnapshot()
+{
+    PipelineStatsSnapshot snapshot;
+    this->stats.copyTo(snapshot);
+
+    // Keeps the buffers from being removed and deleted while we look at them
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
+    std::vector<HulaRingBuffer *> ringBuffers(1, this->playbackBuffer);
+    ringBuffers.insert(ringBuffers.end(), this->rbs.begin(), this->rbs.end());
+    for (HulaRingBuffer *rb : ringBuffers)
+    {
+        RingStats ring;
+        ring.name = rb->getName();
+        ring.capacity = rb->getCapacity();
+        ring.fill = rb->getReadAvailable();
+        ring.highWater = rb->getHighWaterMark();
+        ring.overruns = rb->getOverrunCount();
+        ring.droppedSamples = rb->getDroppedSamples();
+        ring.underruns = rb->getUnderrunCount();
+        snapshot.rings.push_back(ring);
+    }
+
+    for (HulaBroadcastReader *reader : this->readers)
+    {
+        RingStats ring;
+        ring.name = reader->getName();
+        ring.capacity = reader->getCapacity();
+        ring.fill = reader->getReadAvailable();
+        ring.highWater = reader->getHighWaterMark();
+        ring.overruns = reader->getOverrunCount();
+        ring.droppedSamples = reader->getDroppedSamples();
+        snapshot.rings.push_back(ring);
+    }
+
+    return snapshot;
 }
 
 /**
@@ -158,17 +440,22 @@ void OSAudio::doCallbacks(const float *samples, ring_buffer_size_t sampleCount)
  */
 void OSAudio::removeCallback(ICallback *obj)
 {
+    std::lock_guard<std::mutex> lock(this->consumerMutex);
+
     // Check if callback function exists to remove
     std::vector<ICallback *>::iterator it = std::find(cbs.begin(), cbs.end(), obj);
     if(it != cbs.end())
     {
         // Stop the capture thread if there will be no buffers left
-        if(cbs.size() == 1 && rbs.size() == 0)
+        if(getConsumerCount() == 1)
         {
             endRecord();
         }
 
+        // Wait until the capture thread has let go of the old list
+        // so that the caller can safely delete the callback
         this->cbs.erase(it);
+        publishConsumers(true);
     }
 }
 
@@ -184,8 +471,14 @@ void OSAudio::removeCallback(ICallback *obj)
 */
 void OSAudio::backgroundCapture()
 {
+    // Use the published list since consumerMutex may be held by
+    // whoever is waiting on stateSem for this thread
+    const ConsumerList *list = acquireConsumers();
+    bool noConsumers = list->rbs.empty() && list->cbs.empty() && list->readerCount == 0;
+    releaseConsumers();
+
     // TODO: Does this need to move to setActiveInputDevice
-    if (this->rbs.size() == 0 && this->cbs.size() == 0)
+    if (noConsumers)
     {
         this->stateSem.notify();
         return;
@@ -194,25 +487,27 @@ void OSAudio::backgroundCapture()
     // Default to first device
     if (this->activeInputDevice == nullptr)
     {
-        std::vector<Device *> devices = this->getDevices((DeviceType)(DeviceType::RECORD | DeviceType::LOOPBACK));
-        if (devices.empty())
+        std::shared_ptr<const DeviceSnapshot> snapshot = getDeviceSnapshot();
+        for (const Device &device : snapshot->devices)
+        {
+            if (device.getType() & (DeviceType::RECORD | DeviceType::LOOPBACK))
+            {
+                this->activeInputDevice = new Device(device);
+                break;
+            }
+        }
+
+        if (this->activeInputDevice == nullptr)
         {
             hlDebug() << "In backgroundCapture: No input devices available." << std::endl;
 
             this->stateSem.notify();
             return;
         }
-
-        // TODO: Why? Not sure what this means since above condition is opposite
-        // if (this->activeInputDevice)
-        // {
-        //     delete this->activeInputDevice;
-        // }
-        this->activeInputDevice = new Device(*devices[0]);
-        Device::deleteDevices(devices);
     }
 
     this->endCapture.store(false);
+    this->stats.startCapture();
 
     // TODO: Make sure this is a FIFO notification if necessary
     // Notify any waiting threads
@@ -237,22 +532,23 @@ void OSAudio::backgroundPlayback()
     // Default to first device
     if (this->activeOutputDevice == nullptr)
     {
-        std::vector<Device *> devices = this->getDevices((DeviceType)(DeviceType::PLAYBACK));
-        if (devices.empty())
+        std::shared_ptr<const DeviceSnapshot> snapshot = getDeviceSnapshot();
+        for (const Device &device : snapshot->devices)
+        {
+            if (device.getType() == DeviceType::PLAYBACK)
+            {
+                this->activeOutputDevice = new Device(device);
+                break;
+            }
+        }
+
+        if (this->activeOutputDevice == nullptr)
         {
             hlDebug() << "In backgroundPlayback: No output devices available." << std::endl;
 
             this->stateSem.notify();
             return;
         }
-
-        // TODO: Why? Not sure what this means since above condition is opposite
-        // if (this->activeOutputDevice)
-        // {
-        //     delete this->activeOutputDevice;
-        // }
-        this->activeOutputDevice = new Device(*devices[0]);
-        Device::deleteDevices(devices);
     }
 
     this->endPlay.store(false);
@@ -269,6 +565,8 @@ void OSAudio::backgroundPlayback()
  * Signal the start of the playback thread. Add playback buffer to the
  * HulaRingBuffer vector and start the playback thread. This signal is to notify
  * the backend to start reading data that will be played to the selected audio device.
+ *
+ * Returns once the playback thread has confirmed that it started (or gave up).
  */
 void OSAudio::startPlayback()
 {
@@ -282,6 +580,10 @@ void OSAudio::startPlayback()
         // Mutex will be unlocked by backgroundPlayback once
         // thread creation is complete
         outThreads.emplace_back(std::thread(&OSAudio::backgroundPlayback, this));
+
+        // Wait for that confirmation
+        this->stateSem.wait();
+        this->stateSem.notify();
     }
     else
     {
@@ -307,6 +609,42 @@ ring_buffer_size_t OSAudio::playbackCopyToBuffers(const float *samples, ring_buf
     return samplesWritten;
 }
 
+/**
+ * Sleep until the playback buffer can take sampleCount samples.
+ * The device side wakes the caller as soon as it has played enough,
+ * so the feeder never has to guess how long to sleep.
+ *
+ * @param sampleCount Number of samples the caller wants to write
+ * @param timeoutMs Longest time to wait in milliseconds
+ * @return True if the samples fit, false on timeout
+ */
+bool OSAudio::waitForPlaybackSpace(ring_buffer_size_t sampleCount, uint32_t timeoutMs)
+{
+    return this->playbackBuffer->waitForSpace(sampleCount, timeoutMs);
+}
+
+/**
+ * Sleep until the device has played everything in the playback buffer.
+ *
+ * @param timeoutMs Longest time to wait in milliseconds
+ * @return True if the buffer is empty, false on timeout
+ */
+bool OSAudio::waitForPlaybackDrain(uint32_t timeoutMs)
+{
+    return this->playbackBuffer->waitForSpace(this->playbackBuffer->getCapacity(), timeoutMs);
+}
+
+/**
+ * Get the number of samples in the playback buffer
+ * that the device has not played yet.
+ *
+ * @return Number of buffered samples
+ */
+ring_buffer_size_t OSAudio::getPlaybackReadAvailable() const
+{
+    return this->playbackBuffer->getReadAvailable();
+}
+
 /**
  * Signal the end of the playback thread. Kill all playback threads.
  * This signal is to notify the backend to stop reading
@@ -327,7 +665,7 @@ void OSAudio::endPlayback()
     this->stateSem.notify();
 }
 
-
+#ifndef __unix__
 /**
  * This routine will be called by the PortAudio engine when audio is needed.
  * It may be called at interrupt level on some machines so don't do anything
@@ -372,6 +710,8 @@ static int paPlayCallback(const void *inputBuffer, void *outputBuffer,
     // Write silence if we couldn't get enough data
     if (samplesRead < elementsToRead)
     {
+        obj->playbackBuffer->reportUnderrun();
+
         hlDebug() << "Playback: Ring buffer underrun. Received " << samplesRead << " of " << elementsToRead << std::endl;
         hlDebug() << "Writing " << elementsToRead - samplesRead << " samples of silence." << std::endl;
         for (int i = samplesRead; i < elementsToRead; i++)
@@ -453,6 +793,29 @@ void OSAudio::playback()
         hlDebug() << "Failed to close playback stream." << std::endl;
     }
 }
+#else
+/**
+ * There is no generic playback on Linux since PulseAudio
+ * handles device I/O. LinuxAudio overrides this method.
+ */
+void OSAudio::playback()
+{
+    hlDebug() << "No generic playback implementation on this platform." << std::endl;
+}
+#endif
+
+/**
+ * Get the time between audio entering the input device and
+ * reaching the consumers.
+ *
+ * Backends that can measure this override it.
+ *
+ * @return Latency in seconds or -1 if unknown.
+ */
+double OSAudio::getInputLatency()
+{
+    return -1;
+}
 
 /**
  * Set the selected input device and restart capture threads with
@@ -584,15 +947,299 @@ void OSAudio::joinAndKillThreads(std::vector<std::thread> &threads)
     threads.clear();
 }
 
+/**
+ * Check whether two devices refer to the same hardware with the same details.
+ */
+static bool isSameDevice(const Device &a, const Device &b)
+{
+    DeviceID idA = a.getID();
+    DeviceID idB = b.getID();
+
+    if (a.getName() != b.getName() || a.getType() != b.getType()
+        || idA.linuxID != idB.linuxID || idA.portAudioID != idB.portAudioID)
+    {
+        return false;
+    }
+
+    #ifdef _WIN32
+    // IDs are reallocated on every enumeration so compare the strings
+    if ((idA.windowsID == nullptr) != (idB.windowsID == nullptr)
+        || (idA.windowsID != nullptr && wcscmp(idA.windowsID, idB.windowsID) != 0))
+    {
+        return false;
+    }
+    #endif
+
+    return true;
+}
+
+/**
+ * Get the list of all known devices.
+ *
+ * Devices are only re-enumerated if a change was reported since
+ * the last call. The snapshot never changes and remains valid for
+ * as long as the caller holds on to it.
+ *
+ * @return Current device snapshot
+ */
+std::shared_ptr<const DeviceSnapshot> OSAudio::getDeviceSnapshot()
+{
+    bool showRecordDevices = HulaAudioSettings::getInstance()->getShowRecordDevices();
+
+    std::unique_lock<std::mutex> lock(this->deviceMutex);
+
+    // Backends leave out record devices depending on the setting
+    if (this->devicesDirty.load() || this->deviceSnapshot->showRecordDevices != showRecordDevices)
+    {
+        lock.unlock();
+        refreshDevices();
+        lock.lock();
+    }
+
+    return this->deviceSnapshot;
+}
+
+/**
+ * Get the generation of the device list. The generation is
+ * incremented every time the list changes so a caller only
+ * needs to fetch the devices again when it differs from the
+ * last value it saw.
+ *
+ * @return Current device generation
+ */
+uint64_t OSAudio::getDeviceGeneration()
+{
+    return getDeviceSnapshot()->generation;
+}
+
+/**
+ * Enumerate the devices from the backend and publish a new snapshot
+ * if anything changed. Listeners are notified of the new generation.
+ *
+ * Any AudioException from the backend is passed on to the caller.
+ *
+ * @return True if the device list changed
+ */
+bool OSAudio::refreshDevices()
+{
+    // Clear first so that a change reported during enumeration is not lost
+    this->devicesDirty.store(false);
+
+    std::vector<Device *> found;
+    try
+    {
+        found = this->getDevices((DeviceType)(DeviceType::RECORD | DeviceType::PLAYBACK | DeviceType::LOOPBACK));
+    }
+    catch (const AudioException &ae)
+    {
+        // Try again next time
+        this->devicesDirty.store(true);
+        throw;
+    }
+
+    std::shared_ptr<DeviceSnapshot> snapshot = std::make_shared<DeviceSnapshot>();
+    snapshot->showRecordDevices = HulaAudioSettings::getInstance()->getShowRecordDevices();
+    for (Device *device : found)
+    {
+        snapshot->devices.push_back(*device);
+    }
+    Device::deleteDevices(found);
+
+    std::vector<IDeviceListener *> listeners;
+    {
+        std::lock_guard<std::mutex> lock(this->deviceMutex);
+
+        const std::vector<Device> &current = this->deviceSnapshot->devices;
+        bool changed = current.size() != snapshot->devices.size();
+
+        for (size_t i = 0; !changed && i < current.size(); i++)
+        {
+            changed = !isSameDevice(current[i], snapshot->devices[i]);
+        }
+
+        if (!changed)
+        {
+            // Keep the setting current even though the list is the same
+            if (this->deviceSnapshot->showRecordDevices != snapshot->showRecordDevices)
+            {
+                snapshot->generation = this->deviceSnapshot->generation;
+                this->deviceSnapshot = snapshot;
+            }
+
+            return false;
+        }
+
+        snapshot->generation = this->deviceSnapshot->generation + 1;
+        this->deviceSnapshot = snapshot;
+
+        listeners = this->deviceListeners;
+    }
+
+    hlDebug() << "Device list changed. Generation: " << snapshot->generation << std::endl;
+
+    std::lock_guard<std::mutex> notifyLock(this->deviceNotifyMutex);
+    for (IDeviceListener *listener : listeners)
+    {
+        listener->handleDevicesChanged(snapshot->generation);
+    }
+
+    return true;
+}
+
+/**
+ * Report that the device list may have changed.
+ * Backends with hot-plug notifications call this from their
+ * notification handler. Must not block.
+ */
+void OSAudio::markDevicesChanged()
+{
+    this->devicesDirty.store(true);
+
+    // Wake the watcher so listeners hear about it promptly
+    std::lock_guard<std::mutex> lock(this->deviceMutex);
+    this->deviceWatchCond.notify_all();
+}
+
+/**
+ * Register a listener to be notified when the device list changes.
+ * The first listener starts a background thread that keeps
+ * the device list up to date.
+ *
+ * @param listener Listener to add
+ */
+void OSAudio::addDeviceListener(IDeviceListener *listener)
+{
+    // Guard against NULL
+    if (!listener)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> watchLock(this->deviceWatchMutex);
+    std::lock_guard<std::mutex> lock(this->deviceMutex);
+
+    // Prevent duplicate listeners in list
+    if (find(deviceListeners.begin(), deviceListeners.end(), listener) != deviceListeners.end())
+    {
+        return;
+    }
+
+    this->deviceListeners.push_back(listener);
+
+    if (this->endDeviceWatch)
+    {
+        this->endDeviceWatch = false;
+        this->deviceWatchThread = std::thread(&OSAudio::deviceWatchLoop, this);
+    }
+}
+
+/**
+ * Remove a listener. It is guaranteed not to be called
+ * once this returns. Must not be called from inside
+ * IDeviceListener::handleDevicesChanged().
+ *
+ * @param listener Listener to remove
+ */
+void OSAudio::removeDeviceListener(IDeviceListener *listener)
+{
+    std::lock_guard<std::mutex> watchLock(this->deviceWatchMutex);
+
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(this->deviceMutex);
+
+        auto it = find(deviceListeners.begin(), deviceListeners.end(), listener);
+        if (it == deviceListeners.end())
+        {
+            return;
+        }
+
+        this->deviceListeners.erase(it);
+        last = this->deviceListeners.empty();
+    }
+
+    if (last)
+    {
+        joinDeviceWatcher();
+    }
+
+    // Wait out a notification that may have started before the removal
+    std::lock_guard<std::mutex> notifyLock(this->deviceNotifyMutex);
+}
+
+/**
+ * Background loop that refreshes the device list whenever
+ * a change is reported, or every HL_DEVICE_POLL_MS for backends
+ * that can't report changes.
+ */
+void OSAudio::deviceWatchLoop()
+{
+    std::unique_lock<std::mutex> lock(this->deviceMutex);
+    while (!this->endDeviceWatch)
+    {
+        this->deviceWatchCond.wait_for(lock, std::chrono::milliseconds(HL_DEVICE_POLL_MS), [this] {
+            return this->endDeviceWatch || this->devicesDirty.load();
+        });
+
+        if (this->endDeviceWatch)
+        {
+            break;
+        }
+
+        lock.unlock();
+        try
+        {
+            refreshDevices();
+        }
+        catch (const AudioException &ae)
+        {
+            hlDebug() << "Device watcher could not enumerate devices: " << ae.getErrorCode() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * Signal the device watcher thread to exit and wait for it.
+ * Must be called with deviceWatchMutex held.
+ */
+void OSAudio::joinDeviceWatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->deviceMutex);
+        this->endDeviceWatch = true;
+        this->deviceWatchCond.notify_all();
+    }
+
+    if (this->deviceWatchThread.joinable())
+    {
+        this->deviceWatchThread.join();
+    }
+}
+
+/**
+ * Stop the device watcher thread.
+ *
+ * The watcher calls the virtual getDevices(), so every backend must
+ * call this at the start of its destructor.
+ */
+void OSAudio::stopDeviceWatcher()
+{
+    std::lock_guard<std::mutex> watchLock(this->deviceWatchMutex);
+    joinDeviceWatcher();
+}
+
 /**
  * Virtual implementation of Destructor
  */
 OSAudio::~OSAudio()
 {
+    stopDeviceWatcher();
+
     hlDebugf("OSAudio destructor called\n");
 
     // Signal thread death
-    this->endCapture.store(true);
+    signalEndCapture();
     this->endPlay.store(true);
     joinAndKillThreads(inThreads);
     joinAndKillThreads(outThreads);
@@ -611,4 +1258,15 @@ OSAudio::~OSAudio()
     {
         delete playbackBuffer;
     }
+
+    if (broadcastBuffer)
+    {
+        delete broadcastBuffer;
+    }
+
+    for (ConsumerList *retired : retiredConsumers)
+    {
+        delete retired;
+    }
+    delete consumers.load();
 }
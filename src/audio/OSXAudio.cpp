@@ -248,6 +248,7 @@ static int paRecordCallback(const void *inputBuffer, void *outputBuffer,
     (void) statusFlags;
     (void) userData;
 
+    obj->getStats()->addCaptureBlock();
     obj->copyToBuffers(samples, framesPerBuffer * NUM_CHANNELS);
     obj->doCallbacks(samples, framesPerBuffer * NUM_CHANNELS);
 
@@ -435,6 +436,8 @@ OSXAudio::~OSXAudio()
 {
     hlDebugf("OSXAudio destructor called\n");
 
+    stopDeviceWatcher();
+
     // Close the Port Audio session
     PaError err = Pa_Terminate();
     if (err != paNoError)
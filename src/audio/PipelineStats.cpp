@@ -0,0 +1,218 @@
+#include "hlaudio/internal/PipelineStats.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace hula;
+
+/**
+ * Get the upper edge of the histogram bucket below which the given
+ * share of capture intervals fell.
+ *
+ * @param percentile Share of intervals between 0 and 100
+ * @return Interval in microseconds, or 0 if no intervals were recorded
+ */
+double PipelineStatsSnapshot::getIntervalPercentileUs(double percentile) const
+{
+    uint64_t total = 0;
+    for (size_t b = 0; b < HL_STATS_HISTOGRAM_BUCKETS; b++)
+    {
+        total += this->intervalHistogram[b];
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    double target = total * std::min(std::max(percentile, 0.0), 100.0) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HL_STATS_HISTOGRAM_BUCKETS - 1; b++)
+    {
+        seen += this->intervalHistogram[b];
+        if (seen >= target)
+        {
+            return (double)(2ull << b);
+        }
+    }
+
+    // Only the maximum bounds the last bucket
+    return (double)this->maxIntervalUs;
+}
+
+PipelineStats::TimingCounter::TimingCounter()
+{
+    reset();
+}
+
+/**
+ * Record one timed event.
+ *
+ * @param ns Duration in nanoseconds
+ */
+void PipelineStats::TimingCounter::add(uint64_t ns)
+{
+    this->count.fetch_add(1, std::memory_order_relaxed);
+    this->totalNs.fetch_add(ns, std::memory_order_relaxed);
+    storeMax(this->maxNs, ns);
+}
+
+void PipelineStats::TimingCounter::copyTo(TimingStats &stats) const
+{
+    stats.count = this->count.load(std::memory_order_relaxed);
+    stats.totalUs = this->totalNs.load(std::memory_order_relaxed) / 1000;
+    stats.maxUs = this->maxNs.load(std::memory_order_relaxed) / 1000;
+}
+
+void PipelineStats::TimingCounter::reset()
+{
+    this->count.store(0, std::memory_order_relaxed);
+    this->totalNs.store(0, std::memory_order_relaxed);
+    this->maxNs.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Construct a new set of counters, all zero.
+ */
+PipelineStats::PipelineStats()
+{
+    reset();
+    this->lastBlockNs.store(0);
+}
+
+/**
+ * Raise target to value if it is lower.
+ * Never blocks, even with several writers.
+ */
+void PipelineStats::storeMax(std::atomic<uint64_t> &target, uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * Get the clock used for every measurement.
+ *
+ * @return Monotonic time in nanoseconds
+ */
+uint64_t PipelineStats::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Get the histogram bucket that an interval falls into.
+ *
+ * @param intervalUs Interval in microseconds
+ * @return Bucket index
+ */
+size_t PipelineStats::getBucket(uint64_t intervalUs)
+{
+    size_t bucket = 0;
+    while (intervalUs > 1 && bucket < HL_STATS_HISTOGRAM_BUCKETS - 1)
+    {
+        intervalUs >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/**
+ * Forget the time of the previous block, so that the gap
+ * while capture was stopped is not counted as an interval.
+ * Called before the capture thread starts.
+ */
+void PipelineStats::startCapture()
+{
+    this->lastBlockNs.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Record the arrival of a block from the capture backend.
+ * Must only be called from the capture thread.
+ */
+void PipelineStats::addCaptureBlock()
+{
+    uint64_t t = now();
+    uint64_t last = this->lastBlockNs.exchange(t, std::memory_order_relaxed);
+
+    this->captureBlocks.fetch_add(1, std::memory_order_relaxed);
+    if (last == 0)
+    {
+        return;
+    }
+
+    uint64_t interval = t - last;
+    this->intervalHistogram[getBucket(interval / 1000)].fetch_add(1, std::memory_order_relaxed);
+    storeMax(this->maxIntervalNs, interval);
+}
+
+/**
+ * Record the time spent writing one block to the ring buffers.
+ *
+ * @param startNs Value of now() when the writes started
+ */
+void PipelineStats::addBufferTime(uint64_t startNs)
+{
+    this->bufferTime.add(now() - startNs);
+}
+
+/**
+ * Record the time spent passing one block to the callbacks.
+ *
+ * @param startNs Value of now() when the first callback was called
+ */
+void PipelineStats::addCallbackTime(uint64_t startNs)
+{
+    this->callbackTime.add(now() - startNs);
+}
+
+/**
+ * Record how old the newest sample was when it was written to disk.
+ *
+ * @param latencyNs Age in nanoseconds
+ */
+void PipelineStats::addDiskLatency(uint64_t latencyNs)
+{
+    this->diskLatency.add(latencyNs);
+}
+
+/**
+ * Copy the current counters. Ring statistics are filled in by OSAudio.
+ *
+ * @param snapshot Destination
+ */
+void PipelineStats::copyTo(PipelineStatsSnapshot &snapshot) const
+{
+    snapshot.captureBlocks = this->captureBlocks.load(std::memory_order_relaxed);
+    for (size_t b = 0; b < HL_STATS_HISTOGRAM_BUCKETS; b++)
+    {
+        snapshot.intervalHistogram[b] = this->intervalHistogram[b].load(std::memory_order_relaxed);
+    }
+    snapshot.maxIntervalUs = this->maxIntervalNs.load(std::memory_order_relaxed) / 1000;
+
+    this->bufferTime.copyTo(snapshot.bufferTime);
+    this->callbackTime.copyTo(snapshot.callbackTime);
+    this->diskLatency.copyTo(snapshot.diskLatency);
+}
+
+/**
+ * Set every counter back to zero.
+ * Updates that race with this may survive it.
+ */
+void PipelineStats::reset()
+{
+    this->captureBlocks.store(0, std::memory_order_relaxed);
+    for (size_t b = 0; b < HL_STATS_HISTOGRAM_BUCKETS; b++)
+    {
+        this->intervalHistogram[b].store(0, std::memory_order_relaxed);
+    }
+    this->maxIntervalNs.store(0, std::memory_order_relaxed);
+
+    this->bufferTime.reset();
+    this->callbackTime.reset();
+    this->diskLatency.reset();
+}
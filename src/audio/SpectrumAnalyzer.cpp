@@ -0,0 +1,313 @@
+#include "hlaudio/internal/SpectrumAnalyzer.h"
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+
+#include "hlaudio/internal/HulaAudioError.h"
+#include "hlaudio/internal/HulaAudioSettings.h"
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * Set in middleIndex when the slot it names holds a frame
+ * the reader has not taken yet.
+ */
+#define HL_SPECTRUM_FRESH 4
+
+using namespace hula;
+
+/**
+ * Construct a new SpectrumAnalyzer.
+ *
+ * Everything is allocated here so that handleData() never allocates.
+ *
+ * @param fftSize Samples per analysis window. Must be a power of 2.
+ * @param hopSize Samples between the starts of two windows.
+ * @param bandCount Number of frequency bands. Reduced if the window
+ *          does not have enough bins for that many bands.
+ * @param function Window applied before each transform.
+ */
+SpectrumAnalyzer::SpectrumAnalyzer(size_t fftSize, size_t hopSize, size_t bandCount, WindowFunction function)
+    : plan(fftSize), middleIndex(1)
+{
+    this->fftSize = fftSize;
+    this->hopSize = std::max<size_t>(1, hopSize);
+
+    double sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+    this->window.resize(fftSize);
+    double windowSum = 0;
+    for (size_t i = 0; i < fftSize; i++)
+    {
+        double phase = 2 * M_PI * i / fftSize;
+        if (function == BLACKMAN)
+        {
+            this->window[i] = (float)(0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2 * phase));
+        }
+        else
+        {
+            this->window[i] = (float)(0.5 - 0.5 * std::cos(phase));
+        }
+        windowSum += this->window[i];
+    }
+    this->scale = (float)(2 / windowSum);
+
+    // Log-spaced band edges between the first band and Nyquist
+    size_t endBin = plan.getBinCount();
+    size_t startBin = std::max<size_t>(1, (size_t)std::lround(HL_SPECTRUM_MIN_FREQ * fftSize / sampleRate));
+    startBin = std::min(startBin, endBin - 1);
+    this->bandCount = std::max<size_t>(1, std::min(bandCount, endBin - startBin));
+
+    this->bandEdges.resize(this->bandCount + 1);
+    this->bandEdges[0] = startBin;
+    for (size_t b = 1; b <= this->bandCount; b++)
+    {
+        double ideal = startBin * std::pow((double)endBin / startBin, (double)b / this->bandCount);
+
+        // Every band needs at least one bin and must leave one for each band after it
+        size_t edge = std::max((size_t)std::lround(ideal), this->bandEdges[b - 1] + 1);
+        this->bandEdges[b] = std::min(edge, endBin - (this->bandCount - b));
+    }
+
+    this->history.resize(fftSize);
+    this->windowed.resize(fftSize);
+    this->magnitudes.resize(plan.getBinCount());
+
+    this->levels.resize(this->bandCount);
+    this->peaks.resize(this->bandCount);
+    this->peakAge.resize(this->bandCount);
+
+    double hopMs = 1000.0 * this->hopSize / sampleRate;
+    this->release = std::exp(-hopMs / HL_SPECTRUM_RELEASE_MS);
+    this->peakRelease = std::exp(-hopMs / HL_SPECTRUM_PEAK_RELEASE_MS);
+    this->peakHoldFrames = (uint64_t)(HL_SPECTRUM_PEAK_HOLD_MS * sampleRate / 1000);
+
+    for (auto &slot : this->slots)
+    {
+        slot.bands.resize(this->bandCount);
+        slot.peaks.resize(this->bandCount);
+        slot.waveform.resize(fftSize);
+    }
+}
+
+/**
+ * Remove the analyzer from the Controller with
+ * Controller::removeCallback() before deleting it.
+ */
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+}
+
+/**
+ * Receive captured audio. Called on the audio thread.
+ *
+ * @param samples Interleaved samples
+ * @param sampleCount Number of samples
+ */
+void SpectrumAnalyzer::handleData(const SAMPLE *samples, ring_buffer_size_t sampleCount)
+{
+    for (ring_buffer_size_t i = 0; i < sampleCount; i++)
+    {
+        this->frameSum += samples[i];
+        if (++this->frameChannels < NUM_CHANNELS)
+        {
+            continue;
+        }
+
+        addToHistory(this->frameSum / NUM_CHANNELS);
+        this->frameSum = 0;
+        this->frameChannels = 0;
+
+        if (++this->sinceHop >= this->hopSize && this->historyFill == this->fftSize)
+        {
+            analyze(this->samplesSeen + i + 1);
+            this->sinceHop = 0;
+        }
+    }
+
+    this->samplesSeen += sampleCount;
+}
+
+/**
+ * Analyze a snapshot of the latest audio instead of a continuous stream.
+ *
+ * This is for consumers that pull audio on their own clock, such as a
+ * display refresh, with HulaBroadcastReader::readLatest(). Smoothing
+ * follows the time that passed between snapshots. Do not mix this with
+ * handleData() on the same analyzer.
+ *
+ * @param samples Most recent interleaved samples, oldest first
+ * @param sampleCount Number of samples
+ * @param newSamples Number of samples published since the previous snapshot
+ * @return True if a frame was published
+ */
+bool SpectrumAnalyzer::analyzeSnapshot(const SAMPLE *samples, ring_buffer_size_t sampleCount, uint64_t newSamples)
+{
+    if (newSamples == 0)
+    {
+        return false;
+    }
+
+    // Anything older than one window would be overwritten anyway
+    size_t available = (size_t)sampleCount / NUM_CHANNELS;
+    size_t frames = std::min(available, this->fftSize);
+    const SAMPLE *frame = samples + (available - frames) * NUM_CHANNELS;
+
+    for (size_t i = 0; i < frames; i++, frame += NUM_CHANNELS)
+    {
+        float sum = 0;
+        for (int c = 0; c < NUM_CHANNELS; c++)
+        {
+            sum += frame[c];
+        }
+        addToHistory(sum / NUM_CHANNELS);
+    }
+
+    this->frameSum = 0;
+    this->frameChannels = 0;
+    this->sinceHop = 0;
+    this->samplesSeen += newSamples;
+
+    if (this->historyFill < this->fftSize)
+    {
+        return false;
+    }
+
+    analyze(this->samplesSeen);
+    return true;
+}
+
+/**
+ * Append one mono sample to the circular history.
+ *
+ * @param sample Mixed down sample
+ */
+void SpectrumAnalyzer::addToHistory(float sample)
+{
+    this->history[this->historyPos] = sample;
+    this->historyPos = (this->historyPos + 1) & (this->fftSize - 1);
+    this->historyFill = std::min(this->historyFill + 1, this->fftSize);
+}
+
+/**
+ * Transform the latest window, update the smoothed bands and publish them.
+ *
+ * @param sampleCount Total number of samples received up to the end of the window
+ */
+void SpectrumAnalyzer::analyze(uint64_t sampleCount)
+{
+    SpectrumFrame &frame = this->slots[this->backIndex];
+
+    // Unroll the history so the oldest sample comes first
+    size_t tail = this->fftSize - this->historyPos;
+    std::copy(this->history.begin() + this->historyPos, this->history.end(), frame.waveform.begin());
+    std::copy(this->history.begin(), this->history.begin() + this->historyPos, frame.waveform.begin() + tail);
+
+    for (size_t i = 0; i < this->fftSize; i++)
+    {
+        this->windowed[i] = frame.waveform[i] * this->window[i];
+    }
+
+    this->plan.getMagnitudes(this->windowed.data(), this->magnitudes.data());
+
+    // Smoothing follows elapsed time rather than the number of analyses
+    uint64_t elapsedFrames = (sampleCount - this->lastAnalysis) / NUM_CHANNELS;
+    double hops = (double)elapsedFrames / this->hopSize;
+    float release = (float)std::pow(this->release, hops);
+    float peakRelease = (float)std::pow(this->peakRelease, hops);
+    this->lastAnalysis = sampleCount;
+
+    for (size_t b = 0; b < this->bandCount; b++)
+    {
+        float value = 0;
+        for (size_t k = this->bandEdges[b]; k < this->bandEdges[b + 1]; k++)
+        {
+            value = std::max(value, this->magnitudes[k]);
+        }
+        value *= this->scale;
+
+        // Rise instantly, fall gradually
+        this->levels[b] = std::max(value, this->levels[b] * release);
+
+        if (value >= this->peaks[b])
+        {
+            this->peaks[b] = value;
+            this->peakAge[b] = 0;
+        }
+        else
+        {
+            // Only the part of the elapsed time past the hold lets the peak fall
+            this->peakAge[b] += elapsedFrames;
+            if (this->peakAge[b] > this->peakHoldFrames)
+            {
+                uint64_t falling = this->peakAge[b] - this->peakHoldFrames;
+                float factor = (falling >= elapsedFrames) ? peakRelease
+                               : (float)std::pow(this->peakRelease, (double)falling / this->hopSize);
+                this->peaks[b] = std::max(value, this->peaks[b] * factor);
+            }
+        }
+    }
+
+    std::copy(this->levels.begin(), this->levels.end(), frame.bands.begin());
+    std::copy(this->peaks.begin(), this->peaks.end(), frame.peaks.begin());
+    frame.sequence = ++this->sequence;
+    frame.sampleCount = sampleCount;
+
+    publish();
+}
+
+/**
+ * Hand the back slot to the reader and take the spare slot in return.
+ */
+void SpectrumAnalyzer::publish()
+{
+    int previous = this->middleIndex.exchange(this->backIndex | HL_SPECTRUM_FRESH, std::memory_order_acq_rel);
+    this->backIndex = previous & ~HL_SPECTRUM_FRESH;
+}
+
+/**
+ * Get the most recent frame.
+ *
+ * Never blocks. Must only be called from one thread at a time.
+ *
+ * @param frame Overwritten with the latest frame if there is a new one
+ * @return True if a frame was published since the previous call
+ */
+bool SpectrumAnalyzer::getLatest(SpectrumFrame &frame)
+{
+    if (!(this->middleIndex.load(std::memory_order_acquire) & HL_SPECTRUM_FRESH))
+    {
+        return false;
+    }
+
+    int previous = this->middleIndex.exchange(this->frontIndex, std::memory_order_acq_rel);
+    this->frontIndex = previous & ~HL_SPECTRUM_FRESH;
+
+    frame = this->slots[this->frontIndex];
+    return true;
+}
+
+/**
+ * Get the number of bands in each frame.
+ *
+ * @return Band count
+ */
+size_t SpectrumAnalyzer::getBandCount() const
+{
+    return this->bandCount;
+}
+
+/**
+ * Get the lower edge of a band.
+ *
+ * @param band Band index. getBandCount() gives the upper edge of the last band.
+ * @return Frequency in Hz
+ */
+double SpectrumAnalyzer::getBandFrequency(size_t band) const
+{
+    size_t bin = this->bandEdges[std::min(band, this->bandCount)];
+    return (double)bin * HulaAudioSettings::getInstance()->getSampleRate() / this->fftSize;
+}
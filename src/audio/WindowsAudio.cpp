@@ -201,6 +201,8 @@ static int paRecordCallback(const void *inputBuffer, void *outputBuffer,
     (void)statusFlags;
     (void)userData;
 
+    obj->getStats()->addCaptureBlock();
+
     // TODO: Make sure this calculation is right
     obj->copyToBuffers(samples, framesPerBuffer * NUM_CHANNELS);
 
@@ -331,6 +333,7 @@ void WindowsAudio::capture()
                 status = captureClient->GetBuffer(&pData, &numFramesAvailable, &flags, nullptr, nullptr);
                 HANDLE_ERROR(status);
 
+                getStats()->addCaptureBlock();
                 this->copyToBuffers((float *)pData, numFramesAvailable * NUM_CHANNELS);
 
                 this->doCallbacks((float*)pData, numFramesAvailable * NUM_CHANNELS);
@@ -528,6 +531,8 @@ WindowsAudio::~WindowsAudio()
 {
     hlDebugf("WindowsAudio destructor called\n");
 
+    stopDeviceWatcher();
+
     // Close the Port Audio session
     PaError err = Pa_Terminate();
     if (err != paNoError)
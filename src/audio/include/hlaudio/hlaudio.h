@@ -7,8 +7,15 @@
  */
 
 #include "hlaudio/internal/Controller.h"
+#include "hlaudio/internal/FftPlan.h"
+#include "hlaudio/internal/FileAudio.h"
 #include "hlaudio/internal/HulaAudioError.h"
+#include "hlaudio/internal/HulaBroadcastBuffer.h"
+#include "hlaudio/internal/HulaElasticBuffer.h"
 #include "hlaudio/internal/HulaRingBuffer.h"
 #include "hlaudio/internal/ICallback.h"
+#include "hlaudio/internal/IDeviceListener.h"
+#include "hlaudio/internal/PipelineStats.h"
+#include "hlaudio/internal/SpectrumAnalyzer.h"
 
 #endif // HL_AUDIO_H
\ No newline at end of file
@@ -5,8 +5,11 @@
 
 #include "Device.h"
 #include "OSAudio.h"
+#include "HulaBroadcastBuffer.h"
 #include "HulaRingBuffer.h"
 #include "ICallback.h"
+#include "IDeviceListener.h"
+#include "PipelineStats.h"
 
 namespace hula
 {
@@ -23,12 +26,15 @@ namespace hula
 
         public:
             Controller();
+            Controller(OSAudio *audio);
             virtual ~Controller();
 
             void addBuffer(HulaRingBuffer *rb);
             void removeBuffer(HulaRingBuffer *rb);
-            HulaRingBuffer *createBuffer(float duration);
-            HulaRingBuffer *createAndAddBuffer(float duration);
+            HulaBroadcastReader *createBuffer(float duration);
+            HulaBroadcastReader *createAndAddBuffer(float duration);
+            void addReader(HulaBroadcastReader *reader);
+            void removeReader(HulaBroadcastReader *reader);
 
             // Callback Functionality
             void addCallback(ICallback* obj);
@@ -40,11 +46,26 @@ namespace hula
             // Ringbuffer Functionality
             void copyToBuffers(const float *samples, ring_buffer_size_t sampleCount);
             ring_buffer_size_t playbackCopyToBuffers(const float *samples, ring_buffer_size_t sampleCount);
+            bool waitForPlaybackSpace(ring_buffer_size_t sampleCount, uint32_t timeoutMs);
+            bool waitForPlaybackDrain(uint32_t timeoutMs);
+            ring_buffer_size_t getPlaybackReadAvailable() const;
 
             std::vector<Device *> getDevices(DeviceType type) const;
+            std::shared_ptr<const DeviceSnapshot> getDeviceSnapshot() const;
+            uint64_t getDeviceGeneration() const;
+            bool refreshDevices() const;
+
+            void addDeviceListener(IDeviceListener *listener);
+            void removeDeviceListener(IDeviceListener *listener);
 
             bool setActiveInputDevice(Device *device) const;
             bool setActiveOutputDevice(Device *device) const;
+
+            double getInputLatency() const;
+
+            PipelineStats *getStats() const;
+            PipelineStatsSnapshot getStatsSnapshot() const;
+            void resetStats() const;
     };
 }
 
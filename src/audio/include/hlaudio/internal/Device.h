@@ -63,11 +63,11 @@ namespace hula
             Device(DeviceID id, std::string name, DeviceType t);
             ~Device();
 
-            DeviceID getID();
+            DeviceID getID() const;
 
-            std::string getName();
+            std::string getName() const;
 
-            DeviceType getType();
+            DeviceType getType() const;
 
             static void deleteDevices(std::vector<Device *> devices);
     };
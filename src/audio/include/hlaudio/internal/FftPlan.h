@@ -0,0 +1,80 @@
+#ifndef HL_FFT_PLAN_H
+#define HL_FFT_PLAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace hula
+{
+    /**
+     * Reusable FFT of real-valued input.
+     *
+     * Everything that only depends on the transform size is computed once
+     * in the constructor: twiddle factors, the bit-reversal permutation
+     * and the work buffers. A transform therefore never allocates.
+     *
+     * A real input of size N is packed into a complex sequence of N/2
+     * points, transformed with radix-2 butterflies and then split into
+     * the N/2 + 1 non-redundant bins of the real spectrum. Butterflies
+     * use SSE or NEON when the target has them.
+     *
+     * A plan is not thread-safe. Give each thread its own.
+     */
+    class FftPlan {
+
+        private:
+            /**
+             * Number of real input samples.
+             */
+            size_t size;
+
+            /**
+             * Number of points in the packed complex transform.
+             */
+            size_t half;
+
+            /**
+             * Position of every packed input point after bit reversal.
+             */
+            std::vector<uint32_t> bitReverse;
+
+            /**
+             * Butterfly twiddles of every stage back to back.
+             * Stage with half size h starts at index h - 1.
+             */
+            std::vector<float> twiddleRe;
+            std::vector<float> twiddleIm;
+
+            /**
+             * Twiddles used to split the packed transform into the real spectrum.
+             */
+            std::vector<float> splitRe;
+            std::vector<float> splitIm;
+
+            /**
+             * Packed complex work buffers.
+             */
+            std::vector<float> workRe;
+            std::vector<float> workIm;
+
+            /**
+             * Spectrum buffers for getMagnitudes().
+             */
+            std::vector<float> binRe;
+            std::vector<float> binIm;
+
+            void transformPacked();
+
+        public:
+            FftPlan(size_t size);
+
+            size_t getSize() const;
+            size_t getBinCount() const;
+
+            void transform(const float *input, float *real, float *imag);
+            void getMagnitudes(const float *input, float *magnitudes);
+    };
+}
+
+#endif // HL_FFT_PLAN_H
@@ -0,0 +1,103 @@
+#ifndef HL_FILE_AUDIO_H
+#define HL_FILE_AUDIO_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Device.h"
+#include "OSAudio.h"
+
+/**
+ * Frames per capture block when HulaAudioSettings::getCaptureFragmentSize()
+ * does not set one. Also the playback block size.
+ */
+#define HL_FILE_AUDIO_FRAMES_PER_BUFFER 512
+
+/**
+ * Frequency in Hz of the tone generated when no file is given.
+ */
+#define HL_FILE_AUDIO_TONE_FREQ 440
+
+/**
+ * Peak level of the generated tone.
+ */
+#define HL_FILE_AUDIO_TONE_AMPLITUDE 0.5
+
+/**
+ * Interval in milliseconds at which the playback sink
+ * checks for new data while the playback buffer is empty.
+ */
+#define HL_FILE_AUDIO_IDLE_MS 5
+
+/**
+ * Name of the input device that FileAudio offers.
+ */
+#define HL_FILE_AUDIO_INPUT_NAME "HulaLoop File Input"
+
+/**
+ * Name of the output device that FileAudio offers.
+ */
+#define HL_FILE_AUDIO_OUTPUT_NAME "HulaLoop Null Output"
+
+namespace hula
+{
+    /**
+     * An audio backend that does not need a sound server.
+     *
+     * Capture delivers the contents of a WAV file, looped, or a sine
+     * tone if no file is given. Playback goes to a sink that only
+     * counts the samples it consumed. Both run at a configurable speed
+     * relative to real time, so the whole pipeline can be exercised
+     * deterministically on a headless machine and faster than real time.
+     *
+     * Select it with HulaAudioSettings::setAudioBackend() before the
+     * Controller is created, or hand an instance to Controller directly.
+     */
+    class FileAudio : public OSAudio {
+
+        private:
+            std::string path;
+            double speed;
+
+            /**
+             * Interleaved contents of the input file.
+             * Empty if the tone is generated instead.
+             */
+            std::vector<SAMPLE> source;
+
+            /**
+             * Next frame of the source or the tone to deliver.
+             * Only touched by the capture thread.
+             */
+            uint64_t sourcePos;
+
+            std::vector<SAMPLE> captureBlock;
+            std::vector<SAMPLE> playBlock;
+
+            std::atomic<uint64_t> capturedSamples;
+            std::atomic<uint64_t> playedSamples;
+
+            void loadWav(const std::string &path);
+            void fillBlock(SAMPLE *block, size_t frames);
+            void pace(std::chrono::steady_clock::time_point start, uint64_t frames);
+
+        public:
+            FileAudio(const std::string &path = "", double speed = 1.0);
+            ~FileAudio();
+
+            void capture();
+            void playback();
+
+            std::vector<Device *> getDevices(DeviceType type);
+
+            bool checkDeviceParams(Device *device);
+
+            uint64_t getCapturedSampleCount() const;
+            uint64_t getPlayedSampleCount() const;
+    };
+}
+
+#endif // HL_FILE_AUDIO_H
@@ -117,6 +117,9 @@
 #define HL_LINUX_SET_PARAMS_CODE -112
 #define HL_LINUX_SET_PARAMS_MSG "Could not set PulseAudio device params!"
 
+#define HL_LINUX_CONNECT_CODE -113
+#define HL_LINUX_CONNECT_MSG "Could not connect to the PulseAudio server!"
+
 // WindowsAudio error messages
 // Block: 120-229
 #define HL_WIN_GET_DEVICES_CODE -120
@@ -125,6 +128,14 @@
 #define HL_WIN_OPEN_STREAM_CODE -121
 #define HL_WIN_OPEN_STREAM_MSG  "Could not open WASAPI device stream!"
 
+// FileAudio error messages
+// Block: 130-139
+#define HL_FILE_AUDIO_OPEN_CODE -130
+#define HL_FILE_AUDIO_OPEN_MSG  "Could not open the audio input file!"
+
+#define HL_FILE_AUDIO_FORMAT_CODE -131
+#define HL_FILE_AUDIO_FORMAT_MSG  "The audio input file is not a supported WAV file!"
+
 // HulaRingBuffer error messages
 #define HL_RB_ALLOC_BUFFER_CODE -200
 #define HL_RB_ALLOC_BUFFER_MSG  "Could not allocate ring buffer!"
@@ -132,6 +143,10 @@
 #define HL_RB_INIT_BUFFER_CODE -201
 #define HL_RB_INIT_BUFFER_MSG  "Could not initialize ring buffer! Perhaps the size is not power of 2?"
 
+// FftPlan error messages
+#define HL_FFT_SIZE_CODE -210
+#define HL_FFT_SIZE_MSG  "Could not create FFT plan! The size must be a power of 2 and at least 4."
+
 namespace hula
 {
     /**
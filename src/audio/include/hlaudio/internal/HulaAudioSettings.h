@@ -3,8 +3,27 @@
 
 #include <string>
 
+#include "HulaSampleFormat.h"
+
 namespace hula
 {
+    /**
+     * Audio backend that the Controller creates.
+     */
+    enum AudioBackend
+    {
+        /**
+         * The sound system of the host OS.
+         */
+        OS_AUDIO,
+
+        /**
+         * FileAudio. Captures a WAV file or a tone and plays into a
+         * counting sink. Needs no sound server.
+         */
+        FILE_AUDIO
+    };
+
     /**
      * Class containing all settings pertinent to the audio module.
      */
@@ -20,6 +39,14 @@ namespace hula
             int numberOfChannels;
             int sampleRate;
             int sampleSize;
+            SampleFormat sampleFormat;
+
+            int captureFragmentSize;
+            int playbackTargetLength;
+
+            AudioBackend audioBackend;
+            std::string fileAudioPath;
+            double fileAudioSpeed;
 
             std::string defaultInputDeviceName;
             std::string defaultOutputDeviceName;
@@ -44,6 +71,14 @@ namespace hula
             int getNumberOfChannels();
             int getSampleRate();
             int getSampleSize();
+            SampleFormat getSampleFormat();
+
+            int getCaptureFragmentSize();
+            int getPlaybackTargetLength();
+
+            AudioBackend getAudioBackend();
+            std::string getFileAudioPath();
+            double getFileAudioSpeed();
 
             /**
              * Setters
@@ -54,6 +89,14 @@ namespace hula
             void setNumberOfChannels(int);
             void setSampleRate(int);
             void setSampleSize(int);
+            void setSampleFormat(SampleFormat);
+
+            void setCaptureFragmentSize(int);
+            void setPlaybackTargetLength(int);
+
+            void setAudioBackend(AudioBackend);
+            void setFileAudioPath(const std::string &);
+            void setFileAudioSpeed(double);
 
             ~HulaAudioSettings();
     };
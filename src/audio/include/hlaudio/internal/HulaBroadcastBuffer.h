@@ -0,0 +1,669 @@
+#ifndef HL_BROADCAST_BUFFER_H
+#define HL_BROADCAST_BUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "HulaAudioError.h"
+#include "HulaAudioSettings.h"
+#include "HulaRingBuffer.h"
+#include "HulaSampleFormat.h"
+
+namespace hula
+{
+    class HulaBroadcastReader;
+
+    /**
+     * Single-writer, multi-reader ring of samples.
+     *
+     * The writer publishes each block once, no matter how many readers exist.
+     * Every HulaBroadcastReader keeps its own read cursor into the shared storage.
+     * The writer never waits for readers; a reader that falls too far behind
+     * skips ahead and records an overrun instead.
+     *
+     * At most half of the storage can be written in one call and at most half
+     * can be held by a reader. The other half is headroom so that the region
+     * the writer is filling never overlaps data a reader is allowed to see.
+     *
+     * Samples are stored in a SampleFormat chosen at construction, so
+     * beginWrite() and HulaBroadcastReader::directRead() hand out regions in
+     * that format. write() and HulaBroadcastReader::read() convert from/to float.
+     *
+     * Readers can sleep in HulaBroadcastReader::waitForData() until a given
+     * amount has been written. The writer only wakes them once that amount
+     * is reached, instead of on every block.
+     */
+    class HulaBroadcastBuffer {
+
+            friend class HulaBroadcastReader;
+
+        private:
+            /**
+             * Underlying memory shared by all readers.
+             */
+            uint8_t *rbMemory;
+
+            /**
+             * Format of every sample in rbMemory.
+             */
+            SampleFormat format;
+
+            /**
+             * Size in bytes of one sample in rbMemory.
+             */
+            int sampleSize;
+
+            /**
+             * Number of sample slots in rbMemory.
+             * Always a whole number of frames.
+             */
+            ring_buffer_size_t bufferSize;
+
+            char padShared[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Total number of samples ever written.
+             */
+            std::atomic<uint64_t> writeIndex;
+
+            /**
+             * Lowest write index that some waiting reader needs.
+             * UINT64_MAX if nobody is waiting.
+             */
+            std::atomic<uint64_t> wakeIndex;
+
+            char padWriter[HL_CACHE_LINE_SIZE];
+
+            std::mutex wakeMutex;
+            std::condition_variable wakeCond;
+
+            /**
+             * Ask to be woken once writeIndex reaches target.
+             */
+            void armWake(uint64_t target)
+            {
+                uint64_t current = wakeIndex.load();
+                while (target < current && !wakeIndex.compare_exchange_weak(current, target))
+                { }
+            }
+
+            /**
+             * Split a run of count samples starting at the running index
+             * into at most two contiguous regions of rbMemory.
+             */
+            void getRegions(uint64_t index, ring_buffer_size_t count, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2) const
+            {
+                ring_buffer_size_t pos = (ring_buffer_size_t)(index % (uint64_t)bufferSize);
+                ring_buffer_size_t firstPart = std::min(count, bufferSize - pos);
+
+                *dataPtr1 = (firstPart > 0) ? rbMemory + (size_t)pos * sampleSize : nullptr;
+                *size1 = firstPart;
+                *dataPtr2 = (count > firstPart) ? rbMemory : nullptr;
+                *size2 = count - firstPart;
+            }
+
+        public:
+            /**
+             * Create a new broadcast buffer.
+             *
+             * @param maxDuration Length in seconds of the shared storage.
+             *                    Sized with the sample rate from HulaAudioSettings.
+             * @param format Format that samples are stored in.
+             */
+            HulaBroadcastBuffer(float maxDuration, SampleFormat format = FLOAT_32)
+            {
+                int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+                ring_buffer_size_t numSamples = (ring_buffer_size_t)(sampleRate * maxDuration) * NUM_CHANNELS;
+                if (numSamples < 2 * NUM_CHANNELS)
+                {
+                    hlDebugf("Failed to initialize broadcast buffer. Invalid duration: %f\n", maxDuration);
+                    throw AudioException(HL_RB_INIT_BUFFER_CODE, HL_RB_INIT_BUFFER_MSG);
+                }
+
+                this->format = format;
+                this->sampleSize = getSampleFormatSize(format);
+
+                this->rbMemory = new (std::nothrow) uint8_t[(size_t)numSamples * this->sampleSize]();
+                if (this->rbMemory == nullptr)
+                {
+                    hlDebugf("Could not allocate broadcast buffer of size %zu.\n", (size_t)numSamples * this->sampleSize);
+                    throw AudioException(HL_RB_ALLOC_BUFFER_CODE, HL_RB_ALLOC_BUFFER_MSG);
+                }
+
+                this->bufferSize = numSamples;
+                this->writeIndex.store(0);
+                this->wakeIndex.store(UINT64_MAX);
+            }
+
+            HulaBroadcastBuffer(const HulaBroadcastBuffer &) = delete;
+            HulaBroadcastBuffer &operator=(const HulaBroadcastBuffer &) = delete;
+
+            /**
+             * Get the size of the shared storage.
+             *
+             * @return Capacity in samples.
+             */
+            ring_buffer_size_t getCapacity() const
+            {
+                return bufferSize;
+            }
+
+            /**
+             * Get the format that samples are stored in.
+             *
+             * @return Sample format.
+             */
+            SampleFormat getSampleFormat() const
+            {
+                return format;
+            }
+
+            /**
+             * Get the largest number of samples a reader may fall behind
+             * or the writer may reserve at once.
+             *
+             * @return Window size in samples.
+             */
+            ring_buffer_size_t getMaxWindow() const
+            {
+                return bufferSize / 2 / NUM_CHANNELS * NUM_CHANNELS;
+            }
+
+            /**
+             * Reserve space so that it can be filled in place.
+             * This never fails for lack of space since the oldest data is
+             * simply overwritten.
+             *
+             * @param maxSamples Desired number of samples. Clamped to getMaxWindow().
+             * @param dataPtr1 The address where the first writable pointer will be stored.
+             * @param size1 Number of samples writable at dataPtr1.
+             * @param dataPtr2 The address where the second pointer (if required) will be stored. nullptr if not used.
+             * @param size2 Number of samples writable at dataPtr2.
+             * @return Number of samples reserved.
+             */
+            ring_buffer_size_t beginWrite(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+            {
+                ring_buffer_size_t samplesToWrite = std::min(std::max(maxSamples, (ring_buffer_size_t)0), getMaxWindow());
+                getRegions(writeIndex.load(std::memory_order_relaxed), samplesToWrite, dataPtr1, size1, dataPtr2, size2);
+
+                return samplesToWrite;
+            }
+
+            /**
+             * Publish samples that were written into the regions returned by beginWrite().
+             *
+             * @param samples Number of samples written. Must not exceed the amount reserved.
+             */
+            void commitWrite(ring_buffer_size_t samples)
+            {
+                if (samples > 0)
+                {
+                    // Sequentially consistent so that a reader arming wakeIndex
+                    // either sees the new index or is seen by the check below
+                    uint64_t newIndex = writeIndex.load(std::memory_order_relaxed) + samples;
+                    writeIndex.store(newIndex);
+
+                    if (newIndex >= wakeIndex.load())
+                    {
+                        wakeReaders();
+                    }
+                }
+            }
+
+            /**
+             * Wake every reader sleeping in HulaBroadcastReader::waitForData().
+             * Readers whose threshold has not been reached yet return
+             * false from waitForData() and are expected to call it again.
+             */
+            void wakeReaders()
+            {
+                wakeIndex.store(UINT64_MAX);
+
+                // Taking the lock orders this with a reader that is about to sleep
+                {
+                    std::lock_guard<std::mutex> lock(wakeMutex);
+                }
+                wakeCond.notify_all();
+            }
+
+            /**
+             * Publish a block of samples to every reader.
+             * The samples are converted to the storage format on the way in.
+             *
+             * @param data Array of samples to write.
+             * @param maxSamples Number of samples contained in the array.
+             * @return Number of samples written.
+             */
+            ring_buffer_size_t write(const SAMPLE *data, ring_buffer_size_t maxSamples)
+            {
+                ring_buffer_size_t totalWritten = 0;
+
+                // Large blocks are split so that no single reservation exceeds the window
+                while (totalWritten < maxSamples)
+                {
+                    void *ptr1;
+                    void *ptr2;
+                    ring_buffer_size_t size1;
+                    ring_buffer_size_t size2;
+
+                    ring_buffer_size_t samplesReserved = beginWrite(maxSamples - totalWritten, &ptr1, &size1, &ptr2, &size2);
+
+                    if (size1 > 0)
+                    {
+                        convertFromFloat(data + totalWritten, ptr1, format, size1);
+                    }
+
+                    if (size2 > 0)
+                    {
+                        convertFromFloat(data + totalWritten + size1, ptr2, format, size2);
+                    }
+
+                    commitWrite(samplesReserved);
+                    totalWritten += samplesReserved;
+                }
+
+                return totalWritten;
+            }
+
+            /**
+             * Publish a block of samples that is already in the storage format.
+             *
+             * @param data Array of samples in getSampleFormat().
+             * @param maxSamples Number of samples contained in the array.
+             * @return Number of samples written.
+             */
+            ring_buffer_size_t writeRaw(const void *data, ring_buffer_size_t maxSamples)
+            {
+                const uint8_t *in = (const uint8_t *)data;
+                ring_buffer_size_t totalWritten = 0;
+
+                while (totalWritten < maxSamples)
+                {
+                    void *ptr1;
+                    void *ptr2;
+                    ring_buffer_size_t size1;
+                    ring_buffer_size_t size2;
+
+                    ring_buffer_size_t samplesReserved = beginWrite(maxSamples - totalWritten, &ptr1, &size1, &ptr2, &size2);
+
+                    if (size1 > 0)
+                    {
+                        memcpy(ptr1, in + (size_t)totalWritten * sampleSize, (size_t)size1 * sampleSize);
+                    }
+
+                    if (size2 > 0)
+                    {
+                        memcpy(ptr2, in + (size_t)(totalWritten + size1) * sampleSize, (size_t)size2 * sampleSize);
+                    }
+
+                    commitWrite(samplesReserved);
+                    totalWritten += samplesReserved;
+                }
+
+                return totalWritten;
+            }
+
+            /**
+             * Destructor for the broadcast buffer.
+             *
+             * All readers attached to this buffer must be deleted first.
+             */
+            ~HulaBroadcastBuffer()
+            {
+                delete [] this->rbMemory;
+            }
+    };
+
+    /**
+     * @ingroup public_api
+     *
+     * Read handle into a HulaBroadcastBuffer.
+     *
+     * Offers the same read API as HulaRingBuffer, but the samples live in storage
+     * shared with every other reader. Each reader is single-consumer: only one
+     * thread may call read(), directRead() or clear() on it.
+     *
+     * Readers are created via Controller::createBuffer().
+     */
+    class HulaBroadcastReader {
+
+        private:
+            /**
+             * Buffer that this reader is attached to.
+             */
+            HulaBroadcastBuffer *buffer;
+
+            /**
+             * Largest number of samples this reader may fall behind the writer.
+             */
+            ring_buffer_size_t window;
+
+            /**
+             * Label used in PipelineStatsSnapshot.
+             */
+            std::string name;
+
+            char padShared[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Total number of samples consumed by this reader.
+             */
+            std::atomic<uint64_t> readIndex;
+
+            /**
+             * Number of times this reader fell behind and lost data.
+             */
+            std::atomic<uint64_t> overrunCount;
+
+            /**
+             * Number of samples lost to overruns.
+             */
+            std::atomic<uint64_t> droppedSamples;
+
+            /**
+             * Highest fill level seen when reading.
+             */
+            std::atomic<ring_buffer_size_t> highWater;
+
+            char padReader[HL_CACHE_LINE_SIZE];
+
+        public:
+            /**
+             * Attach a new reader to a broadcast buffer.
+             * The reader starts at the current write position.
+             *
+             * @param buffer Buffer to read from. Must outlive the reader.
+             * @param maxDuration The maximum length in seconds that this reader may fall behind.
+             *                    Clamped to what the shared storage can hold.
+             */
+            HulaBroadcastReader(HulaBroadcastBuffer *buffer, float maxDuration)
+            {
+                int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+                ring_buffer_size_t numSamples = (ring_buffer_size_t)(sampleRate * maxDuration) * NUM_CHANNELS;
+                if (buffer == nullptr || numSamples <= 0)
+                {
+                    hlDebugf("Failed to initialize broadcast reader. Invalid duration: %f\n", maxDuration);
+                    throw AudioException(HL_RB_INIT_BUFFER_CODE, HL_RB_INIT_BUFFER_MSG);
+                }
+
+                this->buffer = buffer;
+                this->window = std::min(numSamples, buffer->getMaxWindow());
+                this->readIndex.store(buffer->writeIndex.load(std::memory_order_acquire));
+                this->overrunCount.store(0);
+                this->droppedSamples.store(0);
+                this->highWater.store(0);
+            }
+
+            HulaBroadcastReader(const HulaBroadcastReader &) = delete;
+            HulaBroadcastReader &operator=(const HulaBroadcastReader &) = delete;
+
+            /**
+             * Get the largest number of samples this reader can hold.
+             *
+             * @return Capacity in samples.
+             */
+            ring_buffer_size_t getCapacity() const
+            {
+                return window;
+            }
+
+            /**
+             * Get the format of the regions returned by directRead().
+             *
+             * @return Sample format.
+             */
+            SampleFormat getSampleFormat() const
+            {
+                return buffer->getSampleFormat();
+            }
+
+            /**
+             * Get the number of samples currently waiting to be read.
+             * Capped at the reader's capacity since anything older has been lost.
+             *
+             * @return Number of readable samples.
+             */
+            ring_buffer_size_t getReadAvailable() const
+            {
+                uint64_t w = buffer->writeIndex.load(std::memory_order_acquire);
+                uint64_t r = readIndex.load(std::memory_order_relaxed);
+                return (ring_buffer_size_t)std::min(w - r, (uint64_t)window);
+            }
+
+            /**
+             * Set the label that identifies this reader in statistics.
+             * Must be called before the reader is added to the Controller.
+             *
+             * @param name Label such as "record"
+             */
+            void setName(const std::string &name)
+            {
+                this->name = name;
+            }
+
+            /**
+             * Get the label set with setName().
+             *
+             * @return Label, or empty if none was set.
+             */
+            const std::string &getName() const
+            {
+                return name;
+            }
+
+            /**
+             * Get the highest fill level seen by directRead() and read().
+             *
+             * @return High-water mark in samples.
+             */
+            ring_buffer_size_t getHighWaterMark() const
+            {
+                return highWater.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the number of times this reader fell behind the writer.
+             *
+             * @return Number of overruns.
+             */
+            uint64_t getOverrunCount() const
+            {
+                return overrunCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the number of samples this reader lost by falling behind.
+             *
+             * @return Number of dropped samples.
+             */
+            uint64_t getDroppedSamples() const
+            {
+                return droppedSamples.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Sleep until at least minSamples are waiting to be read.
+             * The writer wakes the reader as soon as the threshold is
+             * reached, so there is no need to poll.
+             *
+             * @param minSamples Number of samples to wait for. Clamped to getCapacity().
+             * @param timeoutMs Longest time to wait in milliseconds.
+             * @return True if the samples are available, false on timeout
+             *         or when woken early by HulaBroadcastBuffer::wakeReaders().
+             */
+            bool waitForData(ring_buffer_size_t minSamples, uint32_t timeoutMs)
+            {
+                minSamples = std::min(std::max(minSamples, (ring_buffer_size_t)1), window);
+                uint64_t target = readIndex.load(std::memory_order_relaxed) + minSamples;
+
+                std::unique_lock<std::mutex> lock(buffer->wakeMutex);
+
+                buffer->armWake(target);
+                if (buffer->writeIndex.load() >= target)
+                {
+                    return true;
+                }
+
+                buffer->wakeCond.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+
+                return buffer->writeIndex.load() >= target;
+            }
+
+            /**
+             * Fetch direct pointers to the shared memory. This can be used to avoid allocating a secondary container.
+             * The second pointer/size pair is for when the data is split between the tail and head of the storage.
+             * If the requested maxSamples are continuous in the underlying memory, only the first pointer/size pair is used.
+             * The regions hold samples in getSampleFormat().
+             *
+             * The regions stay valid until the writer has published another
+             * half of the shared storage, so they must be consumed promptly.
+             *
+             * @param maxSamples Desired number of samples.
+             * @param dataPtr1 The address where the first pointer should be stored.
+             * @param size1 Number of samples available from dataPtr1.
+             * @param dataPtr2 The address where the second pointer (if required) will be stored. nullptr if not used.
+             * @param size2 Number of samples available from dataPtr2.
+             * @return Number of samples read.
+             */
+            ring_buffer_size_t directRead(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+            {
+                uint64_t w = buffer->writeIndex.load(std::memory_order_acquire);
+                uint64_t r = readIndex.load(std::memory_order_relaxed);
+
+                // Fell behind: skip to the oldest sample that is still intact
+                if (w - r > (uint64_t)window)
+                {
+                    uint64_t newRead = w - window;
+                    droppedSamples.fetch_add(newRead - r, std::memory_order_relaxed);
+                    overrunCount.fetch_add(1, std::memory_order_relaxed);
+
+                    hlDebug() << "Broadcast reader overrun: dropped " << newRead - r << " samples." << std::endl;
+                    r = newRead;
+                }
+
+                // Only the reader writes this, so no read-modify-write is needed
+                ring_buffer_size_t available = (ring_buffer_size_t)(w - r);
+                if (available > highWater.load(std::memory_order_relaxed))
+                {
+                    highWater.store(available, std::memory_order_relaxed);
+                }
+
+                ring_buffer_size_t samplesToRead = (ring_buffer_size_t)std::min(w - r, (uint64_t)std::max(maxSamples, (ring_buffer_size_t)0));
+                buffer->getRegions(r, samplesToRead, dataPtr1, size1, dataPtr2, size2);
+
+                readIndex.store(r + samplesToRead, std::memory_order_relaxed);
+
+                return samplesToRead;
+            }
+
+            /**
+             * Read up to maxSamples into the memory pointed to by data.
+             * The samples are converted to float on the way out.
+             *
+             * @param data Pointer to allocated memory of at least maxSamples size.
+             * @param maxSamples Desired number of samples.
+             * @return Number of samples read.
+             */
+            ring_buffer_size_t read(SAMPLE *data, ring_buffer_size_t maxSamples)
+            {
+                void *ptr1;
+                void *ptr2;
+                ring_buffer_size_t size1;
+                ring_buffer_size_t size2;
+
+                ring_buffer_size_t samplesRead = directRead(maxSamples, &ptr1, &size1, &ptr2, &size2);
+
+                if (size1 > 0)
+                {
+                    convertToFloat(ptr1, getSampleFormat(), data, size1);
+                }
+
+                if (size2 > 0)
+                {
+                    convertToFloat(ptr2, getSampleFormat(), data + size1, size2);
+                }
+
+                return samplesRead;
+            }
+
+            /**
+             * Copy the most recent samples without draining everything before them.
+             * Everything up to the write position counts as consumed, so skipping
+             * ahead like this is not reported as an overrun.
+             *
+             * Meant for consumers that only care about the current signal,
+             * such as meters, which would otherwise have to read and throw
+             * away most of what was published.
+             *
+             * @param data Pointer to allocated memory of at least maxSamples size.
+             * @param maxSamples Number of most recent samples wanted. Rounded down to whole frames
+             *                   and clamped to getCapacity().
+             * @param newSamples If not nullptr, set to the number of samples published since
+             *                   the previous read.
+             * @return Number of samples copied. Less than maxSamples if not enough
+             *         has been published yet.
+             */
+            ring_buffer_size_t readLatest(SAMPLE *data, ring_buffer_size_t maxSamples, uint64_t *newSamples = nullptr)
+            {
+                uint64_t w = buffer->writeIndex.load(std::memory_order_acquire);
+                uint64_t r = readIndex.load(std::memory_order_relaxed);
+
+                uint64_t wanted = (uint64_t)(std::max(maxSamples, (ring_buffer_size_t)0) / NUM_CHANNELS * NUM_CHANNELS);
+                ring_buffer_size_t count = (ring_buffer_size_t)std::min(wanted, std::min(w, (uint64_t)window));
+
+                void *ptr1;
+                void *ptr2;
+                ring_buffer_size_t size1;
+                ring_buffer_size_t size2;
+                buffer->getRegions(w - count, count, &ptr1, &size1, &ptr2, &size2);
+
+                if (size1 > 0)
+                {
+                    convertToFloat(ptr1, getSampleFormat(), data, size1);
+                }
+
+                if (size2 > 0)
+                {
+                    convertToFloat(ptr2, getSampleFormat(), data + size1, size2);
+                }
+
+                if (newSamples != nullptr)
+                {
+                    *newSamples = w - r;
+                }
+
+                readIndex.store(w, std::memory_order_relaxed);
+
+                return count;
+            }
+
+            /**
+             * Discard everything that has been published so far.
+             * Must be called from the consumer side.
+             */
+            void clear()
+            {
+                readIndex.store(buffer->writeIndex.load(std::memory_order_acquire), std::memory_order_relaxed);
+            }
+
+            /**
+             * @ingroup memory_management
+             *
+             * Destructor for the reader.
+             *
+             * A reader should only be deleted after it has been
+             * removed from OSAudio using a call to Controller::removeReader().
+             */
+            ~HulaBroadcastReader()
+            {
+            }
+    };
+}
+
+#endif // END HL_BROADCAST_BUFFER_H
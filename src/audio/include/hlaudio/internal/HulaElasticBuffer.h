@@ -0,0 +1,562 @@
+#ifndef HL_ELASTIC_BUFFER_H
+#define HL_ELASTIC_BUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "HulaAudioError.h"
+#include "HulaAudioSettings.h"
+#include "HulaRingBuffer.h"
+#include "HulaSampleFormat.h"
+
+namespace hula
+{
+    /**
+     * Single-producer/single-consumer queue of samples that grows
+     * when the consumer falls behind instead of losing audio.
+     *
+     * Samples are stored in a chain of fixed-size blocks. A reserve of blocks
+     * is allocated up front and always kept. When those are full the chain
+     * grows by another block, up to a hard limit. Blocks beyond the reserve
+     * are freed as soon as the consumer has drained them, so a stall only
+     * costs memory while it lasts.
+     *
+     * Like HulaBroadcastBuffer, samples are stored in a SampleFormat chosen
+     * at construction and the consumer can sleep in waitForData(). Only the
+     * hand-over of a drained block takes a lock, never the copying of samples.
+     */
+    class HulaElasticBuffer {
+
+        private:
+            /**
+             * One link of the chain.
+             */
+            struct Block {
+                std::atomic<Block *> next;
+                uint8_t *data;
+            };
+
+            /**
+             * Format of every sample and its size in bytes.
+             */
+            SampleFormat format;
+            int sampleSize;
+
+            /**
+             * Number of samples in each block. Always a whole number of frames.
+             */
+            ring_buffer_size_t blockSamples;
+
+            /**
+             * Number of blocks that are kept even when empty,
+             * and the most that may ever exist at once.
+             */
+            size_t reserveBlocks;
+            size_t maxBlocks;
+
+            /**
+             * Drained blocks waiting to be reused. Guarded by poolMutex.
+             */
+            std::vector<Block *> freeBlocks;
+            std::mutex poolMutex;
+
+            /**
+             * Number of blocks that exist, in the chain or in freeBlocks.
+             */
+            std::atomic<size_t> allocatedBlocks;
+
+            char padShared[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Total number of samples ever written. Owned by the producer.
+             */
+            std::atomic<uint64_t> writeIndex;
+
+            /**
+             * Block the producer is filling and the index of its first sample.
+             */
+            Block *tail;
+            uint64_t tailBase;
+
+            /**
+             * Number of samples that did not fit and how often it happened.
+             */
+            std::atomic<uint64_t> overrunCount;
+            std::atomic<uint64_t> droppedSamples;
+
+            char padProducer[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Total number of samples ever read. Owned by the consumer.
+             */
+            std::atomic<uint64_t> readIndex;
+
+            /**
+             * Oldest block still in the chain and the index of its first sample.
+             */
+            Block *head;
+            uint64_t headBase;
+
+            /**
+             * Highest number of samples that were waiting when the consumer read.
+             */
+            std::atomic<uint64_t> highWater;
+
+            char padConsumer[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Lowest write index that the waiting consumer needs.
+             * UINT64_MAX if nobody is waiting.
+             */
+            std::atomic<uint64_t> wakeIndex;
+            std::mutex wakeMutex;
+            std::condition_variable wakeCond;
+
+            /**
+             * Allocate a new, unlinked block.
+             *
+             * @return Block or nullptr if out of memory.
+             */
+            Block *allocateBlock()
+            {
+                Block *block = new (std::nothrow) Block;
+                if (block == nullptr)
+                {
+                    return nullptr;
+                }
+
+                block->data = new (std::nothrow) uint8_t[(size_t)blockSamples * sampleSize];
+                if (block->data == nullptr)
+                {
+                    delete block;
+                    return nullptr;
+                }
+
+                block->next.store(nullptr, std::memory_order_relaxed);
+                allocatedBlocks.fetch_add(1, std::memory_order_relaxed);
+                return block;
+            }
+
+            /**
+             * Free a block that is no longer linked anywhere.
+             */
+            void freeBlock(Block *block)
+            {
+                delete [] block->data;
+                delete block;
+                allocatedBlocks.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            /**
+             * Get an empty block for the producer, reusing a drained one if possible.
+             * Called from the producer side.
+             *
+             * @return Block or nullptr if the limit was reached or memory ran out.
+             */
+            Block *takeBlock()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(poolMutex);
+                    if (!freeBlocks.empty())
+                    {
+                        Block *block = freeBlocks.back();
+                        freeBlocks.pop_back();
+                        block->next.store(nullptr, std::memory_order_relaxed);
+                        return block;
+                    }
+                }
+
+                if (allocatedBlocks.load(std::memory_order_relaxed) >= maxBlocks)
+                {
+                    return nullptr;
+                }
+
+                return allocateBlock();
+            }
+
+            /**
+             * Hand a drained block back. Blocks beyond the reserve are freed.
+             * Called from the consumer side.
+             */
+            void releaseBlock(Block *block)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(poolMutex);
+                    if (allocatedBlocks.load(std::memory_order_relaxed) <= reserveBlocks)
+                    {
+                        freeBlocks.push_back(block);
+                        return;
+                    }
+                }
+
+                freeBlock(block);
+            }
+
+            /**
+             * Move the head past every block the consumer has finished with.
+             * A block is only left once its successor exists, so the producer
+             * never writes into a released block.
+             *
+             * @param r Current read index
+             */
+            void releaseDrainedBlocks(uint64_t r)
+            {
+                while (r >= headBase + (uint64_t)blockSamples)
+                {
+                    Block *next = head->next.load(std::memory_order_acquire);
+                    if (next == nullptr)
+                    {
+                        break;
+                    }
+
+                    releaseBlock(head);
+                    head = next;
+                    headBase += blockSamples;
+                }
+            }
+
+            /**
+             * Ask to be woken once writeIndex reaches target.
+             */
+            void armWake(uint64_t target)
+            {
+                uint64_t current = wakeIndex.load();
+                while (target < current && !wakeIndex.compare_exchange_weak(current, target))
+                { }
+            }
+
+        public:
+            /**
+             * Create a new elastic buffer.
+             * Durations are converted to samples with the sample rate from HulaAudioSettings.
+             *
+             * @param reserveDuration Length in seconds that is always allocated.
+             * @param maxDuration Most that may be held before samples are dropped.
+             * @param blockDuration Length in seconds of each block.
+             * @param format Format that samples are stored in.
+             */
+            HulaElasticBuffer(float reserveDuration, float maxDuration, float blockDuration, SampleFormat format = FLOAT_32)
+            {
+                int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+                ring_buffer_size_t numSamples = (ring_buffer_size_t)(sampleRate * blockDuration) * NUM_CHANNELS;
+                if (numSamples <= 0 || reserveDuration <= 0 || maxDuration < reserveDuration)
+                {
+                    hlDebugf("Failed to initialize elastic buffer. Invalid durations: %f, %f, %f\n", reserveDuration, maxDuration, blockDuration);
+                    throw AudioException(HL_RB_INIT_BUFFER_CODE, HL_RB_INIT_BUFFER_MSG);
+                }
+
+                this->format = format;
+                this->sampleSize = getSampleFormatSize(format);
+                this->blockSamples = numSamples;
+
+                // One block is always partly filled, so the reserve needs one extra
+                uint64_t reserveSamples = (uint64_t)(sampleRate * reserveDuration) * NUM_CHANNELS;
+                uint64_t maxSamples = (uint64_t)(sampleRate * maxDuration) * NUM_CHANNELS;
+                this->reserveBlocks = (size_t)((reserveSamples + numSamples - 1) / numSamples) + 1;
+                this->maxBlocks = std::max(this->reserveBlocks, (size_t)((maxSamples + numSamples - 1) / numSamples));
+
+                this->allocatedBlocks.store(0);
+                for (size_t i = 0; i < this->reserveBlocks; i++)
+                {
+                    Block *block = allocateBlock();
+                    if (block == nullptr)
+                    {
+                        for (Block *b : this->freeBlocks)
+                        {
+                            freeBlock(b);
+                        }
+
+                        hlDebugf("Could not allocate elastic buffer block of size %zu.\n", (size_t)numSamples * this->sampleSize);
+                        throw AudioException(HL_RB_ALLOC_BUFFER_CODE, HL_RB_ALLOC_BUFFER_MSG);
+                    }
+                    this->freeBlocks.push_back(block);
+                }
+
+                this->head = this->freeBlocks.back();
+                this->freeBlocks.pop_back();
+                this->tail = this->head;
+                this->headBase = 0;
+                this->tailBase = 0;
+
+                this->writeIndex.store(0);
+                this->readIndex.store(0);
+                this->overrunCount.store(0);
+                this->droppedSamples.store(0);
+                this->highWater.store(0);
+                this->wakeIndex.store(UINT64_MAX);
+            }
+
+            HulaElasticBuffer(const HulaElasticBuffer &) = delete;
+            HulaElasticBuffer &operator=(const HulaElasticBuffer &) = delete;
+
+            /**
+             * Get the format that samples are stored in.
+             *
+             * @return Sample format.
+             */
+            SampleFormat getSampleFormat() const
+            {
+                return format;
+            }
+
+            /**
+             * Get the number of samples in each block.
+             *
+             * @return Block size in samples.
+             */
+            ring_buffer_size_t getBlockSize() const
+            {
+                return blockSamples;
+            }
+
+            /**
+             * Get the most samples that can be held before samples are dropped.
+             *
+             * @return Capacity in samples.
+             */
+            uint64_t getCapacity() const
+            {
+                return (uint64_t)maxBlocks * blockSamples;
+            }
+
+            /**
+             * Get the number of bytes currently allocated for samples.
+             * Safe to call from any thread.
+             *
+             * @return Allocated bytes.
+             */
+            size_t getAllocatedBytes() const
+            {
+                return allocatedBlocks.load(std::memory_order_relaxed) * (size_t)blockSamples * sampleSize;
+            }
+
+            /**
+             * Get the number of samples currently waiting to be read.
+             * Safe to call from either side.
+             *
+             * @return Number of readable samples.
+             */
+            uint64_t getReadAvailable() const
+            {
+                uint64_t r = readIndex.load(std::memory_order_acquire);
+                uint64_t w = writeIndex.load(std::memory_order_acquire);
+                return w - r;
+            }
+
+            /**
+             * Get the number of writes that hit the limit.
+             *
+             * @return Number of overruns.
+             */
+            uint64_t getOverrunCount() const
+            {
+                return overrunCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the number of samples lost to the limit.
+             *
+             * @return Number of dropped samples.
+             */
+            uint64_t getDroppedSamples() const
+            {
+                return droppedSamples.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the most samples that were ever waiting when the consumer read.
+             *
+             * @return High-water mark in samples.
+             */
+            uint64_t getHighWaterMark() const
+            {
+                return highWater.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Append samples that are already in the storage format.
+             * Grows the chain when needed. Samples are only dropped
+             * once the limit from the constructor is reached.
+             *
+             * @param data Array of samples in getSampleFormat().
+             * @param maxSamples Number of samples contained in the array. Should be whole frames.
+             * @return Number of samples written.
+             */
+            ring_buffer_size_t writeRaw(const void *data, ring_buffer_size_t maxSamples)
+            {
+                const uint8_t *in = (const uint8_t *)data;
+                uint64_t w = writeIndex.load(std::memory_order_relaxed);
+                ring_buffer_size_t totalWritten = 0;
+
+                while (totalWritten < maxSamples)
+                {
+                    ring_buffer_size_t pos = (ring_buffer_size_t)(w - tailBase);
+                    if (pos == blockSamples)
+                    {
+                        Block *block = takeBlock();
+                        if (block == nullptr)
+                        {
+                            break;
+                        }
+
+                        // Linked before the samples in it are published
+                        tail->next.store(block, std::memory_order_release);
+                        tail = block;
+                        tailBase += blockSamples;
+                        pos = 0;
+                    }
+
+                    ring_buffer_size_t count = std::min(maxSamples - totalWritten, blockSamples - pos);
+                    memcpy(tail->data + (size_t)pos * sampleSize, in + (size_t)totalWritten * sampleSize, (size_t)count * sampleSize);
+
+                    w += count;
+                    totalWritten += count;
+                }
+
+                if (totalWritten < maxSamples)
+                {
+                    overrunCount.fetch_add(1, std::memory_order_relaxed);
+                    droppedSamples.fetch_add(maxSamples - totalWritten, std::memory_order_relaxed);
+
+                    hlDebug() << "Elastic buffer full: dropped " << maxSamples - totalWritten << " samples." << std::endl;
+                }
+
+                if (totalWritten > 0)
+                {
+                    // Sequentially consistent so that a consumer arming wakeIndex
+                    // either sees the new index or is seen by the check below
+                    writeIndex.store(w);
+
+                    if (w >= wakeIndex.load())
+                    {
+                        wakeReaders();
+                    }
+                }
+
+                return totalWritten;
+            }
+
+            /**
+             * Wake the consumer if it is sleeping in waitForData().
+             */
+            void wakeReaders()
+            {
+                wakeIndex.store(UINT64_MAX);
+
+                // Taking the lock orders this with a consumer that is about to sleep
+                {
+                    std::lock_guard<std::mutex> lock(wakeMutex);
+                }
+                wakeCond.notify_all();
+            }
+
+            /**
+             * Sleep until at least minSamples are waiting to be read.
+             *
+             * @param minSamples Number of samples to wait for.
+             * @param timeoutMs Longest time to wait in milliseconds.
+             * @return True if the samples are available, false on timeout
+             *         or when woken early by wakeReaders().
+             */
+            bool waitForData(ring_buffer_size_t minSamples, uint32_t timeoutMs)
+            {
+                uint64_t target = readIndex.load(std::memory_order_relaxed) + std::max(minSamples, (ring_buffer_size_t)1);
+
+                std::unique_lock<std::mutex> lock(wakeMutex);
+
+                armWake(target);
+                if (writeIndex.load() >= target)
+                {
+                    return true;
+                }
+
+                wakeCond.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+
+                return writeIndex.load() >= target;
+            }
+
+            /**
+             * Fetch direct pointers to the stored samples.
+             * The second pointer/size pair is used when the samples continue in the next block.
+             * The regions hold samples in getSampleFormat() and stay valid until
+             * the next call to directRead() or clear().
+             *
+             * @param maxSamples Desired number of samples. At most getBlockSize() are returned.
+             * @param dataPtr1 The address where the first pointer should be stored.
+             * @param size1 Number of samples available from dataPtr1.
+             * @param dataPtr2 The address where the second pointer (if required) will be stored. nullptr if not used.
+             * @param size2 Number of samples available from dataPtr2.
+             * @return Number of samples read.
+             */
+            ring_buffer_size_t directRead(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+            {
+                uint64_t r = readIndex.load(std::memory_order_relaxed);
+                uint64_t w = writeIndex.load(std::memory_order_acquire);
+
+                // Every block up to w is linked by now, so a reader at the
+                // end of a block always moves on when there is more to read
+                releaseDrainedBlocks(r);
+
+                uint64_t available = w - r;
+
+                // Only the consumer writes this, so no read-modify-write is needed
+                if (available > highWater.load(std::memory_order_relaxed))
+                {
+                    highWater.store(available, std::memory_order_relaxed);
+                }
+
+                ring_buffer_size_t count = (ring_buffer_size_t)std::min(available, (uint64_t)std::min(std::max(maxSamples, (ring_buffer_size_t)0), blockSamples));
+                ring_buffer_size_t pos = (ring_buffer_size_t)(r - headBase);
+                ring_buffer_size_t firstPart = std::min(count, blockSamples - pos);
+
+                *dataPtr1 = (firstPart > 0) ? head->data + (size_t)pos * sampleSize : nullptr;
+                *size1 = firstPart;
+                *dataPtr2 = (count > firstPart) ? head->next.load(std::memory_order_acquire)->data : nullptr;
+                *size2 = count - firstPart;
+
+                readIndex.store(r + count, std::memory_order_release);
+
+                return count;
+            }
+
+            /**
+             * Discard everything that has been written so far and give
+             * back the memory it used. Must be called from the consumer side.
+             */
+            void clear()
+            {
+                uint64_t w = writeIndex.load(std::memory_order_acquire);
+                readIndex.store(w, std::memory_order_release);
+                releaseDrainedBlocks(w);
+            }
+
+            /**
+             * Destructor for the elastic buffer.
+             * Neither side may be in use any more.
+             */
+            ~HulaElasticBuffer()
+            {
+                Block *block = head;
+                while (block != nullptr)
+                {
+                    Block *next = block->next.load();
+                    freeBlock(block);
+                    block = next;
+                }
+
+                for (Block *b : freeBlocks)
+                {
+                    freeBlock(b);
+                }
+            }
+    };
+}
+
+#endif // END HL_ELASTIC_BUFFER_H
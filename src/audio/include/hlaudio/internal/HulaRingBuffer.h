@@ -39,49 +39,93 @@
 #ifndef HL_RING_BUFFER_H
 #define HL_RING_BUFFER_H
 
-#include <pa_ringbuffer.h>
-#include <pa_util.h>
-#include <portaudio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
 #include <thread>
 
+#if _WIN32
+    #include <malloc.h>
+#elif __linux__
+    #include <sys/mman.h>
+#endif
+
+#include "HulaAudioError.h"
+#include "HulaAudioSettings.h"
+
+/**
+ * Default sample rate. The configured rate is
+ * available from HulaAudioSettings::getSampleRate().
+ */
 #define SAMPLE_RATE             (44100)
 #define FRAMES_PER_BUFFER       (512)
 #define NUM_SECONDS             (10)
 #define NUM_CHANNELS            (2)
 #define NUM_WRITES_PER_BUFFER   (4)
 
-// Select sample format.
-#if 1
-    #define PA_SAMPLE_TYPE  paFloat32
-    #define SAMPLE          float
-    #define SAMPLE_SILENCE  (0.0f)
-    #define PRINTF_S_FORMAT "%.8f"
-#elif 1
-    #define PA_SAMPLE_TYPE  paInt16
-    typedef short SAMPLE;
-    #define SAMPLE_SILENCE  (0)
-    #define PRINTF_S_FORMAT "%d"
-#elif 0
-    #define PA_SAMPLE_TYPE  paInt8
-    typedef char SAMPLE;
-    #define SAMPLE_SILENCE  (0)
-    #define PRINTF_S_FORMAT "%d"
-#else
-    #define PA_SAMPLE_TYPE  paUInt8
-    typedef unsigned char SAMPLE;
-    #define SAMPLE_SILENCE  (128)
-    #define PRINTF_S_FORMAT "%d"
-#endif
+/**
+ * Sample type of the public buffer and callback API.
+ * The format used for capture and storage is selected at runtime
+ * via HulaAudioSettings::setSampleFormat() and converted to
+ * this type only where float data is handed out.
+ */
+#define PA_SAMPLE_TYPE  paFloat32
+#define SAMPLE          float
+#define SAMPLE_SILENCE  (0.0f)
+#define PRINTF_S_FORMAT "%.8f"
 
 #define BYTES_TO_SAMPLES(bytes) ((bytes) / (sizeof(SAMPLE)))
 #define SAMPLES_TO_BYTES(samples) ((samples) * (sizeof(SAMPLE)))
 
+/**
+ * Size of a cache line in bytes.
+ * Used to keep the producer and consumer indices of a ring buffer
+ * from sharing (and bouncing) the same line between cores.
+ */
+#define HL_CACHE_LINE_SIZE 64
+
+/**
+ * Size of a transparent huge page in bytes.
+ * Ring buffers at least this large are aligned and padded to a multiple of
+ * this size so that the kernel can back them with huge pages.
+ */
+#define HL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * Signed type used for sample counts throughout the audio API.
+ * Matches the definition previously provided by the PortAudio ring buffer.
+ */
+#if __APPLE__
+    typedef int32_t ring_buffer_size_t;
+#else
+    typedef long ring_buffer_size_t;
+#endif
+
 namespace hula
 {
     /**
-     * HulaLoop wrapper class for PortAudio ring buffer.
+     * Lock-free single-producer/single-consumer ring buffer of samples.
+     *
+     * Exactly one thread may call write() or beginWrite()/commitWrite() and
+     * exactly one (other) thread may call read(), directRead() or clear() at any given time.
+     *
+     * The producer and consumer indices live on separate cache lines and each side
+     * keeps a cached copy of the opposite index so that the shared index is only
+     * reloaded when the cached one says the buffer is full (or empty).
+     *
+     * Indices are running sample counts rather than positions, so every slot
+     * is usable and, as long as writes are whole frames, regions handed out
+     * by beginWrite() and directRead() never split a frame.
+     *
+     * A producer that is ahead of its consumer, such as playback, can sleep in
+     * waitForSpace() and is woken by the consumer once enough has been read.
      */
     class HulaRingBuffer {
 
@@ -92,35 +136,550 @@ namespace hula
             SAMPLE *rbMemory;
 
             /**
-             * PortAudio ring buffer structure.
+             * Number of sample slots in rbMemory.
+             * Always a whole number of frames.
+             */
+            ring_buffer_size_t bufferSize;
+
+            /**
+             * Number of bytes actually allocated for rbMemory.
+             */
+            size_t allocSize;
+
+            /**
+             * Label used in PipelineStatsSnapshot.
+             */
+            std::string name;
+
+            char padShared[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Total number of samples ever written. Owned by the producer.
+             */
+            std::atomic<uint64_t> writeIndex;
+
+            /**
+             * Producer's last observed value of readIndex.
+             */
+            uint64_t cachedReadIndex;
+
+            /**
+             * Number of writes that did not fit and the samples they lost.
+             */
+            std::atomic<uint64_t> overrunCount;
+            std::atomic<uint64_t> droppedSamples;
+
+            char padProducer[HL_CACHE_LINE_SIZE];
+
+            /**
+             * Total number of samples ever read. Owned by the consumer.
+             */
+            std::atomic<uint64_t> readIndex;
+
+            /**
+             * Consumer's last observed value of writeIndex.
+             */
+            uint64_t cachedWriteIndex;
+
+            /**
+             * Highest fill level seen by the consumer and the number
+             * of underruns it reported.
+             */
+            std::atomic<ring_buffer_size_t> highWater;
+            std::atomic<uint64_t> underrunCount;
+
+            /**
+             * Read index the producer sleeping in waitForSpace() needs.
+             * UINT64_MAX if the producer is not waiting.
+             */
+            std::atomic<uint64_t> spaceIndex;
+
+            char padConsumer[HL_CACHE_LINE_SIZE];
+
+            std::mutex spaceMutex;
+            std::condition_variable spaceCond;
+
+            /**
+             * Publish a new read index and wake the producer
+             * if it was waiting for it.
+             */
+            void advanceReadIndex(uint64_t newIndex)
+            {
+                // Sequentially consistent so that a producer arming spaceIndex
+                // either sees the new index or is seen by the check below
+                readIndex.store(newIndex);
+
+                if (newIndex >= spaceIndex.load())
+                {
+                    wakeWriter();
+                }
+            }
+
+            /**
+             * Split a run of count samples starting at the running index
+             * into at most two contiguous regions of rbMemory.
              */
-            PaUtilRingBuffer rb;
+            void getRegions(uint64_t index, ring_buffer_size_t count, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2) const
+            {
+                ring_buffer_size_t pos = (ring_buffer_size_t)(index % (uint64_t)bufferSize);
+                ring_buffer_size_t firstPart = std::min(count, bufferSize - pos);
+
+                *dataPtr1 = (firstPart > 0) ? rbMemory + pos : nullptr;
+                *size1 = firstPart;
+                *dataPtr2 = (count > firstPart) ? rbMemory : nullptr;
+                *size2 = count - firstPart;
+            }
 
             /**
-            * Helper function for determining the next power of two.
-            *
-            * @return Next power of 2 from val
-            */
-            static uint32_t nextPowerOf2(uint32_t val)
+             * Allocate sample storage aligned to a cache line, or to a huge page
+             * for large buffers. The memory is touched so that page faults happen
+             * here rather than on the audio thread.
+             *
+             * @param numSamples Number of samples to allocate.
+             * @param allocSize Set to the number of bytes allocated.
+             * @return Allocated memory or nullptr on failure.
+             */
+            static SAMPLE *allocateSamples(size_t numSamples, size_t *allocSize)
             {
-                val--;
-                val = (val >> 1) | val;
-                val = (val >> 2) | val;
-                val = (val >> 4) | val;
-                val = (val >> 8) | val;
-                val = (val >> 16) | val;
-                return ++val;
-            };
+                size_t bytes = SAMPLES_TO_BYTES(numSamples);
+                size_t alignment = (bytes >= HL_HUGE_PAGE_SIZE) ? HL_HUGE_PAGE_SIZE : HL_CACHE_LINE_SIZE;
+                bytes = (bytes + alignment - 1) / alignment * alignment;
+
+                void *mem = nullptr;
+                #if _WIN32
+                mem = _aligned_malloc(bytes, alignment);
+                #else
+                if (posix_memalign(&mem, alignment, bytes) != 0)
+                {
+                    mem = nullptr;
+                }
+                #endif
+
+                if (mem == nullptr)
+                {
+                    return nullptr;
+                }
+
+                #if __linux__ && defined(MADV_HUGEPAGE)
+                if (alignment == HL_HUGE_PAGE_SIZE)
+                {
+                    madvise(mem, bytes, MADV_HUGEPAGE);
+                }
+                #endif
+
+                memset(mem, 0, bytes);
+
+                *allocSize = bytes;
+                return (SAMPLE *)mem;
+            }
+
+            /**
+             * Free memory allocated by allocateSamples().
+             */
+            static void freeSamples(SAMPLE *mem)
+            {
+                #if _WIN32
+                _aligned_free(mem);
+                #else
+                free(mem);
+                #endif
+            }
 
         public:
-            HulaRingBuffer(float maxDuration);
+            /**
+             * Create a new ring buffer.
+             * The ring buffer's size is determined using the formula:
+             * \code maxDuration * sampleRate * channelCount * sampleSize \endcode
+             * where sampleRate is taken from HulaAudioSettings.
+             *
+             * The capacity is rounded to a whole number of frames but,
+             * unlike the PortAudio ring buffer, not to a power of 2.
+             *
+             * @param maxDuration The maximum length in seconds that the ring buffer should be capable of holding.
+             */
+            HulaRingBuffer(float maxDuration)
+            {
+                int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+                ring_buffer_size_t numSamples = (ring_buffer_size_t)(sampleRate * maxDuration) * NUM_CHANNELS;
+                if (numSamples <= 0)
+                {
+                    hlDebugf("Failed to initialize ring buffer. Invalid duration: %f\n", maxDuration);
+                    throw AudioException(HL_RB_INIT_BUFFER_CODE, HL_RB_INIT_BUFFER_MSG);
+                }
+
+                this->bufferSize = numSamples;
+                this->allocSize = 0;
+                this->rbMemory = allocateSamples(this->bufferSize, &this->allocSize);
+
+                // Make sure ring buffer was allocated
+                if (this->rbMemory == nullptr)
+                {
+                    hlDebugf("Could not allocate ring buffer of size %zu.\n", SAMPLES_TO_BYTES((size_t)this->bufferSize));
+                    throw AudioException(HL_RB_ALLOC_BUFFER_CODE, HL_RB_ALLOC_BUFFER_MSG);
+                }
+
+                this->writeIndex.store(0);
+                this->cachedReadIndex = 0;
+                this->readIndex.store(0);
+                this->cachedWriteIndex = 0;
+
+                this->overrunCount.store(0);
+                this->droppedSamples.store(0);
+                this->highWater.store(0);
+                this->underrunCount.store(0);
+                this->spaceIndex.store(UINT64_MAX);
+            }
+
+            HulaRingBuffer(const HulaRingBuffer &) = delete;
+            HulaRingBuffer &operator=(const HulaRingBuffer &) = delete;
+
+            /**
+             * Get the maximum number of samples the ring buffer can hold.
+             *
+             * @return Capacity in samples.
+             */
+            ring_buffer_size_t getCapacity() const
+            {
+                return bufferSize;
+            }
+
+            /**
+             * Get the number of samples currently waiting to be read.
+             * Safe to call from either side.
+             *
+             * @return Number of readable samples.
+             */
+            ring_buffer_size_t getReadAvailable() const
+            {
+                uint64_t r = readIndex.load(std::memory_order_acquire);
+                uint64_t w = writeIndex.load(std::memory_order_acquire);
+                return (ring_buffer_size_t)(w - r);
+            }
+
+            /**
+             * Get the number of samples that can currently be written.
+             * Safe to call from either side.
+             *
+             * @return Number of writable samples.
+             */
+            ring_buffer_size_t getWriteAvailable() const
+            {
+                return bufferSize - getReadAvailable();
+            }
 
-            ring_buffer_size_t read(SAMPLE *data, ring_buffer_size_t maxSamples);
-            ring_buffer_size_t directRead(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2);
-            ring_buffer_size_t write(const SAMPLE *data, ring_buffer_size_t maxSamples);
-            void clear();
+            /**
+             * Set the label that identifies this buffer in statistics.
+             * Must be called before the buffer is added to the Controller.
+             *
+             * @param name Label such as "record"
+             */
+            void setName(const std::string &name)
+            {
+                this->name = name;
+            }
+
+            /**
+             * Get the label set with setName().
+             *
+             * @return Label, or empty if none was set.
+             */
+            const std::string &getName() const
+            {
+                return name;
+            }
+
+            /**
+             * Get the number of writes that found the buffer too full.
+             *
+             * @return Number of overruns.
+             */
+            uint64_t getOverrunCount() const
+            {
+                return overrunCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the number of samples that did not fit.
+             *
+             * @return Number of dropped samples.
+             */
+            uint64_t getDroppedSamples() const
+            {
+                return droppedSamples.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the highest fill level seen by the consumer.
+             * The level is sampled whenever the consumer reads.
+             *
+             * @return High-water mark in samples.
+             */
+            ring_buffer_size_t getHighWaterMark() const
+            {
+                return highWater.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Get the number of underruns reported by the consumer.
+             *
+             * @return Number of underruns.
+             */
+            uint64_t getUnderrunCount() const
+            {
+                return underrunCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Count an underrun. Called by a consumer that needed
+             * more samples than were available, such as playback.
+             * Must be called from the consumer side.
+             */
+            void reportUnderrun()
+            {
+                underrunCount.store(underrunCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+            /**
+             * Read up to maxSamples from the ring buffer into the memory pointed to by data.
+             *
+             * @param data Pointer to allocated memory of at least maxSamples size.
+             * @param maxSamples Desired number of samples.
+             * @return Number of samples read.
+             */
+            ring_buffer_size_t read(SAMPLE *data, ring_buffer_size_t maxSamples)
+            {
+                void *ptr1;
+                void *ptr2;
+                ring_buffer_size_t size1;
+                ring_buffer_size_t size2;
+
+                ring_buffer_size_t samplesRead = directRead(maxSamples, &ptr1, &size1, &ptr2, &size2);
+
+                if (size1 > 0)
+                {
+                    memcpy(data, ptr1, SAMPLES_TO_BYTES(size1));
+                }
+
+                if (size2 > 0)
+                {
+                    memcpy(data + size1, ptr2, SAMPLES_TO_BYTES(size2));
+                }
+
+                return samplesRead;
+            }
+
+            /**
+             * Fetch direct pointers to memory within the ring buffer. This can be used to avoid allocating a secondary container.
+             * The second pointer/size pair is for when the ring buffer has split data between its tail and head.
+             * If the requested maxSamples are continuous in the underlying memory, only the first pointer/size pair is used.
+             *
+             * The read index is advanced before returning, so the returned regions
+             * must be consumed before the producer has a chance to wrap around onto them.
+             *
+             * @param maxSamples Desired number of samples.
+             * @param dataPtr1 The address where the first pointer should be stored.
+             * @param size1 Number of samples available from dataPtr1.
+             * @param dataPtr2 The address where the second pointer (if required) will be stored. nullptr if not used.
+             * @param size2 Number of samples available from dataPtr2.
+             * @return Number of samples read.
+             */
+            ring_buffer_size_t directRead(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+            {
+                uint64_t r = readIndex.load(std::memory_order_relaxed);
+
+                // Only touch the producer's cache line when our copy says we're empty
+                ring_buffer_size_t available = (ring_buffer_size_t)(cachedWriteIndex - r);
+                if (available < maxSamples)
+                {
+                    cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+                    available = (ring_buffer_size_t)(cachedWriteIndex - r);
+                }
+
+                // Only the consumer writes this, so no read-modify-write is needed
+                if (available > highWater.load(std::memory_order_relaxed))
+                {
+                    highWater.store(available, std::memory_order_relaxed);
+                }
+
+                ring_buffer_size_t samplesToRead = std::min(available, std::max(maxSamples, (ring_buffer_size_t)0));
+                getRegions(r, samplesToRead, dataPtr1, size1, dataPtr2, size2);
+
+                if (samplesToRead > 0)
+                {
+                    // Advance the index after successful read
+                    advanceReadIndex(r + samplesToRead);
+                }
 
-            ~HulaRingBuffer();
+                return samplesToRead;
+            }
+
+            /**
+             * Reserve space in the ring buffer so that it can be filled in place,
+             * avoiding a copy through an intermediate buffer.
+             * The second pointer/size pair is used when the free space wraps around
+             * the end of the underlying memory.
+             *
+             * Nothing becomes visible to the consumer until commitWrite() is called.
+             * Only one reservation may be outstanding at a time.
+             *
+             * @param maxSamples Desired number of samples.
+             * @param dataPtr1 The address where the first writable pointer will be stored.
+             * @param size1 Number of samples writable at dataPtr1.
+             * @param dataPtr2 The address where the second pointer (if required) will be stored. nullptr if not used.
+             * @param size2 Number of samples writable at dataPtr2.
+             * @return Number of samples reserved. Less than maxSamples if the buffer is nearly full.
+             */
+            ring_buffer_size_t beginWrite(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+            {
+                uint64_t w = writeIndex.load(std::memory_order_relaxed);
+
+                // Only touch the consumer's cache line when our copy says we're full
+                ring_buffer_size_t writeable = bufferSize - (ring_buffer_size_t)(w - cachedReadIndex);
+                if (writeable < maxSamples)
+                {
+                    cachedReadIndex = readIndex.load(std::memory_order_acquire);
+                    writeable = bufferSize - (ring_buffer_size_t)(w - cachedReadIndex);
+                }
+
+                ring_buffer_size_t samplesToWrite = std::min(writeable, std::max(maxSamples, (ring_buffer_size_t)0));
+                getRegions(w, samplesToWrite, dataPtr1, size1, dataPtr2, size2);
+
+                return samplesToWrite;
+            }
+
+            /**
+             * Publish samples that were written into the regions returned by beginWrite().
+             *
+             * @param samples Number of samples written. Must not exceed the amount reserved.
+             */
+            void commitWrite(ring_buffer_size_t samples)
+            {
+                if (samples > 0)
+                {
+                    writeIndex.store(writeIndex.load(std::memory_order_relaxed) + samples, std::memory_order_release);
+                }
+            }
+
+            /**
+             * Add data to the ring buffer.
+             *
+             * @param data Array of samples to write to the ring buffer.
+             * @param maxSamples Number of samples contained in the array.
+             * @return Number of samples written.
+             */
+            ring_buffer_size_t write(const SAMPLE *data, ring_buffer_size_t maxSamples)
+            {
+                void *ptr1;
+                void *ptr2;
+                ring_buffer_size_t size1;
+                ring_buffer_size_t size2;
+
+                ring_buffer_size_t elementsToWrite = beginWrite(maxSamples, &ptr1, &size1, &ptr2, &size2);
+
+                if (size1 > 0)
+                {
+                    memcpy(ptr1, data, SAMPLES_TO_BYTES(size1));
+                }
+
+                if (size2 > 0)
+                {
+                    memcpy(ptr2, data + size1, SAMPLES_TO_BYTES(size2));
+                }
+
+                commitWrite(elementsToWrite);
+
+                if (elementsToWrite < maxSamples)
+                {
+                    overrunCount.fetch_add(1, std::memory_order_relaxed);
+                    droppedSamples.fetch_add(maxSamples - elementsToWrite, std::memory_order_relaxed);
+
+                    hlDebug() << "Overrun: " << elementsToWrite << " of " << maxSamples << " written." << std::endl;
+                }
+
+                return elementsToWrite;
+            }
+
+            /**
+             * Clear the contents of the ring buffer.
+             *
+             * This discards everything the producer has published so far
+             * and must be called from the consumer side.
+             */
+            void clear()
+            {
+                cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+                advanceReadIndex(cachedWriteIndex);
+            }
+
+            /**
+             * Sleep until at least minSamples can be written.
+             * The consumer wakes the producer as soon as it has read enough,
+             * so there is no need to poll. Must be called from the producer side.
+             *
+             * The consumer only takes a lock when it actually wakes the producer,
+             * which happens once per wait rather than once per read.
+             *
+             * @param minSamples Number of free samples to wait for. Clamped to getCapacity().
+             * @param timeoutMs Longest time to wait in milliseconds.
+             * @return True if the space is available, false on timeout
+             *         or when woken early by wakeWriter().
+             */
+            bool waitForSpace(ring_buffer_size_t minSamples, uint32_t timeoutMs)
+            {
+                minSamples = std::min(std::max(minSamples, (ring_buffer_size_t)1), bufferSize);
+                uint64_t w = writeIndex.load(std::memory_order_relaxed);
+                if (w + minSamples <= (uint64_t)bufferSize)
+                {
+                    return true;
+                }
+                uint64_t target = w + minSamples - bufferSize;
+
+                std::unique_lock<std::mutex> lock(spaceMutex);
+
+                spaceIndex.store(target);
+                if (readIndex.load() >= target)
+                {
+                    spaceIndex.store(UINT64_MAX);
+                    return true;
+                }
+
+                spaceCond.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+                spaceIndex.store(UINT64_MAX);
+
+                return readIndex.load() >= target;
+            }
+
+            /**
+             * Wake the producer sleeping in waitForSpace().
+             */
+            void wakeWriter()
+            {
+                spaceIndex.store(UINT64_MAX);
+
+                // Taking the lock orders this with a producer that is about to sleep
+                {
+                    std::lock_guard<std::mutex> lock(spaceMutex);
+                }
+                spaceCond.notify_all();
+            }
+
+            /**
+             * @ingroup memory_management
+             *
+             * Destructor for the ring buffer.
+             *
+             * A HulaRingBuffer should only be deleted after is has been
+             * removed from the OSAudio ring buffer list using a call to
+             * Controller::removeBuffer().
+             */
+            ~HulaRingBuffer()
+            {
+                if (this->rbMemory != nullptr)
+                {
+                    freeSamples(this->rbMemory);
+                    this->rbMemory = nullptr;
+                }
+            }
 
     };
 }
@@ -0,0 +1,166 @@
+#ifndef HL_SAMPLE_FORMAT_H
+#define HL_SAMPLE_FORMAT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace hula
+{
+    /**
+     * Encoding of a single sample in the capture pipeline.
+     *
+     * Audio is converted into this format once, where it enters
+     * the application, and stays in it through the shared capture
+     * buffer and the temporary record files.
+     */
+    enum SampleFormat
+    {
+        /**
+         * 32-bit float in the range [-1, 1].
+         */
+        FLOAT_32,
+
+        /**
+         * 16-bit signed integer.
+         */
+        INT_16,
+
+        /**
+         * 24-bit signed integer packed into 3 little endian bytes.
+         */
+        INT_24
+    };
+
+    /**
+     * Get the size of a single sample.
+     *
+     * @param format Sample format.
+     * @return Size in bytes.
+     */
+    inline int getSampleFormatSize(SampleFormat format)
+    {
+        switch (format)
+        {
+            case INT_16:
+                return 2;
+            case INT_24:
+                return 3;
+            case FLOAT_32:
+            default:
+                return 4;
+        }
+    }
+
+    /**
+     * Convert samples from any format to float.
+     *
+     * @param src Samples in the given format.
+     * @param format Format of src.
+     * @param dst Destination with room for count floats.
+     * @param count Number of samples.
+     */
+    inline void convertToFloat(const void *src, SampleFormat format, float *dst, long count)
+    {
+        const uint8_t *in = (const uint8_t *)src;
+
+        switch (format)
+        {
+            case INT_16:
+                for (long i = 0; i < count; i++)
+                {
+                    int16_t val;
+                    memcpy(&val, in + i * 2, 2);
+                    dst[i] = val / 32768.0f;
+                }
+                break;
+
+            case INT_24:
+                for (long i = 0; i < count; i++)
+                {
+                    const uint8_t *p = in + i * 3;
+                    int32_t val = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+                    dst[i] = val / 8388608.0f;
+                }
+                break;
+
+            case FLOAT_32:
+            default:
+                memcpy(dst, src, count * sizeof(float));
+                break;
+        }
+    }
+
+    /**
+     * Convert float samples to any format.
+     * Values outside of [-1, 1] are clipped for the integer formats.
+     *
+     * @param src Float samples.
+     * @param dst Destination with room for count samples in the given format.
+     * @param format Format of dst.
+     * @param count Number of samples.
+     */
+    inline void convertFromFloat(const float *src, void *dst, SampleFormat format, long count)
+    {
+        uint8_t *out = (uint8_t *)dst;
+
+        switch (format)
+        {
+            case INT_16:
+                for (long i = 0; i < count; i++)
+                {
+                    float clipped = std::min(1.0f, std::max(-1.0f, src[i]));
+                    int16_t val = (int16_t)(clipped * 32767.0f);
+                    memcpy(out + i * 2, &val, 2);
+                }
+                break;
+
+            case INT_24:
+                for (long i = 0; i < count; i++)
+                {
+                    float clipped = std::min(1.0f, std::max(-1.0f, src[i]));
+                    int32_t val = (int32_t)(clipped * 8388607.0f);
+                    out[i * 3 + 0] = (uint8_t)(val);
+                    out[i * 3 + 1] = (uint8_t)(val >> 8);
+                    out[i * 3 + 2] = (uint8_t)(val >> 16);
+                }
+                break;
+
+            case FLOAT_32:
+            default:
+                memcpy(dst, src, count * sizeof(float));
+                break;
+        }
+    }
+
+    /**
+     * Widen integer samples to left-justified 32-bit integers.
+     * Useful for encoders that take int input without a float round trip.
+     *
+     * @param src Samples in INT_16 or INT_24 format.
+     * @param format Format of src. Must not be FLOAT_32.
+     * @param dst Destination with room for count ints.
+     * @param count Number of samples.
+     */
+    inline void convertToInt32(const void *src, SampleFormat format, int32_t *dst, long count)
+    {
+        const uint8_t *in = (const uint8_t *)src;
+
+        for (long i = 0; i < count; i++)
+        {
+            if (format == INT_16)
+            {
+                int16_t val;
+                memcpy(&val, in + i * 2, 2);
+                dst[i] = (int32_t)((uint32_t)(int32_t)val << 16);
+            }
+            else
+            {
+                const uint8_t *p = in + i * 3;
+                dst[i] = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+            }
+        }
+    }
+}
+
+#endif // END HL_SAMPLE_FORMAT_H
@@ -0,0 +1,47 @@
+#ifndef HL_IDEVICELISTENER_H
+#define HL_IDEVICELISTENER_H
+
+#include <cstdint>
+
+namespace hula
+{
+    /**
+     * Class (interface) that must be extended to be notified
+     * when audio devices are added, removed or changed.
+     *
+     * Example class:
+     * @code{.cpp}
+     *
+     * #include <hula/hlaudio.h>
+     *
+     * class Example : public IDeviceListener {
+     *      public:
+     *          handleDevicesChanged(uint64_t generation)
+     *          {
+     *              printf("Device list is now at generation %llu.\n", generation);
+     *          }
+     * }
+     *
+     * @endcode
+     */
+    class IDeviceListener {
+        public:
+            IDeviceListener(){};
+            ~IDeviceListener(){};
+
+            /**
+             * Must be implemented by the inheriting class.
+             *
+             * Called from a background thread, only when the device
+             * list actually differs from the previous one. Fetch the
+             * new list with Controller::getDeviceSnapshot().
+             *
+             * Do not add or remove listeners from inside this method.
+             *
+             * @param generation Generation of the new device list.
+             */
+            virtual void handleDevicesChanged(uint64_t generation) = 0;
+    };
+}
+
+#endif
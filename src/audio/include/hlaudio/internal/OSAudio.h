@@ -5,13 +5,17 @@
 #include <atomic>
 #include <condition_variable>
 #include <cstdlib>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 
 #include "Device.h"
+#include "HulaBroadcastBuffer.h"
 #include "HulaRingBuffer.h"
 #include "ICallback.h"
+#include "IDeviceListener.h"
+#include "PipelineStats.h"
 #include "Semaphore.h"
 
 /**
@@ -19,19 +23,134 @@
  */
 #define HL_PLAYBACK_RB_DURATION 1
 
+/**
+ * Playback is refilled once the playback ring buffer
+ * holds less than this many seconds of audio.
+ */
+#define HL_PLAYBACK_LOW_WATER_DURATION 0.5
+
+/**
+ * Name of the playback ring buffer in PipelineStatsSnapshot.
+ */
+#define HL_PLAYBACK_RB_NAME "playback"
+
+/**
+ * Length of the shared capture storage in seconds.
+ * Readers can fall behind by at most half of this.
+ */
+#define HL_BROADCAST_RB_DURATION 2
+
+/**
+ * Interval in milliseconds at which the device list is
+ * re-checked while there are device listeners.
+ */
+#define HL_DEVICE_POLL_MS 2000
+
 namespace hula
 {
+    /**
+     * Immutable list of every device known at one point in time.
+     * Shared between all holders and freed with the last of them.
+     */
+    struct DeviceSnapshot
+    {
+        /**
+         * Incremented every time the device list changes.
+         */
+        uint64_t generation = 0;
+
+        /**
+         * HulaAudioSettings::getShowRecordDevices() at the time of enumeration.
+         */
+        bool showRecordDevices = false;
+
+        std::vector<Device> devices;
+    };
+
     /**
      * Abstract class that defines the required components
      * for OS specfic audio classes.
      */
     class OSAudio {
         private:
+            /**
+             * Immutable copy of the consumer lists.
+             * The capture thread only ever iterates one of these.
+             */
+            struct ConsumerList {
+                std::vector<HulaRingBuffer *> rbs;
+                std::vector<ICallback *> cbs;
+                size_t readerCount = 0;
+            };
+
             void joinAndKillThreads(std::vector<std::thread> &threads);
 
             Semaphore stateSem;
             void startRecord();
             void endRecord();
+            size_t getConsumerCount() const;
+
+            /**
+             * Guards rbs, cbs and readers and serializes publishing.
+             * Never taken by the capture thread.
+             */
+            std::mutex consumerMutex;
+
+            /**
+             * Most recently published consumer list.
+             */
+            std::atomic<ConsumerList *> consumers;
+
+            /**
+             * Number of threads currently iterating a consumer list.
+             */
+            std::atomic<uint32_t> activeConsumerReaders;
+
+            /**
+             * Replaced consumer lists that may still be in use.
+             * Freed once no thread is iterating a list.
+             */
+            std::vector<ConsumerList *> retiredConsumers;
+
+            /**
+             * Counters updated by the capture thread and the consumers.
+             */
+            PipelineStats stats;
+
+            void publishConsumers(bool waitForReaders);
+            const ConsumerList *acquireConsumers();
+            void releaseConsumers();
+
+            /**
+             * Guards deviceSnapshot and deviceListeners.
+             */
+            std::mutex deviceMutex;
+
+            /**
+             * Held while listeners are being notified so that
+             * a removed listener is never called afterwards.
+             */
+            std::mutex deviceNotifyMutex;
+
+            std::shared_ptr<const DeviceSnapshot> deviceSnapshot;
+            std::atomic<bool> devicesDirty;
+            std::vector<IDeviceListener *> deviceListeners;
+
+            /**
+             * Re-checks the device list while there are listeners.
+             */
+            std::thread deviceWatchThread;
+            std::condition_variable deviceWatchCond;
+            bool endDeviceWatch;
+
+            /**
+             * Serializes starting and stopping the watcher.
+             * Never taken by the watcher itself.
+             */
+            std::mutex deviceWatchMutex;
+
+            void deviceWatchLoop();
+            void joinDeviceWatcher();
 
         protected:
 
@@ -44,6 +163,15 @@ namespace hula
                 this->activeOutputDevice = nullptr;
 
                 playbackBuffer = new HulaRingBuffer(HL_PLAYBACK_RB_DURATION);
+                playbackBuffer->setName(HL_PLAYBACK_RB_NAME);
+                broadcastBuffer = new HulaBroadcastBuffer(HL_BROADCAST_RB_DURATION, HulaAudioSettings::getInstance()->getSampleFormat());
+
+                consumers.store(new ConsumerList());
+                activeConsumerReaders.store(0);
+
+                deviceSnapshot = std::make_shared<const DeviceSnapshot>();
+                devicesDirty.store(true);
+                endDeviceWatch = true;
 
                // stateSem = Semaphore(1);
 
@@ -67,6 +195,19 @@ namespace hula
              */
             std::vector<HulaRingBuffer *> rbs;
 
+            /**
+             * Storage shared by every reader in readers.
+             * Data received from the operating system is written here once
+             * regardless of how many readers are attached.
+             */
+            HulaBroadcastBuffer *broadcastBuffer;
+
+            /**
+             * List of all added broadcast readers.
+             * A non-empty list keeps the capture thread running.
+             */
+            std::vector<HulaBroadcastReader *> readers;
+
             /**
              * List of registered callbacks.
              * Data received from the operating system is passed
@@ -93,6 +234,16 @@ namespace hula
              */
             std::atomic<bool> endCapture;
 
+            /**
+             * Signalled by signalEndCapture() so that capture threads
+             * with nothing to poll can sleep until they are stopped.
+             */
+            std::mutex captureEndMutex;
+            std::condition_variable captureEndCond;
+
+            void signalEndCapture();
+            void waitForEndCapture();
+
             /**
              * Flag to syncronize the playback thread for an instance.
              * This is used to break the playback loop when switching devices
@@ -110,6 +261,10 @@ namespace hula
              */
             uint32_t captureBufferSize;
 
+            void copyToRingBuffers(const SAMPLE *samples, ring_buffer_size_t sampleCount);
+
+            void stopDeviceWatcher();
+
         public:
             /**
              * Singular buffer reserved for distributing playback audio data
@@ -124,16 +279,26 @@ namespace hula
             void addBuffer(HulaRingBuffer *rb);
             void removeBuffer(HulaRingBuffer *rb);
 
+            HulaBroadcastReader *createReader(float duration);
+            void addReader(HulaBroadcastReader *reader);
+            void removeReader(HulaBroadcastReader *reader);
+
             void startPlayback();
             void endPlayback();
 
             void copyToBuffers(const SAMPLE *samples, ring_buffer_size_t sampleCount);
             ring_buffer_size_t playbackCopyToBuffers(const SAMPLE *samples, ring_buffer_size_t sampleCount);
+            bool waitForPlaybackSpace(ring_buffer_size_t sampleCount, uint32_t timeoutMs);
+            bool waitForPlaybackDrain(uint32_t timeoutMs);
+            ring_buffer_size_t getPlaybackReadAvailable() const;
 
             void addCallback(ICallback* obj);
             void removeCallback(ICallback* obj);
             void doCallbacks(const SAMPLE *samples, ring_buffer_size_t sampleCount);
 
+            PipelineStats *getStats();
+            PipelineStatsSnapshot getStatsSnapshot();
+
             /**
              * Receive the list of available record, playback and/or loopback audio devices
              * connected to the OS and return them as Device instances
@@ -143,6 +308,14 @@ namespace hula
              */
             virtual std::vector<Device *> getDevices(DeviceType type) = 0;
 
+            std::shared_ptr<const DeviceSnapshot> getDeviceSnapshot();
+            uint64_t getDeviceGeneration();
+            bool refreshDevices();
+            virtual void markDevicesChanged();
+
+            void addDeviceListener(IDeviceListener *listener);
+            void removeDeviceListener(IDeviceListener *listener);
+
             /**
              * Execution loop for loopback capture
              */
@@ -160,6 +333,8 @@ namespace hula
              */
             virtual bool checkDeviceParams(Device *device) = 0;
 
+            virtual double getInputLatency();
+
             virtual bool setActiveInputDevice(Device *device);
             virtual bool setActiveOutputDevice(Device *device);
     };
@@ -0,0 +1,167 @@
+#ifndef HL_PIPELINE_STATS_H
+#define HL_PIPELINE_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "HulaRingBuffer.h"
+
+/**
+ * Number of buckets in the capture interval histogram.
+ * Bucket b counts intervals from 2^b up to 2^(b+1) microseconds,
+ * and the last bucket takes everything longer.
+ */
+#define HL_STATS_HISTOGRAM_BUCKETS 20
+
+namespace hula
+{
+    /**
+     * Point in time copy of the counters of one ring buffer or reader.
+     */
+    struct RingStats
+    {
+        /**
+         * Name given with setName(), or empty.
+         */
+        std::string name;
+
+        /**
+         * Capacity, current fill level and the highest fill
+         * level the consumer has seen, in samples.
+         */
+        ring_buffer_size_t capacity = 0;
+        ring_buffer_size_t fill = 0;
+        ring_buffer_size_t highWater = 0;
+
+        /**
+         * Number of times the producer found the buffer full,
+         * and the samples lost because of it.
+         */
+        uint64_t overruns = 0;
+        uint64_t droppedSamples = 0;
+
+        /**
+         * Number of times the consumer ran dry while it needed data.
+         */
+        uint64_t underruns = 0;
+    };
+
+    /**
+     * Point in time copy of the count, total and maximum of a timed stage.
+     */
+    struct TimingStats
+    {
+        uint64_t count = 0;
+        uint64_t totalUs = 0;
+        uint64_t maxUs = 0;
+
+        /**
+         * Get the average duration.
+         *
+         * @return Mean in microseconds, or 0 if nothing was timed
+         */
+        double getMeanUs() const
+        {
+            return (count > 0) ? (double)totalUs / count : 0;
+        }
+    };
+
+    /**
+     * Point in time copy of everything PipelineStats tracks.
+     * Obtained from Controller::getStatsSnapshot().
+     */
+    struct PipelineStatsSnapshot
+    {
+        /**
+         * Every buffer that receives audio from the Controller,
+         * starting with the playback buffer.
+         */
+        std::vector<RingStats> rings;
+
+        /**
+         * Number of blocks delivered by the capture backend
+         * and the time between consecutive blocks.
+         */
+        uint64_t captureBlocks = 0;
+        uint64_t intervalHistogram[HL_STATS_HISTOGRAM_BUCKETS] = {0};
+        uint64_t maxIntervalUs = 0;
+
+        /**
+         * Time the capture thread spent handing blocks to
+         * ring buffers and to callbacks.
+         */
+        TimingStats bufferTime;
+        TimingStats callbackTime;
+
+        /**
+         * Age of the newest sample each time the recorder
+         * handed audio to the encoder's output file.
+         */
+        TimingStats diskLatency;
+
+        double getIntervalPercentileUs(double percentile) const;
+    };
+
+    /**
+     * Counters describing the health of the capture pipeline.
+     *
+     * Every update is a relaxed atomic so that the audio thread
+     * never waits on a reader. A snapshot is therefore not taken
+     * at a single instant, but each counter in it is exact.
+     */
+    class PipelineStats {
+
+        private:
+            /**
+             * Atomic counterpart of TimingStats.
+             */
+            struct TimingCounter
+            {
+                std::atomic<uint64_t> count;
+                std::atomic<uint64_t> totalNs;
+                std::atomic<uint64_t> maxNs;
+
+                TimingCounter();
+                void add(uint64_t ns);
+                void copyTo(TimingStats &stats) const;
+                void reset();
+            };
+
+            std::atomic<uint64_t> captureBlocks;
+            std::atomic<uint64_t> intervalHistogram[HL_STATS_HISTOGRAM_BUCKETS];
+            std::atomic<uint64_t> maxIntervalNs;
+
+            /**
+             * Time of the previous capture block, or 0 after capture (re)started.
+             */
+            std::atomic<uint64_t> lastBlockNs;
+
+            TimingCounter bufferTime;
+            TimingCounter callbackTime;
+            TimingCounter diskLatency;
+
+            static void storeMax(std::atomic<uint64_t> &target, uint64_t value);
+
+        public:
+            PipelineStats();
+
+            PipelineStats(const PipelineStats &) = delete;
+            PipelineStats &operator=(const PipelineStats &) = delete;
+
+            static uint64_t now();
+            static size_t getBucket(uint64_t intervalUs);
+
+            void startCapture();
+            void addCaptureBlock();
+            void addBufferTime(uint64_t startNs);
+            void addCallbackTime(uint64_t startNs);
+            void addDiskLatency(uint64_t latencyNs);
+
+            void copyTo(PipelineStatsSnapshot &snapshot) const;
+            void reset();
+    };
+}
+
+#endif // END HL_PIPELINE_STATS_H
@@ -0,0 +1,198 @@
+#ifndef HL_SPECTRUM_ANALYZER_H
+#define HL_SPECTRUM_ANALYZER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "FftPlan.h"
+#include "HulaRingBuffer.h"
+#include "ICallback.h"
+
+/**
+ * Default number of samples per analysis window.
+ */
+#define HL_SPECTRUM_FFT_SIZE 1024
+
+/**
+ * Default number of samples between the starts of two windows.
+ * Half the window size gives 50% overlap.
+ */
+#define HL_SPECTRUM_HOP_SIZE 512
+
+/**
+ * Default number of log-spaced frequency bands.
+ */
+#define HL_SPECTRUM_BANDS 64
+
+/**
+ * Lower edge of the first band in Hz.
+ */
+#define HL_SPECTRUM_MIN_FREQ 30.0
+
+/**
+ * Time constant in milliseconds with which a band level falls.
+ */
+#define HL_SPECTRUM_RELEASE_MS 120.0
+
+/**
+ * Time in milliseconds that a peak is held before it falls.
+ */
+#define HL_SPECTRUM_PEAK_HOLD_MS 500.0
+
+/**
+ * Time constant in milliseconds with which a peak falls once released.
+ */
+#define HL_SPECTRUM_PEAK_RELEASE_MS 400.0
+
+namespace hula
+{
+    /**
+     * Window applied to each block before it is transformed.
+     */
+    enum WindowFunction
+    {
+        /**
+         * Good all-round choice with fast falling side lobes.
+         */
+        HANN,
+
+        /**
+         * Lower side lobes than Hann at the cost of a wider main lobe.
+         */
+        BLACKMAN
+    };
+
+    /**
+     * One published analysis result.
+     */
+    struct SpectrumFrame
+    {
+        /**
+         * Increases by one for every frame published.
+         */
+        uint64_t sequence = 0;
+
+        /**
+         * Number of interleaved samples the analyzer had received
+         * when this frame was published.
+         */
+        uint64_t sampleCount = 0;
+
+        /**
+         * Smoothed level of each band. A full scale sine reads 1.
+         */
+        std::vector<float> bands;
+
+        /**
+         * Held peak level of each band.
+         */
+        std::vector<float> peaks;
+
+        /**
+         * Mono input of the analyzed window, oldest sample first.
+         */
+        std::vector<float> waveform;
+    };
+
+    /**
+     * Computes a smoothed, log-frequency spectrum of the captured audio.
+     *
+     * Add it to the Controller with Controller::addCallback(). Input is
+     * mixed to mono and collected into overlapping windows. Every hop
+     * the latest window is transformed and reduced to bands whose edges
+     * are spaced evenly on a log scale. Bands fall gradually and peaks
+     * are held for a moment before they fall too.
+     *
+     * Alternatively, audio can be pulled by the consumer and passed to
+     * analyzeSnapshot() whenever a new frame is wanted.
+     *
+     * Results are handed over through a triple buffer. The audio thread
+     * never waits for the reader, and the reader always gets the most
+     * recent frame without locking. There must be only one reader.
+     */
+    class SpectrumAnalyzer : public ICallback {
+
+        private:
+            FftPlan plan;
+
+            size_t fftSize;
+            size_t hopSize;
+            size_t bandCount;
+
+            /**
+             * Window coefficients and the factor that scales a windowed
+             * full scale sine back to 1.
+             */
+            std::vector<float> window;
+            float scale;
+
+            /**
+             * First bin of each band. Band b covers bins
+             * bandEdges[b] to bandEdges[b + 1] - 1.
+             */
+            std::vector<size_t> bandEdges;
+
+            /**
+             * Circular history of mono samples.
+             */
+            std::vector<float> history;
+            size_t historyPos = 0;
+            size_t historyFill = 0;
+            size_t sinceHop = 0;
+
+            /**
+             * Channels of the frame that is being mixed down.
+             * Blocks don't have to end on a frame boundary.
+             */
+            float frameSum = 0;
+            int frameChannels = 0;
+
+            std::vector<float> windowed;
+            std::vector<float> magnitudes;
+
+            /**
+             * Smoothing state. Only touched by the thread feeding the analyzer.
+             * Release factors are per hop, peak ages are in frames.
+             */
+            std::vector<float> levels;
+            std::vector<float> peaks;
+            std::vector<uint64_t> peakAge;
+            double release;
+            double peakRelease;
+            uint64_t peakHoldFrames;
+
+            uint64_t samplesSeen = 0;
+            uint64_t lastAnalysis = 0;
+            uint64_t sequence = 0;
+
+            /**
+             * Triple buffer. The writer owns slots[backIndex], the reader
+             * owns slots[frontIndex] and the remaining slot is swapped
+             * through middleIndex, which also carries a fresh flag.
+             */
+            SpectrumFrame slots[3];
+            int backIndex = 0;
+            std::atomic<int> middleIndex;
+            int frontIndex = 2;
+
+            void addToHistory(float sample);
+            void analyze(uint64_t sampleCount);
+            void publish();
+
+        public:
+            SpectrumAnalyzer(size_t fftSize = HL_SPECTRUM_FFT_SIZE, size_t hopSize = HL_SPECTRUM_HOP_SIZE,
+                             size_t bandCount = HL_SPECTRUM_BANDS, WindowFunction function = HANN);
+            virtual ~SpectrumAnalyzer();
+
+            void handleData(const SAMPLE *samples, ring_buffer_size_t sampleCount);
+            bool analyzeSnapshot(const SAMPLE *samples, ring_buffer_size_t sampleCount, uint64_t newSamples);
+
+            bool getLatest(SpectrumFrame &frame);
+
+            size_t getBandCount() const;
+            double getBandFrequency(size_t band) const;
+    };
+}
+
+#endif // HL_SPECTRUM_ANALYZER_H
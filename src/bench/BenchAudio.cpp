@@ -0,0 +1,227 @@
+/**
+ * @file BenchAudio.cpp
+ * Benchmarks of the hlaudio side of the pipeline: ring buffers,
+ * publishing captured audio to consumers and the visualizer FFT.
+ *
+ * Part of hulaloop-bench. No audio device is needed since the
+ * Controller runs on FileAudio.
+ */
+
+#include <benchmark/benchmark.h>
+#include <hlaudio/hlaudio.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace hula;
+
+#define BENCH_BUFFER_DURATION 0.5f
+#define BENCH_BLOCK_SIZE 512
+
+/**
+ * FileAudio whose capture thread delivers nothing, so that the
+ * benchmark is the only writer to the consumers.
+ */
+class IdleAudio : public FileAudio {
+    public:
+        void capture()
+        {
+            while (!this->endCapture.load())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+};
+
+/**
+ * Callback that does nothing but touch the data.
+ */
+class NullCallback : public ICallback {
+    public:
+        float sink = 0;
+
+        void handleData(const SAMPLE *samples, ring_buffer_size_t sampleCount)
+        {
+            sink += samples[sampleCount - 1];
+        }
+};
+
+/**
+ * Write and read back one block at a time on a single thread
+ * for a range of block sizes.
+ */
+static void BM_RingBufferThroughput(benchmark::State &state)
+{
+    HulaRingBuffer rb(BENCH_BUFFER_DURATION);
+    std::vector<SAMPLE> in(state.range(0), 0.5f);
+    std::vector<SAMPLE> out(state.range(0));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(rb.write(in.data(), state.range(0)));
+        benchmark::DoNotOptimize(rb.read(out.data(), state.range(0)));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * SAMPLES_TO_BYTES(state.range(0)));
+}
+BENCHMARK(BM_RingBufferThroughput)->RangeMultiplier(4)->Range(64, 16384);
+
+/**
+ * Write one block to the broadcast buffer and read it from every reader.
+ * The write cost should not depend on the number of readers.
+ */
+static void BM_BroadcastThroughput(benchmark::State &state)
+{
+    HulaBroadcastBuffer buffer(HL_BROADCAST_RB_DURATION, HulaAudioSettings::getInstance()->getSampleFormat());
+    std::vector<HulaBroadcastReader *> readers;
+    for (int i = 0; i < state.range(0); i++)
+    {
+        readers.push_back(new HulaBroadcastReader(&buffer, BENCH_BUFFER_DURATION));
+    }
+
+    std::vector<SAMPLE> in(BENCH_BLOCK_SIZE, 0.5f);
+    std::vector<SAMPLE> out(BENCH_BLOCK_SIZE);
+
+    for (auto _ : state)
+    {
+        buffer.write(in.data(), BENCH_BLOCK_SIZE);
+        for (HulaBroadcastReader *reader : readers)
+        {
+            benchmark::DoNotOptimize(reader->read(out.data(), BENCH_BLOCK_SIZE));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_BLOCK_SIZE);
+
+    for (HulaBroadcastReader *reader : readers)
+    {
+        delete reader;
+    }
+}
+BENCHMARK(BM_BroadcastThroughput)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+/**
+ * Publish one captured block through Controller::copyToBuffers()
+ * with a growing number of ring buffers attached.
+ */
+static void BM_CopyToBuffersFanOut(benchmark::State &state)
+{
+    Controller controller(new IdleAudio());
+
+    std::vector<HulaRingBuffer *> rbs;
+    for (int i = 0; i < state.range(0); i++)
+    {
+        rbs.push_back(new HulaRingBuffer(BENCH_BUFFER_DURATION));
+        controller.addBuffer(rbs.back());
+    }
+
+    // Keeps capture running when there are no ring buffers
+    HulaBroadcastReader *reader = controller.createAndAddBuffer(BENCH_BUFFER_DURATION);
+
+    std::vector<SAMPLE> in(BENCH_BLOCK_SIZE, 0.5f);
+
+    for (auto _ : state)
+    {
+        controller.copyToBuffers(in.data(), BENCH_BLOCK_SIZE);
+
+        // Nobody reads them, so keep them from filling up
+        for (HulaRingBuffer *rb : rbs)
+        {
+            rb->clear();
+        }
+        reader->clear();
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_BLOCK_SIZE);
+
+    controller.removeReader(reader);
+    delete reader;
+    for (HulaRingBuffer *rb : rbs)
+    {
+        controller.removeBuffer(rb);
+        delete rb;
+    }
+}
+BENCHMARK(BM_CopyToBuffersFanOut)->Arg(0)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+/**
+ * Hand one captured block to a growing number of callbacks.
+ */
+static void BM_CallbackFanOut(benchmark::State &state)
+{
+    IdleAudio *audio = new IdleAudio();
+    Controller controller(audio);
+
+    std::vector<NullCallback> callbacks(state.range(0));
+    for (NullCallback &cb : callbacks)
+    {
+        controller.addCallback(&cb);
+    }
+
+    std::vector<SAMPLE> in(BENCH_BLOCK_SIZE, 0.5f);
+
+    for (auto _ : state)
+    {
+        audio->doCallbacks(in.data(), BENCH_BLOCK_SIZE);
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_BLOCK_SIZE);
+
+    for (NullCallback &cb : callbacks)
+    {
+        controller.removeCallback(&cb);
+    }
+}
+BENCHMARK(BM_CallbackFanOut)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+/**
+ * Real-input FFT at the sizes the visualizer and meters use.
+ */
+static void BM_FftTransform(benchmark::State &state)
+{
+    FftPlan plan(state.range(0));
+
+    std::vector<float> input(state.range(0));
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = (float)((i * 7919) % 2000) / 1000.0f - 1.0f;
+    }
+    std::vector<float> real(plan.getBinCount());
+    std::vector<float> imag(plan.getBinCount());
+
+    for (auto _ : state)
+    {
+        plan.transform(input.data(), real.data(), imag.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FftTransform)->RangeMultiplier(2)->Range(512, 4096);
+
+/**
+ * Full visualizer analysis of captured stereo blocks, including the
+ * mixdown, windowing, FFT and band reduction.
+ */
+static void BM_SpectrumAnalyzer(benchmark::State &state)
+{
+    SpectrumAnalyzer analyzer;
+
+    std::vector<SAMPLE> in(BENCH_BLOCK_SIZE);
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        in[i] = (float)((i * 7919) % 2000) / 1000.0f - 1.0f;
+    }
+
+    for (auto _ : state)
+    {
+        analyzer.handleData(in.data(), BENCH_BLOCK_SIZE);
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_BLOCK_SIZE);
+}
+BENCHMARK(BM_SpectrumAnalyzer);
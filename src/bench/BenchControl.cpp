@@ -0,0 +1,201 @@
+/**
+ * @file BenchControl.cpp
+ * Benchmarks of the hlcontrol side of the pipeline: encoding
+ * captured audio to temp files and exporting them.
+ *
+ * Part of hulaloop-bench. No audio device is needed since the
+ * Controller runs on FileAudio.
+ */
+
+#include <benchmark/benchmark.h>
+#include <hlcontrol/hlcontrol.h>
+#include <hlcontrol/internal/Record.h>
+
+#include <sndfile.h>
+
+#define _USE_MATH_DEFINES
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+using namespace hula;
+
+/**
+ * Wall time in milliseconds that each Record iteration records for.
+ */
+#define BENCH_RECORD_MS 500
+
+/**
+ * Number and length in seconds of the temp files that are exported.
+ */
+#define BENCH_EXPORT_SEGMENTS 4
+#define BENCH_EXPORT_SECONDS 5
+
+static const SampleFormat benchFormats[] = { FLOAT_32, INT_16, INT_24 };
+static const char *benchFormatNames[] = { "float32", "int16", "int24" };
+static const char *benchExtensions[] = { "wav", "flac", "caf", "aiff", "raw" };
+
+/**
+ * Set the capture format for one benchmark and restore it afterwards.
+ */
+class ScopedSampleFormat {
+    private:
+        SampleFormat previous;
+
+    public:
+        ScopedSampleFormat(SampleFormat format)
+        {
+            previous = HulaAudioSettings::getInstance()->getSampleFormat();
+            HulaAudioSettings::getInstance()->setSampleFormat(format);
+        }
+
+        ~ScopedSampleFormat()
+        {
+            HulaAudioSettings::getInstance()->setSampleFormat(previous);
+        }
+};
+
+/**
+ * Count the frames in an audio file.
+ */
+static sf_count_t countFrames(const std::string &path)
+{
+    SF_INFO info = {0};
+    SNDFILE *file = sf_open(path.c_str(), SFM_READ, &info);
+    if (file == nullptr)
+    {
+        return 0;
+    }
+
+    sf_close(file);
+    return info.frames;
+}
+
+/**
+ * Record from FileAudio running as fast as it can. The encoder is the
+ * bottleneck, so the samples that reach the temp file per second of
+ * wall time are the FLAC encode rate. Samples the encoder could not
+ * keep up with are reported as dropped.
+ */
+static void BM_RecordEncode(benchmark::State &state)
+{
+    ScopedSampleFormat scopedFormat(benchFormats[state.range(0)]);
+    state.SetLabel(benchFormatNames[state.range(0)]);
+
+    int64_t samplesEncoded = 0;
+    uint64_t samplesDropped = 0;
+
+    for (auto _ : state)
+    {
+        Controller controller(new FileAudio("", 0));
+        Record record(&controller);
+
+        auto start = std::chrono::steady_clock::now();
+        record.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_RECORD_MS));
+        record.stop();
+        auto end = std::chrono::steady_clock::now();
+
+        state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+
+        std::vector<std::string> paths = record.getExportPaths();
+        for (const std::string &path : paths)
+        {
+            samplesEncoded += countFrames(path) * NUM_CHANNELS;
+        }
+        samplesDropped += record.getDroppedSamples();
+
+        Export::deleteTempFiles(paths);
+        record.clearExportPaths();
+    }
+
+    state.SetItemsProcessed(samplesEncoded);
+    state.counters["dropped"] = benchmark::Counter((double)samplesDropped, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RecordEncode)->DenseRange(0, 2)->UseManualTime()->Iterations(4)->Unit(benchmark::kMillisecond);
+
+/**
+ * Write temp files the way Record does, filled with a tone.
+ *
+ * @return Paths of the files
+ */
+static std::vector<std::string> createTempFiles()
+{
+    HulaAudioSettings *settings = HulaAudioSettings::getInstance();
+    int sampleRate = settings->getSampleRate();
+
+    SF_INFO sfinfo = {0};
+    sfinfo.samplerate = sampleRate;
+    sfinfo.channels = NUM_CHANNELS;
+    sfinfo.format = SF_FORMAT_FLAC | Export::getSndfileSubtype(settings->getSampleFormat(), SF_FORMAT_FLAC);
+
+    std::vector<float> block((size_t)sampleRate * NUM_CHANNELS);
+    std::vector<std::string> paths;
+    for (int s = 0; s < BENCH_EXPORT_SEGMENTS; s++)
+    {
+        std::string path = Export::getTempPath() + "/hulaloop_bench_" + std::to_string(s) + ".flac";
+        SNDFILE *file = sf_open(path.c_str(), SFM_WRITE, &sfinfo);
+        if (file == nullptr)
+        {
+            break;
+        }
+
+        for (int second = 0; second < BENCH_EXPORT_SECONDS; second++)
+        {
+            for (size_t i = 0; i < block.size(); i++)
+            {
+                double t = (double)(i / NUM_CHANNELS) / sampleRate;
+                block[i] = (float)(0.5 * std::sin(2 * M_PI * (220 * (s + 1)) * t));
+            }
+            sf_writef_float(file, block.data(), sampleRate);
+        }
+
+        sf_close(file);
+        paths.push_back(path);
+    }
+
+    return paths;
+}
+
+/**
+ * Export a fixed set of temp files to each supported container.
+ * FLAC output takes the path that joins the files without re-encoding.
+ */
+static void BM_ExportCopyData(benchmark::State &state)
+{
+    std::string extension = benchExtensions[state.range(0)];
+    state.SetLabel(extension);
+
+    std::vector<std::string> dirs = createTempFiles();
+    if (dirs.size() != BENCH_EXPORT_SEGMENTS)
+    {
+        Export::deleteTempFiles(dirs);
+        state.SkipWithError("Could not write temp files");
+        return;
+    }
+
+    std::string target = Export::getTempPath() + "/hulaloop_bench_export." + extension;
+
+    for (auto _ : state)
+    {
+        Export exporter(target);
+        exporter.copyData(dirs);
+
+        state.PauseTiming();
+        std::remove(target.c_str());
+        state.ResumeTiming();
+    }
+
+    int64_t samplesPerExport = (int64_t)BENCH_EXPORT_SEGMENTS * BENCH_EXPORT_SECONDS * HulaAudioSettings::getInstance()->getSampleRate() * NUM_CHANNELS;
+    state.SetItemsProcessed(state.iterations() * samplesPerExport);
+
+    Export::deleteTempFiles(dirs);
+}
+BENCHMARK(BM_ExportCopyData)->DenseRange(0, 4)->UseRealTime()->Unit(benchmark::kMillisecond);
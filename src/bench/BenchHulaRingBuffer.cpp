@@ -0,0 +1,174 @@
+/**
+ * @file BenchHulaRingBuffer.cpp
+ * Microbenchmark comparing the native lock-free HulaRingBuffer against
+ * the PortAudio ring buffer that it replaced.
+ *
+ * Run with:
+ * @code
+ * ./BenchHulaRingBuffer --benchmark_counters_tabular=true
+ * @endcode
+ */
+
+#include <benchmark/benchmark.h>
+#include <hlaudio/hlaudio.h>
+#include <pa_ringbuffer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace hula;
+
+#define BENCH_BUFFER_DURATION 0.5f
+#define BENCH_BLOCK_SIZE 512
+#define BENCH_BLOCKS_PER_ITERATION 4096
+
+/**
+ * Previous implementation of HulaRingBuffer.
+ * Kept here only as the baseline for comparison.
+ */
+class PaRingBuffer {
+
+    private:
+        SAMPLE *rbMemory;
+        PaUtilRingBuffer rb;
+
+        static uint32_t nextPowerOf2(uint32_t val)
+        {
+            val--;
+            val = (val >> 1) | val;
+            val = (val >> 2) | val;
+            val = (val >> 4) | val;
+            val = (val >> 8) | val;
+            val = (val >> 16) | val;
+            return ++val;
+        }
+
+    public:
+        PaRingBuffer(float maxDuration)
+        {
+            int numSamples = nextPowerOf2((uint32_t)(SAMPLE_RATE * maxDuration * NUM_CHANNELS));
+            this->rbMemory = new SAMPLE[numSamples];
+            PaUtil_InitializeRingBuffer(&this->rb, sizeof(SAMPLE), numSamples, this->rbMemory);
+        }
+
+        ring_buffer_size_t read(SAMPLE *data, ring_buffer_size_t maxSamples)
+        {
+            return PaUtil_ReadRingBuffer(&this->rb, (void *)data, maxSamples);
+        }
+
+        ring_buffer_size_t write(const SAMPLE *data, ring_buffer_size_t maxSamples)
+        {
+            ring_buffer_size_t elementsWriteable = PaUtil_GetRingBufferWriteAvailable(&this->rb);
+            ring_buffer_size_t elementsToWrite = std::min(elementsWriteable, maxSamples);
+
+            return PaUtil_WriteRingBuffer(&this->rb, data, elementsToWrite);
+        }
+
+        ~PaRingBuffer()
+        {
+            delete [] this->rbMemory;
+        }
+};
+
+/**
+ * Write and immediately read back one block at a time on a single thread.
+ * Measures the raw cost of the copy and index bookkeeping.
+ */
+template <class RingBuffer>
+static void BM_SingleThreadThroughput(benchmark::State &state)
+{
+    RingBuffer rb(BENCH_BUFFER_DURATION);
+    std::vector<SAMPLE> in(state.range(0), 0.5f);
+    std::vector<SAMPLE> out(state.range(0));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(rb.write(in.data(), state.range(0)));
+        benchmark::DoNotOptimize(rb.read(out.data(), state.range(0)));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * SAMPLES_TO_BYTES(state.range(0)));
+}
+
+/**
+ * Fetch the given percentile from a sorted list of latencies.
+ */
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+
+    size_t index = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[index];
+}
+
+/**
+ * Producer writes blocks while a consumer thread drains them, the way the
+ * capture thread and Record thread share a buffer. Reports throughput and
+ * the tail latency of each producer write call.
+ */
+template <class RingBuffer>
+static void BM_ProducerConsumer(benchmark::State &state)
+{
+    const ring_buffer_size_t blockSize = state.range(0);
+
+    RingBuffer rb(BENCH_BUFFER_DURATION);
+    std::vector<SAMPLE> in(blockSize, 0.5f);
+    std::vector<double> latencies;
+    latencies.reserve(BENCH_BLOCKS_PER_ITERATION);
+
+    std::vector<double> allLatencies;
+
+    for (auto _ : state)
+    {
+        std::thread consumer([&]()
+        {
+            std::vector<SAMPLE> out(blockSize);
+            long count = 0;
+            while (count < (long)blockSize * BENCH_BLOCKS_PER_ITERATION)
+            {
+                count += rb.read(out.data(), blockSize);
+            }
+        });
+
+        latencies.clear();
+        for (int i = 0; i < BENCH_BLOCKS_PER_ITERATION; i++)
+        {
+            ring_buffer_size_t written = 0;
+            auto start = std::chrono::steady_clock::now();
+            while (written < blockSize)
+            {
+                written += rb.write(in.data() + written, blockSize - written);
+            }
+            auto end = std::chrono::steady_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+
+        consumer.join();
+
+        allLatencies.insert(allLatencies.end(), latencies.begin(), latencies.end());
+    }
+
+    std::sort(allLatencies.begin(), allLatencies.end());
+
+    state.SetItemsProcessed(state.iterations() * BENCH_BLOCKS_PER_ITERATION * blockSize);
+    state.SetBytesProcessed(state.iterations() * BENCH_BLOCKS_PER_ITERATION * SAMPLES_TO_BYTES(blockSize));
+    state.counters["p50_ns"] = percentile(allLatencies, 0.50);
+    state.counters["p99_ns"] = percentile(allLatencies, 0.99);
+    state.counters["p999_ns"] = percentile(allLatencies, 0.999);
+    state.counters["max_ns"] = allLatencies.empty() ? 0 : allLatencies.back();
+}
+
+BENCHMARK_TEMPLATE(BM_SingleThreadThroughput, PaRingBuffer)->Arg(BENCH_BLOCK_SIZE);
+BENCHMARK_TEMPLATE(BM_SingleThreadThroughput, HulaRingBuffer)->Arg(BENCH_BLOCK_SIZE);
+
+BENCHMARK_TEMPLATE(BM_ProducerConsumer, PaRingBuffer)->Arg(BENCH_BLOCK_SIZE)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ProducerConsumer, HulaRingBuffer)->Arg(BENCH_BLOCK_SIZE)->UseRealTime();
+
+BENCHMARK_MAIN();
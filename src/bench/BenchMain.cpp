@@ -0,0 +1,51 @@
+/**
+ * @file BenchMain.cpp
+ * Entry point of the hulaloop-bench pipeline benchmark suite.
+ *
+ * Results are always written as JSON so that runs can be compared
+ * between releases, e.g. with Google Benchmark's tools/compare.py.
+ *
+ * Run with:
+ * @code
+ * ./hulaloop-bench --benchmark_out=release.json
+ * @endcode
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * File the results go to if --benchmark_out is not given.
+ */
+#define HL_BENCH_DEFAULT_OUT "hulaloop-bench.json"
+
+int main(int argc, char **argv)
+{
+    std::vector<char *> args(argv, argv + argc);
+
+    bool hasOut = false;
+    for (int i = 1; i < argc; i++)
+    {
+        hasOut = hasOut || strncmp(argv[i], "--benchmark_out=", strlen("--benchmark_out=")) == 0;
+    }
+
+    // JSON is already the default format of --benchmark_out
+    std::string outArg = std::string("--benchmark_out=") + HL_BENCH_DEFAULT_OUT;
+    if (!hasOut)
+    {
+        args.push_back(&outArg[0]);
+    }
+
+    int count = (int)args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+    {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
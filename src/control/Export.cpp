@@ -1,10 +1,18 @@
 #include "hlcontrol/internal/Export.h"
+#include "hlcontrol/internal/FlacJoiner.h"
+#include "hlcontrol/internal/HulaControlError.h"
+#include "hlcontrol/internal/SegmentIndex.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <QDir>
 #include <sndfile.h>
@@ -31,12 +39,130 @@ std::string Export::getTempPath()
     return QDir::toNativeSeparators(QDir::tempPath()).toStdString();
 }
 
+/**
+ * Get the libsndfile subtype that stores samples of the given format.
+ * Containers that can't hold float samples (FLAC) fall back to 24-bit PCM.
+ *
+ * @param format Sample format.
+ * @param majorFormat libsndfile container, e.g. SF_FORMAT_WAV.
+ * @return libsndfile subtype, e.g. SF_FORMAT_PCM_16.
+ */
+int Export::getSndfileSubtype(SampleFormat format, int majorFormat)
+{
+    switch (format)
+    {
+        case INT_16:
+            return SF_FORMAT_PCM_16;
+        case INT_24:
+            return SF_FORMAT_PCM_24;
+        case FLOAT_32:
+        default:
+            return (majorFormat == SF_FORMAT_FLAC) ? SF_FORMAT_PCM_24 : SF_FORMAT_FLOAT;
+    }
+}
+
+/**
+ * Decoded blocks of one temp file on their way from a decode worker to the encoder.
+ */
+struct SegmentQueue
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::vector<int>> blocks;
+    bool done = false;
+};
+
+/**
+ * Decode worker. Claims temp files in order and decodes each into its
+ * queue, waiting whenever the encoder has not caught up yet.
+ *
+ * Since files are claimed in order, every file before the one the
+ * encoder waits on is already owned by a running worker.
+ *
+ * @param dirs Temp files to decode
+ * @param sfinfo Format of the temp files
+ * @param queues One queue per temp file
+ * @param nextSegment Index of the next unclaimed temp file
+ */
+static void decodeSegments(const std::vector<std::string> &dirs, SF_INFO sfinfo, std::vector<SegmentQueue> &queues, std::atomic<size_t> &nextSegment)
+{
+    size_t i;
+    while ((i = nextSegment.fetch_add(1)) < dirs.size())
+    {
+        SegmentQueue &queue = queues[i];
+
+        SF_INFO info = sfinfo;
+        SNDFILE *in_file = sf_open(dirs[i].c_str(), SFM_READ, &info);
+        if (in_file == nullptr)
+        {
+            hlDebug() << "Could not open temp file: " << dirs[i] << std::endl;
+        }
+
+        while (in_file != nullptr)
+        {
+            // Ints keep the PCM temp samples bit exact
+            std::vector<int> block((size_t)HL_EXPORT_BLOCK_FRAMES * info.channels);
+            sf_count_t framesRead = sf_readf_int(in_file, block.data(), HL_EXPORT_BLOCK_FRAMES);
+            if (framesRead <= 0)
+            {
+                break;
+            }
+            block.resize((size_t)framesRead * info.channels);
+
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.cond.wait(lock, [&queue] { return queue.blocks.size() < HL_EXPORT_QUEUE_BLOCKS; });
+                queue.blocks.push_back(std::move(block));
+            }
+            queue.cond.notify_all();
+
+            if (framesRead < HL_EXPORT_BLOCK_FRAMES)
+            {
+                break;
+            }
+        }
+
+        if (in_file != nullptr)
+        {
+            sf_close(in_file);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.done = true;
+        }
+        queue.cond.notify_all();
+    }
+}
+
+/**
+ * Get the number of decode workers to use for an export.
+ * One core is left for the encoder.
+ *
+ * @param segments Number of temp files
+ * @return Number of decode threads
+ */
+static size_t getDecodeThreadCount(size_t segments)
+{
+    size_t cores = std::thread::hardware_concurrency();
+    size_t workers = (cores > 1) ? cores - 1 : 1;
+
+    return std::max((size_t)1, std::min(workers, segments));
+}
+
 /**
  * Copies the data from the temp file
  *
+ * The temp files are decoded in parallel by a pool of workers.
+ * The calling thread acts as the single encoder and consumes
+ * their blocks in the original order.
+ *
  * @param dirs The list of input file directory to copy from
+ * @param progress Optional, called with the fraction of frames written.
+ *                 Not called when the files are joined without re-encoding.
+ * @throws ControlException HL_EXPORT_WRITE_CODE if the file could not be written
  */
-void Export::copyData(std::vector<std::string> dirs)
+void Export::copyData(std::vector<std::string> dirs, const ProgressCallback &progress)
 {
 
     // Get file extension of the target export file
@@ -44,74 +170,139 @@ void Export::copyData(std::vector<std::string> dirs)
 
     hlDebug() << "Extension: " << extension << std::endl;
 
+    HulaAudioSettings *settings = HulaAudioSettings::getInstance();
+    SampleFormat format = settings->getSampleFormat();
+
     // Initialize libsndfile info.
+    // Temp files are written by Record in the capture format
     SF_INFO sfinfo_in = {0};
-    sfinfo_in.samplerate = SAMPLE_RATE;
+    sfinfo_in.samplerate = settings->getSampleRate();
     sfinfo_in.channels = NUM_CHANNELS;
-    sfinfo_in.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
-
-    // Initialize libsndfile info.
-    SF_INFO sfinfo_out = {0};
-    sfinfo_out.samplerate = SAMPLE_RATE;
-    sfinfo_out.channels = NUM_CHANNELS;
-    sfinfo_out.format = SF_FORMAT_FLOAT;
+    sfinfo_in.format = SF_FORMAT_FLAC | getSndfileSubtype(format, SF_FORMAT_FLAC);
 
-    // Set libsndfile settings based on extension
+    // Set libsndfile container based on extension
     // TODO: Compare against Encoding enum from HulaAudioSettings
+    int majorFormat = SF_FORMAT_WAV;
     if (!extension.compare("wav"))
     {
-        sfinfo_out.format |= SF_FORMAT_WAV;
+        majorFormat = SF_FORMAT_WAV;
     }
     else if (!extension.compare("flac"))
     {
-        sfinfo_out.format |= SF_FORMAT_FLAC | SF_FORMAT_PCM_24;;
+        majorFormat = SF_FORMAT_FLAC;
     }
     else if (!extension.compare("caf"))
     {
-        sfinfo_out.format |= SF_FORMAT_CAF;
+        majorFormat = SF_FORMAT_CAF;
     }
     else if (!extension.compare("aiff"))
     {
-        sfinfo_out.format |= SF_FORMAT_AIFF;
+        majorFormat = SF_FORMAT_AIFF;
     }
     else if(!extension.compare("raw"))
     {
-        sfinfo_out.format |= SF_FORMAT_RAW;
-    }
-    else
-    {
-        sfinfo_out.format |= SF_FORMAT_WAV;
+        majorFormat = SF_FORMAT_RAW;
     }
+
+    // Initialize libsndfile info.
+    // The output keeps the capture format's sample size
+    SF_INFO sfinfo_out = {0};
+    sfinfo_out.samplerate = settings->getSampleRate();
+    sfinfo_out.channels = NUM_CHANNELS;
+    sfinfo_out.format = majorFormat | getSndfileSubtype(format, majorFormat);
+
     if(!sf_format_check(&sfinfo_out) || !sf_format_check(&sfinfo_in))
     {
         hlDebug() << "Invalid libsndfile format: " << sfinfo_out.format << std::endl;
-        return;
+        throw ControlException(HL_EXPORT_WRITE_CODE);
+    }
+
+    // Same codec and sample size as the temp files.
+    // Copy the encoded frames instead of decoding and encoding again.
+    if (sfinfo_out.format == sfinfo_in.format)
+    {
+        if (FlacJoiner::join(dirs, this->targetFile))
+        {
+            hlDebug() << "Joined temp files without re-encoding." << std::endl;
+            return;
+        }
+
+        hlDebug() << "Could not join temp files directly, re-encoding instead." << std::endl;
     }
 
     SNDFILE *out_file = sf_open(this->targetFile.c_str(), SFM_WRITE, &sfinfo_out);
-    float buffer[512];
+    if (out_file == nullptr)
+    {
+        hlDebug() << "Could not open export file: " << this->targetFile << std::endl;
+        throw ControlException(HL_EXPORT_WRITE_CODE);
+    }
 
-    for (int i = 0; i < dirs.size(); i++)
+    // Only read the headers if someone wants to know
+    uint64_t totalFrames = progress ? SegmentIndex(dirs).getTotalFrames() : 0;
+    uint64_t framesWritten = 0;
+    bool failed = false;
+
+    std::vector<SegmentQueue> queues(dirs.size());
+    std::atomic<size_t> nextSegment(0);
+
+    std::vector<std::thread> workers;
+    size_t workerCount = getDecodeThreadCount(dirs.size());
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(decodeSegments, std::cref(dirs), sfinfo_in, std::ref(queues), std::ref(nextSegment));
+    }
+
+    hlDebug() << "Exporting " << dirs.size() << " files with " << workerCount << " decode threads." << std::endl;
+
+    // Encode every file in order as its blocks arrive
+    for (size_t i = 0; i < queues.size(); i++)
     {
-        // opens the files
-        SNDFILE *in_file = sf_open(dirs[i].c_str(), SFM_READ, &sfinfo_in);
+        SegmentQueue &queue = queues[i];
 
         while (true)
         {
-            sf_count_t framesRead = sf_readf_float(in_file, (float *)&buffer, 512 / NUM_CHANNELS);
-            sf_count_t framesWritten = sf_writef_float(out_file, (float *)&buffer, framesRead);
+            std::vector<int> block;
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.cond.wait(lock, [&queue] { return !queue.blocks.empty() || queue.done; });
+
+                if (queue.blocks.empty())
+                {
+                    break;
+                }
+
+                block.swap(queue.blocks.front());
+                queue.blocks.pop_front();
+            }
+            queue.cond.notify_all();
 
-            if (framesRead != 512 / NUM_CHANNELS)
+            sf_count_t frames = (sf_count_t)block.size() / NUM_CHANNELS;
+            // Keep draining so that the workers can finish
+            if (!failed && sf_writef_int(out_file, block.data(), frames) != frames)
             {
-                break;
+                hlDebugf("Could not write export file (%s)\n", sf_strerror(out_file));
+                failed = true;
+            }
+
+            framesWritten += frames;
+            if (progress && totalFrames > 0)
+            {
+                progress(std::min(1.0f, (float)framesWritten / totalFrames));
             }
         }
+    }
 
-        // Close the file
-        sf_close(in_file);
+    for (std::thread &worker : workers)
+    {
+        worker.join();
     }
 
     sf_close(out_file);
+
+    if (failed)
+    {
+        throw ControlException(HL_EXPORT_WRITE_CODE);
+    }
 }
 
 /**
@@ -139,14 +330,22 @@ std::string Export::getFileExtension(std::string file_path)
 
 /**
  * Deletes all the files in the vector
+ *
+ * @param dirs Files to delete
+ * @param progress Optional, called with the fraction of files deleted
  */
-void Export::deleteTempFiles(std::vector<std::string> dirs)
+void Export::deleteTempFiles(std::vector<std::string> dirs, const ProgressCallback &progress)
 {
     // loop throught all the files
-    for (std::string file : dirs)
+    for (size_t i = 0; i < dirs.size(); i++)
     {
         // no good c++ function so we'll just use the C one
-        remove((char *)file.c_str());
+        remove((char *)dirs[i].c_str());
+
+        if (progress)
+        {
+            progress((float)(i + 1) / dirs.size());
+        }
     }
 }
 
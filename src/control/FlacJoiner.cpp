@@ -0,0 +1,706 @@
+#include "hlcontrol/internal/FlacJoiner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <hlaudio/hlaudio.h>
+
+#include <QFile>
+
+using namespace hula;
+
+/**
+ * Longest possible frame header in bytes.
+ * 4 fixed bytes, 7 byte coded number, 2 bytes block size,
+ * 2 bytes sample rate and the CRC-8.
+ */
+#define HL_FLAC_MAX_HEADER 16
+
+/**
+ * Size of the STREAMINFO metadata block without its block header.
+ */
+#define HL_FLAC_STREAMINFO_SIZE 34
+
+/**
+ * Fewest samples a frame may hold unless it is the last one of the stream.
+ */
+#define HL_FLAC_MIN_BLOCK_SIZE 16
+
+/**
+ * Get the length of the UTF-8 style coded number that starts with the given byte.
+ *
+ * @param first First byte of the coded number
+ * @return Length in bytes or 0 if invalid
+ */
+static size_t getCodedNumberLength(uint8_t first)
+{
+    if ((first & 0x80) == 0x00) return 1;
+    if ((first & 0xE0) == 0xC0) return 2;
+    if ((first & 0xF0) == 0xE0) return 3;
+    if ((first & 0xF8) == 0xF0) return 4;
+    if ((first & 0xFC) == 0xF8) return 5;
+    if ((first & 0xFE) == 0xFC) return 6;
+    if (first == 0xFE) return 7;
+    return 0;
+}
+
+/**
+ * Write a number in the UTF-8 style coding used by FLAC frame headers.
+ *
+ * @param value Number to write. At most 36 bits.
+ * @param out Destination with room for 7 bytes
+ * @return Number of bytes written
+ */
+static size_t writeCodedNumber(uint64_t value, uint8_t *out)
+{
+    if (value < 0x80)
+    {
+        out[0] = (uint8_t)value;
+        return 1;
+    }
+
+    // Each extra byte holds 6 bits, the first byte holds what's left
+    size_t len = 2;
+    while (len < 7 && value >= (1ULL << (5 * len + 1)))
+    {
+        len++;
+    }
+
+    for (size_t i = len - 1; i > 0; i--)
+    {
+        out[i] = (uint8_t)(0x80 | (value & 0x3F));
+        value >>= 6;
+    }
+    out[0] = (uint8_t)(((0xFF00 >> len) & 0xFF) | value);
+
+    return len;
+}
+
+/**
+ * CRC-8 of a FLAC frame header. Polynomial x^8 + x^2 + x + 1.
+ *
+ * @param data Header bytes
+ * @param size Number of bytes
+ * @return CRC-8
+ */
+uint8_t FlacJoiner::crc8(const uint8_t *data, size_t size)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * Continue the CRC-16 of a FLAC frame. Polynomial x^16 + x^15 + x^2 + 1.
+ *
+ * The CRC over a whole frame, including the CRC stored at its end, is 0.
+ *
+ * @param crc CRC of the preceding bytes, 0 to start
+ * @param data Frame bytes
+ * @param size Number of bytes
+ * @return CRC-16
+ */
+uint16_t FlacJoiner::crc16(uint16_t crc, const uint8_t *data, size_t size)
+{
+    static const std::vector<uint16_t> table = []() {
+        std::vector<uint16_t> t(256);
+        for (int i = 0; i < 256; i++)
+        {
+            uint16_t value = (uint16_t)(i << 8);
+            for (int bit = 0; bit < 8; bit++)
+            {
+                value = (value & 0x8000) ? (uint16_t)((value << 1) ^ 0x8005) : (uint16_t)(value << 1);
+            }
+            t[i] = value;
+        }
+        return t;
+    }();
+
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+}
+
+/**
+ * Check whether data starts with a valid frame header.
+ *
+ * @param data Bytes that may hold a frame header
+ * @param size Number of bytes available
+ * @param blockSize Set to the number of samples per channel in the frame
+ * @return Length of the header including its CRC-8, or 0 if there is no valid header
+ */
+size_t FlacJoiner::parseFrameHeader(const uint8_t *data, size_t size, uint32_t *blockSize)
+{
+    if (size < 6 || data[0] != 0xFF || (data[1] & 0xFE) != 0xF8)
+    {
+        return 0;
+    }
+
+    uint8_t blockSizeCode = data[2] >> 4;
+    uint8_t sampleRateCode = data[2] & 0x0F;
+    uint8_t channelCode = data[3] >> 4;
+    uint8_t sampleSizeCode = (data[3] >> 1) & 0x07;
+
+    // Reserved values
+    if (blockSizeCode == 0 || sampleRateCode == 0x0F || channelCode > 10 || sampleSizeCode == 3 || (data[3] & 0x01))
+    {
+        return 0;
+    }
+
+    size_t codedLength = getCodedNumberLength(data[4]);
+    if (codedLength == 0 || size < 4 + codedLength)
+    {
+        return 0;
+    }
+
+    for (size_t i = 5; i < 4 + codedLength; i++)
+    {
+        if ((data[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+    }
+
+    size_t length = 4 + codedLength;
+    size_t blockSizePos = length;
+
+    if (blockSizeCode == 6)
+    {
+        length += 1;
+    }
+    else if (blockSizeCode == 7)
+    {
+        length += 2;
+    }
+
+    if (sampleRateCode == 12)
+    {
+        length += 1;
+    }
+    else if (sampleRateCode == 13 || sampleRateCode == 14)
+    {
+        length += 2;
+    }
+
+    // CRC-8
+    length += 1;
+    if (size < length || crc8(data, length - 1) != data[length - 1])
+    {
+        return 0;
+    }
+
+    if (blockSizeCode == 1)
+    {
+        *blockSize = 192;
+    }
+    else if (blockSizeCode <= 5)
+    {
+        *blockSize = 576 << (blockSizeCode - 2);
+    }
+    else if (blockSizeCode == 6)
+    {
+        *blockSize = data[blockSizePos] + 1;
+    }
+    else if (blockSizeCode == 7)
+    {
+        *blockSize = ((uint32_t)data[blockSizePos] << 8 | data[blockSizePos + 1]) + 1;
+    }
+    else
+    {
+        *blockSize = 256 << (blockSizeCode - 8);
+    }
+
+    return length;
+}
+
+/**
+ * Rewrite a frame header for the variable-blocksize strategy
+ * at the given position in the stream.
+ *
+ * @param header Valid frame header
+ * @param headerSize Length of header as returned by parseFrameHeader()
+ * @param sampleNumber Number of samples per channel before this frame
+ * @param out Destination with room for HL_FLAC_MAX_HEADER bytes
+ * @return Length of the new header
+ */
+size_t FlacJoiner::writeFrameHeader(const uint8_t *header, size_t headerSize, uint64_t sampleNumber, uint8_t *out)
+{
+    size_t codedLength = getCodedNumberLength(header[4]);
+
+    // Sync code with the blocking strategy bit set
+    out[0] = 0xFF;
+    out[1] = 0xF9;
+    out[2] = header[2];
+    out[3] = header[3];
+
+    size_t length = 4 + writeCodedNumber(sampleNumber, out + 4);
+
+    // Block size and sample rate stay as they were
+    size_t tailLength = headerSize - 4 - codedLength - 1;
+    memcpy(out + length, header + 4 + codedLength, tailLength);
+    length += tailLength;
+
+    out[length] = crc8(out, length);
+
+    return length + 1;
+}
+
+/**
+ * Skip over the metadata of a FLAC file and read its STREAMINFO.
+ * Leaves the stream at the first frame.
+ *
+ * @param in FLAC file
+ * @param info Set to the audio properties of the file
+ * @return True if the file has a valid STREAMINFO block
+ */
+bool FlacJoiner::readStreamInfo(std::istream &in, StreamInfo &info)
+{
+    char magic[4];
+    if (!in.read(magic, 4) || memcmp(magic, "fLaC", 4) != 0)
+    {
+        return false;
+    }
+
+    bool found = false;
+    bool lastBlock = false;
+    while (!lastBlock)
+    {
+        uint8_t header[4];
+        if (!in.read((char *)header, 4))
+        {
+            return false;
+        }
+
+        lastBlock = (header[0] & 0x80) != 0;
+        uint8_t type = header[0] & 0x7F;
+        uint32_t length = (uint32_t)header[1] << 16 | (uint32_t)header[2] << 8 | header[3];
+
+        if (type == 0 && length >= HL_FLAC_STREAMINFO_SIZE)
+        {
+            uint8_t block[HL_FLAC_STREAMINFO_SIZE];
+            if (!in.read((char *)block, HL_FLAC_STREAMINFO_SIZE))
+            {
+                return false;
+            }
+
+            info.sampleRate = (uint32_t)block[10] << 12 | (uint32_t)block[11] << 4 | block[12] >> 4;
+            info.channels = ((block[12] >> 1) & 0x07) + 1;
+            info.bitsPerSample = (((block[12] & 0x01) << 4) | (block[13] >> 4)) + 1;
+            info.maxBlockSize = (uint32_t)block[2] << 8 | block[3];
+
+            length -= HL_FLAC_STREAMINFO_SIZE;
+            found = true;
+        }
+
+        // Everything else is dropped from the joined file
+        in.ignore(length);
+    }
+
+    return found && in.good();
+}
+
+/**
+ * Copy every frame of a FLAC file with rewritten headers.
+ *
+ * Frames are found by their sync code and header CRC-8, and
+ * confirmed by the CRC-16 of the frame before them.
+ *
+ * @param in FLAC file positioned at its first frame
+ * @param out Joined file
+ * @param totals Stream totals, updated with every frame copied
+ * @return True if the whole file was copied
+ */
+bool FlacJoiner::copyFrames(std::istream &in, std::ostream &out, StreamTotals &totals)
+{
+    std::vector<uint8_t> buffer;
+    size_t start = 0;
+    bool eof = false;
+
+    // Append the next chunk of the file
+    auto fill = [&]() {
+        size_t oldSize = buffer.size();
+        buffer.resize(oldSize + HL_FLAC_READ_CHUNK);
+        in.read((char *)buffer.data() + oldSize, HL_FLAC_READ_CHUNK);
+        buffer.resize(oldSize + (size_t)in.gcount());
+        eof = in.gcount() == 0;
+    };
+
+    while (true)
+    {
+        // Drop consumed bytes once in a while rather than on every frame
+        if (start >= HL_FLAC_READ_CHUNK)
+        {
+            buffer.erase(buffer.begin(), buffer.begin() + start);
+            start = 0;
+        }
+
+        while (!eof && buffer.size() - start < HL_FLAC_MAX_HEADER)
+        {
+            fill();
+        }
+
+        if (start == buffer.size())
+        {
+            return true;
+        }
+
+        uint32_t blockSize = 0;
+        size_t headerSize = parseFrameHeader(buffer.data() + start, buffer.size() - start, &blockSize);
+        if (headerSize == 0)
+        {
+            hlDebug() << "FLAC join: invalid frame header." << std::endl;
+            return false;
+        }
+
+        // Only the final frame of a stream may be that short, and the
+        // one before this frame no longer is once they are joined
+        if (totals.lastBlockSize > 0 && totals.lastBlockSize < HL_FLAC_MIN_BLOCK_SIZE)
+        {
+            hlDebug() << "FLAC join: short frame in the middle of the stream." << std::endl;
+            return false;
+        }
+
+        // The next frame starts at the first valid header after
+        // which the CRC-16 of everything before it comes out to 0
+        uint16_t crc = crc16(0, buffer.data() + start, headerSize);
+        size_t pos = start + headerSize;
+        size_t end = 0;
+        while (true)
+        {
+            if (!eof && buffer.size() - pos < HL_FLAC_MAX_HEADER)
+            {
+                fill();
+                continue;
+            }
+
+            if (pos == buffer.size())
+            {
+                if (crc != 0)
+                {
+                    hlDebug() << "FLAC join: CRC mismatch in last frame." << std::endl;
+                    return false;
+                }
+
+                end = pos;
+                break;
+            }
+
+            uint32_t nextBlockSize;
+            if (crc == 0 && pos >= start + headerSize + 2 && buffer[pos] == 0xFF
+                && parseFrameHeader(buffer.data() + pos, buffer.size() - pos, &nextBlockSize) > 0)
+            {
+                end = pos;
+                break;
+            }
+
+            crc = crc16(crc, buffer.data() + pos, 1);
+            pos++;
+        }
+
+        uint8_t header[HL_FLAC_MAX_HEADER];
+        size_t newHeaderSize = writeFrameHeader(buffer.data() + start, headerSize, totals.samples, header);
+
+        // Subframes are copied untouched. Only the CRC-16 changes with the header.
+        const uint8_t *body = buffer.data() + start + headerSize;
+        size_t bodySize = end - start - headerSize - 2;
+        uint16_t newCrc = crc16(crc16(0, header, newHeaderSize), body, bodySize);
+        uint8_t footer[2] = {(uint8_t)(newCrc >> 8), (uint8_t)(newCrc & 0xFF)};
+
+        out.write((const char *)header, newHeaderSize);
+        out.write((const char *)body, bodySize);
+        out.write((const char *)footer, 2);
+
+        // The final block of the stream doesn't count towards the minimum
+        if (totals.lastBlockSize > 0)
+        {
+            totals.minBlockSize = std::min(totals.minBlockSize, totals.lastBlockSize);
+        }
+        totals.lastBlockSize = blockSize;
+        totals.maxBlockSize = std::max(totals.maxBlockSize, blockSize);
+
+        uint32_t frameSize = (uint32_t)(newHeaderSize + bodySize + 2);
+        totals.minFrameSize = std::min(totals.minFrameSize, frameSize);
+        totals.maxFrameSize = std::max(totals.maxFrameSize, frameSize);
+
+        totals.samples += blockSize;
+        start = end;
+    }
+}
+
+/**
+ * Join FLAC files into a single FLAC file without decoding.
+ * All inputs must have the same sample rate, channel count and sample size.
+ *
+ * On failure the output is removed so the caller can fall back to re-encoding.
+ *
+ * @param inputs FLAC files in the order they should be played
+ * @param output Path of the joined file
+ * @return True if the joined file was written
+ */
+bool FlacJoiner::join(const std::vector<std::string> &inputs, const std::string &output)
+{
+    if (inputs.empty())
+    {
+        return false;
+    }
+
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        return false;
+    }
+
+    // Placeholder STREAMINFO, filled in once the totals are known
+    uint8_t streamInfo[4 + HL_FLAC_STREAMINFO_SIZE] = {0};
+    streamInfo[0] = 0x80;
+    streamInfo[3] = HL_FLAC_STREAMINFO_SIZE;
+    out.write("fLaC", 4);
+    out.write((const char *)streamInfo, sizeof(streamInfo));
+
+    StreamInfo first;
+    StreamTotals totals;
+    bool ok = true;
+
+    for (size_t i = 0; i < inputs.size() && ok; i++)
+    {
+        std::ifstream in(inputs[i], std::ios::binary);
+
+        StreamInfo info;
+        ok = in && readStreamInfo(in, info);
+
+        if (ok && i == 0)
+        {
+            first = info;
+        }
+        else if (ok && (info.sampleRate != first.sampleRate || info.channels != first.channels || info.bitsPerSample != first.bitsPerSample))
+        {
+            hlDebug() << "FLAC join: " << inputs[i] << " does not match the other files." << std::endl;
+            ok = false;
+        }
+
+        ok = ok && copyFrames(in, out, totals);
+    }
+
+    if (ok)
+    {
+        uint32_t minBlockSize = totals.minBlockSize;
+        uint32_t minFrameSize = (totals.minFrameSize == UINT32_MAX) ? 0 : totals.minFrameSize;
+
+        // A stream of a single frame has no block that counts towards
+        // the minimum, so describe it with the block size of the encoder
+        if (minBlockSize == UINT32_MAX)
+        {
+            minBlockSize = std::max(first.maxBlockSize, totals.lastBlockSize);
+            totals.maxBlockSize = minBlockSize;
+        }
+
+        uint8_t *block = streamInfo + 4;
+        block[0] = (uint8_t)(minBlockSize >> 8);
+        block[1] = (uint8_t)minBlockSize;
+        block[2] = (uint8_t)(totals.maxBlockSize >> 8);
+        block[3] = (uint8_t)totals.maxBlockSize;
+        block[4] = (uint8_t)(minFrameSize >> 16);
+        block[5] = (uint8_t)(minFrameSize >> 8);
+        block[6] = (uint8_t)minFrameSize;
+        block[7] = (uint8_t)(totals.maxFrameSize >> 16);
+        block[8] = (uint8_t)(totals.maxFrameSize >> 8);
+        block[9] = (uint8_t)totals.maxFrameSize;
+        block[10] = (uint8_t)(first.sampleRate >> 12);
+        block[11] = (uint8_t)(first.sampleRate >> 4);
+        block[12] = (uint8_t)((first.sampleRate & 0x0F) << 4 | (first.channels - 1) << 1 | (first.bitsPerSample - 1) >> 4);
+        block[13] = (uint8_t)(((first.bitsPerSample - 1) & 0x0F) << 4 | ((totals.samples >> 32) & 0x0F));
+        block[14] = (uint8_t)(totals.samples >> 24);
+        block[15] = (uint8_t)(totals.samples >> 16);
+        block[16] = (uint8_t)(totals.samples >> 8);
+        block[17] = (uint8_t)totals.samples;
+
+        // MD5 stays zero, which means unknown
+
+        out.seekp(4);
+        out.write((const char *)streamInfo, sizeof(streamInfo));
+        ok = out.good();
+    }
+
+    out.close();
+
+    if (!ok)
+    {
+        remove(output.c_str());
+    }
+
+    return ok;
+}
+
+/**
+ * Move past every complete frame that follows a known frame boundary.
+ *
+ * Complete frames are found by their header CRC-8 and the CRC-16 that
+ * ends each frame. The file is read in blocks of HL_FLAC_READ_CHUNK,
+ * so no more than one frame has to be held however long the file is.
+ *
+ * @param path FLAC file, which may still be written to
+ * @param bytes Offset of a frame boundary, or 0 for the first frame.
+ *              Set to the end of the last complete frame.
+ * @param samples Samples per channel before bytes. Increased by
+ *                the block size of every complete frame.
+ * @return False if the file has no valid STREAMINFO
+ */
+bool FlacJoiner::scanFrames(const std::string &path, uint64_t &bytes, uint64_t &samples)
+{
+    std::ifstream in(path, std::ios::binary);
+
+    StreamInfo info;
+    if (!in || !readStreamInfo(in, info))
+    {
+        return false;
+    }
+
+    uint64_t firstFrame = (uint64_t)in.tellg();
+    in.seekg(0, std::ios::end);
+    uint64_t fileSize = (uint64_t)in.tellg();
+
+    if (bytes < firstFrame || bytes > fileSize)
+    {
+        bytes = firstFrame;
+        samples = 0;
+    }
+    in.seekg(bytes);
+
+    std::vector<uint8_t> buffer;
+    size_t start = 0;
+    bool eof = false;
+
+    // Append the next chunk of the file
+    auto fill = [&]() {
+        size_t oldSize = buffer.size();
+        buffer.resize(oldSize + HL_FLAC_READ_CHUNK);
+        in.read((char *)buffer.data() + oldSize, HL_FLAC_READ_CHUNK);
+        buffer.resize(oldSize + (size_t)in.gcount());
+        eof = in.gcount() == 0;
+    };
+
+    while (true)
+    {
+        // Drop consumed bytes once in a while rather than on every frame
+        if (start >= HL_FLAC_READ_CHUNK)
+        {
+            buffer.erase(buffer.begin(), buffer.begin() + start);
+            start = 0;
+        }
+
+        while (!eof && buffer.size() - start < HL_FLAC_MAX_HEADER)
+        {
+            fill();
+        }
+
+        uint32_t blockSize = 0;
+        size_t headerSize = parseFrameHeader(buffer.data() + start, buffer.size() - start, &blockSize);
+        if (headerSize == 0)
+        {
+            return true;
+        }
+
+        // Even a VERBATIM frame is smaller than this, so anything
+        // longer was cut short and would only grow the buffer
+        size_t maxFrameSize = HL_FLAC_MAX_HEADER + info.channels * ((size_t)blockSize * (info.bitsPerSample + 1) / 8 + 8) + 2;
+
+        // The frame ends where the CRC-16 comes out to 0 right before
+        // the next valid header or the end of the file
+        uint16_t crc = crc16(0, buffer.data() + start, headerSize);
+        size_t pos = start + headerSize;
+        while (true)
+        {
+            if (!eof && buffer.size() - pos < HL_FLAC_MAX_HEADER)
+            {
+                fill();
+                continue;
+            }
+
+            if (pos == buffer.size() || pos - start > maxFrameSize)
+            {
+                // A frame the crash cut short is not counted
+                if (crc != 0 || pos != buffer.size())
+                {
+                    return true;
+                }
+                break;
+            }
+
+            uint32_t nextBlockSize;
+            if (crc == 0 && pos >= start + headerSize + 2 && buffer[pos] == 0xFF
+                && parseFrameHeader(buffer.data() + pos, buffer.size() - pos, &nextBlockSize) > 0)
+            {
+                break;
+            }
+
+            crc = crc16(crc, buffer.data() + pos, 1);
+            pos++;
+        }
+
+        bytes += pos - start;
+        samples += blockSize;
+        start = pos;
+    }
+}
+
+/**
+ * Repair a FLAC file whose encoder never closed it, without decoding.
+ *
+ * A partly written frame at the end is cut off, and the number of
+ * samples in STREAMINFO is set from the complete frames. Only the part
+ * of the file after the checkpoint is read, so a recent checkpoint
+ * keeps this fast for long recordings. If not even one frame was
+ * completed after it, the file is cut at the checkpoint.
+ *
+ * @param path FLAC file to repair in place
+ * @param scanFrom Frame boundary up to which the file is known to be intact, or 0
+ * @param scanSamples Samples per channel before scanFrom
+ * @return Number of samples per channel in the repaired file, or -1 on failure
+ */
+int64_t FlacJoiner::finalize(const std::string &path, uint64_t scanFrom, uint64_t scanSamples)
+{
+    uint64_t lastEnd = scanFrom;
+    uint64_t totalSamples = scanSamples;
+    if (!scanFrames(path, lastEnd, totalSamples))
+    {
+        hlDebug() << "FLAC finalize: " << path << " has no valid STREAMINFO." << std::endl;
+        return -1;
+    }
+
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = (uint64_t)file.tellg();
+
+    // STREAMINFO is always the first metadata block. Keep the bits per sample.
+    uint8_t counts[5];
+    file.seekg(8 + 13);
+    file.read((char *)counts, 1);
+    counts[0] = (uint8_t)((counts[0] & 0xF0) | ((totalSamples >> 32) & 0x0F));
+    counts[1] = (uint8_t)(totalSamples >> 24);
+    counts[2] = (uint8_t)(totalSamples >> 16);
+    counts[3] = (uint8_t)(totalSamples >> 8);
+    counts[4] = (uint8_t)totalSamples;
+
+    file.seekp(8 + 13);
+    file.write((const char *)counts, sizeof(counts));
+    file.close();
+
+    if (!file || (lastEnd < fileSize && !QFile::resize(QString::fromStdString(path), (qint64)lastEnd)))
+    {
+        hlDebug() << "FLAC finalize: could not update " << path << std::endl;
+        return -1;
+    }
+
+    return (int64_t)totalSamples;
+}
@@ -20,6 +20,9 @@ HulaSettings::HulaSettings()
 
     // Output file
     this->outputFileEncoding = WAV;
+
+    // Record
+    this->recordSpooling = false;
 }
 
 /**
@@ -64,6 +67,30 @@ void HulaSettings::setOutputFileEncoding(Encoding val)
     getInstance()->outputFileEncoding = val;
 }
 
+/**
+ * Check whether recordings are spooled to a memory mapped
+ * file before they are compressed.
+ *
+ * @return True if spooling is enabled
+ */
+bool HulaSettings::getRecordSpooling()
+{
+    return getInstance()->recordSpooling;
+}
+
+/**
+ * Spool recordings to a memory mapped file in the temp directory
+ * before they are compressed. Capture then never waits on the
+ * encoder, and an interrupted recording leaves a raw spool behind.
+ * Takes effect on the next call to Record::start().
+ *
+ * @param val True to enable spooling
+ */
+void HulaSettings::setRecordSpooling(bool val)
+{
+    getInstance()->recordSpooling = val;
+}
+
 /**
  * Fetch a pointer to the translation object setup for Qt.
  * This translator can be loaded with different languages
@@ -3,7 +3,8 @@
 using namespace hula;
 
 #include <iostream>
-#include <sndfile.h>
+
+#include "hlcontrol/internal/SegmentReader.h"
 
 /**
  * @brief Construct a new Playback instance to replay the captured audio data
@@ -14,14 +15,21 @@ Playback::Playback(Controller *control, Record *record)
 {
     this->controller = control;
     this->recorder = record;
+    this->startFrame = 0;
+    this->position.store(0);
+
+    this->endPlay.store(true);
 }
 
 /**
- * @brief Starts the playback of audio data from the specified time of the capture duration
+ * @brief Starts the playback of audio data from the specified frame of the capture
+ *
+ * The frame may fall anywhere in the session, including inside
+ * a later segment.
  *
- * @param initTime Begin time of the capture duration (in seconds)
+ * @param startFrame Frame of the session to start at, e.g. from getPosition()
  */
-void Playback::start(uint32_t startTime)
+void Playback::start(uint64_t startFrame)
 {
     // Make sure the last thread was joined or
     // the assignment of the new thread will fail
@@ -29,97 +37,125 @@ void Playback::start(uint32_t startTime)
     if (playThread.joinable())
         playThread.join();
 
+    this->startFrame = startFrame;
+    this->position.store(startFrame);
+
     this->endPlay.store(false);
+
+    // Returns once the device is running
+    this->controller->startPlayback();
+
     playThread = std::thread(&Playback::player, this);
 }
 
+/**
+ * Body of the playback thread. Feeds the recording to the device
+ * and, if it was not stopped first, waits for the device to play
+ * everything that is still buffered.
+ */
 void Playback::player()
 {
-    this->controller->startPlayback();
+    uint64_t samplesFed = 0;
+    if (feed(&samplesFed))
+    {
+        while (!this->endPlay.load() && !this->controller->waitForPlaybackDrain(HL_PLAYBACK_WAIT_MS))
+        { }
+    }
 
-    // Initialize libsndfile info.
-    SF_INFO sfinfo;
-    sfinfo.samplerate = SAMPLE_RATE;
-    sfinfo.channels = NUM_CHANNELS;
-    sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    // Whatever the device has not played yet is thrown away below
+    uint64_t unplayed = this->controller->getPlaybackReadAvailable();
+    if (this->endPlay.load() && samplesFed > unplayed)
+    {
+        this->position.store(this->startFrame + (samplesFed - unplayed) / NUM_CHANNELS);
+    }
+    else if (!this->endPlay.load())
+    {
+        this->position.store(0);
+    }
+
+    this->controller->endPlayback();
 
-    ring_buffer_size_t maxSize = 1024;
-    float buffer[1024];
+    // TODO: The UI will not know that this has ended
+    hlDebug() << "Playback finished." << std::endl;
+}
+
+/**
+ * Feed the recorded files into the playback buffer.
+ *
+ * Audio is read in chunks that fill the buffer back up from its
+ * low-water mark. Between chunks the thread sleeps until the device
+ * has played the buffer down to that mark.
+ *
+ * @param samplesFed Increased by every sample written to the playback buffer
+ * @return True once the end of the recording was written,
+ *         false if playback was stopped first
+ */
+bool Playback::feed(uint64_t *samplesFed)
+{
+    int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+    // Whatever fits between the low-water mark and a full buffer
+    ring_buffer_size_t chunkSize = (ring_buffer_size_t)(sampleRate * (HL_PLAYBACK_RB_DURATION - HL_PLAYBACK_LOW_WATER_DURATION)) * NUM_CHANNELS;
+    std::vector<float> buffer(chunkSize);
 
-    size_t fileIndex = 0;
     std::vector<std::string> files = recorder->getExportPaths();
 
     // No files to play
     if (files.size() == 0)
     {
-        return;
+        return true;
+    }
+
+    if (files != this->index.getPaths())
+    {
+        this->index = SegmentIndex(files);
+    }
+
+    SegmentPosition position;
+    if (!this->index.locate(this->startFrame, &position))
+    {
+        hlDebug() << "Playback start frame " << this->startFrame << " is past the end of the recording." << std::endl;
+        return true;
     }
 
-    hlDebug() << "Playing back " << files.size() << " files." << std::endl;
+    hlDebug() << "Playing back " << files.size() << " files from file #" << position.segment << std::endl;
 
-    SNDFILE *sndFile = sf_open(files[fileIndex].c_str(), SFM_READ, &sfinfo);
+    // Opens the following files in the background so chunks run across them without a gap
+    SegmentReader reader(files, position);
 
-    hlDebug() << "Opened file #" << fileIndex << std::endl;
-    hlDebug() << "Location: " << files[fileIndex] << std::endl;
+    // Samples of the current chunk that have not been written yet
+    ring_buffer_size_t offset = 0;
+    ring_buffer_size_t pending = 0;
 
-    sf_count_t samplesRead = 0;
-    while(!this->endPlay.load())
+    while (!this->endPlay.load())
     {
-        samplesRead = sf_read_float(sndFile, (float *)&buffer, maxSize);
-
-        ring_buffer_size_t lastWrite = 0;
-        ring_buffer_size_t totalWrite = 0;
-        while (!this->endPlay.load() && totalWrite < samplesRead)
+        if (pending == 0)
         {
-            ring_buffer_size_t samplesWritten = this->controller->playbackCopyToBuffers((float *)&buffer + lastWrite, samplesRead - totalWrite * sizeof(float));
-            lastWrite = samplesWritten;
-            totalWrite += samplesWritten;
-
-            // If the buffer was too full, wait a little bit
-            if (totalWrite != samplesRead)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(150));
-            }
+            offset = 0;
+            pending = reader.read(buffer.data(), chunkSize);
         }
 
-        // We're done with the file
-        if (samplesRead == 0)
+        // We're done with the last file
+        if (pending == 0)
         {
-            // Open the next file or end the playback
-            if (fileIndex < files.size() - 1)
-            {
-                sf_close(sndFile);
-
-                fileIndex++;
-                sndFile = sf_open(files[fileIndex].c_str(), SFM_READ, &sfinfo);
-
-                hlDebug() << "Opened file #" << fileIndex << std::endl;
-            }
-            else
-            {
-                hlDebug() << "Played final file. Exiting playback loop." << std::endl;
-                this->endPlay.store(true);
-
-                // TODO: The UI will not know that this has ended
-            }
+            hlDebug() << "Played final file. Exiting playback loop." << std::endl;
+            return true;
+        }
 
+        // Sleep until the device has drained the buffer below the low-water mark
+        if (!this->controller->waitForPlaybackSpace(pending, HL_PLAYBACK_WAIT_MS))
+        {
             continue;
         }
 
-        // Calculate the length of the audio that we just wrote
-        // With a buffer of 1024 samples, 2 channels, and 44,100 Hz sample rate
-        // this is approximately 11ms
-        // We trim this by 3ms to accomodate for execution
-        std::this_thread::sleep_for(std::chrono::milliseconds(maxSize / NUM_CHANNELS * 1000 / SAMPLE_RATE - 3));
+        ring_buffer_size_t samplesWritten = this->controller->playbackCopyToBuffers(buffer.data() + offset, pending);
+        offset += samplesWritten;
+        pending -= samplesWritten;
+        *samplesFed += samplesWritten;
     }
 
     hlDebug() << "Playback write loop exited." << std::endl;
-
-    sf_close(sndFile);
-
-    // Make sure the playback buffer gets drained first
-    std::this_thread::sleep_for(std::chrono::milliseconds(HL_PLAYBACK_RB_DURATION * 1000 + 200));
-    this->controller->endPlayback();
+    return false;
 }
 
 /**
@@ -129,10 +165,24 @@ void Playback::player()
 void Playback::stop()
 {
     this->endPlay.store(true);
-    this->controller->endPlayback();
 
+    // The thread notes how far the device got before ending playback itself
     if (playThread.joinable())
         playThread.join();
+    else
+        this->controller->endPlayback();
+}
+
+/**
+ * Get the frame of the session the device had reached when playback
+ * was last stopped, so that it can be started again from there.
+ * 0 if playback ran to the end of the recording.
+ *
+ * @return Frame of the session
+ */
+uint64_t Playback::getPosition() const
+{
+    return this->position.load();
 }
 
 Playback::~Playback()
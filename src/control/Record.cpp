@@ -1,7 +1,13 @@
 #include "hlcontrol/internal/Record.h"
 
 #include "hlcontrol/internal/Export.h"
+#include "hlcontrol/internal/FlacJoiner.h"
+#include "hlcontrol/internal/HulaSettings.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
 #include <iostream>
 #include <fstream>
 #include <sndfile.h>
@@ -16,9 +22,20 @@ using namespace hula;
 Record::Record(Controller *control)
 {
     this->controller = control;
+    this->endRecord.store(true);
+    this->endEncode.store(true);
+    this->writeFailed.store(false);
+    this->spool = nullptr;
+    this->journal = nullptr;
+    this->spoolOverruns = 0;
+    this->spoolDroppedSamples = 0;
+
     try
     {
-        this->rb = this->controller->createBuffer(0.5);
+        this->rb = this->controller->createBuffer(HL_RECORD_RB_DURATION);
+        this->rb->setName(HL_RECORD_RB_NAME);
+        this->stagingBuffer = new HulaElasticBuffer(HL_RECORD_STAGING_DURATION, HL_RECORD_STAGING_MAX_DURATION,
+                                                    HL_RECORD_STAGING_BLOCK_DURATION, this->rb->getSampleFormat());
     }
     catch(const AudioException &ae)
     {
@@ -26,6 +43,59 @@ Record::Record(Controller *control)
     }
 }
 
+/**
+ * Get the current local time for naming temp files.
+ *
+ * @return Time formatted as YYYY-MM-DD_HH-MM-SS-mmm
+ */
+static std::string getTimestamp()
+{
+    auto now = std::chrono::system_clock::now();
+    time_t seconds = std::chrono::system_clock::to_time_t(now);
+    long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+
+    char timestamp[20];
+    strftime(timestamp, 20, "%Y-%m-%d_%H-%M-%S", localtime(&seconds));
+
+    char withMillis[32];
+    snprintf(withMillis, sizeof(withMillis), "%s-%03lld", timestamp, millis);
+
+    return std::string(withMillis);
+}
+
+/**
+ * Get a timestamped path in the temp directory that no file has yet,
+ * so that segments recorded in quick succession never replace each other.
+ *
+ * @param prefix Start of the file name
+ * @param extension End of the file name, including the dot
+ * @return Path of a file that does not exist
+ */
+static std::string getUniquePath(const std::string &prefix, const std::string &extension)
+{
+    std::string base = Export::getTempPath() + "/" + prefix + getTimestamp();
+    std::string path = base + extension;
+    for (int i = 1; std::ifstream(path).good(); i++)
+    {
+        path = base + "_" + std::to_string(i) + extension;
+    }
+
+    return path;
+}
+
+/**
+ * Get the number of samples that make up one block of HL_RECORD_BLOCK_MS.
+ *
+ * @return Block size in samples
+ */
+ring_buffer_size_t Record::getBlockSize() const
+{
+    int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+    ring_buffer_size_t blockSize = (ring_buffer_size_t)(sampleRate * HL_RECORD_BLOCK_MS / 1000) * NUM_CHANNELS;
+
+    return std::min(blockSize, this->rb->getCapacity());
+}
+
 /**
  * @brief Starts the capture of audio data by adding ringbuffer to Controller
  * and reading from ringbuffer
@@ -33,63 +103,286 @@ Record::Record(Controller *control)
  */
 void Record::start()
 {
+    if (this->journal == nullptr)
+    {
+        this->journal = new SessionJournal(getUniquePath(HL_JOURNAL_PREFIX, HL_JOURNAL_EXTENSION));
+    }
+
+    if (HulaSettings::getInstance()->getRecordSpooling())
+    {
+        // Throws ControlException if the file can't be created
+        this->spool = new SpoolFile(getUniquePath("hulaloop_", ".spool"));
+    }
+    else
+    {
+        this->stagingBuffer->clear();
+    }
+
+    this->writeFailed.store(false);
+    this->endEncode.store(false);
+    encodeThread = std::thread(&Record::encoder, this);
+
     this->endRecord.store(false);
     recordThread = std::thread(&Record::recorder, this);
 
-    this->controller->addBuffer(this->rb);
+    this->controller->addReader(this->rb);
 }
 
+/**
+ * Move everything that is waiting in the capture reader
+ * over to the staging buffer or the spool.
+ *
+ * @param blockSize Largest number of samples to move at once
+ */
+void Record::drainCapture(ring_buffer_size_t blockSize)
+{
+    ring_buffer_size_t samplesRead;
+    do
+    {
+        void *ptr[2] = {0};
+        ring_buffer_size_t sizes[2] = {0};
+        samplesRead = this->rb->directRead(blockSize, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+
+        for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
+        {
+            if (this->spool)
+            {
+                this->spool->write(ptr[i], this->rb->getSampleFormat(), sizes[i]);
+            }
+            else
+            {
+                this->stagingBuffer->writeRaw(ptr[i], sizes[i]);
+            }
+        }
+    } while (samplesRead == blockSize);
+}
+
+/**
+ * Sleep until the staging buffer or the spool holds minSamples.
+ *
+ * @param minSamples Number of samples to wait for
+ * @param timeoutMs Longest time to wait in milliseconds
+ * @return True if the samples are available
+ */
+bool Record::waitForStaged(ring_buffer_size_t minSamples, uint32_t timeoutMs)
+{
+    if (this->spool)
+    {
+        return this->spool->waitForData(minSamples, timeoutMs);
+    }
+
+    return this->stagingBuffer->waitForData(minSamples, timeoutMs);
+}
+
+/**
+ * Fetch direct pointers to staged samples.
+ * See HulaElasticBuffer::directRead().
+ */
+ring_buffer_size_t Record::readStaged(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+{
+    if (this->spool)
+    {
+        return this->spool->directRead(maxSamples, dataPtr1, size1, dataPtr2, size2);
+    }
+
+    return this->stagingBuffer->directRead(maxSamples, dataPtr1, size1, dataPtr2, size2);
+}
+
+/**
+ * Get the number of staged samples the encoder has not read yet.
+ *
+ * @return Number of samples
+ */
+uint64_t Record::getStagedAvailable() const
+{
+    if (this->spool)
+    {
+        return this->spool->getReadAvailable();
+    }
+
+    return this->stagingBuffer->getReadAvailable();
+}
+
+/**
+ * Recorder thread. Sleeps until the capture reader holds a full block
+ * and then moves it to the staging buffer for the encoder.
+ */
 void Record::recorder()
+{
+    ring_buffer_size_t blockSize = getBlockSize();
+
+    // Keep recording until recording is stopped
+    while (!this->endRecord.load())
+    {
+        // The capture thread wakes us once a block is ready.
+        // The timeout only matters if capture stops delivering.
+        this->rb->waitForData(blockSize, 4 * HL_RECORD_BLOCK_MS);
+        drainCapture(blockSize);
+    }
+
+    this->controller->removeReader(this->rb);
+
+    // Keep whatever arrived before the reader was removed
+    drainCapture(blockSize);
+    this->rb->clear();
+
+    // Let the encoder finish what is staged
+    this->endEncode.store(true);
+    if (this->spool)
+    {
+        this->spool->wakeReaders();
+    }
+    this->stagingBuffer->wakeReaders();
+    if (encodeThread.joinable())
+    {
+        encodeThread.join();
+    }
+
+    uint64_t overruns = getOverrunCount();
+    if (overruns > 0)
+    {
+        hlDebug() << "Record: " << overruns << " overruns, " << getDroppedSamples() << " samples dropped." << std::endl;
+    }
+}
+
+/**
+ * Encoder thread. Writes staged audio to a temp FLAC file
+ * in large blocks until the recorder is done.
+ *
+ * With spooling enabled this compresses the spool in the background,
+ * so it can fall behind capture by as much as the disk holds.
+ */
+void Record::encoder()
 {
     ring_buffer_size_t samplesRead;
 
+    // Temp files are written in the capture format so that
+    // samples are not converted again on the way to disk
+    int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+    SampleFormat captureFormat = this->rb->getSampleFormat();
+
+    // The spool always holds 32-bit float samples
+    SampleFormat format = this->spool ? FLOAT_32 : this->stagingBuffer->getSampleFormat();
+
     // Initialize libsndfile info.
     SF_INFO sfinfo = {0};
-    sfinfo.samplerate = SAMPLE_RATE;
+    sfinfo.samplerate = sampleRate;
     sfinfo.channels = NUM_CHANNELS;
-    sfinfo.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+    sfinfo.format = SF_FORMAT_FLAC | Export::getSndfileSubtype(captureFormat, SF_FORMAT_FLAC);
 
     // Create a timestamped file name
-    char timestamp[20];
-    time_t now = time(0);
-    strftime(timestamp, 20, "%Y-%m-%d_%H-%M-%S", localtime(&now));
-    std::string file_path = Export::getTempPath() + "/hulaloop_" + std::string(timestamp) + ".flac";
+    std::string file_path = getUniquePath("hulaloop_", ".flac");
     SNDFILE *file = sf_open(file_path.c_str(), SFM_WRITE, &sfinfo);
+    if (file == nullptr)
+    {
+        hlDebugf("Could not open sndfile %s (%s)\n", file_path.c_str(), sf_strerror(NULL));
+        failWrite();
+        return;
+    }
 
     // Add file_path to vector of files
     exportPaths.push_back(file_path);
+    size_t segment = this->journal->addSegment(file_path);
+    if (this->spool)
+    {
+        this->journal->setSpool(segment, this->spool->getPath());
+    }
 
-    int maxSize = 512;
+    // End of the last complete frame in the file and the samples before it
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    uint64_t checkpointBytes = 0;
+    uint64_t checkpointSamples = 0;
 
-    // Keep recording until recording is stopped
-    while (!this->endRecord.load())
+    ring_buffer_size_t blockSize = getBlockSize();
+    std::vector<int32_t> intBuffer(blockSize);
+
+    while (true)
     {
-        void *ptr[2] = {0};
-        ring_buffer_size_t sizes[2] = {0};
-        samplesRead = this->rb->directRead(maxSize, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+        // Checked before draining so that nothing staged is left behind
+        bool stopping = this->endEncode.load();
+        if (!stopping)
+        {
+            waitForStaged(blockSize, 4 * HL_RECORD_BLOCK_MS);
+        }
 
-        if (samplesRead > 0)
+        ring_buffer_size_t samplesEncoded = 0;
+        do
         {
+            void *ptr[2] = {0};
+            ring_buffer_size_t sizes[2] = {0};
+            samplesRead = readStaged(blockSize, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+            samplesEncoded += samplesRead;
+
             for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
             {
-                sf_count_t samplesWritten = sf_write_float(file, (float *)ptr[i], sizes[i]);
+                sf_count_t samplesWritten = 0;
+                switch (format)
+                {
+                    case INT_16:
+                        samplesWritten = sf_write_short(file, (short *)ptr[i], sizes[i]);
+                        break;
+                    case INT_24:
+                        convertToInt32(ptr[i], format, intBuffer.data(), sizes[i]);
+                        samplesWritten = sf_write_int(file, intBuffer.data(), sizes[i]);
+                        break;
+                    case FLOAT_32:
+                    default:
+                        samplesWritten = sf_write_float(file, (float *)ptr[i], sizes[i]);
+                        break;
+                }
+
                 if (samplesWritten != sizes[i])
                 {
-                    char errstr[256];
-                    sf_error_str (0, errstr, sizeof (errstr) - 1);
-                    hlDebugf("Could not write sndfile (%s)\n", errstr);
-                    exit(1);
+                    hlDebugf("Could not write sndfile (%s)\n", sf_strerror(file));
+                    failWrite();
+                    break;
                 }
             }
+        } while (samplesRead == blockSize && !this->writeFailed.load());
+
+        if (this->writeFailed.load())
+        {
+            break;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds((maxSize / NUM_CHANNELS * 1000 / SAMPLE_RATE) - 1));
-    }
+        // Everything captured after the newest sample on disk is still on its way,
+        // so its age is however long that much audio takes to capture
+        if (samplesEncoded > 0)
+        {
+            uint64_t pending = this->rb->getReadAvailable() + getStagedAvailable();
+            this->controller->getStats()->addDiskLatency(pending * 1000000000ull / ((uint64_t)sampleRate * NUM_CHANNELS));
+        }
 
+        // Whatever is in the file now survives a crash of this process
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastCheckpoint >= std::chrono::milliseconds(HL_JOURNAL_CHECKPOINT_MS))
+        {
+            sf_write_sync(file);
+            if (FlacJoiner::scanFrames(file_path, checkpointBytes, checkpointSamples))
+            {
+                this->journal->checkpoint(segment, checkpointBytes, checkpointSamples);
+            }
+            lastCheckpoint = now;
+        }
+
+        if (stopping)
+        {
+            break;
+        }
+    }
 
-    this->controller->removeBuffer(this->rb);
-    this->rb->clear();
     sf_close(file);
+    this->journal->closeSegment(segment);
+}
+
+/**
+ * Give up on the temp file once it could not be created or written.
+ * Capture stops, and the error is kept for hasWriteError().
+ */
+void Record::failWrite()
+{
+    this->writeFailed.store(true);
+    this->endRecord.store(true);
 }
 
 /**
@@ -104,6 +397,63 @@ void Record::stop()
     {
         recordThread.join();
     }
+
+    // Only reachable if the recorder thread never ran
+    this->endEncode.store(true);
+    if (this->spool)
+    {
+        this->spool->wakeReaders();
+    }
+    this->stagingBuffer->wakeReaders();
+    if (encodeThread.joinable())
+    {
+        encodeThread.join();
+    }
+
+    // Everything in the spool is encoded now
+    if (this->spool)
+    {
+        this->spoolOverruns += this->spool->getOverrunCount();
+        this->spoolDroppedSamples += this->spool->getDroppedSamples();
+
+        this->spool->remove();
+        delete this->spool;
+        this->spool = nullptr;
+    }
+}
+
+/**
+ * Get the number of times audio was lost on the way to disk.
+ * Counts both the capture reader falling behind capture and
+ * the encoder falling so far behind that staging reached its limit.
+ * Losses of a spool are counted once the recording has stopped.
+ *
+ * @return Number of overruns since this Record was created
+ */
+uint64_t Record::getOverrunCount() const
+{
+    return this->rb->getOverrunCount() + this->stagingBuffer->getOverrunCount() + this->spoolOverruns;
+}
+
+/**
+ * Get the number of samples lost on the way to disk.
+ *
+ * @return Number of dropped samples since this Record was created
+ */
+uint64_t Record::getDroppedSamples() const
+{
+    return this->rb->getDroppedSamples() + this->stagingBuffer->getDroppedSamples() + this->spoolDroppedSamples;
+}
+
+/**
+ * Check whether the latest recording stopped early because
+ * its temp file could not be created or written.
+ *
+ * @return True until the next start()
+ */
+bool Record::hasWriteError() const
+{
+    return this->writeFailed.load();
 }
 
 /**
@@ -120,10 +470,42 @@ std::vector<std::string> Record::getExportPaths()
  * @brief Clear the vector to denote that the captured data has been discarded or
  * exported to a new file
  *
+ * Stops any running recording first, since the encoder
+ * adds to the paths and writes to the journal.
  */
 void Record::clearExportPaths()
 {
+    stop();
+
     exportPaths.clear();
+
+    // Nothing is left to recover
+    if (this->journal)
+    {
+        this->journal->finish();
+        delete this->journal;
+        this->journal = nullptr;
+    }
+}
+
+/**
+ * Continue a session recovered from its journal. Its temp files
+ * become the export paths, and recording again adds to the session.
+ * Must only be called while nothing is recorded and there are no export paths.
+ *
+ * @param journal Journal of the session. Ownership is taken.
+ * @param paths Usable temp files of the session in order
+ */
+void Record::adoptSession(SessionJournal *journal, const std::vector<std::string> &paths)
+{
+    if (this->journal)
+    {
+        this->journal->finish();
+        delete this->journal;
+    }
+
+    this->journal = journal;
+    this->exportPaths = paths;
 }
 
 /**
@@ -136,5 +518,12 @@ Record::~Record()
 
     stop();
 
+    // The journal stays on disk until the session is exported or discarded
+    if (journal)
+    {
+        delete journal;
+    }
+
+    delete stagingBuffer;
     delete rb;
 }
\ No newline at end of file
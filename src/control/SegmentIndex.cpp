@@ -0,0 +1,130 @@
+#include "hlcontrol/internal/SegmentIndex.h"
+
+#include <algorithm>
+
+#include <sndfile.h>
+
+#include <hlaudio/hlaudio.h>
+
+using namespace hula;
+
+/**
+ * Create an empty index.
+ */
+SegmentIndex::SegmentIndex()
+{
+    this->offsets.push_back(0);
+}
+
+/**
+ * Index the given segments by reading the header of each.
+ * No audio is decoded.
+ *
+ * @param paths Temp files in recording order
+ */
+SegmentIndex::SegmentIndex(const std::vector<std::string> &paths)
+{
+    this->paths = paths;
+    this->offsets.push_back(0);
+
+    for (const std::string &path : paths)
+    {
+        SF_INFO info = {0};
+        SNDFILE *file = sf_open(path.c_str(), SFM_READ, &info);
+
+        uint64_t frames = 0;
+        if (file == nullptr)
+        {
+            hlDebug() << "Could not index temp file: " << path << std::endl;
+        }
+        else
+        {
+            frames = (uint64_t)std::max(info.frames, (sf_count_t)0);
+            sf_close(file);
+        }
+
+        this->offsets.push_back(this->offsets.back() + frames);
+    }
+}
+
+/**
+ * Get the segments this index was built from.
+ *
+ * @return Temp file paths in recording order
+ */
+const std::vector<std::string> &SegmentIndex::getPaths() const
+{
+    return this->paths;
+}
+
+/**
+ * Get the number of indexed segments.
+ *
+ * @return Number of segments, including any that could not be opened
+ */
+size_t SegmentIndex::getSegmentCount() const
+{
+    return this->paths.size();
+}
+
+/**
+ * Get the length of the whole session.
+ *
+ * @return Number of frames across every segment
+ */
+uint64_t SegmentIndex::getTotalFrames() const
+{
+    return this->offsets.back();
+}
+
+/**
+ * Get the position of a segment in the session.
+ *
+ * @param segment Index of the segment
+ * @return Frame of the session at which the segment starts
+ */
+uint64_t SegmentIndex::getSegmentStart(size_t segment) const
+{
+    return this->offsets[std::min(segment, this->paths.size())];
+}
+
+/**
+ * Get the length of a segment.
+ *
+ * @param segment Index of the segment
+ * @return Number of frames in the segment
+ */
+uint64_t SegmentIndex::getSegmentFrames(size_t segment) const
+{
+    if (segment >= this->paths.size())
+    {
+        return 0;
+    }
+
+    return this->offsets[segment + 1] - this->offsets[segment];
+}
+
+/**
+ * Find the segment that holds a frame of the session.
+ *
+ * @param frame Frame counted from the start of the session
+ * @param position Set to the segment and the frame within it
+ * @return False if the frame is past the end of the session
+ */
+bool SegmentIndex::locate(uint64_t frame, SegmentPosition *position) const
+{
+    if (frame >= getTotalFrames())
+    {
+        return false;
+    }
+
+    // Last segment that starts at or before the frame.
+    // Empty segments share their start with the next one and are skipped.
+    std::vector<uint64_t>::const_iterator next = std::upper_bound(this->offsets.begin(), this->offsets.end(), frame);
+    size_t segment = (size_t)(next - this->offsets.begin()) - 1;
+
+    position->segment = segment;
+    position->frame = frame - this->offsets[segment];
+
+    return true;
+}
@@ -0,0 +1,220 @@
+#include "hlcontrol/internal/SegmentReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace hula;
+
+/**
+ * Open the segment holding the start position and begin
+ * prefetching the one after it.
+ *
+ * @param paths Temp files in recording order
+ * @param start Position to start reading from, as found by SegmentIndex::locate()
+ */
+SegmentReader::SegmentReader(const std::vector<std::string> &paths, const SegmentPosition &start)
+{
+    this->paths = paths;
+    this->currentIndex = start.segment;
+    this->headOffset = 0;
+
+    this->nextFile = nullptr;
+    this->nextIndex = start.segment + 1;
+    this->nextReady = false;
+    this->prefetchRequested = false;
+    this->endPrefetch = false;
+
+    SF_INFO info = {0};
+    this->current = (start.segment < paths.size()) ? sf_open(paths[start.segment].c_str(), SFM_READ, &info) : nullptr;
+    if (this->current == nullptr)
+    {
+        hlDebug() << "Could not open segment #" << start.segment << std::endl;
+    }
+    else if (start.frame > 0 && sf_seek(this->current, (sf_count_t)start.frame, SEEK_SET) < 0)
+    {
+        hlDebug() << "Could not seek to frame " << start.frame << " of segment #" << start.segment << std::endl;
+    }
+
+    requestPrefetch(this->nextIndex);
+    this->prefetchThread = std::thread(&SegmentReader::prefetcher, this);
+}
+
+/**
+ * Ask the prefetch thread to prepare the segment at index
+ * or, if that can't be opened, the first one after it that can.
+ *
+ * @param index Segment to prepare
+ */
+void SegmentReader::requestPrefetch(size_t index)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->nextIndex = index;
+    this->nextReady = false;
+    this->prefetchRequested = true;
+    this->cond.notify_all();
+}
+
+/**
+ * Body of the prefetch thread.
+ * Opens the requested segment and decodes its first samples.
+ */
+void SegmentReader::prefetcher()
+{
+    int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->endPrefetch)
+    {
+        if (!this->prefetchRequested)
+        {
+            this->cond.wait(lock);
+            continue;
+        }
+
+        this->prefetchRequested = false;
+        size_t index = this->nextIndex;
+        lock.unlock();
+
+        SNDFILE *file = nullptr;
+        SF_INFO info = {0};
+        while (index < this->paths.size() && (file = sf_open(this->paths[index].c_str(), SFM_READ, &info)) == nullptr)
+        {
+            hlDebug() << "Could not open segment #" << index << ". Skipping it." << std::endl;
+            index++;
+        }
+
+        std::vector<float> head;
+        if (file != nullptr)
+        {
+            head.resize((size_t)sampleRate * HL_SEGMENT_PREFETCH_DURATION * info.channels);
+            head.resize((size_t)std::max(sf_read_float(file, head.data(), (sf_count_t)head.size()), (sf_count_t)0));
+
+            hlDebug() << "Prefetched " << head.size() << " samples of segment #" << index << std::endl;
+        }
+
+        lock.lock();
+        this->nextFile = file;
+        this->nextIndex = index;
+        this->nextHead.swap(head);
+        this->nextReady = true;
+        this->cond.notify_all();
+    }
+}
+
+/**
+ * Close the finished segment and switch to the prefetched one.
+ * Only blocks if the prefetch thread is not done with it yet.
+ *
+ * @return False once every segment has been read
+ */
+bool SegmentReader::advance()
+{
+    if (this->current != nullptr)
+    {
+        sf_close(this->current);
+        this->current = nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cond.wait(lock, [this] { return this->nextReady; });
+
+    if (this->nextFile == nullptr)
+    {
+        // Stays ready so that later calls return straight away
+        this->currentIndex = this->paths.size();
+        return false;
+    }
+
+    this->current = this->nextFile;
+    this->currentIndex = this->nextIndex;
+    this->currentHead.swap(this->nextHead);
+    this->headOffset = 0;
+    this->nextFile = nullptr;
+    lock.unlock();
+
+    hlDebug() << "Switched to segment #" << this->currentIndex << std::endl;
+
+    requestPrefetch(this->currentIndex + 1);
+    return true;
+}
+
+/**
+ * Read the next samples of the recording, continuing into
+ * the following segments as each one ends.
+ *
+ * @param samples Buffer of at least count samples
+ * @param count Number of samples wanted. Should be whole frames.
+ * @return Number of samples read. Less than count only at the end of the recording.
+ */
+ring_buffer_size_t SegmentReader::read(float *samples, ring_buffer_size_t count)
+{
+    ring_buffer_size_t total = 0;
+    while (total < count)
+    {
+        if (this->current == nullptr)
+        {
+            if (!advance())
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Samples decoded ahead come first
+        if (this->headOffset < this->currentHead.size())
+        {
+            size_t n = std::min((size_t)(count - total), this->currentHead.size() - this->headOffset);
+            memcpy(samples + total, this->currentHead.data() + this->headOffset, n * sizeof(float));
+            this->headOffset += n;
+            total += (ring_buffer_size_t)n;
+            continue;
+        }
+
+        sf_count_t samplesRead = sf_read_float(this->current, samples + total, count - total);
+        if (samplesRead > 0)
+        {
+            total += (ring_buffer_size_t)samplesRead;
+        }
+        else if (!advance())
+        {
+            break;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * Get the segment currently being read.
+ *
+ * @return Index into the paths, or the number of paths once all were read
+ */
+size_t SegmentReader::getSegment() const
+{
+    return this->currentIndex;
+}
+
+SegmentReader::~SegmentReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->endPrefetch = true;
+        this->cond.notify_all();
+    }
+
+    if (this->prefetchThread.joinable())
+    {
+        this->prefetchThread.join();
+    }
+
+    if (this->current != nullptr)
+    {
+        sf_close(this->current);
+    }
+
+    if (this->nextFile != nullptr)
+    {
+        sf_close(this->nextFile);
+    }
+}
@@ -0,0 +1,415 @@
+#include "hlcontrol/internal/SessionJournal.h"
+#include "hlcontrol/internal/FlacJoiner.h"
+#include "hlcontrol/internal/SpoolFile.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <QDir>
+#include <QStringList>
+
+#include <hlaudio/hlaudio.h>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+using namespace hula;
+
+/**
+ * Open a session journal.
+ *
+ * A journal that can't be written to is logged and otherwise
+ * ignored, since losing the journal should never stop a recording.
+ *
+ * @param path Location of the journal
+ * @param resume True to read an existing journal and append to it,
+ *               false to start a new one
+ */
+SessionJournal::SessionJournal(const std::string &path, bool resume)
+{
+    this->path = path;
+
+    if (resume)
+    {
+        load();
+        this->file = fopen(path.c_str(), "ab");
+    }
+    else
+    {
+        this->file = fopen(path.c_str(), "wb");
+        if (this->file)
+        {
+            append(HL_JOURNAL_HEADER);
+        }
+    }
+
+    if (this->file == nullptr)
+    {
+        hlDebug() << "Could not open session journal " << path << std::endl;
+    }
+}
+
+/**
+ * Find the journals of every session that was never exported or discarded.
+ *
+ * @param directory Directory to search, normally Export::getTempPath()
+ * @return Paths of the journals, oldest first
+ */
+std::vector<std::string> SessionJournal::findSessions(const std::string &directory)
+{
+    QDir dir(QString::fromStdString(directory));
+    QStringList names = dir.entryList(QStringList() << HL_JOURNAL_PREFIX "*" HL_JOURNAL_EXTENSION, QDir::Files, QDir::Name);
+
+    std::vector<std::string> journals;
+    for (const QString &name : names)
+    {
+        journals.push_back(directory + "/" + name.toStdString());
+    }
+
+    return journals;
+}
+
+/**
+ * Read the segments of an existing journal.
+ * A line cut short by a crash is ignored.
+ */
+void SessionJournal::load()
+{
+    std::ifstream in(this->path);
+    std::string line;
+
+    if (!std::getline(in, line) || line != HL_JOURNAL_HEADER)
+    {
+        hlDebug() << "Not a session journal: " << this->path << std::endl;
+        return;
+    }
+
+    while (std::getline(in, line))
+    {
+        std::istringstream record(line);
+        std::string type;
+        size_t index = 0;
+        if (!(record >> type >> index))
+        {
+            continue;
+        }
+
+        if (type == "segment" && index == this->segments.size())
+        {
+            JournalSegment segment;
+            record >> std::ws;
+            std::getline(record, segment.path);
+            if (!segment.path.empty())
+            {
+                this->segments.push_back(segment);
+            }
+        }
+        else if ((type == "spool" || type == "tail") && index < this->segments.size())
+        {
+            std::string path;
+            record >> std::ws;
+            std::getline(record, path);
+            (type == "spool" ? this->segments[index].spoolPath : this->segments[index].tailPath) = path;
+        }
+        else if (type == "checkpoint" && index < this->segments.size())
+        {
+            // Checkpoints without a sample count are not at a frame boundary
+            uint64_t bytes = 0;
+            uint64_t samples = 0;
+            if (record >> bytes >> samples)
+            {
+                this->segments[index].checkpointBytes = bytes;
+                this->segments[index].checkpointSamples = samples;
+            }
+        }
+        else if (type == "close" && index < this->segments.size())
+        {
+            this->segments[index].closed = true;
+        }
+    }
+}
+
+/**
+ * Append one record and wait until it is on disk.
+ *
+ * @param line Record without the line break
+ */
+void SessionJournal::append(const std::string &line)
+{
+    if (this->file == nullptr)
+    {
+        return;
+    }
+
+    fprintf(this->file, "%s\n", line.c_str());
+    fflush(this->file);
+
+#ifdef _WIN32
+    _commit(_fileno(this->file));
+#else
+    fsync(fileno(this->file));
+#endif
+}
+
+/**
+ * Get the location of the journal.
+ *
+ * @return Path given to the constructor
+ */
+std::string SessionJournal::getPath() const
+{
+    return this->path;
+}
+
+/**
+ * Get every segment in the order they were recorded.
+ *
+ * @return Copy of the segments
+ */
+std::vector<JournalSegment> SessionJournal::getSegments()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->segments;
+}
+
+/**
+ * Get the paths of every file that belongs to the session,
+ * including spools and the tails recovered from them.
+ *
+ * @return Temp file paths
+ */
+std::vector<std::string> SessionJournal::getFilePaths()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    std::vector<std::string> paths;
+    for (const JournalSegment &segment : this->segments)
+    {
+        paths.push_back(segment.path);
+        for (const std::string &path : { segment.spoolPath, segment.tailPath })
+        {
+            if (!path.empty())
+            {
+                paths.push_back(path);
+            }
+        }
+    }
+
+    return paths;
+}
+
+/**
+ * Record that a new temp file was started.
+ *
+ * @param segmentPath Path of the temp file
+ * @return Index used for checkpoint() and closeSegment()
+ */
+size_t SessionJournal::addSegment(const std::string &segmentPath)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    JournalSegment segment;
+    segment.path = segmentPath;
+    this->segments.push_back(segment);
+
+    size_t index = this->segments.size() - 1;
+    append("segment " + std::to_string(index) + " " + segmentPath);
+
+    return index;
+}
+
+/**
+ * Record the spool file a segment is encoded from.
+ *
+ * @param segment Index from addSegment()
+ * @param spoolPath Path of the spool file
+ */
+void SessionJournal::setSpool(size_t segment, const std::string &spoolPath)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (segment < this->segments.size())
+    {
+        this->segments[segment].spoolPath = spoolPath;
+        append("spool " + std::to_string(segment) + " " + spoolPath);
+    }
+}
+
+/**
+ * Record the file that holds the rest of a segment's spool.
+ *
+ * @param segment Index from addSegment()
+ * @param tailPath Path of the FLAC file
+ */
+void SessionJournal::setTail(size_t segment, const std::string &tailPath)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (segment < this->segments.size())
+    {
+        this->segments[segment].tailPath = tailPath;
+        append("tail " + std::to_string(segment) + " " + tailPath);
+    }
+}
+
+/**
+ * Record how much of a segment is known to be on disk.
+ *
+ * @param segment Index from addSegment()
+ * @param bytes End of the last complete frame in the temp file
+ * @param samples Number of samples per channel before bytes
+ */
+void SessionJournal::checkpoint(size_t segment, uint64_t bytes, uint64_t samples)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (segment < this->segments.size())
+    {
+        this->segments[segment].checkpointBytes = bytes;
+        this->segments[segment].checkpointSamples = samples;
+        append("checkpoint " + std::to_string(segment) + " " + std::to_string(bytes) + " " + std::to_string(samples));
+    }
+}
+
+/**
+ * Record that a segment was closed properly and needs no repair.
+ *
+ * @param segment Index from addSegment()
+ */
+void SessionJournal::closeSegment(size_t segment)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (segment < this->segments.size())
+    {
+        this->segments[segment].closed = true;
+        append("close " + std::to_string(segment));
+    }
+}
+
+/**
+ * Encode what the encoder had not taken from a segment's spool yet
+ * into a file of its own. The spool is deleted once that file is
+ * in the journal, or right away if nothing was left in it.
+ *
+ * @param segment Index of a segment that was not closed
+ * @param encodedFrames Frames of the spool that made it into the segment
+ */
+void SessionJournal::recoverSpool(size_t segment, uint64_t encodedFrames)
+{
+    std::string spoolPath = getSegments()[segment].spoolPath;
+    if (!std::ifstream(spoolPath).good())
+    {
+        return;
+    }
+
+    std::string segmentPath = getSegments()[segment].path;
+    std::string tailPath = segmentPath.substr(0, segmentPath.rfind('.')) + "_spool.flac";
+
+    int64_t frames = SpoolFile::encodeTail(spoolPath, encodedFrames, tailPath);
+    if (frames < 0)
+    {
+        hlDebug() << "Could not recover spool " << spoolPath << std::endl;
+        return;
+    }
+
+    if (frames > 0)
+    {
+        setTail(segment, tailPath);
+    }
+    std::remove(spoolPath.c_str());
+}
+
+/**
+ * Repair every segment that was not closed properly.
+ * Each one is finalized in place, scanning only what was
+ * written after its last checkpoint. Audio that was still
+ * waiting in a spool is encoded into a file that follows
+ * its segment.
+ *
+ * @return Paths of every usable temp file in recording order
+ */
+std::vector<std::string> SessionJournal::recover()
+{
+    std::vector<std::string> paths;
+    std::vector<JournalSegment> segments = getSegments();
+
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        int64_t frames = 0;
+        bool usable = std::ifstream(segments[i].path).good();
+        if (!usable)
+        {
+            hlDebug() << "Session segment is missing: " << segments[i].path << std::endl;
+        }
+        else if (!segments[i].closed)
+        {
+            frames = FlacJoiner::finalize(segments[i].path, segments[i].checkpointBytes, segments[i].checkpointSamples);
+            usable = frames >= 0;
+        }
+
+        if (usable)
+        {
+            paths.push_back(segments[i].path);
+        }
+
+        // A closed segment or its tail holds everything that was spooled
+        if (!segments[i].spoolPath.empty())
+        {
+            if (!segments[i].closed && segments[i].tailPath.empty())
+            {
+                recoverSpool(i, usable ? (uint64_t)frames : 0);
+                segments[i].tailPath = getSegments()[i].tailPath;
+            }
+            else
+            {
+                std::remove(segments[i].spoolPath.c_str());
+            }
+        }
+
+        if (!segments[i].tailPath.empty() && std::ifstream(segments[i].tailPath).good())
+        {
+            paths.push_back(segments[i].tailPath);
+        }
+
+        // Only closed once the spool is taken care of
+        if (usable && !segments[i].closed)
+        {
+            closeSegment(i);
+        }
+    }
+
+    return paths;
+}
+
+/**
+ * Close and delete the journal once its session was exported or discarded.
+ * The temp files themselves are left alone.
+ */
+void SessionJournal::finish()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (this->file)
+    {
+        fclose(this->file);
+        this->file = nullptr;
+    }
+
+    std::remove(this->path.c_str());
+    this->segments.clear();
+}
+
+/**
+ * Close the journal, leaving it on disk so the session can be recovered.
+ */
+SessionJournal::~SessionJournal()
+{
+    if (this->file)
+    {
+        fclose(this->file);
+    }
+}
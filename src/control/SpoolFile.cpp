@@ -0,0 +1,541 @@
+#include "hlcontrol/internal/SpoolFile.h"
+#include "hlcontrol/internal/HulaControlError.h"
+#include "hlcontrol/internal/Export.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sndfile.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace hula;
+
+/**
+ * Create a new spool file, replacing any file at the same path.
+ * The header and the first chunks are allocated right away.
+ *
+ * @param path Location of the spool file
+ */
+SpoolFile::SpoolFile(const std::string &path)
+{
+    this->path = path;
+    this->header = nullptr;
+    this->allocatedChunks = 0;
+    this->writeIndex = 0;
+    this->overrunCount.store(0);
+    this->droppedSamples.store(0);
+    this->readIndex.store(0);
+    this->releasedChunks = 0;
+
+    // Chunks must start on a mapping boundary and hold whole frames
+    int sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+    uint64_t frameBytes = sizeof(float) * NUM_CHANNELS;
+    uint64_t chunkBytes = (uint64_t)sampleRate * HL_SPOOL_CHUNK_DURATION * frameBytes;
+    chunkBytes = (chunkBytes + HL_SPOOL_HEADER_BYTES - 1) / HL_SPOOL_HEADER_BYTES * HL_SPOOL_HEADER_BYTES;
+    while (chunkBytes % frameBytes != 0)
+    {
+        chunkBytes += HL_SPOOL_HEADER_BYTES;
+    }
+    this->chunkSamples = chunkBytes / sizeof(float);
+
+#ifdef _WIN32
+    this->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    bool opened = (this->file != INVALID_HANDLE_VALUE);
+#else
+    this->file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    bool opened = (this->file >= 0);
+#endif
+
+    void *region = nullptr;
+    if (opened && growFile(HL_SPOOL_HEADER_BYTES))
+    {
+        region = mapRegion(0, HL_SPOOL_HEADER_BYTES);
+    }
+
+    if (region == nullptr)
+    {
+        hlDebug() << "Could not create spool file " << path << std::endl;
+        close();
+        std::remove(path.c_str());
+        throw ControlException(HL_SPOOL_OPEN_CODE);
+    }
+
+    this->header = new (region) SpoolHeader;
+    memcpy(this->header->magic, HL_SPOOL_MAGIC, sizeof(HL_SPOOL_MAGIC));
+    this->header->version = HL_SPOOL_VERSION;
+    this->header->sampleRate = sampleRate;
+    this->header->channels = NUM_CHANNELS;
+    this->header->reserved = 0;
+    this->header->committedSamples.store(0, std::memory_order_release);
+
+    // Map the first chunk and allocate the one after it
+    getChunk(0);
+}
+
+/**
+ * Get the location of the spool file.
+ *
+ * @return Path given to the constructor
+ */
+std::string SpoolFile::getPath() const
+{
+    return this->path;
+}
+
+/**
+ * Extend the file and reserve disk space for all of it.
+ * Existing mappings stay valid.
+ *
+ * The space has to be reserved before it is mapped. A page of a
+ * sparse file that can't be allocated when it is first written
+ * through the mapping raises SIGBUS instead of an error.
+ *
+ * @param bytes New size of the file
+ * @return True on success, false if the disk is full
+ */
+bool SpoolFile::growFile(uint64_t bytes)
+{
+#ifdef _WIN32
+    // Not sparse, so NTFS allocates every cluster up to the new end
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)bytes;
+    return SetFilePointerEx(this->file, size, NULL, FILE_BEGIN) && SetEndOfFile(this->file);
+#else
+    struct stat info;
+    if (fstat(this->file, &info) != 0)
+    {
+        return false;
+    }
+
+    if ((uint64_t)info.st_size >= bytes)
+    {
+        return true;
+    }
+
+    off_t extra = (off_t)(bytes - (uint64_t)info.st_size);
+
+    #ifdef __APPLE__
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, extra, 0};
+    if (fcntl(this->file, F_PREALLOCATE, &store) == -1)
+    {
+        return false;
+    }
+
+    return ftruncate(this->file, (off_t)bytes) == 0;
+    #else
+    return posix_fallocate(this->file, info.st_size, extra) == 0;
+    #endif
+#endif
+}
+
+/**
+ * Map part of the file for reading and writing.
+ *
+ * @param offset Start of the region. Must be a multiple of HL_SPOOL_HEADER_BYTES.
+ * @param bytes Length of the region
+ * @return Address of the region or nullptr on failure
+ */
+void *SpoolFile::mapRegion(uint64_t offset, size_t bytes)
+{
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(this->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        return nullptr;
+    }
+
+    // The view keeps the mapping alive after its handle is closed
+    void *region = MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)(offset >> 32), (DWORD)offset, bytes);
+    CloseHandle(mapping);
+    return region;
+#else
+    void *region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, this->file, (off_t)offset);
+    return (region == MAP_FAILED) ? nullptr : region;
+#endif
+}
+
+/**
+ * Unmap a region returned by mapRegion().
+ */
+void SpoolFile::unmapRegion(void *region, size_t bytes)
+{
+#ifdef _WIN32
+    (void)bytes;
+    UnmapViewOfFile(region);
+#else
+    munmap(region, bytes);
+#endif
+}
+
+/**
+ * Get the mapping of a chunk, mapping it if needed.
+ * The file is always kept one chunk ahead, so that the
+ * writer rarely has to wait for the file system.
+ *
+ * @param index Chunk number
+ * @return Samples of the chunk or nullptr if it could not be mapped
+ */
+float *SpoolFile::getChunk(uint64_t index)
+{
+    std::lock_guard<std::mutex> lock(this->chunkMutex);
+
+    if (index < this->releasedChunks)
+    {
+        return nullptr;
+    }
+
+    size_t chunkBytes = (size_t)this->chunkSamples * sizeof(float);
+    if (index + 1 >= this->allocatedChunks)
+    {
+        if (growFile(HL_SPOOL_HEADER_BYTES + (index + 2) * chunkBytes))
+        {
+            this->allocatedChunks = index + 2;
+        }
+        else if (index >= this->allocatedChunks)
+        {
+            hlDebug() << "Could not grow spool file " << this->path << std::endl;
+            return nullptr;
+        }
+    }
+
+    if (this->chunks.size() <= index)
+    {
+        this->chunks.resize(index + 1, nullptr);
+    }
+
+    if (this->chunks[index] == nullptr)
+    {
+        this->chunks[index] = (float *)mapRegion(HL_SPOOL_HEADER_BYTES + index * chunkBytes, chunkBytes);
+    }
+
+    return this->chunks[index];
+}
+
+/**
+ * Unmap every chunk before the given one.
+ * Called by the reader once it has moved past them.
+ *
+ * @param index First chunk that is still needed
+ */
+void SpoolFile::releaseChunksBefore(uint64_t index)
+{
+    std::lock_guard<std::mutex> lock(this->chunkMutex);
+
+    size_t chunkBytes = (size_t)this->chunkSamples * sizeof(float);
+    for (uint64_t c = this->releasedChunks; c < index && c < this->chunks.size(); c++)
+    {
+        if (this->chunks[c] != nullptr)
+        {
+            unmapRegion(this->chunks[c], chunkBytes);
+            this->chunks[c] = nullptr;
+        }
+    }
+
+    this->releasedChunks = std::max(this->releasedChunks, index);
+}
+
+/**
+ * Append samples and commit them.
+ * Samples are converted to 32-bit float on the way in.
+ * Must only be called from one thread.
+ *
+ * @param data Samples in the given format
+ * @param format Format of data
+ * @param samples Number of samples in data. Should be whole frames.
+ * @return Number of samples written. Less than samples only if the file could
+ *         not grow, which is counted as an overrun.
+ */
+ring_buffer_size_t SpoolFile::write(const void *data, SampleFormat format, ring_buffer_size_t samples)
+{
+    const uint8_t *in = (const uint8_t *)data;
+    int sampleSize = getSampleFormatSize(format);
+    ring_buffer_size_t totalWritten = 0;
+
+    while (totalWritten < samples)
+    {
+        float *chunk = getChunk(this->writeIndex / this->chunkSamples);
+        if (chunk == nullptr)
+        {
+            break;
+        }
+
+        uint64_t pos = this->writeIndex % this->chunkSamples;
+        ring_buffer_size_t count = (ring_buffer_size_t)std::min((uint64_t)(samples - totalWritten), this->chunkSamples - pos);
+
+        if (format == FLOAT_32)
+        {
+            memcpy(chunk + pos, in + (size_t)totalWritten * sampleSize, (size_t)count * sizeof(float));
+        }
+        else
+        {
+            convertToFloat(in + (size_t)totalWritten * sampleSize, format, chunk + pos, count);
+        }
+
+        this->writeIndex += count;
+        totalWritten += count;
+    }
+
+    if (totalWritten < samples)
+    {
+        this->overrunCount.fetch_add(1, std::memory_order_relaxed);
+        this->droppedSamples.fetch_add(samples - totalWritten, std::memory_order_relaxed);
+    }
+
+    if (totalWritten > 0)
+    {
+        this->header->committedSamples.store(this->writeIndex, std::memory_order_release);
+        wakeReaders();
+    }
+
+    return totalWritten;
+}
+
+/**
+ * Wake the reader if it is sleeping in waitForData().
+ */
+void SpoolFile::wakeReaders()
+{
+    // Taking the lock orders this with a reader that is about to sleep
+    {
+        std::lock_guard<std::mutex> lock(this->waitMutex);
+    }
+    this->waitCond.notify_all();
+}
+
+/**
+ * Sleep until at least minSamples are committed past the read position.
+ *
+ * @param minSamples Number of samples to wait for
+ * @param timeoutMs Longest time to wait in milliseconds
+ * @return True if the samples are available, false on timeout
+ *         or when woken early by wakeReaders()
+ */
+bool SpoolFile::waitForData(ring_buffer_size_t minSamples, uint32_t timeoutMs)
+{
+    uint64_t target = this->readIndex.load(std::memory_order_relaxed) + std::max(minSamples, (ring_buffer_size_t)1);
+
+    std::unique_lock<std::mutex> lock(this->waitMutex);
+    if (getCommittedSamples() >= target)
+    {
+        return true;
+    }
+
+    this->waitCond.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+
+    return getCommittedSamples() >= target;
+}
+
+/**
+ * Fetch direct pointers to committed samples. The second pointer/size
+ * pair is used when the samples continue in the next chunk.
+ * The regions hold 32-bit float samples and stay valid until
+ * the next call to directRead().
+ *
+ * @param maxSamples Desired number of samples. At most one chunk is returned.
+ * @param dataPtr1 The address where the first pointer should be stored.
+ * @param size1 Number of samples available from dataPtr1.
+ * @param dataPtr2 The address where the second pointer (if required) will be stored. nullptr if not used.
+ * @param size2 Number of samples available from dataPtr2.
+ * @return Number of samples read.
+ */
+ring_buffer_size_t SpoolFile::directRead(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2)
+{
+    uint64_t r = this->readIndex.load(std::memory_order_relaxed);
+    uint64_t index = r / this->chunkSamples;
+    releaseChunksBefore(index);
+
+    uint64_t available = getCommittedSamples() - r;
+    uint64_t count = std::min(available, std::min((uint64_t)std::max(maxSamples, (ring_buffer_size_t)0), this->chunkSamples));
+    uint64_t pos = r % this->chunkSamples;
+    uint64_t firstPart = std::min(count, this->chunkSamples - pos);
+
+    *dataPtr1 = (firstPart > 0) ? getChunk(index) + pos : nullptr;
+    *size1 = (ring_buffer_size_t)firstPart;
+    *dataPtr2 = (count > firstPart) ? getChunk(index + 1) : nullptr;
+    *size2 = (ring_buffer_size_t)(count - firstPart);
+
+    this->readIndex.store(r + count, std::memory_order_release);
+
+    return (ring_buffer_size_t)count;
+}
+
+/**
+ * Get the number of samples that are completely written.
+ *
+ * @return Committed samples
+ */
+uint64_t SpoolFile::getCommittedSamples() const
+{
+    return this->header->committedSamples.load(std::memory_order_acquire);
+}
+
+/**
+ * Get the number of committed samples that have not been read yet.
+ *
+ * @return Number of readable samples
+ */
+uint64_t SpoolFile::getReadAvailable() const
+{
+    uint64_t r = this->readIndex.load(std::memory_order_acquire);
+    return getCommittedSamples() - r;
+}
+
+/**
+ * Get the number of writes that could not be stored completely.
+ *
+ * @return Number of overruns
+ */
+uint64_t SpoolFile::getOverrunCount() const
+{
+    return this->overrunCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * Get the number of samples that could not be stored.
+ *
+ * @return Number of dropped samples
+ */
+uint64_t SpoolFile::getDroppedSamples() const
+{
+    return this->droppedSamples.load(std::memory_order_relaxed);
+}
+
+/**
+ * Unmap everything and close the file, leaving it on disk.
+ */
+void SpoolFile::close()
+{
+    size_t chunkBytes = (size_t)this->chunkSamples * sizeof(float);
+    for (float *chunk : this->chunks)
+    {
+        if (chunk != nullptr)
+        {
+            unmapRegion(chunk, chunkBytes);
+        }
+    }
+    this->chunks.clear();
+
+    if (this->header != nullptr)
+    {
+        unmapRegion(this->header, HL_SPOOL_HEADER_BYTES);
+        this->header = nullptr;
+    }
+
+#ifdef _WIN32
+    if (this->file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(this->file);
+        this->file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (this->file >= 0)
+    {
+        ::close(this->file);
+        this->file = -1;
+    }
+#endif
+}
+
+/**
+ * Close and delete the spool file once its samples are safely encoded.
+ * The object must not be used afterwards except to delete it.
+ */
+void SpoolFile::remove()
+{
+    close();
+    std::remove(this->path.c_str());
+}
+
+/**
+ * Encode the committed samples a crashed recording left in a spool
+ * file into a FLAC file. Samples are read in blocks, so the spool
+ * may be far larger than memory.
+ *
+ * @param spoolPath Spool file left behind by the crash
+ * @param skipFrames Frames at the start of the spool that were already encoded
+ * @param flacPath File to write the remaining frames to
+ * @return Number of frames written, 0 if nothing was left, or -1 on failure
+ */
+int64_t SpoolFile::encodeTail(const std::string &spoolPath, uint64_t skipFrames, const std::string &flacPath)
+{
+    std::ifstream in(spoolPath, std::ios::binary);
+
+    char magic[8] = {0};
+    uint32_t fields[4] = {0};
+    uint64_t committedSamples = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char *)fields, sizeof(fields));
+    in.seekg(offsetof(SpoolHeader, committedSamples));
+    in.read((char *)&committedSamples, sizeof(committedSamples));
+
+    uint32_t version = fields[0];
+    uint32_t sampleRate = fields[1];
+    uint32_t channels = fields[2];
+    if (!in || memcmp(magic, HL_SPOOL_MAGIC, sizeof(HL_SPOOL_MAGIC)) != 0 || version != HL_SPOOL_VERSION || channels == 0 || sampleRate == 0)
+    {
+        hlDebug() << "Not a spool file: " << spoolPath << std::endl;
+        return -1;
+    }
+
+    uint64_t committedFrames = committedSamples / channels;
+    if (committedFrames <= skipFrames)
+    {
+        return 0;
+    }
+
+    SF_INFO sfinfo = {0};
+    sfinfo.samplerate = sampleRate;
+    sfinfo.channels = channels;
+    sfinfo.format = SF_FORMAT_FLAC | Export::getSndfileSubtype(FLOAT_32, SF_FORMAT_FLAC);
+
+    SNDFILE *out = sf_open(flacPath.c_str(), SFM_WRITE, &sfinfo);
+    if (out == nullptr)
+    {
+        hlDebugf("Could not open %s (%s)\n", flacPath.c_str(), sf_strerror(nullptr));
+        return -1;
+    }
+
+    in.seekg(HL_SPOOL_HEADER_BYTES + skipFrames * channels * sizeof(float));
+    std::vector<float> block((size_t)HL_EXPORT_BLOCK_FRAMES * channels);
+
+    uint64_t frames = 0;
+    bool failed = false;
+    while (frames < committedFrames - skipFrames && !failed)
+    {
+        uint64_t count = std::min<uint64_t>(HL_EXPORT_BLOCK_FRAMES, committedFrames - skipFrames - frames);
+        in.read((char *)block.data(), count * channels * sizeof(float));
+        failed = !in || sf_writef_float(out, block.data(), count) != (sf_count_t)count;
+        frames += count;
+    }
+
+    sf_close(out);
+    if (failed)
+    {
+        hlDebug() << "Could not encode spool " << spoolPath << std::endl;
+        std::remove(flacPath.c_str());
+        return -1;
+    }
+
+    return (int64_t)frames;
+}
+
+/**
+ * Close the spool file. The file itself is kept so
+ * that an interrupted recording can be recovered.
+ */
+SpoolFile::~SpoolFile()
+{
+    close();
+}
@@ -1,4 +1,4 @@
-#include <chrono>
+#include <algorithm>
 
 #include "hlcontrol/internal/Export.h"
 #include "hlcontrol/internal/HulaControlError.h"
@@ -7,6 +7,28 @@
 
 using namespace hula;
 
+/**
+ * Wrap a progress callback so that it never receives 1.
+ * The async commands report that themselves once they are completely done.
+ *
+ * @param progress Callback given to an async command, may be empty
+ * @return Callback for Export, or an empty one
+ */
+static ProgressCallback partialProgress(const ProgressCallback &progress)
+{
+    if (!progress)
+    {
+        return nullptr;
+    }
+
+    return [progress](float done) {
+        if (done < 1)
+        {
+            progress(done);
+        }
+    };
+}
+
 /**
  * Construct a new instance of the Transport class.
  */
@@ -43,10 +65,68 @@ Transport::Transport()
         throw ControlException(ae.getErrorCode());
     }
 
-    canRecord = true;
-    canPlayback = false;
-    initRecordClicked = false;
     state = READY;
+    pausedState = READY;
+    unsaved = false;
+
+    // Anything still journaled was never exported or discarded
+    recoverableSessions = SessionJournal::findSessions(Export::getTempPath());
+    if (!recoverableSessions.empty())
+    {
+        hlDebug() << "Found " << recoverableSessions.size() << " recoverable sessions." << std::endl;
+    }
+
+    endCommands = false;
+    commandThread = std::thread(&Transport::commandWorker, this);
+}
+
+/**
+ * Body of the worker thread. Runs queued commands in order
+ * until the Transport is destroyed, finishing any that are
+ * still queued at that point.
+ */
+void Transport::commandWorker()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true)
+    {
+        queueCond.wait(lock, [this] { return endCommands || !commands.empty(); });
+        if (commands.empty())
+        {
+            break;
+        }
+
+        std::function<void()> command = commands.front();
+        commands.pop_front();
+
+        lock.unlock();
+        command();
+        lock.lock();
+    }
+}
+
+/**
+ * Check whether a command may move the transport from
+ * its current state to the given one.
+ *
+ * @param next State the command would enter
+ * @return True if the transition is allowed
+ */
+bool Transport::canEnter(TransportState next) const
+{
+    switch (next)
+    {
+        case RECORDING:
+            return state == READY || (state == PAUSED && pausedState == RECORDING);
+        case STOPPED:
+            return state == RECORDING || state == PLAYING || state == PAUSED;
+        case PLAYING:
+            return state == STOPPED || (state == PAUSED && pausedState == PLAYING);
+        case PAUSED:
+            return state == RECORDING || state == PLAYING;
+        default:
+            return true;
+    }
 }
 
 /**
@@ -59,11 +139,13 @@ Transport::Transport()
  */
 bool Transport::record(double delay, double duration)
 {
+    std::lock_guard<std::mutex> lock(commandMutex);
+
     hlDebug() << "Transport received RECORD signal."<< std::endl;
     hlDebug() << "Delay set to: " << delay << std::endl;
     hlDebug() << "Duration set to: " << duration << std::endl;
 
-    if (canRecord)
+    if (canEnter(RECORDING))
     {
         hlDebug() << "Starting record..." << std::endl;
 
@@ -76,13 +158,8 @@ bool Transport::record(double delay, double duration)
             throw ControlException(ae.getErrorCode());
         }
 
-        initRecordClicked = true;
-        canRecord = false;
-        canPlayback = false;
-
         state = RECORDING;
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(HL_TRANSPORT_LOCKOUT_MS));
+        unsaved = true;
         return true;
     }
 
@@ -106,25 +183,29 @@ bool Transport::record()
  */
 bool Transport::stop()
 {
+    std::lock_guard<std::mutex> lock(commandMutex);
+
     hlDebug() << "Transport received STOP signal." << std::endl;
 
-    if ((!canRecord && !canPlayback) || state == PAUSED)
+    if (canEnter(STOPPED))
     {
-        try
+        if (state == PLAYING)
         {
-            recorder->stop();
+            player->stop();
         }
-        catch(const AudioException &ae)
+        else
         {
-            throw ControlException(ae.getErrorCode());
+            try
+            {
+                recorder->stop();
+            }
+            catch(const AudioException &ae)
+            {
+                throw ControlException(ae.getErrorCode());
+            }
         }
 
-        canRecord = false;
-        canPlayback = true;
-
         state = STOPPED;
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(HL_TRANSPORT_LOCKOUT_MS));
         return true;
     }
 
@@ -134,21 +215,29 @@ bool Transport::stop()
 
 /**
  * Playback previously recorded audio.
+ *
+ * @param startFrame Frame of the session to start at, or HL_PLAYBACK_RESUME
+ *                   to continue where playback was paused
+ *
+ * @return Successful start of playback
  */
-bool Transport::play()
+bool Transport::play(uint64_t startFrame)
 {
+    std::lock_guard<std::mutex> lock(commandMutex);
+
     hlDebug() << "Transport received PLAY signal." << std::endl;
 
-    if (canPlayback)
+    if (canEnter(PLAYING))
     {
-        player->start(0);
+        if (startFrame == HL_PLAYBACK_RESUME)
+        {
+            startFrame = (state == PAUSED) ? player->getPosition() : 0;
+        }
 
-        canPlayback = false;
-        canRecord = false;
+        hlDebug() << "Starting playback at frame " << startFrame << std::endl;
+        player->start(startFrame);
 
         state = PLAYING;
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(HL_TRANSPORT_LOCKOUT_MS));
         return true;
     }
 
@@ -156,41 +245,46 @@ bool Transport::play()
     return false;
 }
 
+/**
+ * Overload of play that continues where playback was
+ * paused, or starts at the beginning of the session.
+ *
+ * @return Successful start of playback
+ */
+bool Transport::play()
+{
+    return play(HL_PLAYBACK_RESUME);
+}
+
 /**
  * Enter the paused state for playback or recording.
  */
 bool Transport::pause()
 {
+    std::lock_guard<std::mutex> lock(commandMutex);
+
     hlDebug() << "Transport received PAUSE signal." << std::endl;
 
-    if (state == RECORDING && !canRecord) // Pause record
+    if (canEnter(PAUSED))
     {
-        try
+        if (state == RECORDING) // Pause record
         {
-            recorder->stop();
+            try
+            {
+                recorder->stop();
+            }
+            catch(const AudioException &ae)
+            {
+                throw ControlException(ae.getErrorCode());
+            }
         }
-        catch(const AudioException &ae)
+        else // Pause playback
         {
-            throw ControlException(ae.getErrorCode());
+            player->stop();
         }
 
-        canRecord = true;
-        canPlayback = false;
-
+        pausedState = state;
         state = PAUSED;
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(HL_TRANSPORT_LOCKOUT_MS));
-        return true;
-    }
-    else if (!canPlayback && initRecordClicked) // Pause playback
-    {
-        player->stop();
-
-        canPlayback = true;
-
-        state = PAUSED;
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(HL_TRANSPORT_LOCKOUT_MS));
         return true;
     }
 
@@ -242,39 +336,321 @@ Controller *Transport::getController() const
     return controller;
 }
 
-void Transport::exportFile(std::string targetDirectory)
+/**
+ * Export the captured audio into a single file and
+ * remove it from the list of temp files.
+ *
+ * @param targetDirectory Path of the file to export to
+ * @param progress Optional, called with the fraction of audio exported
+ */
+void Transport::exportFile(std::string targetDirectory, const ProgressCallback &progress)
 {
+    std::lock_guard<std::mutex> lock(commandMutex);
+
     Export exp(targetDirectory);
-    exp.copyData(recorder->getExportPaths());
+    exp.copyData(recorder->getExportPaths(), progress);
 
     recorder->clearExportPaths();
+    unsaved = false;
 }
 
 /**
  * Reset transport states and delete captured audio files from system temp folder
+ *
+ * @param progress Optional, called with the fraction of files deleted
  */
-void Transport::discard()
+void Transport::discard(const ProgressCallback &progress)
 {
-    // Reset states
-    canRecord = true;
-    canPlayback = false;
-    initRecordClicked = false;
+    std::lock_guard<std::mutex> lock(commandMutex);
+
+    // Reset states. A recording must stop writing before its files are deleted.
+    if (state == PLAYING)
+    {
+        player->stop();
+    }
+    else if (state == RECORDING)
+    {
+        try
+        {
+            recorder->stop();
+        }
+        catch(const AudioException &ae)
+        {
+            throw ControlException(ae.getErrorCode());
+        }
+    }
     state = READY;
+    pausedState = READY;
 
     // Delete audio files from system temp folder
-    Export::deleteTempFiles(recorder->getExportPaths());
+    Export::deleteTempFiles(recorder->getExportPaths(), progress);
     recorder->clearExportPaths();
+    unsaved = false;
+}
+
+/**
+ * Run a queued command and pass its outcome to done, if given.
+ * done is called whatever the command throws, and the
+ * exception still reaches the future of the command.
+ *
+ * @param command Command to run on the worker thread
+ * @param done Optional, called on the worker thread once command has run
+ * @return Result of command
+ */
+bool Transport::runReported(const std::function<bool()> &command, const CommandCallback &done)
+{
+    bool success = false;
+    try
+    {
+        success = command();
+    }
+    catch (const ControlException &ce)
+    {
+        if (done)
+        {
+            done(false, ce.getErrorMessage());
+        }
+        throw;
+    }
+    catch (const AudioException &ae)
+    {
+        if (done)
+        {
+            done(false, ControlException(ae.getErrorCode()).getErrorMessage());
+        }
+        throw;
+    }
+    catch (const std::exception &e)
+    {
+        if (done)
+        {
+            done(false, e.what());
+        }
+        throw;
+    }
+    catch (...)
+    {
+        // Whoever waits for the outcome must always get one
+        if (done)
+        {
+            done(false, std::string(qPrintable(tr("Unknown error"))));
+        }
+        throw;
+    }
+
+    if (done)
+    {
+        done(success, "");
+    }
+    return success;
+}
+
+/**
+ * Queue record() for the worker thread.
+ *
+ * @param done Optional, called on the worker thread with the outcome
+ * @return Future for the result of record()
+ */
+std::future<bool> Transport::recordAsync(CommandCallback done)
+{
+    return enqueue<bool>([this, done]() { return runReported([this]() { return record(); }, done); });
+}
+
+/**
+ * Queue stop() for the worker thread.
+ *
+ * @param done Optional, called on the worker thread with the outcome
+ * @return Future for the result of stop()
+ */
+std::future<bool> Transport::stopAsync(CommandCallback done)
+{
+    return enqueue<bool>([this, done]() { return runReported([this]() { return stop(); }, done); });
+}
+
+/**
+ * Queue play() for the worker thread.
+ *
+ * @param done Optional, called on the worker thread with the outcome
+ * @return Future for the result of play()
+ */
+std::future<bool> Transport::playAsync(CommandCallback done)
+{
+    return enqueue<bool>([this, done]() { return runReported([this]() { return play(); }, done); });
+}
+
+/**
+ * Queue pause() for the worker thread.
+ *
+ * @param done Optional, called on the worker thread with the outcome
+ * @return Future for the result of pause()
+ */
+std::future<bool> Transport::pauseAsync(CommandCallback done)
+{
+    return enqueue<bool>([this, done]() { return runReported([this]() { return pause(); }, done); });
+}
+
+/**
+ * Queue discard() for the worker thread.
+ *
+ * @param progress Optional, called on the worker thread with fractions below 1
+ *                 while files are deleted and exactly once with 1 when done
+ * @return Future that is ready once everything was deleted
+ */
+std::future<void> Transport::discardAsync(ProgressCallback progress)
+{
+    return enqueue<void>([this, progress]() {
+        discard(partialProgress(progress));
+        if (progress)
+        {
+            progress(1);
+        }
+    });
+}
+
+/**
+ * Queue exportFile() for the worker thread.
+ *
+ * @param targetDirectory Path of the file to export to
+ * @param progress Optional, called on the worker thread with fractions below 1
+ *                 while exporting and exactly once with 1 when done
+ * @param done Optional, called on the worker thread with the outcome,
+ *             after progress
+ * @return Future that is ready once the file was written
+ */
+std::future<void> Transport::exportFileAsync(std::string targetDirectory, ProgressCallback progress, CommandCallback done)
+{
+    return enqueue<void>([this, targetDirectory, progress, done]() {
+        runReported([this, &targetDirectory, &progress]() {
+            exportFile(targetDirectory, partialProgress(progress));
+            if (progress)
+            {
+                progress(1);
+            }
+            return true;
+        }, done);
+    });
 }
 
 /**
  * Checks if there are files in the export paths which means
- * recording has happened and there are no files left to export
+ * recording has happened and there are no files left to export.
+ * Never waits for a running command, such as an export.
  *
  * @return true is the user has recorded files
  */
-bool Transport::hasExportPaths()
+bool Transport::hasExportPaths() const
+{
+    return unsaved;
+}
+
+/**
+ * Check whether the latest recording stopped capturing because its
+ * temp file could not be written. The Transport stays in RECORDING
+ * until it is stopped, so the error can be shown first.
+ * Never waits for a running command.
+ *
+ * @return True if the latest recording failed to write
+ */
+bool Transport::hasRecordError() const
+{
+    return recorder->hasWriteError();
+}
+
+/**
+ * Get the sessions that an earlier run left behind, for example
+ * because it crashed or was closed without exporting.
+ *
+ * @return Paths of the session journals, oldest first
+ */
+std::vector<std::string> Transport::getRecoverableSessions() const
 {
-    return !recorder->getExportPaths().empty();
+    std::lock_guard<std::mutex> lock(commandMutex);
+    return recoverableSessions;
+}
+
+/**
+ * Recover a session left behind by an earlier run. Temp files that
+ * were never closed are repaired in place without re-encoding, and
+ * the session can then be played back or exported like a recording
+ * that was just stopped.
+ *
+ * Only possible before anything was recorded.
+ *
+ * @param journalPath One of getRecoverableSessions()
+ * @return True if the session had audio that could be recovered
+ */
+bool Transport::recoverSession(const std::string &journalPath)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+
+    hlDebug() << "Transport received RECOVER signal." << std::endl;
+
+    if (state != READY || !recorder->getExportPaths().empty())
+    {
+        hlDebug() << "Invalid state for RECOVER." << std::endl;
+        return false;
+    }
+
+    recoverableSessions.erase(std::remove(recoverableSessions.begin(), recoverableSessions.end(), journalPath), recoverableSessions.end());
+
+    SessionJournal *journal = new SessionJournal(journalPath, true);
+    std::vector<std::string> paths = journal->recover();
+    if (paths.empty())
+    {
+        journal->finish();
+        delete journal;
+        return false;
+    }
+
+    recorder->adoptSession(journal, paths);
+
+    // Same as after stopping a recording
+    state = STOPPED;
+    unsaved = true;
+
+    return true;
+}
+
+/**
+ * Delete a session left behind by an earlier run, with all of its temp files.
+ *
+ * @param journalPath One of getRecoverableSessions()
+ */
+void Transport::discardSession(const std::string &journalPath)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+
+    recoverableSessions.erase(std::remove(recoverableSessions.begin(), recoverableSessions.end(), journalPath), recoverableSessions.end());
+
+    SessionJournal journal(journalPath, true);
+    Export::deleteTempFiles(journal.getFilePaths());
+    journal.finish();
+}
+
+/**
+ * Queue recoverSession() for the worker thread.
+ * Repairing the temp files can take a while.
+ *
+ * @param journalPath One of getRecoverableSessions()
+ * @param done Optional, called on the worker thread with the outcome
+ * @return Future for the result of recoverSession()
+ */
+std::future<bool> Transport::recoverSessionAsync(std::string journalPath, CommandCallback done)
+{
+    return enqueue<bool>([this, journalPath, done]() {
+        return runReported([this, &journalPath]() { return recoverSession(journalPath); }, done);
+    });
+}
+
+/**
+ * Queue discardSession() for the worker thread.
+ *
+ * @param journalPath One of getRecoverableSessions()
+ * @return Future that is ready once the session was deleted
+ */
+std::future<void> Transport::discardSessionAsync(std::string journalPath)
+{
+    return enqueue<void>([this, journalPath]() { discardSession(journalPath); });
 }
 
 /**
@@ -284,6 +660,18 @@ Transport::~Transport()
 {
     hlDebugf("Transport destructor called\n");
 
+    // Let the worker finish whatever is still queued
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        endCommands = true;
+    }
+    queueCond.notify_all();
+
+    if (commandThread.joinable())
+    {
+        commandThread.join();
+    }
+
     if (player)
     {
         delete player;
@@ -2,11 +2,28 @@
 #define HL_EXPORT_H
 
 #include <hlaudio/hlaudio.h>
+#include <functional>
 #include <string>
 #include <vector>
 
+/**
+ * Number of frames decoded or encoded at once during export.
+ */
+#define HL_EXPORT_BLOCK_FRAMES 32768
+
+/**
+ * Number of decoded blocks a temp file may have waiting for the encoder.
+ * Bounds export memory to roughly decode threads * this * block size.
+ */
+#define HL_EXPORT_QUEUE_BLOCKS 4
+
 namespace hula
 {
+    /**
+     * Receives how much of a long operation is done, from 0 to 1.
+     */
+    typedef std::function<void(float)> ProgressCallback;
+
     /**
      * A class used to copy data from temp files and export files.
      */
@@ -17,12 +34,13 @@ namespace hula
 
         public:
             Export(std::string targetFile);
-            void copyData(std::vector<std::string> dirs);
+            void copyData(std::vector<std::string> dirs, const ProgressCallback &progress = nullptr);
 
             std::string getFileExtension(std::string file_path);
 
             static std::string getTempPath();
-            static void deleteTempFiles(std::vector<std::string> dirs);
+            static int getSndfileSubtype(SampleFormat format, int majorFormat);
+            static void deleteTempFiles(std::vector<std::string> dirs, const ProgressCallback &progress = nullptr);
 
             ~Export();
     };
@@ -0,0 +1,76 @@
+#ifndef HL_FLAC_JOINER_H
+#define HL_FLAC_JOINER_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+ * Number of bytes read from a FLAC file at once while joining.
+ */
+#define HL_FLAC_READ_CHUNK (1 << 20)
+
+namespace hula
+{
+    /**
+     * Joins FLAC files into one FLAC file without decoding them.
+     *
+     * The encoded frames of every input are copied as they are.
+     * Only the frame headers are rewritten so that they carry the
+     * position of the frame in the joined stream, and a new
+     * STREAMINFO block describes the result.
+     *
+     * Inputs may end in a short frame, which a fixed-blocksize
+     * stream only allows at the very end. The output therefore
+     * always uses the variable-blocksize strategy. A frame under
+     * 16 samples is not allowed anywhere but at the end, so inputs
+     * other than the last must not end in one.
+     *
+     * Files whose encoder never closed them can be repaired in
+     * place with finalize(), which also works without decoding.
+     */
+    class FlacJoiner {
+
+        private:
+            /**
+             * Audio properties shared by every input.
+             */
+            struct StreamInfo
+            {
+                uint32_t sampleRate = 0;
+                uint32_t channels = 0;
+                uint32_t bitsPerSample = 0;
+                uint32_t maxBlockSize = 0;
+            };
+
+            /**
+             * Running totals for the output STREAMINFO block.
+             */
+            struct StreamTotals
+            {
+                uint64_t samples = 0;
+                uint32_t minBlockSize = UINT32_MAX;
+                uint32_t maxBlockSize = 0;
+                uint32_t lastBlockSize = 0;
+                uint32_t minFrameSize = UINT32_MAX;
+                uint32_t maxFrameSize = 0;
+            };
+
+            static bool readStreamInfo(std::istream &in, StreamInfo &info);
+            static bool copyFrames(std::istream &in, std::ostream &out, StreamTotals &totals);
+
+        public:
+            static bool join(const std::vector<std::string> &inputs, const std::string &output);
+            static bool scanFrames(const std::string &path, uint64_t &bytes, uint64_t &samples);
+            static int64_t finalize(const std::string &path, uint64_t scanFrom, uint64_t scanSamples);
+
+            static size_t parseFrameHeader(const uint8_t *data, size_t size, uint32_t *blockSize);
+            static size_t writeFrameHeader(const uint8_t *header, size_t headerSize, uint64_t sampleNumber, uint8_t *out);
+
+            static uint8_t crc8(const uint8_t *data, size_t size);
+            static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t size);
+    };
+}
+
+#endif // HL_FLAC_JOINER_H
@@ -29,6 +29,14 @@
 // Export error messages
 #define HL_EXPORT_OPEN_FILE_CODE -18
 #define HL_EXPORT_OPEN_FILE_MSG  "Could not open file %s!"
+#define HL_EXPORT_WRITE_CODE -20
+#define HL_EXPORT_WRITE_MSG  "Could not write the exported file!"
+
+// Record error messages
+#define HL_SPOOL_OPEN_CODE -19
+#define HL_SPOOL_OPEN_MSG  "Could not create the recording spool file!"
+#define HL_RECORD_WRITE_CODE -21
+#define HL_RECORD_WRITE_MSG  "Could not write the recording to the temp folder! Recording was stopped."
 
 namespace hula
 {
@@ -139,15 +147,36 @@ namespace hula
             case HL_LINUX_OPEN_DEVICE_CODE:
                 return ControlException::tr(HL_LINUX_OPEN_DEVICE_MSG);
                 break;
+            case HL_LINUX_CONNECT_CODE:
+                return ControlException::tr(HL_LINUX_CONNECT_MSG);
+                break;
+            case HL_FILE_AUDIO_OPEN_CODE:
+                return ControlException::tr(HL_FILE_AUDIO_OPEN_MSG);
+                break;
+            case HL_FILE_AUDIO_FORMAT_CODE:
+                return ControlException::tr(HL_FILE_AUDIO_FORMAT_MSG);
+                break;
             case HL_RB_ALLOC_BUFFER_CODE:
                 return ControlException::tr(HL_RB_ALLOC_BUFFER_MSG);
                 break;
             case HL_RB_INIT_BUFFER_CODE:
                 return ControlException::tr(HL_RB_INIT_BUFFER_MSG);
                 break;
+            case HL_FFT_SIZE_CODE:
+                return ControlException::tr(HL_FFT_SIZE_MSG);
+                break;
             case HL_EXPORT_OPEN_FILE_CODE:
                 return ControlException::tr(HL_EXPORT_OPEN_FILE_MSG);
                 break;
+            case HL_EXPORT_WRITE_CODE:
+                return ControlException::tr(HL_EXPORT_WRITE_MSG);
+                break;
+            case HL_SPOOL_OPEN_CODE:
+                return ControlException::tr(HL_SPOOL_OPEN_MSG);
+                break;
+            case HL_RECORD_WRITE_CODE:
+                return ControlException::tr(HL_RECORD_WRITE_MSG);
+                break;
             default:
                 return QString(ControlException::tr("Unknown error code: %1").arg(code));
                 break;
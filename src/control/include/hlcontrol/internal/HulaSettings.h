@@ -29,6 +29,7 @@ namespace hula
             static HulaSettings *hlcontrol_instance;
 
             Encoding outputFileEncoding;
+            bool recordSpooling;
 
         protected:
             /**
@@ -45,6 +46,9 @@ namespace hula
             void setOutputFileEncoding(Encoding);
             Encoding getOutputFileEncoding();
 
+            void setRecordSpooling(bool);
+            bool getRecordSpooling();
+
             QTranslator *getTranslator();
             bool loadLanguage(QCoreApplication *app, const std::string &id);
 
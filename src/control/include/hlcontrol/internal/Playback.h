@@ -3,6 +3,13 @@
 
 #include <hlaudio/hlaudio.h>
 #include "Record.h"
+#include "SegmentIndex.h"
+
+/**
+ * Longest time in milliseconds the playback feeder sleeps
+ * before checking whether it was stopped.
+ */
+#define HL_PLAYBACK_WAIT_MS 100
 
 namespace hula
 {
@@ -19,14 +26,34 @@ namespace hula
             std::thread playThread;
             std::atomic<bool> endPlay;
 
+            /**
+             * Index of the segments last played back.
+             * Rebuilt whenever Record has added a segment.
+             */
+            SegmentIndex index;
+
+            /**
+             * Frame of the session at which the next playback starts.
+             */
+            uint64_t startFrame;
+
+            /**
+             * Frame of the session the device had reached when playback
+             * last ended. 0 if it played to the end of the recording.
+             */
+            std::atomic<uint64_t> position;
+
         public:
             Playback(Controller *controller, Record *record);
             ~Playback();
 
             void player();
+            bool feed(uint64_t *samplesFed);
 
-            void start(uint32_t initTime);
+            void start(uint64_t startFrame);
             void stop();
+
+            uint64_t getPosition() const;
     };
 }
 
@@ -5,34 +5,127 @@
 
 #include <hlaudio/hlaudio.h>
 
+#include "SessionJournal.h"
+#include "SpoolFile.h"
+
+/**
+ * Length in seconds of the reader attached to the capture buffer.
+ */
+#define HL_RECORD_RB_DURATION 0.5
+
+/**
+ * Name of the capture reader in PipelineStatsSnapshot.
+ */
+#define HL_RECORD_RB_NAME "record"
+
+/**
+ * Amount of audio in milliseconds moved or encoded at once.
+ * The recorder sleeps until this much has been captured.
+ */
+#define HL_RECORD_BLOCK_MS 40
+
+/**
+ * Length in seconds of the storage between the recorder and the encoder
+ * that is always allocated.
+ */
+#define HL_RECORD_STAGING_DURATION 2
+
+/**
+ * Length in seconds that the staging storage may grow to while the
+ * encoder is stalled. Audio is only lost once this much is waiting.
+ */
+#define HL_RECORD_STAGING_MAX_DURATION 300
+
+/**
+ * Length in seconds of each block that the staging storage grows by.
+ */
+#define HL_RECORD_STAGING_BLOCK_DURATION 0.5
+
 namespace hula
 {
     /**
      * Class for Recording audio and abstracting OS specific stuff
+     *
+     * Two threads are involved. The recorder thread moves captured
+     * audio into an elastic staging buffer in large blocks, and the
+     * encoder thread writes it to disk. A slow encoder therefore
+     * never holds up the capture reader, and the staging buffer
+     * grows to hold whatever the encoder has not caught up with.
+     *
+     * With spooling enabled, the staging buffer is replaced by a
+     * memory mapped SpoolFile in the temp directory.
      */
     class Record {
 
         private:
             Controller *controller;
-            HulaRingBuffer *rb;
+            HulaBroadcastReader *rb;
+
+            /**
+             * Staging storage filled by the recorder and drained by the encoder.
+             */
+            HulaElasticBuffer *stagingBuffer;
+
+            /**
+             * Replaces the staging buffer while HulaSettings::getRecordSpooling() is set.
+             * nullptr otherwise.
+             */
+            SpoolFile *spool;
+
+            /**
+             * Losses of spools that were already deleted.
+             */
+            uint64_t spoolOverruns;
+            uint64_t spoolDroppedSamples;
 
             std::thread recordThread;
             std::atomic<bool> endRecord;
 
+            std::thread encodeThread;
+            std::atomic<bool> endEncode;
+
+            /**
+             * Set by the encoder if the temp file could not be created or written.
+             * Capture stops then, and whatever was written is kept.
+             */
+            std::atomic<bool> writeFailed;
+
             std::vector<std::string> exportPaths;
 
+            /**
+             * Journal of the temp files in exportPaths, so that they
+             * can be recovered if the process dies. Created by the
+             * first start() after the paths were cleared.
+             */
+            SessionJournal *journal;
+
+            ring_buffer_size_t getBlockSize() const;
+            void drainCapture(ring_buffer_size_t blockSize);
+            void failWrite();
+
+            bool waitForStaged(ring_buffer_size_t minSamples, uint32_t timeoutMs);
+            ring_buffer_size_t readStaged(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2);
+            uint64_t getStagedAvailable() const;
+
         public:
             Record(Controller *control);
             ~Record();
 
             void recorder();
+            void encoder();
 
             std::vector<std::string> getExportPaths();
             void clearExportPaths();
+            void adoptSession(SessionJournal *journal, const std::vector<std::string> &paths);
+
+            uint64_t getOverrunCount() const;
+            uint64_t getDroppedSamples() const;
+
+            bool hasWriteError() const;
 
             void start();
             void stop();
     };
 }
 
-#endif // END HL_RECORD_H
\ No newline at end of file
+#endif // END HL_RECORD_H
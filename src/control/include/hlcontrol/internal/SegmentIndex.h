@@ -0,0 +1,62 @@
+#ifndef HL_SEGMENT_INDEX_H
+#define HL_SEGMENT_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hula
+{
+    /**
+     * Location of a frame within the segments of a recording.
+     */
+    struct SegmentPosition
+    {
+        /**
+         * Index of the temp file that holds the frame.
+         */
+        size_t segment = 0;
+
+        /**
+         * Frame within that file.
+         */
+        uint64_t frame = 0;
+    };
+
+    /**
+     * Maps positions in a recording session onto the temp files it was
+     * recorded to.
+     *
+     * The length of every segment is read from its header once, so
+     * locating a frame is a binary search over the cumulative offsets.
+     * The caller can then sf_seek() straight to it, and libFLAC
+     * bisects the file instead of decoding it from the start.
+     *
+     * Segments that can't be opened are kept with a length of zero
+     * so that segment indices still match the paths.
+     */
+    class SegmentIndex {
+
+        private:
+            std::vector<std::string> paths;
+
+            /**
+             * First frame of every segment, followed by the total length.
+             */
+            std::vector<uint64_t> offsets;
+
+        public:
+            SegmentIndex();
+            SegmentIndex(const std::vector<std::string> &paths);
+
+            const std::vector<std::string> &getPaths() const;
+            size_t getSegmentCount() const;
+            uint64_t getTotalFrames() const;
+            uint64_t getSegmentStart(size_t segment) const;
+            uint64_t getSegmentFrames(size_t segment) const;
+
+            bool locate(uint64_t frame, SegmentPosition *position) const;
+    };
+}
+
+#endif // END HL_SEGMENT_INDEX_H
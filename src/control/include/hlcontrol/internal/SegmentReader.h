@@ -0,0 +1,80 @@
+#ifndef HL_SEGMENT_READER_H
+#define HL_SEGMENT_READER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sndfile.h>
+
+#include <hlaudio/hlaudio.h>
+
+#include "SegmentIndex.h"
+
+/**
+ * Length in seconds of the audio decoded ahead of time
+ * from the start of the next segment.
+ */
+#define HL_SEGMENT_PREFETCH_DURATION 1
+
+namespace hula
+{
+    /**
+     * Reads the segments of a recording as one continuous stream.
+     *
+     * While a segment is being read, a background thread opens the
+     * next one and decodes its first HL_SEGMENT_PREFETCH_DURATION
+     * seconds. Crossing into the next segment therefore only swaps
+     * in a decoder that is already primed, and a read can span the
+     * boundary without a gap.
+     *
+     * Segments that can't be opened are skipped.
+     */
+    class SegmentReader {
+
+        private:
+            std::vector<std::string> paths;
+
+            /**
+             * Segment being read and the samples decoded ahead from it.
+             * Only touched by the thread calling read().
+             */
+            SNDFILE *current;
+            size_t currentIndex;
+            std::vector<float> currentHead;
+            size_t headOffset;
+
+            /**
+             * Segment prepared by the prefetch thread. Guarded by mutex.
+             * nextFile is nullptr once nextIndex has run past the last segment.
+             */
+            SNDFILE *nextFile;
+            size_t nextIndex;
+            std::vector<float> nextHead;
+            bool nextReady;
+            bool prefetchRequested;
+            bool endPrefetch;
+
+            std::mutex mutex;
+            std::condition_variable cond;
+            std::thread prefetchThread;
+
+            void prefetcher();
+            void requestPrefetch(size_t index);
+            bool advance();
+
+        public:
+            SegmentReader(const std::vector<std::string> &paths, const SegmentPosition &start);
+            ~SegmentReader();
+
+            SegmentReader(const SegmentReader &) = delete;
+            SegmentReader &operator=(const SegmentReader &) = delete;
+
+            ring_buffer_size_t read(float *samples, ring_buffer_size_t count);
+            size_t getSegment() const;
+    };
+}
+
+#endif // END HL_SEGMENT_READER_H
@@ -0,0 +1,122 @@
+#ifndef HL_SESSION_JOURNAL_H
+#define HL_SESSION_JOURNAL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * File name pattern of session journals in the temp directory.
+ */
+#define HL_JOURNAL_PREFIX "hulaloop_"
+#define HL_JOURNAL_EXTENSION ".session"
+
+/**
+ * First line of every session journal.
+ */
+#define HL_JOURNAL_HEADER "hulaloop-session 1"
+
+/**
+ * Time in milliseconds between checkpoints of the segment being recorded.
+ * At most this much audio has to be scanned when recovering a segment.
+ */
+#define HL_JOURNAL_CHECKPOINT_MS 5000
+
+namespace hula
+{
+    /**
+     * State of one temp file of a session, as far as the journal knows.
+     */
+    struct JournalSegment
+    {
+        std::string path;
+
+        /**
+         * End of the last complete frame at the last checkpoint and the
+         * number of samples per channel before it. Everything before it
+         * was on disk at that time.
+         */
+        uint64_t checkpointBytes = 0;
+        uint64_t checkpointSamples = 0;
+
+        /**
+         * Spool file the segment was encoded from, if spooling was on.
+         * Whatever the encoder had not reached yet is still in there.
+         */
+        std::string spoolPath;
+
+        /**
+         * FLAC file holding the rest of the spool after a recovery.
+         * Played right after the segment.
+         */
+        std::string tailPath;
+
+        /**
+         * True once the encoder closed the file properly.
+         */
+        bool closed = false;
+    };
+
+    /**
+     * Append-only record of the temp files that make up a recording session.
+     *
+     * Record writes a line whenever it starts a segment, at every
+     * checkpoint and when it closes a segment. Each line is flushed to
+     * disk before the call returns, so if the process dies the journal
+     * still lists every segment and how far each was known to be intact.
+     *
+     * A journal is deleted once its session is exported or discarded.
+     * Any journal found in the temp directory on startup therefore
+     * belongs to a session that can be recovered.
+     *
+     * Format, one record per line:
+     * @code
+     * hulaloop-session 1
+     * segment <index> <path>
+     * spool <index> <path>
+     * checkpoint <index> <bytes> <samples>
+     * tail <index> <path>
+     * close <index>
+     * @endcode
+     */
+    class SessionJournal {
+
+        private:
+            std::string path;
+            FILE *file;
+
+            std::vector<JournalSegment> segments;
+            std::mutex mutex;
+
+            void append(const std::string &line);
+            void load();
+
+            void setTail(size_t segment, const std::string &tailPath);
+            void recoverSpool(size_t segment, uint64_t encodedFrames);
+
+        public:
+            SessionJournal(const std::string &path, bool resume = false);
+            ~SessionJournal();
+
+            SessionJournal(const SessionJournal &) = delete;
+            SessionJournal &operator=(const SessionJournal &) = delete;
+
+            static std::vector<std::string> findSessions(const std::string &directory);
+
+            std::string getPath() const;
+            std::vector<JournalSegment> getSegments();
+            std::vector<std::string> getFilePaths();
+
+            size_t addSegment(const std::string &segmentPath);
+            void setSpool(size_t segment, const std::string &spoolPath);
+            void checkpoint(size_t segment, uint64_t bytes, uint64_t samples);
+            void closeSegment(size_t segment);
+
+            std::vector<std::string> recover();
+            void finish();
+    };
+}
+
+#endif // END HL_SESSION_JOURNAL_H
@@ -0,0 +1,141 @@
+#ifndef HL_SPOOL_FILE_H
+#define HL_SPOOL_FILE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <hlaudio/hlaudio.h>
+
+/**
+ * Size in bytes of the header at the start of a spool file.
+ * Also the alignment of every mapped chunk, which must be a
+ * multiple of the mapping granularity on every platform.
+ */
+#define HL_SPOOL_HEADER_BYTES 65536
+
+/**
+ * Length in seconds of audio held by each mapped chunk of a spool file.
+ */
+#define HL_SPOOL_CHUNK_DURATION 10
+
+/**
+ * Identifies a spool file. Stored at the start of the header.
+ */
+#define HL_SPOOL_MAGIC "HLSPOOL"
+#define HL_SPOOL_VERSION 1
+
+namespace hula
+{
+    /**
+     * Header at the start of every spool file.
+     * Everything after HL_SPOOL_HEADER_BYTES is interleaved 32-bit float samples.
+     */
+    struct SpoolHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sampleRate;
+        uint32_t channels;
+        uint32_t reserved;
+
+        /**
+         * Number of samples that are completely written.
+         * Everything past this is garbage left by a crash.
+         */
+        std::atomic<uint64_t> committedSamples;
+    };
+
+    /**
+     * Append-only file of raw captured samples that is memory mapped,
+     * so that writing a block is a copy into the page cache.
+     *
+     * Disk space is reserved and mapped one chunk ahead of the writer,
+     * so a full disk shows up as dropped samples rather than a crash.
+     * After every write the number of committed samples is updated in
+     * the header, so a spool that outlives a crash can still be read back.
+     *
+     * One thread writes and one thread reads, like a ring buffer. The
+     * reader unmaps chunks as soon as it has moved past them.
+     */
+    class SpoolFile {
+
+        private:
+            std::string path;
+
+#ifdef _WIN32
+            void *file;
+#else
+            int file;
+#endif
+
+            SpoolHeader *header;
+
+            /**
+             * Number of samples in each chunk and the
+             * number of chunks the file has room for.
+             */
+            uint64_t chunkSamples;
+            uint64_t allocatedChunks;
+
+            /**
+             * Mapped chunks by index. nullptr once the reader is done with one.
+             * Guarded by chunkMutex, like the number of chunks released so far.
+             */
+            std::vector<float *> chunks;
+            uint64_t releasedChunks;
+            std::mutex chunkMutex;
+
+            /**
+             * Owned by the writer.
+             */
+            uint64_t writeIndex;
+            std::atomic<uint64_t> overrunCount;
+            std::atomic<uint64_t> droppedSamples;
+
+            /**
+             * Owned by the reader.
+             */
+            std::atomic<uint64_t> readIndex;
+
+            std::mutex waitMutex;
+            std::condition_variable waitCond;
+
+            bool growFile(uint64_t bytes);
+            void *mapRegion(uint64_t offset, size_t bytes);
+            void unmapRegion(void *region, size_t bytes);
+
+            float *getChunk(uint64_t index);
+            void releaseChunksBefore(uint64_t index);
+            void close();
+
+        public:
+            SpoolFile(const std::string &path);
+            ~SpoolFile();
+
+            SpoolFile(const SpoolFile &) = delete;
+            SpoolFile &operator=(const SpoolFile &) = delete;
+
+            std::string getPath() const;
+
+            ring_buffer_size_t write(const void *data, SampleFormat format, ring_buffer_size_t samples);
+            void wakeReaders();
+
+            bool waitForData(ring_buffer_size_t minSamples, uint32_t timeoutMs);
+            ring_buffer_size_t directRead(ring_buffer_size_t maxSamples, void **dataPtr1, ring_buffer_size_t *size1, void **dataPtr2, ring_buffer_size_t *size2);
+
+            uint64_t getCommittedSamples() const;
+            uint64_t getReadAvailable() const;
+            uint64_t getOverrunCount() const;
+            uint64_t getDroppedSamples() const;
+
+            void remove();
+
+            static int64_t encodeTail(const std::string &spoolPath, uint64_t skipFrames, const std::string &flacPath);
+    };
+}
+
+#endif // END HL_SPOOL_FILE_H
@@ -2,15 +2,30 @@
 #define HL_TRANSPORT_H
 
 #include <hlaudio/hlaudio.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <QCoreApplication>
 
+#include "Export.h"
 #include "Record.h"
 #include "Playback.h"
 
 #define HL_INFINITE_RECORD -1
-#define HL_TRANSPORT_LOCKOUT_MS 200
+
+/**
+ * Start frame that continues playback where it was paused,
+ * or starts at the beginning of the session otherwise.
+ */
+#define HL_PLAYBACK_RESUME UINT64_MAX
 
 namespace hula
 {
@@ -26,22 +41,102 @@ namespace hula
         PAUSED
     };
 
+    /**
+     * Receives the outcome of a queued command on the worker thread.
+     *
+     * @param success Result of the command, false if it threw
+     * @param error Message of the exception it threw, empty otherwise
+     */
+    typedef std::function<void(bool success, const std::string &error)> CommandCallback;
+
     /**
      * @ingroup public_api
      *
      * Extra class for managing the state of the application and all audio related processes.
+     *
+     * Each command is a transition of an explicit state machine:
+     * @code
+     * READY     -> RECORDING
+     * RECORDING -> PAUSED | STOPPED
+     * STOPPED   -> PLAYING
+     * PLAYING   -> PAUSED | STOPPED
+     * PAUSED    -> STOPPED | whichever of RECORDING/PLAYING was paused
+     * any       -> READY (discard)
+     * @endcode
+     * A command returns once the backend has confirmed the new state,
+     * so commands can follow each other immediately.
+     *
+     * Every command also has an asynchronous variant that is queued for a
+     * worker thread and returns a future straight away, so a UI thread never
+     * blocks on disk or codec work. Queued commands run in order and never
+     * overlap with each other or with the synchronous calls.
      */
     class Transport {
 
             Q_DECLARE_TR_FUNCTIONS(Transport)
 
         private:
-            TransportState state;
-            bool canRecord;
-            bool canPlayback;
-            bool initRecordClicked;
+            std::atomic<TransportState> state;
+
+            /**
+             * RECORDING or PLAYING, whichever was last paused.
+             * Decides what PAUSED can resume to.
+             */
+            TransportState pausedState;
+
+            bool canEnter(TransportState next) const;
+
+            /**
+             * Journals of sessions left behind by an earlier run.
+             */
+            std::vector<std::string> recoverableSessions;
+
+            /**
+             * True while there is audio that was neither exported nor discarded.
+             * Updated by the commands, so it can be read while one is running.
+             */
+            std::atomic<bool> unsaved;
+
+            /**
+             * Held for the whole of every command.
+             */
+            mutable std::mutex commandMutex;
+
+            /**
+             * Commands waiting for the worker thread.
+             */
+            std::deque<std::function<void()>> commands;
+            std::mutex queueMutex;
+            std::condition_variable queueCond;
+            bool endCommands;
+            std::thread commandThread;
+
+            void commandWorker();
+
+            /**
+             * Queue a command for the worker thread.
+             *
+             * @param command Function to run on the worker
+             * @return Future for the result of command, or the exception it threw
+             */
+            template <typename T>
+            std::future<T> enqueue(std::function<T()> command)
+            {
+                std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(command);
+                std::future<T> result = task->get_future();
+
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    commands.push_back([task]() { (*task)(); });
+                }
+                queueCond.notify_one();
+
+                return result;
+            }
 
         protected:
+            bool runReported(const std::function<bool()> &command, const CommandCallback &done);
+
             /**
              * Instance of the Recorder class.
              */
@@ -65,15 +160,31 @@ namespace hula
             bool record(double delay, double duration);
             bool record();
             bool stop();
+            bool play(uint64_t startFrame);
             bool play();
             bool pause();
-            void discard();
+            void discard(const ProgressCallback &progress = nullptr);
+
+            std::future<bool> recordAsync(CommandCallback done = nullptr);
+            std::future<bool> stopAsync(CommandCallback done = nullptr);
+            std::future<bool> playAsync(CommandCallback done = nullptr);
+            std::future<bool> pauseAsync(CommandCallback done = nullptr);
+            std::future<void> discardAsync(ProgressCallback progress = nullptr);
+            std::future<void> exportFileAsync(std::string targetDirectory, ProgressCallback progress = nullptr,
+                                              CommandCallback done = nullptr);
 
             Controller *getController() const;
 
-            void exportFile(std::string targetDirectory);
+            void exportFile(std::string targetDirectory, const ProgressCallback &progress = nullptr);
+
+            bool hasExportPaths() const;
+            bool hasRecordError() const;
 
-            bool hasExportPaths();
+            std::vector<std::string> getRecoverableSessions() const;
+            bool recoverSession(const std::string &journalPath);
+            void discardSession(const std::string &journalPath);
+            std::future<bool> recoverSessionAsync(std::string journalPath, CommandCallback done = nullptr);
+            std::future<void> discardSessionAsync(std::string journalPath);
 
             TransportState getState() const;
             std::string stateToStr(const TransportState state) const;
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <hlaudio/hlaudio.h>
+
+#include <cmath>
+#include <random>
+
+using namespace hula;
+
+/**
+ * Reference DFT of real input, computed in double.
+ */
+void referenceDft(const std::vector<float> &input, std::vector<double> &real, std::vector<double> &imag)
+{
+    size_t n = input.size();
+    real.assign(n / 2 + 1, 0);
+    imag.assign(n / 2 + 1, 0);
+    for (size_t k = 0; k <= n / 2; k++)
+    {
+        for (size_t t = 0; t < n; t++)
+        {
+            double angle = 2 * M_PI * ((k * t) % n) / n;
+            real[k] += input[t] * std::cos(angle);
+            imag[k] -= input[t] * std::sin(angle);
+        }
+    }
+}
+
+TEST(TestFftPlan, matchesReference)
+{
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (size_t size = 4; size <= 2048; size *= 2)
+    {
+        FftPlan plan(size);
+        ASSERT_EQ(size, plan.getSize());
+        ASSERT_EQ(size / 2 + 1, plan.getBinCount());
+
+        std::vector<float> input(size);
+        for (auto &sample : input)
+        {
+            sample = dist(gen);
+        }
+
+        std::vector<double> expectedRe, expectedIm;
+        referenceDft(input, expectedRe, expectedIm);
+
+        // Run twice to make sure no state leaks between transforms
+        std::vector<float> real(plan.getBinCount()), imag(plan.getBinCount());
+        for (int run = 0; run < 2; run++)
+        {
+            plan.transform(input.data(), real.data(), imag.data());
+
+            double tolerance = 1e-4 * size;
+            for (size_t k = 0; k < plan.getBinCount(); k++)
+            {
+                ASSERT_NEAR(expectedRe[k], real[k], tolerance) << "size " << size << " bin " << k;
+                ASSERT_NEAR(expectedIm[k], imag[k], tolerance) << "size " << size << " bin " << k;
+            }
+        }
+    }
+}
+
+TEST(TestFftPlan, sineMagnitude)
+{
+    size_t size = 512;
+    size_t bin = 37;
+    FftPlan plan(size);
+
+    std::vector<float> input(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        input[i] = (float)std::sin(2 * M_PI * bin * i / size);
+    }
+
+    std::vector<float> magnitudes(plan.getBinCount());
+    plan.getMagnitudes(input.data(), magnitudes.data());
+
+    for (size_t k = 0; k < plan.getBinCount(); k++)
+    {
+        ASSERT_NEAR((k == bin) ? size / 2.0 : 0.0, magnitudes[k], 1e-2);
+    }
+}
+
+TEST(TestFftPlan, invalidSize)
+{
+    ASSERT_THROW(FftPlan(0), AudioException);
+    ASSERT_THROW(FftPlan(2), AudioException);
+    ASSERT_THROW(FftPlan(100), AudioException);
+}
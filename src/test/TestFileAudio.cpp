@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include <hlaudio/hlaudio.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+using namespace hula;
+
+#define TEST_WAV_PATH "test/test.wav"
+#define TEST_NUM_SAMPLES 4096
+#define TEST_WAV_SAMPLES 16384 // test.wav starts with a bit of silence
+
+/**
+ * Keeps the first maxSamples samples it is handed
+ * and counts everything after that.
+ */
+class CollectingCallback : public ICallback {
+    public:
+        std::vector<SAMPLE> samples;
+        std::atomic<uint64_t> received;
+        size_t maxSamples;
+
+        CollectingCallback(size_t maxSamples)
+        {
+            this->maxSamples = maxSamples;
+            this->samples.reserve(maxSamples);
+            this->received.store(0);
+        }
+
+        void handleData(const SAMPLE *data, ring_buffer_size_t sampleCount)
+        {
+            for (ring_buffer_size_t i = 0; i < sampleCount && samples.size() < maxSamples; i++)
+            {
+                samples.push_back(data[i]);
+            }
+            received.fetch_add(sampleCount);
+        }
+};
+
+class TestFileAudio : public ::testing::Test {
+    public:
+        FileAudio *audio;
+        Controller *controller;
+
+        virtual void SetUp()
+        {
+            audio = nullptr;
+            controller = nullptr;
+        }
+
+        virtual void TearDown()
+        {
+            delete controller;
+        }
+
+        void create(const std::string &path, double speed)
+        {
+            audio = new FileAudio(path, speed);
+            controller = new Controller(audio);
+        }
+
+        /**
+         * Run capture until the callback has received count samples.
+         */
+        void captureUntil(CollectingCallback &cb, uint64_t count)
+        {
+            controller->addCallback(&cb);
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (cb.received.load() < count && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+
+            controller->removeCallback(&cb);
+        }
+};
+
+/**
+ * Offers one loopback input and one playback output.
+ *
+ * EXPECTED:
+ *      Each type filter returns only its device.
+ */
+TEST_F(TestFileAudio, devices)
+{
+    create("", 0);
+
+    std::vector<Device *> devices = controller->getDevices((DeviceType)(DeviceType::LOOPBACK | DeviceType::PLAYBACK));
+    ASSERT_EQ(2, devices.size());
+    Device::deleteDevices(devices);
+
+    devices = controller->getDevices(DeviceType::PLAYBACK);
+    ASSERT_EQ(1, devices.size());
+    EXPECT_EQ(HL_FILE_AUDIO_OUTPUT_NAME, devices[0]->getName());
+    Device::deleteDevices(devices);
+
+    devices = controller->getDevices(DeviceType::RECORD);
+    EXPECT_EQ(0, devices.size());
+    Device::deleteDevices(devices);
+}
+
+/**
+ * Capture the generated tone as fast as possible.
+ *
+ * EXPECTED:
+ *      Every channel carries the same sine, starting at phase 0.
+ *      Capture runs well ahead of real time.
+ */
+TEST_F(TestFileAudio, tone_is_deterministic)
+{
+    create("", 0);
+    double sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+    // Two seconds worth of audio
+    uint64_t target = (uint64_t)(2 * sampleRate * NUM_CHANNELS);
+
+    CollectingCallback cb(TEST_NUM_SAMPLES);
+    auto start = std::chrono::steady_clock::now();
+    captureUntil(cb, target);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ASSERT_GE(cb.received.load(), target);
+    EXPECT_LT(elapsed, 1.0);
+    EXPECT_EQ(cb.received.load(), audio->getCapturedSampleCount());
+
+    ASSERT_EQ(TEST_NUM_SAMPLES, cb.samples.size());
+    for (size_t i = 0; i < cb.samples.size(); i++)
+    {
+        size_t frame = i / NUM_CHANNELS;
+        double expected = HL_FILE_AUDIO_TONE_AMPLITUDE * std::sin(2 * M_PI * HL_FILE_AUDIO_TONE_FREQ * frame / sampleRate);
+        ASSERT_NEAR(expected, cb.samples[i], 1e-5) << "sample " << i;
+    }
+}
+
+/**
+ * Capture a mono WAV file.
+ *
+ * EXPECTED:
+ *      The file is spread across every channel.
+ *      The same file read twice gives the same samples.
+ */
+TEST_F(TestFileAudio, wav_is_deterministic)
+{
+    create(TEST_WAV_PATH, 0);
+    CollectingCallback first(TEST_WAV_SAMPLES);
+    captureUntil(first, TEST_WAV_SAMPLES);
+    delete controller;
+
+    create(TEST_WAV_PATH, 0);
+    CollectingCallback second(TEST_WAV_SAMPLES);
+    captureUntil(second, TEST_WAV_SAMPLES);
+
+    ASSERT_EQ(TEST_WAV_SAMPLES, first.samples.size());
+    ASSERT_EQ(first.samples, second.samples);
+
+    bool silent = true;
+    for (size_t i = 0; i < first.samples.size(); i += NUM_CHANNELS)
+    {
+        for (int c = 1; c < NUM_CHANNELS; c++)
+        {
+            ASSERT_EQ(first.samples[i], first.samples[i + c]);
+        }
+        silent = silent && first.samples[i] == 0;
+    }
+    EXPECT_FALSE(silent);
+}
+
+/**
+ * Files that can't be used are reported.
+ *
+ * EXPECTED:
+ *      AudioException is thrown.
+ */
+TEST_F(TestFileAudio, invalid_file_throws)
+{
+    EXPECT_THROW(FileAudio("does/not/exist.wav"), AudioException);
+}
+
+/**
+ * Run capture at real time.
+ *
+ * EXPECTED:
+ *      Roughly as many samples as the elapsed time calls for.
+ */
+TEST_F(TestFileAudio, real_time_pacing)
+{
+    create("", 1.0);
+    double sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+    CollectingCallback cb(0);
+    controller->addCallback(&cb);
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint64_t received = cb.received.load();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    controller->removeCallback(&cb);
+
+    double expected = elapsed * sampleRate * NUM_CHANNELS;
+    EXPECT_LT(received, expected * 1.5);
+    EXPECT_GT(received, expected * 0.5);
+}
+
+/**
+ * Play into the counting sink.
+ *
+ * EXPECTED:
+ *      Everything written to the playback buffer is consumed and counted.
+ */
+TEST_F(TestFileAudio, playback_sink_counts)
+{
+    create("", 0);
+
+    std::vector<SAMPLE> block(TEST_NUM_SAMPLES, 0.25f);
+    controller->startPlayback();
+    ASSERT_EQ(TEST_NUM_SAMPLES, controller->playbackCopyToBuffers(block.data(), block.size()));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (audio->getPlayedSampleCount() < TEST_NUM_SAMPLES && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    controller->endPlayback();
+
+    EXPECT_EQ(TEST_NUM_SAMPLES, audio->getPlayedSampleCount());
+}
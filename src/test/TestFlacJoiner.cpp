@@ -0,0 +1,313 @@
+#include <gtest/gtest.h>
+#include <hlcontrol/internal/FlacJoiner.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace hula;
+
+#define TEST_CHANNELS 2
+#define TEST_SAMPLE_RATE 44100
+
+class TestFlacJoiner : public ::testing::Test {
+    public:
+        std::vector<std::string> files;
+
+        virtual void TearDown()
+        {
+            for (auto const &file : files)
+            {
+                remove(file.c_str());
+            }
+        }
+
+        /**
+         * Write a 16-bit stereo FLAC file with fixed-blocksize frames
+         * made of VERBATIM subframes, the way an encoder would number them.
+         */
+        std::string writeFlac(const std::string &name, const std::vector<uint32_t> &blockSizes)
+        {
+            std::vector<uint8_t> data = {'f', 'L', 'a', 'C'};
+
+            // STREAMINFO. Only the audio properties matter to the joiner.
+            std::vector<uint8_t> info(34, 0);
+            info[10] = (uint8_t)(TEST_SAMPLE_RATE >> 12);
+            info[11] = (uint8_t)(TEST_SAMPLE_RATE >> 4);
+            info[12] = (uint8_t)((TEST_SAMPLE_RATE & 0x0F) << 4 | (TEST_CHANNELS - 1) << 1);
+            info[13] = (uint8_t)(15 << 4);
+
+            // Some other metadata block the joiner has to skip
+            data.insert(data.end(), {0x00, 0x00, 0x00, 34});
+            data.insert(data.end(), info.begin(), info.end());
+            data.insert(data.end(), {0x84, 0x00, 0x00, 0x03, 'a', 'b', 'c'});
+
+            for (size_t frame = 0; frame < blockSizes.size(); frame++)
+            {
+                uint32_t blockSize = blockSizes[frame];
+
+                // Fixed blocksize, 16 bit block size code, 44.1 kHz, stereo, 16 bit
+                std::vector<uint8_t> header = {0xFF, 0xF8, 0x79, 0x18, (uint8_t)frame};
+                header.push_back((uint8_t)((blockSize - 1) >> 8));
+                header.push_back((uint8_t)(blockSize - 1));
+                header.push_back(FlacJoiner::crc8(header.data(), header.size()));
+
+                std::vector<uint8_t> frameData = header;
+                for (int channel = 0; channel < TEST_CHANNELS; channel++)
+                {
+                    // VERBATIM subframe, no wasted bits
+                    frameData.push_back(0x02);
+                    for (uint32_t i = 0; i < blockSize; i++)
+                    {
+                        // Sync-like bytes inside the audio must not be taken for a frame
+                        frameData.push_back(0xFF);
+                        frameData.push_back((uint8_t)(0xF8 + (i & 1)));
+                    }
+                }
+
+                uint16_t crc = FlacJoiner::crc16(0, frameData.data(), frameData.size());
+                frameData.push_back((uint8_t)(crc >> 8));
+                frameData.push_back((uint8_t)crc);
+
+                data.insert(data.end(), frameData.begin(), frameData.end());
+            }
+
+            std::string path = "TestFlacJoiner-" + name + ".flac";
+            std::ofstream out(path, std::ios::binary);
+            out.write((const char *)data.data(), data.size());
+            files.push_back(path);
+
+            return path;
+        }
+
+        std::vector<uint8_t> readFile(const std::string &path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+};
+
+TEST_F(TestFlacJoiner, crc)
+{
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+    ASSERT_EQ(0xF4, FlacJoiner::crc8(check, sizeof(check)));
+    ASSERT_EQ(0xFEE8, FlacJoiner::crc16(0, check, sizeof(check)));
+}
+
+TEST_F(TestFlacJoiner, frameHeader)
+{
+    std::vector<uint8_t> header = {0xFF, 0xF8, 0x79, 0x18, 0x05, 0x01, 0x00};
+    header.push_back(FlacJoiner::crc8(header.data(), header.size()));
+
+    uint32_t blockSize = 0;
+    ASSERT_EQ(header.size(), FlacJoiner::parseFrameHeader(header.data(), header.size(), &blockSize));
+    ASSERT_EQ(257, blockSize);
+
+    // Large sample numbers take more bytes than the frame number did
+    uint8_t rewritten[16];
+    size_t size = FlacJoiner::writeFrameHeader(header.data(), header.size(), 1ULL << 30, rewritten);
+    ASSERT_EQ(header.size() + 5, size);
+    ASSERT_EQ(0xF9, rewritten[1]);
+    ASSERT_EQ(size, FlacJoiner::parseFrameHeader(rewritten, size, &blockSize));
+    ASSERT_EQ(257, blockSize);
+
+    header[7] ^= 0x01;
+    ASSERT_EQ(0, FlacJoiner::parseFrameHeader(header.data(), header.size(), &blockSize));
+}
+
+TEST_F(TestFlacJoiner, join)
+{
+    std::vector<std::string> inputs;
+    inputs.push_back(writeFlac("a", {4096, 4096, 1000}));
+    inputs.push_back(writeFlac("b", {4096, 300}));
+
+    std::string output = "TestFlacJoiner-out.flac";
+    files.push_back(output);
+    ASSERT_TRUE(FlacJoiner::join(inputs, output));
+
+    std::vector<uint8_t> data = readFile(output);
+    ASSERT_GT(data.size(), 42);
+    ASSERT_EQ(0, memcmp(data.data(), "fLaC", 4));
+    ASSERT_EQ(0x80, data[4]);
+
+    const uint8_t *info = data.data() + 8;
+    uint32_t minBlockSize = info[0] << 8 | info[1];
+    uint32_t maxBlockSize = info[2] << 8 | info[3];
+    uint64_t totalSamples = (uint64_t)(info[13] & 0x0F) << 32 | (uint32_t)info[14] << 24 | info[15] << 16 | info[16] << 8 | info[17];
+    uint32_t sampleRate = info[10] << 12 | info[11] << 4 | info[12] >> 4;
+
+    ASSERT_EQ(1000, minBlockSize);
+    ASSERT_EQ(4096, maxBlockSize);
+    ASSERT_EQ(4096 * 3 + 1000 + 300, totalSamples);
+    ASSERT_EQ(TEST_SAMPLE_RATE, sampleRate);
+
+    // Every frame starts at the sample where the previous one ended
+    const uint32_t expected[] = {4096, 4096, 1000, 4096, 300};
+    size_t pos = 42;
+    uint64_t sample = 0;
+    for (uint32_t blockSize : expected)
+    {
+        uint32_t parsedSize = 0;
+        size_t headerSize = FlacJoiner::parseFrameHeader(data.data() + pos, data.size() - pos, &parsedSize);
+        ASSERT_GT(headerSize, 0);
+        ASSERT_EQ(blockSize, parsedSize);
+        ASSERT_EQ(0xF9, data[pos + 1]);
+
+        // Decode the sample number
+        uint64_t number = data[pos + 4];
+        size_t extra = 0;
+        if (number >= 0x80)
+        {
+            uint8_t mask = 0x40;
+            while (number & mask)
+            {
+                mask >>= 1;
+                extra++;
+            }
+            number &= mask - 1;
+            for (size_t i = 0; i < extra; i++)
+            {
+                number = number << 6 | (data[pos + 5 + i] & 0x3F);
+            }
+        }
+        ASSERT_EQ(sample, number);
+
+        size_t frameSize = headerSize + TEST_CHANNELS * (1 + 2 * blockSize) + 2;
+        ASSERT_EQ(0, FlacJoiner::crc16(0, data.data() + pos, frameSize));
+
+        pos += frameSize;
+        sample += blockSize;
+    }
+    ASSERT_EQ(data.size(), pos);
+}
+
+TEST_F(TestFlacJoiner, mismatchedInputs)
+{
+    std::vector<std::string> inputs;
+    inputs.push_back(writeFlac("a", {4096}));
+
+    // Not a FLAC file
+    std::string other = "TestFlacJoiner-bad.flac";
+    std::ofstream(other) << "RIFF";
+    files.push_back(other);
+    inputs.push_back(other);
+
+    std::string output = "TestFlacJoiner-out.flac";
+    files.push_back(output);
+    ASSERT_FALSE(FlacJoiner::join(inputs, output));
+    ASSERT_FALSE(std::ifstream(output).good());
+}
+
+/**
+ * Join files where one that is not the last ends in a frame
+ * of fewer than 16 samples.
+ *
+ * EXPECTED:
+ *      Joining fails so the caller re-encodes instead, while
+ *      the same short frame at the very end is accepted.
+ */
+TEST_F(TestFlacJoiner, shortFrameInTheMiddle)
+{
+    std::string output = "TestFlacJoiner-out.flac";
+    files.push_back(output);
+
+    std::vector<std::string> inputs;
+    inputs.push_back(writeFlac("a", {4096, 10}));
+    inputs.push_back(writeFlac("b", {4096}));
+    ASSERT_FALSE(FlacJoiner::join(inputs, output));
+    ASSERT_FALSE(std::ifstream(output).good());
+
+    std::reverse(inputs.begin(), inputs.end());
+    ASSERT_TRUE(FlacJoiner::join(inputs, output));
+
+    std::vector<uint8_t> data = readFile(output);
+    ASSERT_GT(data.size(), 42);
+    const uint8_t *info = data.data() + 8;
+    ASSERT_EQ(4096, info[0] << 8 | info[1]);
+}
+
+/**
+ * Finalize a file whose last frame was only partly written,
+ * scanning from the start, from a checkpoint and from a checkpoint
+ * at the end of the last complete frame.
+ *
+ * EXPECTED:
+ *      The partial frame is cut off and STREAMINFO holds the
+ *      samples of the complete frames every time.
+ */
+TEST_F(TestFlacJoiner, finalize)
+{
+    const std::vector<uint32_t> blockSizes = {4096, 4096, 4096, 1000};
+    auto frameSize = [](uint32_t blockSize) { return 8 + TEST_CHANNELS * (1 + 2 * blockSize) + 2; };
+
+    std::vector<uint8_t> complete = readFile(writeFlac("complete", blockSizes));
+    size_t firstFrame = complete.size() - frameSize(4096) * 3 - frameSize(1000);
+    size_t lastEnd = firstFrame + frameSize(4096) * 3;
+
+    const std::pair<uint64_t, uint64_t> checkpoints[] = {
+        {0, 0},
+        {firstFrame + frameSize(4096), 4096},
+        {lastEnd, 4096 * 3}
+    };
+    for (auto const &checkpoint : checkpoints)
+    {
+        std::string path = "TestFlacJoiner-crash.flac";
+        files.push_back(path);
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write((const char *)complete.data(), lastEnd + 50);
+        }
+
+        ASSERT_EQ(4096 * 3, FlacJoiner::finalize(path, checkpoint.first, checkpoint.second));
+
+        std::vector<uint8_t> data = readFile(path);
+        ASSERT_EQ(lastEnd, data.size());
+
+        const uint8_t *info = data.data() + 8;
+        uint64_t totalSamples = (uint64_t)(info[13] & 0x0F) << 32 | (uint32_t)info[14] << 24 | info[15] << 16 | info[16] << 8 | info[17];
+        ASSERT_EQ(4096 * 3, totalSamples);
+        ASSERT_EQ(15, info[13] >> 4);
+    }
+
+    // Finalizing again changes nothing
+    std::string path = "TestFlacJoiner-crash.flac";
+    ASSERT_EQ(4096 * 3, FlacJoiner::finalize(path, firstFrame, 0));
+    ASSERT_EQ(lastEnd, readFile(path).size());
+}
+
+/**
+ * Scan a file that is still being written, one checkpoint at a time.
+ *
+ * EXPECTED:
+ *      Each scan continues from the last one and stops
+ *      in front of the frame that is not complete yet.
+ */
+TEST_F(TestFlacJoiner, scanFrames)
+{
+    auto frameSize = [](uint32_t blockSize) { return 8 + TEST_CHANNELS * (1 + 2 * blockSize) + 2; };
+
+    std::vector<uint8_t> complete = readFile(writeFlac("complete", {4096, 4096, 1000}));
+    size_t firstFrame = complete.size() - frameSize(4096) * 2 - frameSize(1000);
+
+    std::string path = "TestFlacJoiner-growing.flac";
+    files.push_back(path);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    uint64_t bytes = 0;
+    uint64_t samples = 0;
+
+    out.write((const char *)complete.data(), firstFrame + frameSize(4096) + 10);
+    out.flush();
+    ASSERT_TRUE(FlacJoiner::scanFrames(path, bytes, samples));
+    EXPECT_EQ(firstFrame + frameSize(4096), bytes);
+    EXPECT_EQ(4096, samples);
+
+    out.write((const char *)complete.data() + firstFrame + frameSize(4096) + 10, complete.size() - firstFrame - frameSize(4096) - 10);
+    out.flush();
+    ASSERT_TRUE(FlacJoiner::scanFrames(path, bytes, samples));
+    EXPECT_EQ(complete.size(), bytes);
+    EXPECT_EQ(4096 * 2 + 1000, samples);
+}
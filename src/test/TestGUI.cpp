@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QQmlApplicationEngine>
 
 #include <QQmlProperty>
@@ -34,6 +35,13 @@ class TestGUI : public ::testing::Test {
 
         virtual void TearDown()
         {
+            // Make sure any recorded files get deleted
+            QMLBridge *bridge = engine->rootObjects()[0]->findChild<QMLBridge *>();
+            if (bridge)
+            {
+                bridge->cleanTempFiles();
+            }
+
             app->exit();
             delete engine;
             delete app;
@@ -63,6 +71,24 @@ class TestGUI : public ::testing::Test {
             return QString();
         }
 
+        /**
+         * Commands run on the Transport's worker thread. Let the event
+         * loop deliver their outcome until the UI shows the given state.
+         *
+         * @return State shown once it matched or the wait timed out
+         */
+        QString waitForState(const QString &state)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            while (getTransportState() != state && timer.elapsed() < 5000)
+            {
+                QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+            }
+
+            return getTransportState();
+        }
+
         bool isVisible(QString objName)
         {
             QObject *obj = engine->rootObjects()[0]->findChild<QObject *>(objName);
@@ -198,7 +224,7 @@ TEST_F(TestGUI, ui_state_machine_1)
 {
     // Click Record button
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
 
     EXPECT_FALSE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -209,7 +235,7 @@ TEST_F(TestGUI, ui_state_machine_1)
 
     // Click Stop button
     clickButton("stopBtn");
-    ASSERT_EQ(getTransportState(), "Stopped");
+    ASSERT_EQ(waitForState("Stopped"), "Stopped");
 
     EXPECT_FALSE(isEnabled("stopBtn"));
     EXPECT_TRUE(isEnabled("playpauseBtn"));
@@ -232,7 +258,7 @@ TEST_F(TestGUI, ui_state_machine_2)
 {
     // Click Record button
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
 
     EXPECT_FALSE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -243,7 +269,7 @@ TEST_F(TestGUI, ui_state_machine_2)
 
     // Click Stop button
     clickButton("stopBtn");
-    ASSERT_EQ(getTransportState(), "Stopped");
+    ASSERT_EQ(waitForState("Stopped"), "Stopped");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_FALSE(isEnabled("stopBtn"));
@@ -254,7 +280,7 @@ TEST_F(TestGUI, ui_state_machine_2)
 
     // Click Play button
     clickButton("playpauseBtn");
-    ASSERT_EQ(getTransportState(), "Playing");
+    ASSERT_EQ(waitForState("Playing"), "Playing");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_FALSE(isEnabled("stopBtn"));
@@ -265,7 +291,7 @@ TEST_F(TestGUI, ui_state_machine_2)
 
     // Click Pause button
     clickButton("playpauseBtn");
-    ASSERT_EQ(getTransportState(), "Paused");
+    ASSERT_EQ(waitForState("Paused"), "Paused");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_FALSE(isEnabled("stopBtn"));
@@ -286,7 +312,7 @@ TEST_F(TestGUI, ui_state_machine_3)
 {
     // Click Record button
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
 
     EXPECT_FALSE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -297,7 +323,7 @@ TEST_F(TestGUI, ui_state_machine_3)
 
     // Click Pause button
     clickButton("playpauseBtn");
-    ASSERT_EQ(getTransportState(), "Paused");
+    ASSERT_EQ(waitForState("Paused"), "Paused");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -308,7 +334,7 @@ TEST_F(TestGUI, ui_state_machine_3)
 
     // Click Stop button
     clickButton("stopBtn");
-    ASSERT_EQ(getTransportState(), "Stopped");
+    ASSERT_EQ(waitForState("Stopped"), "Stopped");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_FALSE(isEnabled("stopBtn"));
@@ -329,7 +355,7 @@ TEST_F(TestGUI, ui_state_machine_4)
 {
     // Click Record button
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
 
     EXPECT_FALSE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -340,7 +366,7 @@ TEST_F(TestGUI, ui_state_machine_4)
 
     // Click Pause button
     clickButton("playpauseBtn");
-    ASSERT_EQ(getTransportState(), "Paused");
+    ASSERT_EQ(waitForState("Paused"), "Paused");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -351,7 +377,7 @@ TEST_F(TestGUI, ui_state_machine_4)
 
     // Click Record button
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
 
     EXPECT_FALSE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -372,7 +398,7 @@ TEST_F(TestGUI, ui_state_machine_5)
 {
     // Click Record button
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
 
     EXPECT_FALSE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -383,7 +409,7 @@ TEST_F(TestGUI, ui_state_machine_5)
 
     // Click Pause button
     clickButton("playpauseBtn");
-    ASSERT_EQ(getTransportState(), "Paused");
+    ASSERT_EQ(waitForState("Paused"), "Paused");
 
     EXPECT_TRUE(isEnabled("recordBtn"));
     EXPECT_TRUE(isEnabled("stopBtn"));
@@ -394,7 +420,7 @@ TEST_F(TestGUI, ui_state_machine_5)
 
     // Click Stop button
     clickButton("stopBtn");
-    ASSERT_EQ(getTransportState(), "Stopped");
+    ASSERT_EQ(waitForState("Stopped"), "Stopped");
 
     EXPECT_TRUE(isEnabled("recordBtn")); // Will be discard
     EXPECT_FALSE(isEnabled("stopBtn"));
@@ -405,7 +431,7 @@ TEST_F(TestGUI, ui_state_machine_5)
 
     // Click Play button
     clickButton("playpauseBtn");
-    ASSERT_EQ(getTransportState(), "Playing");
+    ASSERT_EQ(waitForState("Playing"), "Playing");
 
     EXPECT_TRUE(isEnabled("recordBtn")); // Will be discard
     EXPECT_FALSE(isEnabled("stopBtn"));
@@ -418,25 +444,25 @@ TEST_F(TestGUI, ui_state_machine_5)
 TEST_F(TestGUI, stress_test)
 {
     clickButton("recordBtn");
-    ASSERT_EQ(getTransportState(), "Recording");
+    ASSERT_EQ(waitForState("Recording"), "Recording");
     for(unsigned i = 0; i < 25; i++)
     {
         // click pause button
         clickButton("playpauseBtn");
         EXPECT_TRUE(isEnabled("recordBtn"));
         EXPECT_TRUE(isEnabled("stopBtn"));
-        ASSERT_EQ(getTransportState(), "Paused");
+        ASSERT_EQ(waitForState("Paused"), "Paused");
 
         // click record button
         clickButton("recordBtn");
         EXPECT_FALSE(isEnabled("recordBtn"));
         EXPECT_TRUE(isEnabled("stopBtn"));
-        ASSERT_EQ(getTransportState(), "Recording");
+        ASSERT_EQ(waitForState("Recording"), "Recording");
     }
 
     clickButton("stopBtn");
     EXPECT_FALSE(isEnabled("stopBtn"));
-    ASSERT_EQ(getTransportState(), "Stopped");
+    ASSERT_EQ(waitForState("Stopped"), "Stopped");
 
     // Let the fragmented audio play back
     clickButton("playpauseBtn");
@@ -0,0 +1,482 @@
+#include <gtest/gtest.h>
+#include <hlaudio/hlaudio.h>
+
+#include <thread>
+#include <vector>
+
+using namespace hula;
+
+#define TEST_STORAGE_SIZE 0.2f
+#define TEST_READER_SIZE 0.05f
+#define TEST_NUM_SAMPLES 200 // Don't pick a power of 2
+
+/**
+ * Create an array of samples where each sample holds
+ * its running index starting at offset.
+ *
+ * @return Vector of count samples.
+ */
+std::vector<SAMPLE> createTestSamples(int offset, int count)
+{
+    std::vector<SAMPLE> samples(count);
+    for (int i = 0; i < count; i++)
+    {
+        samples[i] = (SAMPLE)(offset + i);
+    }
+    return samples;
+}
+
+/**
+ * Create a broadcast buffer with a reader.
+ * Destroy both.
+ *
+ * EXPECTED:
+ *      Reader capacity is clamped to half of the storage.
+ *      Destructors do not explode.
+ */
+TEST(TestHulaBroadcastBuffer, create_and_destroy_buffer)
+{
+    HulaBroadcastBuffer *buffer = new HulaBroadcastBuffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader *small = new HulaBroadcastReader(buffer, TEST_READER_SIZE);
+    HulaBroadcastReader *large = new HulaBroadcastReader(buffer, 10 * TEST_STORAGE_SIZE);
+
+    EXPECT_LT(small->getCapacity(), buffer->getMaxWindow());
+    EXPECT_EQ(large->getCapacity(), buffer->getMaxWindow());
+    EXPECT_LE(buffer->getMaxWindow() * 2, buffer->getCapacity());
+
+    delete large;
+    delete small;
+    delete buffer;
+}
+
+/**
+ * Invalid durations are rejected.
+ *
+ * EXPECTED:
+ *      AudioException is thrown.
+ */
+TEST(TestHulaBroadcastBuffer, invalid_duration_throws)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+
+    EXPECT_THROW(HulaBroadcastBuffer(0), AudioException);
+    EXPECT_THROW(HulaBroadcastReader(&buffer, 0), AudioException);
+    EXPECT_THROW(HulaBroadcastReader(nullptr, TEST_READER_SIZE), AudioException);
+}
+
+/**
+ * Write once and read from several readers.
+ *
+ * EXPECTED:
+ *      Each reader receives every sample independently.
+ *      Reading from one reader does not consume data for another.
+ */
+TEST(TestHulaBroadcastBuffer, every_reader_gets_data)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader r1(&buffer, TEST_READER_SIZE);
+    HulaBroadcastReader r2(&buffer, TEST_READER_SIZE);
+
+    std::vector<SAMPLE> writeData = createTestSamples(0, TEST_NUM_SAMPLES);
+    EXPECT_EQ(buffer.write(writeData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+
+    std::vector<SAMPLE> readData(TEST_NUM_SAMPLES);
+
+    EXPECT_EQ(r1.read(readData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+    EXPECT_EQ(readData, writeData);
+    EXPECT_EQ(r1.getReadAvailable(), 0);
+
+    EXPECT_EQ(r2.getReadAvailable(), TEST_NUM_SAMPLES);
+    EXPECT_EQ(r2.read(readData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+    EXPECT_EQ(readData, writeData);
+}
+
+/**
+ * A reader created after data was written only sees new data.
+ *
+ * EXPECTED:
+ *      Late reader starts at the current write position.
+ */
+TEST(TestHulaBroadcastBuffer, late_reader_skips_old_data)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+
+    std::vector<SAMPLE> oldData = createTestSamples(0, TEST_NUM_SAMPLES);
+    buffer.write(oldData.data(), TEST_NUM_SAMPLES);
+
+    HulaBroadcastReader reader(&buffer, TEST_READER_SIZE);
+    EXPECT_EQ(reader.getReadAvailable(), 0);
+
+    std::vector<SAMPLE> newData = createTestSamples(TEST_NUM_SAMPLES, TEST_NUM_SAMPLES);
+    buffer.write(newData.data(), TEST_NUM_SAMPLES);
+
+    std::vector<SAMPLE> readData(TEST_NUM_SAMPLES);
+    EXPECT_EQ(reader.read(readData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+    EXPECT_EQ(readData, newData);
+}
+
+/**
+ * Write in place across the end of the storage.
+ *
+ * EXPECTED:
+ *      beginWrite returns two regions once the storage wraps.
+ *      Reader sees the committed samples in order.
+ */
+TEST(TestHulaBroadcastBuffer, begin_write_wrap_buffer)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader reader(&buffer, TEST_STORAGE_SIZE);
+
+    std::vector<SAMPLE> readData(TEST_NUM_SAMPLES);
+    ring_buffer_size_t capacity = buffer.getCapacity();
+    int offset = 0;
+
+    // Walk the write position to just before the end of storage
+    while (offset + TEST_NUM_SAMPLES < capacity - TEST_NUM_SAMPLES / 2)
+    {
+        std::vector<SAMPLE> data = createTestSamples(offset, TEST_NUM_SAMPLES);
+        buffer.write(data.data(), TEST_NUM_SAMPLES);
+        reader.read(readData.data(), TEST_NUM_SAMPLES);
+        offset += TEST_NUM_SAMPLES;
+    }
+
+    std::vector<SAMPLE> tail = createTestSamples(offset, capacity - offset - TEST_NUM_SAMPLES / 2);
+    buffer.write(tail.data(), (ring_buffer_size_t)tail.size());
+    reader.read(readData.data(), (ring_buffer_size_t)tail.size());
+    offset += (int)tail.size();
+
+    void *ptr1;
+    void *ptr2;
+    ring_buffer_size_t size1;
+    ring_buffer_size_t size2;
+
+    ring_buffer_size_t reserved = buffer.beginWrite(TEST_NUM_SAMPLES, &ptr1, &size1, &ptr2, &size2);
+    ASSERT_EQ(reserved, TEST_NUM_SAMPLES);
+    ASSERT_EQ(size1, TEST_NUM_SAMPLES / 2);
+    ASSERT_EQ(size2, TEST_NUM_SAMPLES / 2);
+    ASSERT_TRUE(ptr2 != nullptr);
+
+    std::vector<SAMPLE> data = createTestSamples(offset, TEST_NUM_SAMPLES);
+    memcpy(ptr1, data.data(), SAMPLES_TO_BYTES(size1));
+    memcpy(ptr2, data.data() + size1, SAMPLES_TO_BYTES(size2));
+
+    // Nothing is visible until commit
+    EXPECT_EQ(reader.getReadAvailable(), 0);
+    buffer.commitWrite(reserved);
+
+    EXPECT_EQ(reader.read(readData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+    EXPECT_EQ(readData, data);
+}
+
+/**
+ * Let a reader fall behind the writer.
+ *
+ * EXPECTED:
+ *      Writer is never blocked.
+ *      Reader reports an overrun and the number of dropped samples.
+ *      Reader resumes with the newest samples that fit in its capacity.
+ *      Other readers are unaffected.
+ */
+TEST(TestHulaBroadcastBuffer, slow_reader_overrun)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader slow(&buffer, TEST_READER_SIZE);
+    HulaBroadcastReader fast(&buffer, TEST_READER_SIZE);
+
+    ring_buffer_size_t window = slow.getCapacity();
+    int total = 0;
+    std::vector<SAMPLE> readData(TEST_NUM_SAMPLES);
+
+    while (total < 2 * window)
+    {
+        std::vector<SAMPLE> data = createTestSamples(total, TEST_NUM_SAMPLES);
+        EXPECT_EQ(buffer.write(data.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+        total += TEST_NUM_SAMPLES;
+
+        EXPECT_EQ(fast.read(readData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+        EXPECT_EQ(readData, data);
+    }
+
+    EXPECT_EQ(slow.getReadAvailable(), window);
+
+    std::vector<SAMPLE> lateData(window);
+    EXPECT_EQ(slow.read(lateData.data(), window), window);
+    EXPECT_EQ(lateData, createTestSamples(total - window, window));
+
+    EXPECT_EQ(slow.getOverrunCount(), 1);
+    EXPECT_EQ(slow.getDroppedSamples(), (uint64_t)(total - window));
+    EXPECT_EQ(fast.getOverrunCount(), 0);
+    EXPECT_EQ(fast.getDroppedSamples(), 0);
+}
+
+/**
+ * Take snapshots of the latest samples from a reader that never drains.
+ *
+ * EXPECTED:
+ *      Only the most recent samples are copied, in order.
+ *      The number of samples published since the last snapshot is reported.
+ *      Skipping ahead is not counted as an overrun.
+ */
+TEST(TestHulaBroadcastBuffer, read_latest_snapshot)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader reader(&buffer, TEST_READER_SIZE);
+
+    ring_buffer_size_t window = reader.getCapacity();
+    std::vector<SAMPLE> snapshot(TEST_NUM_SAMPLES);
+    uint64_t newSamples = 0;
+
+    // Less than asked for is available at first
+    std::vector<SAMPLE> data = createTestSamples(0, TEST_NUM_SAMPLES / 2);
+    buffer.write(data.data(), TEST_NUM_SAMPLES / 2);
+    EXPECT_EQ(reader.readLatest(snapshot.data(), TEST_NUM_SAMPLES, &newSamples), TEST_NUM_SAMPLES / 2);
+    EXPECT_EQ(newSamples, TEST_NUM_SAMPLES / 2);
+    snapshot.resize(TEST_NUM_SAMPLES / 2);
+    EXPECT_EQ(snapshot, data);
+
+    // Publish far more than the reader can hold
+    int total = TEST_NUM_SAMPLES / 2;
+    while (total < 3 * window)
+    {
+        data = createTestSamples(total, TEST_NUM_SAMPLES);
+        buffer.write(data.data(), TEST_NUM_SAMPLES);
+        total += TEST_NUM_SAMPLES;
+    }
+
+    snapshot.resize(TEST_NUM_SAMPLES);
+    EXPECT_EQ(reader.readLatest(snapshot.data(), TEST_NUM_SAMPLES + 1, &newSamples), TEST_NUM_SAMPLES);
+    EXPECT_EQ(newSamples, (uint64_t)(total - TEST_NUM_SAMPLES / 2));
+    EXPECT_EQ(snapshot, createTestSamples(total - TEST_NUM_SAMPLES, TEST_NUM_SAMPLES));
+
+    EXPECT_EQ(reader.getReadAvailable(), 0);
+    EXPECT_EQ(reader.getOverrunCount(), 0);
+    EXPECT_EQ(reader.getDroppedSamples(), 0);
+}
+
+/**
+ * Clear a reader.
+ *
+ * EXPECTED:
+ *      Pending data is discarded for that reader only.
+ */
+TEST(TestHulaBroadcastBuffer, clear_reader)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader r1(&buffer, TEST_READER_SIZE);
+    HulaBroadcastReader r2(&buffer, TEST_READER_SIZE);
+
+    std::vector<SAMPLE> data = createTestSamples(0, TEST_NUM_SAMPLES);
+    buffer.write(data.data(), TEST_NUM_SAMPLES);
+
+    r1.clear();
+    EXPECT_EQ(r1.getReadAvailable(), 0);
+    EXPECT_EQ(r2.getReadAvailable(), TEST_NUM_SAMPLES);
+}
+
+/**
+ * Store samples as 16-bit integers.
+ *
+ * EXPECTED:
+ *      Regions from directRead hold INT_16 samples.
+ *      read() converts back to float within 16-bit precision.
+ *      Out of range samples are clipped.
+ */
+TEST(TestHulaBroadcastBuffer, int16_storage)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE, INT_16);
+    HulaBroadcastReader r1(&buffer, TEST_READER_SIZE);
+    HulaBroadcastReader r2(&buffer, TEST_READER_SIZE);
+    EXPECT_EQ(r1.getSampleFormat(), INT_16);
+
+    SAMPLE writeData[4] = {0.5f, -0.25f, 2.0f, -2.0f};
+    buffer.write(writeData, 4);
+
+    void *ptr1;
+    void *ptr2;
+    ring_buffer_size_t size1;
+    ring_buffer_size_t size2;
+    ASSERT_EQ(r1.directRead(4, &ptr1, &size1, &ptr2, &size2), 4);
+    EXPECT_EQ(((int16_t *)ptr1)[0], 16383);
+    EXPECT_EQ(((int16_t *)ptr1)[2], 32767);
+
+    SAMPLE readData[4] = {0};
+    ASSERT_EQ(r2.read(readData, 4), 4);
+    EXPECT_NEAR(readData[0], 0.5f, 1.0f / 32768);
+    EXPECT_NEAR(readData[1], -0.25f, 1.0f / 32768);
+    EXPECT_NEAR(readData[2], 1.0f, 1.0f / 32768);
+    EXPECT_NEAR(readData[3], -1.0f, 1.0f / 32768);
+}
+
+/**
+ * Store samples as packed 24-bit integers.
+ *
+ * EXPECTED:
+ *      Samples take 3 bytes each.
+ *      read() converts back to float within 24-bit precision.
+ */
+TEST(TestHulaBroadcastBuffer, int24_storage)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE, INT_24);
+    HulaBroadcastReader r1(&buffer, TEST_READER_SIZE);
+    HulaBroadcastReader r2(&buffer, TEST_READER_SIZE);
+
+    std::vector<SAMPLE> writeData(TEST_NUM_SAMPLES);
+    for (int i = 0; i < TEST_NUM_SAMPLES; i++)
+    {
+        writeData[i] = (SAMPLE)(i - TEST_NUM_SAMPLES / 2) / TEST_NUM_SAMPLES;
+    }
+    buffer.write(writeData.data(), TEST_NUM_SAMPLES);
+    buffer.write(writeData.data(), TEST_NUM_SAMPLES);
+
+    std::vector<SAMPLE> readData(TEST_NUM_SAMPLES);
+    ASSERT_EQ(r1.read(readData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+    for (int i = 0; i < TEST_NUM_SAMPLES; i++)
+    {
+        EXPECT_NEAR(readData[i], writeData[i], 2.0f / 8388608);
+    }
+
+    // Samples are packed back to back
+    void *first;
+    void *second;
+    void *ptr2;
+    ring_buffer_size_t size1;
+    ring_buffer_size_t size2;
+    ASSERT_EQ(r2.directRead(TEST_NUM_SAMPLES, &first, &size1, &ptr2, &size2), TEST_NUM_SAMPLES);
+    ASSERT_EQ(r2.directRead(TEST_NUM_SAMPLES, &second, &size1, &ptr2, &size2), TEST_NUM_SAMPLES);
+    EXPECT_EQ((uint8_t *)second - (uint8_t *)first, TEST_NUM_SAMPLES * 3);
+}
+
+/**
+ * Size the storage from the configured sample rate.
+ *
+ * EXPECTED:
+ *      Halving the sample rate halves the capacity.
+ */
+TEST(TestHulaBroadcastBuffer, capacity_follows_sample_rate)
+{
+    HulaAudioSettings *settings = HulaAudioSettings::getInstance();
+    int defaultRate = settings->getSampleRate();
+
+    HulaBroadcastBuffer full(TEST_STORAGE_SIZE);
+
+    settings->setSampleRate(defaultRate / 2);
+    HulaBroadcastBuffer half(TEST_STORAGE_SIZE);
+    settings->setSampleRate(defaultRate);
+
+    EXPECT_EQ(half.getCapacity() * 2, full.getCapacity());
+}
+
+/**
+ * Copy samples in the storage format without conversion.
+ *
+ * EXPECTED:
+ *      Bytes read back are identical to the bytes written.
+ */
+TEST(TestHulaBroadcastBuffer, write_raw_int16)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE, INT_16);
+    HulaBroadcastReader reader(&buffer, TEST_STORAGE_SIZE);
+
+    std::vector<int16_t> writeData(TEST_NUM_SAMPLES);
+    for (int i = 0; i < TEST_NUM_SAMPLES; i++)
+    {
+        writeData[i] = (int16_t)(i * 97 - 5000);
+    }
+
+    ASSERT_EQ(buffer.writeRaw(writeData.data(), TEST_NUM_SAMPLES), TEST_NUM_SAMPLES);
+
+    void *ptr1;
+    void *ptr2;
+    ring_buffer_size_t size1;
+    ring_buffer_size_t size2;
+    ASSERT_EQ(reader.directRead(TEST_NUM_SAMPLES, &ptr1, &size1, &ptr2, &size2), TEST_NUM_SAMPLES);
+    ASSERT_EQ(size1, TEST_NUM_SAMPLES);
+    EXPECT_EQ(memcmp(ptr1, writeData.data(), TEST_NUM_SAMPLES * sizeof(int16_t)), 0);
+}
+
+/**
+ * Wait for data that never arrives.
+ *
+ * EXPECTED:
+ *      waitForData returns false after the timeout.
+ *      waitForData returns true right away once enough is written.
+ */
+TEST(TestHulaBroadcastBuffer, wait_for_data_timeout)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader reader(&buffer, TEST_READER_SIZE);
+
+    EXPECT_FALSE(reader.waitForData(TEST_NUM_SAMPLES, 10));
+
+    std::vector<SAMPLE> writeData = createTestSamples(0, TEST_NUM_SAMPLES);
+    buffer.write(writeData.data(), TEST_NUM_SAMPLES);
+
+    EXPECT_TRUE(reader.waitForData(TEST_NUM_SAMPLES, 0));
+    EXPECT_FALSE(reader.waitForData(TEST_NUM_SAMPLES + 2, 0));
+}
+
+/**
+ * A reader sleeping on a threshold is woken by the writer.
+ *
+ * EXPECTED:
+ *      Writes below the threshold don't satisfy the wait.
+ *      The reader sees the full threshold once it returns true.
+ */
+TEST(TestHulaBroadcastBuffer, writer_wakes_reader_at_threshold)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader reader(&buffer, TEST_STORAGE_SIZE);
+
+    const int blocks = 10;
+    std::thread writer([&buffer]() {
+        std::vector<SAMPLE> writeData = createTestSamples(0, TEST_NUM_SAMPLES);
+        for (int i = 0; i < blocks; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            buffer.write(writeData.data(), TEST_NUM_SAMPLES);
+        }
+    });
+
+    // Generous timeout so that only a missed wakeup fails the test
+    bool ready = false;
+    for (int i = 0; i < 100 && !ready; i++)
+    {
+        ready = reader.waitForData(blocks * TEST_NUM_SAMPLES, 50);
+    }
+
+    writer.join();
+
+    EXPECT_TRUE(ready);
+    EXPECT_EQ(reader.getReadAvailable(), blocks * TEST_NUM_SAMPLES);
+}
+
+/**
+ * wakeReaders interrupts a wait.
+ *
+ * EXPECTED:
+ *      waitForData returns false long before its timeout.
+ */
+TEST(TestHulaBroadcastBuffer, wake_readers_interrupts_wait)
+{
+    HulaBroadcastBuffer buffer(TEST_STORAGE_SIZE);
+    HulaBroadcastReader reader(&buffer, TEST_READER_SIZE);
+
+    // Keep waking in case the first one comes before the reader sleeps
+    std::atomic<bool> done(false);
+    std::thread waker([&buffer, &done]() {
+        while (!done.load())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            buffer.wakeReaders();
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(reader.waitForData(TEST_NUM_SAMPLES, 5000));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    done.store(true);
+    waker.join();
+
+    EXPECT_LT(elapsed, std::chrono::milliseconds(2000));
+}
@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+#include <hlaudio/hlaudio.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace hula;
+
+#define TEST_BLOCK_SIZE 0.01f
+#define TEST_RESERVE_SIZE 0.02f
+#define TEST_MAX_SIZE 0.1f
+
+/**
+ * Create an array of samples where each sample holds
+ * its running index starting at offset.
+ *
+ * @return Vector of count samples.
+ */
+std::vector<SAMPLE> createTestSamples(int offset, int count)
+{
+    std::vector<SAMPLE> samples(count);
+    for (int i = 0; i < count; i++)
+    {
+        samples[i] = (SAMPLE)(offset + i);
+    }
+    return samples;
+}
+
+/**
+ * Read everything that is waiting and check that it continues the
+ * running index.
+ *
+ * @return Number of samples read.
+ */
+uint64_t readAndCheck(HulaElasticBuffer &buffer, uint64_t &next)
+{
+    uint64_t total = 0;
+    ring_buffer_size_t samplesRead;
+    do
+    {
+        void *ptr[2] = {0};
+        ring_buffer_size_t sizes[2] = {0};
+        samplesRead = buffer.directRead(buffer.getBlockSize(), ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+
+        for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
+        {
+            SAMPLE *samples = (SAMPLE *)ptr[i];
+            for (ring_buffer_size_t s = 0; s < sizes[i]; s++)
+            {
+                EXPECT_EQ((SAMPLE)next++, samples[s]);
+            }
+        }
+        total += samplesRead;
+    } while (samplesRead > 0);
+
+    return total;
+}
+
+/**
+ * Invalid durations are rejected.
+ *
+ * EXPECTED:
+ *      AudioException is thrown.
+ */
+TEST(TestHulaElasticBuffer, invalid_duration_throws)
+{
+    EXPECT_THROW(HulaElasticBuffer(TEST_RESERVE_SIZE, TEST_MAX_SIZE, 0), AudioException);
+    EXPECT_THROW(HulaElasticBuffer(0, TEST_MAX_SIZE, TEST_BLOCK_SIZE), AudioException);
+    EXPECT_THROW(HulaElasticBuffer(TEST_MAX_SIZE, TEST_RESERVE_SIZE, TEST_BLOCK_SIZE), AudioException);
+}
+
+/**
+ * Write far more than the reserve without reading, then drain.
+ *
+ * EXPECTED:
+ *      Nothing is dropped and every sample comes back in order.
+ *      Memory grows while full and shrinks back to the reserve once drained.
+ */
+TEST(TestHulaElasticBuffer, grows_and_shrinks)
+{
+    HulaElasticBuffer buffer(TEST_RESERVE_SIZE, TEST_MAX_SIZE, TEST_BLOCK_SIZE);
+    size_t idleBytes = buffer.getAllocatedBytes();
+
+    ring_buffer_size_t count = buffer.getBlockSize() * 6 + 7;
+    std::vector<SAMPLE> samples = createTestSamples(0, count);
+    EXPECT_EQ(count, buffer.writeRaw(samples.data(), count));
+
+    EXPECT_EQ(count, buffer.getReadAvailable());
+    EXPECT_EQ(0, buffer.getDroppedSamples());
+    EXPECT_GT(buffer.getAllocatedBytes(), idleBytes);
+
+    uint64_t next = 0;
+    EXPECT_EQ(count, readAndCheck(buffer, next));
+    EXPECT_EQ(count, buffer.getHighWaterMark());
+
+    // The block being read is released on the next read
+    void *ptr[2] = {0};
+    ring_buffer_size_t sizes[2] = {0};
+    EXPECT_EQ(0, buffer.directRead(1, ptr + 0, sizes + 0, ptr + 1, sizes + 1));
+    EXPECT_EQ(idleBytes, buffer.getAllocatedBytes());
+}
+
+/**
+ * Write more than the limit without reading.
+ *
+ * EXPECTED:
+ *      Samples beyond the capacity are dropped and counted.
+ *      Everything kept can still be read in order.
+ */
+TEST(TestHulaElasticBuffer, limit_drops)
+{
+    HulaElasticBuffer buffer(TEST_RESERVE_SIZE, TEST_MAX_SIZE, TEST_BLOCK_SIZE);
+
+    ring_buffer_size_t count = (ring_buffer_size_t)buffer.getCapacity() + 100;
+    std::vector<SAMPLE> samples = createTestSamples(0, count);
+    ring_buffer_size_t written = buffer.writeRaw(samples.data(), count);
+
+    EXPECT_EQ(buffer.getCapacity(), (uint64_t)written);
+    EXPECT_EQ(1, buffer.getOverrunCount());
+    EXPECT_EQ((uint64_t)(count - written), buffer.getDroppedSamples());
+
+    uint64_t next = 0;
+    EXPECT_EQ((uint64_t)written, readAndCheck(buffer, next));
+}
+
+/**
+ * Clear a buffer that has grown.
+ *
+ * EXPECTED:
+ *      Nothing is left to read and the memory is given back.
+ *      Writing afterwards works as before.
+ */
+TEST(TestHulaElasticBuffer, clear)
+{
+    HulaElasticBuffer buffer(TEST_RESERVE_SIZE, TEST_MAX_SIZE, TEST_BLOCK_SIZE);
+    size_t idleBytes = buffer.getAllocatedBytes();
+
+    ring_buffer_size_t count = buffer.getBlockSize() * 5;
+    std::vector<SAMPLE> samples = createTestSamples(0, count);
+    buffer.writeRaw(samples.data(), count);
+
+    buffer.clear();
+    EXPECT_EQ(0, buffer.getReadAvailable());
+    EXPECT_EQ(idleBytes, buffer.getAllocatedBytes());
+
+    samples = createTestSamples(count, 10);
+    buffer.writeRaw(samples.data(), 10);
+
+    uint64_t next = count;
+    EXPECT_EQ(10, readAndCheck(buffer, next));
+}
+
+/**
+ * Store INT_16 samples.
+ *
+ * EXPECTED:
+ *      Samples come back byte for byte.
+ */
+TEST(TestHulaElasticBuffer, int16_storage)
+{
+    HulaElasticBuffer buffer(TEST_RESERVE_SIZE, TEST_MAX_SIZE, TEST_BLOCK_SIZE, INT_16);
+    EXPECT_EQ(INT_16, buffer.getSampleFormat());
+
+    ring_buffer_size_t count = buffer.getBlockSize() + 3;
+    std::vector<int16_t> samples(count);
+    for (ring_buffer_size_t i = 0; i < count; i++)
+    {
+        samples[i] = (int16_t)(i - 1000);
+    }
+    buffer.writeRaw(samples.data(), count);
+
+    ring_buffer_size_t index = 0;
+    ring_buffer_size_t samplesRead;
+    do
+    {
+        void *ptr[2] = {0};
+        ring_buffer_size_t sizes[2] = {0};
+        samplesRead = buffer.directRead(count, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+        for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
+        {
+            for (ring_buffer_size_t s = 0; s < sizes[i]; s++)
+            {
+                EXPECT_EQ(samples[index++], ((int16_t *)ptr[i])[s]);
+            }
+        }
+    } while (samplesRead > 0);
+
+    EXPECT_EQ(count, index);
+}
+
+/**
+ * Producer writes in bursts while the consumer sleeps in waitForData().
+ *
+ * EXPECTED:
+ *      Every sample arrives exactly once and in order.
+ */
+TEST(TestHulaElasticBuffer, concurrent_producer_consumer)
+{
+    HulaElasticBuffer buffer(TEST_RESERVE_SIZE, 100 * TEST_MAX_SIZE, TEST_BLOCK_SIZE);
+    const int bursts = 2000;
+    const int burstSize = 96;
+
+    std::thread producer([&]() {
+        for (int b = 0; b < bursts; b++)
+        {
+            std::vector<SAMPLE> samples = createTestSamples(b * burstSize, burstSize);
+            buffer.writeRaw(samples.data(), burstSize);
+            if (b % 100 == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        buffer.wakeReaders();
+    });
+
+    uint64_t next = 0;
+    uint64_t total = 0;
+    while (total < (uint64_t)bursts * burstSize)
+    {
+        buffer.waitForData(burstSize, 50);
+        total += readAndCheck(buffer, next);
+    }
+
+    producer.join();
+
+    EXPECT_EQ((uint64_t)bursts * burstSize, total);
+    EXPECT_EQ(0, buffer.getDroppedSamples());
+}
+
+/**
+ * Consumer reads in sizes that end exactly on block boundaries
+ * while the producer keeps linking new blocks in small bursts.
+ *
+ * EXPECTED:
+ *      Every read that returns samples fills the first region,
+ *      and every sample arrives exactly once and in order.
+ */
+TEST(TestHulaElasticBuffer, block_boundary_reads)
+{
+    HulaElasticBuffer buffer(TEST_RESERVE_SIZE, 100 * TEST_MAX_SIZE, TEST_BLOCK_SIZE);
+    const ring_buffer_size_t readSize = buffer.getBlockSize() / 2;
+    const uint64_t count = 2000 * (uint64_t)readSize;
+    const int burstSize = 2;
+    std::atomic<bool> failed(false);
+
+    std::thread producer([&]() {
+        for (uint64_t written = 0; written < count && !failed.load(); written += burstSize)
+        {
+            std::vector<SAMPLE> samples = createTestSamples((int)written, burstSize);
+            while (buffer.writeRaw(samples.data(), burstSize) == 0 && !failed.load())
+            {
+                std::this_thread::yield();
+            }
+
+            // Let the consumer catch up to the end of the block
+            // so the next block is linked while it is reading
+            if ((written + burstSize) % buffer.getBlockSize() == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t next = 0;
+    while (next < count && !failed.load())
+    {
+        void *ptr[2] = {0};
+        ring_buffer_size_t sizes[2] = {0};
+        ring_buffer_size_t samplesRead = buffer.directRead(readSize, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+        if (samplesRead == 0)
+        {
+            continue;
+        }
+
+        EXPECT_NE(nullptr, ptr[0]);
+        EXPECT_EQ(samplesRead, sizes[0] + sizes[1]);
+        failed.store(ptr[0] == nullptr || samplesRead != sizes[0] + sizes[1]);
+
+        for (int i = 0; i < 2 && ptr[i] != nullptr && !failed.load(); i++)
+        {
+            SAMPLE *samples = (SAMPLE *)ptr[i];
+            for (ring_buffer_size_t s = 0; s < sizes[i]; s++)
+            {
+                EXPECT_EQ((SAMPLE)next++, samples[s]);
+            }
+        }
+    }
+
+    producer.join();
+
+    EXPECT_EQ(0, buffer.getDroppedSamples());
+}
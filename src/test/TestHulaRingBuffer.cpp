@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 #include <hlaudio/hlaudio.h>
 
+#include <thread>
+#include <vector>
+
 using namespace hula;
 
 #define TEST_BUFFER_SIZE 0.2f
@@ -280,4 +283,187 @@ TEST(TestHulaRingBuffer, direct_read_wrap_buffer)
     delete [] readData;
     delete [] writeData;
     delete rb;
-}
\ No newline at end of file
+}
+
+/**
+ * Reserve space in the buffer, fill it in place and commit it.
+ *
+ * EXPECTED:
+ *      Nothing is readable before the commit.
+ *      Everything is readable after the commit.
+ *      Data is intact.
+ */
+TEST(TestHulaRingBuffer, begin_and_commit_write)
+{
+    HulaRingBuffer *rb = new HulaRingBuffer(TEST_BUFFER_SIZE);
+
+    SAMPLE *writeData = createTestSamples();
+    SAMPLE *readData = new SAMPLE[TEST_NUM_SAMPLES];
+
+    void *ptr1 = nullptr;
+    ring_buffer_size_t count1 = 0;
+    void *ptr2 = nullptr;
+    ring_buffer_size_t count2 = 0;
+
+    ring_buffer_size_t samplesReserved = rb->beginWrite(TEST_NUM_SAMPLES, &ptr1, &count1, &ptr2, &count2);
+    EXPECT_EQ(samplesReserved, TEST_NUM_SAMPLES);
+
+    // Fresh buffer should not wrap
+    EXPECT_TRUE(ptr1 != nullptr);
+    EXPECT_EQ(count1, TEST_NUM_SAMPLES);
+    EXPECT_TRUE(ptr2 == nullptr);
+    EXPECT_EQ(count2, 0);
+
+    memcpy(ptr1, writeData, SAMPLES_TO_BYTES(count1));
+
+    // Not visible until committed
+    EXPECT_EQ(rb->read(readData, TEST_NUM_SAMPLES), 0);
+
+    rb->commitWrite(samplesReserved);
+
+    ring_buffer_size_t samplesRead = rb->read(readData, TEST_NUM_SAMPLES);
+    EXPECT_EQ(samplesRead, TEST_NUM_SAMPLES);
+
+    // Make sure the two are identical
+    EXPECT_TRUE(verifySamples(readData, TEST_NUM_SAMPLES));
+
+    delete [] readData;
+    delete [] writeData;
+    delete rb;
+}
+
+/**
+ * Reserve and commit until the write region wraps.
+ *
+ * EXPECTED:
+ *      The second pointer from beginWrite becomes non-null.
+ *      Regions are whole frames.
+ *      Data is intact accross wrap.
+ */
+TEST(TestHulaRingBuffer, begin_write_wrap_buffer)
+{
+    HulaRingBuffer *rb = new HulaRingBuffer(TEST_BUFFER_SIZE);
+
+    SAMPLE *writeData = createTestSamples();
+    SAMPLE *readData = new SAMPLE[TEST_NUM_SAMPLES];
+
+    void *ptr1 = nullptr;
+    ring_buffer_size_t count1 = 0;
+    void *ptr2 = nullptr;
+    ring_buffer_size_t count2 = 0;
+
+    // Write/read until the reservation wraps around
+    while (count2 == 0)
+    {
+        ring_buffer_size_t samplesReserved = rb->beginWrite(TEST_NUM_SAMPLES, &ptr1, &count1, &ptr2, &count2);
+        EXPECT_EQ(samplesReserved, TEST_NUM_SAMPLES);
+
+        memcpy(ptr1, writeData, SAMPLES_TO_BYTES(count1));
+        if (ptr2 != nullptr)
+        {
+            memcpy(ptr2, writeData + count1, SAMPLES_TO_BYTES(count2));
+        }
+        rb->commitWrite(samplesReserved);
+
+        ring_buffer_size_t samplesRead = rb->read(readData, TEST_NUM_SAMPLES);
+        EXPECT_EQ(samplesRead, TEST_NUM_SAMPLES);
+    }
+
+    // Frames should never be split
+    EXPECT_EQ(count1 % NUM_CHANNELS, 0);
+    EXPECT_EQ(count2 % NUM_CHANNELS, 0);
+    EXPECT_EQ(count1 + count2, TEST_NUM_SAMPLES);
+
+    // Make sure the two are identical
+    EXPECT_TRUE(verifySamples(readData, TEST_NUM_SAMPLES));
+
+    delete [] readData;
+    delete [] writeData;
+    delete rb;
+}
+
+/**
+ * Fill the buffer past capacity, drain it and report an underrun.
+ *
+ * EXPECTED:
+ *      The short write is counted as one overrun with the lost samples.
+ *      The high-water mark is the full buffer.
+ *      The reported underrun is counted.
+ */
+TEST(TestHulaRingBuffer, stats_counters)
+{
+    HulaRingBuffer *rb = new HulaRingBuffer(TEST_BUFFER_SIZE);
+    rb->setName("test");
+
+    SAMPLE *writeData = createTestSamples();
+    SAMPLE *readData = new SAMPLE[TEST_NUM_SAMPLES];
+
+    EXPECT_EQ("test", rb->getName());
+    EXPECT_EQ(0, rb->getOverrunCount());
+    EXPECT_EQ(0, rb->getHighWaterMark());
+
+    // The capacity is not a multiple of TEST_NUM_SAMPLES,
+    // so the last write only fits partially
+    ring_buffer_size_t written = 0;
+    while (rb->getWriteAvailable() > 0)
+    {
+        written += rb->write(writeData, TEST_NUM_SAMPLES);
+    }
+    ASSERT_EQ(written, rb->getCapacity());
+    ASSERT_NE(0, rb->getCapacity() % TEST_NUM_SAMPLES);
+
+    EXPECT_EQ(1, rb->getOverrunCount());
+    EXPECT_EQ(TEST_NUM_SAMPLES - rb->getCapacity() % TEST_NUM_SAMPLES, rb->getDroppedSamples());
+
+    // A full buffer is refused outright
+    EXPECT_EQ(0, rb->write(writeData, TEST_NUM_SAMPLES));
+    EXPECT_EQ(2, rb->getOverrunCount());
+
+    while (rb->read(readData, TEST_NUM_SAMPLES) > 0)
+    {
+    }
+    EXPECT_EQ(rb->getCapacity(), rb->getHighWaterMark());
+
+    rb->reportUnderrun();
+    EXPECT_EQ(1, rb->getUnderrunCount());
+
+    delete [] readData;
+    delete [] writeData;
+    delete rb;
+}
+
+/**
+ * Fill the buffer and wait for space while nothing is read,
+ * then again while another thread drains it.
+ *
+ * EXPECTED:
+ *      The first wait times out.
+ *      The second wait is woken by the reader well before its timeout
+ *      and the requested space is free.
+ */
+TEST(TestHulaRingBuffer, wait_for_space)
+{
+    HulaRingBuffer *rb = new HulaRingBuffer(TEST_BUFFER_SIZE);
+    std::vector<SAMPLE> block(rb->getCapacity());
+    ASSERT_EQ(rb->getCapacity(), rb->write(block.data(), rb->getCapacity()));
+
+    ring_buffer_size_t half = rb->getCapacity() / 2;
+    EXPECT_FALSE(rb->waitForSpace(half, 20));
+
+    std::thread reader([&]() {
+        SAMPLE readData[TEST_NUM_SAMPLES];
+        while (rb->getReadAvailable() > 0)
+        {
+            rb->read(readData, TEST_NUM_SAMPLES);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(rb->waitForSpace(half, 5000));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_GE(rb->getWriteAvailable(), half);
+
+    reader.join();
+    delete rb;
+}
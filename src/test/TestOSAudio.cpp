@@ -24,6 +24,27 @@ using namespace hula;
                                     }, std::ref(promisedFinished)).detach(); \
                                     EXPECT_FALSE(futureResult.wait_for(std::chrono::milliseconds(X)) != std::future_status::timeout);
 
+/**
+ * Counts device change notifications.
+ */
+class TestDeviceListener : public IDeviceListener {
+    public:
+        std::atomic<int> calls;
+        std::atomic<uint64_t> lastGeneration;
+
+        TestDeviceListener()
+        {
+            calls.store(0);
+            lastGeneration.store(0);
+        }
+
+        void handleDevicesChanged(uint64_t generation)
+        {
+            lastGeneration.store(generation);
+            calls++;
+        }
+};
+
 class TestOSAudio : public OSAudio, public ::testing::Test {
     public:
         Device *testDevice;
@@ -63,12 +84,30 @@ class TestOSAudio : public OSAudio, public ::testing::Test {
             return true;
         }
 
+        /**
+         * Devices reported by getDevices.
+         */
+        std::vector<Device> mockDevices;
+        std::mutex mockDevicesMutex;
+
         std::vector<Device *> getDevices(DeviceType type)
         {
+            std::lock_guard<std::mutex> lock(mockDevicesMutex);
+
             std::vector<Device *> devices;
+            for (const Device &device : mockDevices)
+            {
+                devices.push_back(new Device(device));
+            }
             return devices;
         }
 
+        void setMockDevices(std::vector<Device> devices)
+        {
+            std::lock_guard<std::mutex> lock(mockDevicesMutex);
+            mockDevices = devices;
+        }
+
         bool checkDeviceParams(Device *device)
         {
             return true;
@@ -212,6 +251,46 @@ TEST_F(TestOSAudio, remove_buffer_kills_thread)
     EXPECT_EQ(this->inThreads.size(), 0);
 }
 
+/**
+ * Add readers and publish data once.
+ *
+ * EXPECTED:
+ *      Readers keep the capture thread alive.
+ *      Each reader receives the data from a single copyToBuffers.
+ *      Removing the last reader stops the capture thread.
+ */
+TEST_F(TestOSAudio, readers_share_one_write)
+{
+    HulaBroadcastReader *r1 = this->createReader(TEST_BUFFER_SIZE);
+    HulaBroadcastReader *r2 = this->createReader(TEST_BUFFER_SIZE);
+
+    this->addReader(nullptr);
+    this->addReader(r1);
+    this->addReader(r2);
+    this->addReader(r2);
+    ASSERT_EQ(this->readers.size(), 2);
+    EXPECT_EQ(this->inThreads.size(), 1);
+
+    SAMPLE data[4] = {1, 2, 3, 4};
+    this->copyToBuffers(data, 4);
+
+    SAMPLE out[4] = {0};
+    EXPECT_EQ(r1->read(out, 4), 4);
+    EXPECT_EQ(out[3], 4);
+    EXPECT_EQ(r2->read(out, 4), 4);
+    EXPECT_EQ(out[0], 1);
+
+    this->removeReader(r1);
+    this->removeReader(r2);
+    EXPECT_EQ(this->readers.size(), 0);
+
+    waitForThreadDeathBeforeDestruction();
+    EXPECT_EQ(this->inThreads.size(), 0);
+
+    delete r1;
+    delete r2;
+}
+
 
 
 /*********************************************
@@ -393,3 +472,142 @@ TEST_F(TestOSAudio, remove_callback_kills_thread)
     // this assumption to check that the thread was joined
     EXPECT_EQ(this->inThreads.size(), 0);
 }
+
+/*********************************************
+ *                Concurrency                *
+ *********************************************/
+
+/**
+ * Attach and detach consumers while another thread
+ * continuously delivers data, deleting each consumer
+ * right after it is removed.
+ *
+ * EXPECTED:
+ *      No crash or use-after-free.
+ *      The permanent callback keeps receiving data.
+ *      Lists are empty at the end.
+ */
+TEST_F(TestOSAudio, attach_detach_during_capture)
+{
+    TestCallback anchor;
+    this->addCallback(&anchor);
+
+    std::atomic<bool> done(false);
+    std::atomic<long> blocks(0);
+
+    // Stand in for the capture thread
+    std::thread producer([&]()
+    {
+        SAMPLE data[FRAMES_PER_BUFFER * NUM_CHANNELS] = {0};
+        while (!done.load())
+        {
+            this->copyToBuffers(data, FRAMES_PER_BUFFER * NUM_CHANNELS);
+            this->doCallbacks(data, FRAMES_PER_BUFFER * NUM_CHANNELS);
+            blocks++;
+        }
+    });
+
+    for (int i = 0; i < 5000; i++)
+    {
+        TestCallback cb;
+        HulaRingBuffer *rb = new HulaRingBuffer(TEST_BUFFER_SIZE);
+        HulaBroadcastReader *reader = this->createReader(TEST_BUFFER_SIZE);
+
+        this->addCallback(&cb);
+        this->addBuffer(rb);
+        this->addReader(reader);
+
+        this->removeReader(reader);
+        this->removeBuffer(rb);
+        this->removeCallback(&cb);
+
+        delete reader;
+        delete rb;
+    }
+
+    done.store(true);
+    producer.join();
+
+    EXPECT_GT(blocks.load(), 0);
+    EXPECT_TRUE(anchor.dataReceived);
+    EXPECT_EQ(this->rbs.size(), 0);
+    EXPECT_EQ(this->readers.size(), 0);
+
+    this->removeCallback(&anchor);
+    EXPECT_EQ(this->cbs.size(), 0);
+
+    waitForThreadDeathBeforeDestruction();
+}
+
+/**
+ * The device snapshot only changes generation when the devices do.
+ *
+ * EXPECTED:
+ *      Generation starts at 0 with no devices.
+ *      Generation increments once per change and not on a refresh without changes.
+ *      Old snapshots stay valid after a change.
+ */
+TEST_F(TestOSAudio, device_snapshot_generation)
+{
+    EXPECT_EQ(getDeviceGeneration(), 0);
+    EXPECT_EQ(getDeviceSnapshot()->devices.size(), 0);
+
+    std::shared_ptr<const DeviceSnapshot> first = getDeviceSnapshot();
+
+    setMockDevices({Device(DeviceID(), "Input", RECORD), Device(DeviceID(), "Output", PLAYBACK)});
+    markDevicesChanged();
+
+    std::shared_ptr<const DeviceSnapshot> second = getDeviceSnapshot();
+    EXPECT_EQ(second->generation, 1);
+    ASSERT_EQ(second->devices.size(), 2);
+    EXPECT_EQ(second->devices[0].getName(), "Input");
+    EXPECT_EQ(second->devices[1].getType(), PLAYBACK);
+
+    // Nothing changed
+    EXPECT_FALSE(refreshDevices());
+    EXPECT_EQ(getDeviceGeneration(), 1);
+
+    // Same count but a different device
+    setMockDevices({Device(DeviceID(), "Input", RECORD), Device(DeviceID(), "Headphones", PLAYBACK)});
+    EXPECT_TRUE(refreshDevices());
+    EXPECT_EQ(getDeviceGeneration(), 2);
+
+    // Held snapshots are untouched
+    EXPECT_EQ(first->devices.size(), 0);
+    EXPECT_EQ(second->devices[1].getName(), "Output");
+}
+
+/**
+ * Listeners hear about changes from the watcher thread.
+ *
+ * EXPECTED:
+ *      Listener is called once with the new generation.
+ *      Listener is not called after removal.
+ */
+TEST_F(TestOSAudio, device_listener_notified)
+{
+    TestDeviceListener listener;
+
+    // Settle the initial list
+    getDeviceSnapshot();
+
+    addDeviceListener(&listener);
+    addDeviceListener(&listener);
+
+    setMockDevices({Device(DeviceID(), "Input", RECORD)});
+    markDevicesChanged();
+
+    for (int i = 0; i < 100 && listener.calls.load() == 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(CHECK_IF_DEAD_TIME));
+    }
+
+    EXPECT_EQ(listener.calls.load(), 1);
+    EXPECT_EQ(listener.lastGeneration.load(), getDeviceGeneration());
+
+    removeDeviceListener(&listener);
+
+    setMockDevices({});
+    EXPECT_TRUE(refreshDevices());
+    EXPECT_EQ(listener.calls.load(), 1);
+}
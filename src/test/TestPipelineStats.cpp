@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <hlaudio/hlaudio.h>
+
+#include <chrono>
+#include <thread>
+
+using namespace hula;
+
+#define TEST_CAPTURE_MS 300
+#define TEST_SMALL_BUFFER 0.05f
+
+/**
+ * Callback that does nothing with the data.
+ */
+class NullCallback : public ICallback {
+    public:
+        void handleData(const SAMPLE *samples, ring_buffer_size_t sampleCount)
+        {
+            (void)samples;
+            (void)sampleCount;
+        }
+};
+
+/**
+ * Map intervals onto histogram buckets.
+ *
+ * EXPECTED:
+ *      Bucket b holds intervals from 2^b up to 2^(b+1) microseconds.
+ *      Anything too long ends up in the last bucket.
+ */
+TEST(TestPipelineStats, histogram_buckets)
+{
+    EXPECT_EQ(0, PipelineStats::getBucket(0));
+    EXPECT_EQ(0, PipelineStats::getBucket(1));
+    EXPECT_EQ(1, PipelineStats::getBucket(2));
+    EXPECT_EQ(1, PipelineStats::getBucket(3));
+    EXPECT_EQ(9, PipelineStats::getBucket(1000));
+    EXPECT_EQ(13, PipelineStats::getBucket(11610));
+    EXPECT_EQ(HL_STATS_HISTOGRAM_BUCKETS - 1, PipelineStats::getBucket(UINT64_MAX));
+}
+
+/**
+ * Read percentiles from a known histogram.
+ *
+ * EXPECTED:
+ *      The upper edge of the bucket holding the percentile.
+ *      The maximum for the last bucket and 0 when empty.
+ */
+TEST(TestPipelineStats, interval_percentiles)
+{
+    PipelineStatsSnapshot stats;
+    EXPECT_EQ(0, stats.getIntervalPercentileUs(50));
+
+    stats.intervalHistogram[3] = 98;
+    stats.intervalHistogram[10] = 1;
+    stats.intervalHistogram[HL_STATS_HISTOGRAM_BUCKETS - 1] = 1;
+    stats.maxIntervalUs = 5000000;
+
+    EXPECT_EQ(16, stats.getIntervalPercentileUs(50));
+    EXPECT_EQ(16, stats.getIntervalPercentileUs(98));
+    EXPECT_EQ(2048, stats.getIntervalPercentileUs(99));
+    EXPECT_EQ(5000000, stats.getIntervalPercentileUs(100));
+}
+
+/**
+ * Run capture at real time with a ring buffer that is never read,
+ * a reader and a callback attached.
+ *
+ * EXPECTED:
+ *      Every attached buffer shows up with its name.
+ *      The ring buffer overran and dropped samples.
+ *      Blocks, intervals and consumer time were recorded.
+ */
+TEST(TestPipelineStats, controller_snapshot)
+{
+    Controller controller(new FileAudio("", 1.0));
+
+    HulaRingBuffer rb(TEST_SMALL_BUFFER);
+    rb.setName("ring");
+
+    HulaBroadcastReader *reader = controller.createBuffer(TEST_SMALL_BUFFER);
+    reader->setName("reader");
+
+    NullCallback cb;
+
+    controller.addBuffer(&rb);
+    controller.addReader(reader);
+    controller.addCallback(&cb);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(TEST_CAPTURE_MS));
+    PipelineStatsSnapshot stats = controller.getStatsSnapshot();
+
+    ASSERT_EQ(3, stats.rings.size());
+    EXPECT_EQ(HL_PLAYBACK_RB_NAME, stats.rings[0].name);
+    EXPECT_EQ("ring", stats.rings[1].name);
+    EXPECT_EQ("reader", stats.rings[2].name);
+
+    EXPECT_EQ(rb.getCapacity(), stats.rings[1].capacity);
+    EXPECT_EQ(stats.rings[1].capacity, stats.rings[1].fill);
+    EXPECT_GT(stats.rings[1].overruns, 0);
+    EXPECT_GT(stats.rings[1].droppedSamples, 0);
+
+    EXPECT_GT(stats.captureBlocks, 1);
+    uint64_t intervals = 0;
+    for (size_t b = 0; b < HL_STATS_HISTOGRAM_BUCKETS; b++)
+    {
+        intervals += stats.intervalHistogram[b];
+    }
+    EXPECT_GT(intervals, 0);
+    EXPECT_LT(intervals, stats.captureBlocks + 1);
+
+    // Blocks are about 11.6 ms apart at real time
+    EXPECT_GE(stats.getIntervalPercentileUs(50), 4096);
+    EXPECT_LE(stats.getIntervalPercentileUs(50), 65536);
+
+    EXPECT_GT(stats.bufferTime.count, 0);
+    EXPECT_GT(stats.callbackTime.count, 0);
+    EXPECT_EQ(0, stats.diskLatency.count);
+
+    controller.removeCallback(&cb);
+    controller.removeReader(reader);
+    controller.removeBuffer(&rb);
+    delete reader;
+
+    stats = controller.getStatsSnapshot();
+    EXPECT_EQ(1, stats.rings.size());
+
+    controller.resetStats();
+    stats = controller.getStatsSnapshot();
+    EXPECT_EQ(0, stats.captureBlocks);
+    EXPECT_EQ(0, stats.bufferTime.count);
+}
+
+/**
+ * Add measurements directly.
+ *
+ * EXPECTED:
+ *      Count, total and maximum follow what was added.
+ */
+TEST(TestPipelineStats, timing)
+{
+    PipelineStats stats;
+    stats.addDiskLatency(2000000);
+    stats.addDiskLatency(4000000);
+
+    PipelineStatsSnapshot snapshot;
+    stats.copyTo(snapshot);
+
+    EXPECT_EQ(2, snapshot.diskLatency.count);
+    EXPECT_EQ(6000, snapshot.diskLatency.totalUs);
+    EXPECT_EQ(4000, snapshot.diskLatency.maxUs);
+    EXPECT_DOUBLE_EQ(3000, snapshot.diskLatency.getMeanUs());
+}
@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 #include <hlcontrol/hlcontrol.h>
 
+#include <hlcontrol/internal/Record.h>
+
+#include <chrono>
+#include <thread>
+
+#include <sndfile.h>
+
 using namespace hula;
 
 class TestRecord : public ::testing::Test {
@@ -29,4 +36,68 @@ TEST_F(TestRecord, checkIfRecording)
 TEST_F(TestRecord, checkIfStopped)
 {
     ASSERT_EQ(3, 3);
-}
\ No newline at end of file
+}
+
+/**
+ * Record from FileAudio at real time.
+ *
+ * EXPECTED:
+ *      The capture reader is listed by name in the statistics.
+ *      Capture-to-disk latency was measured and stays below what
+ *      the staging buffer can hold.
+ */
+TEST_F(TestRecord, disk_latency_is_reported)
+{
+    Controller controller(new FileAudio("", 1.0));
+    Record record(&controller);
+
+    record.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    PipelineStatsSnapshot stats = controller.getStatsSnapshot();
+    ASSERT_EQ(2, stats.rings.size());
+    EXPECT_EQ(HL_RECORD_RB_NAME, stats.rings[1].name);
+
+    record.stop();
+
+    stats = controller.getStatsSnapshot();
+    EXPECT_GT(stats.diskLatency.count, 0);
+    EXPECT_LT(stats.diskLatency.maxUs, HL_RECORD_STAGING_DURATION * 1000000 / 2);
+
+    Export::deleteTempFiles(record.getExportPaths());
+    record.clearExportPaths();
+}
+
+/**
+ * Record from FileAudio at real time through a spool file.
+ *
+ * EXPECTED:
+ *      The spool is compressed to a temp FLAC file and nothing was dropped.
+ */
+TEST_F(TestRecord, spooled_recording)
+{
+    HulaSettings::getInstance()->setRecordSpooling(true);
+
+    Controller controller(new FileAudio("", 1.0));
+    Record record(&controller);
+
+    record.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    record.stop();
+
+    HulaSettings::getInstance()->setRecordSpooling(false);
+
+    std::vector<std::string> paths = record.getExportPaths();
+    ASSERT_EQ(1, paths.size());
+
+    SF_INFO info = {0};
+    SNDFILE *file = sf_open(paths[0].c_str(), SFM_READ, &info);
+    ASSERT_NE(nullptr, file);
+    sf_close(file);
+
+    EXPECT_GT(info.frames, 0);
+    EXPECT_EQ(0, record.getDroppedSamples());
+
+    Export::deleteTempFiles(paths);
+    record.clearExportPaths();
+}
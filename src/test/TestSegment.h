@@ -0,0 +1,62 @@
+#ifndef HL_TEST_SEGMENT_H
+#define HL_TEST_SEGMENT_H
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sndfile.h>
+
+#include <hlaudio/hlaudio.h>
+
+using namespace hula;
+
+/**
+ * Fixture for tests that read sessions of temp files.
+ * Every segment it writes is deleted after the test.
+ */
+class TestSegment : public ::testing::Test {
+    public:
+        std::vector<std::string> files;
+
+        virtual void TearDown()
+        {
+            for (auto const &file : files)
+            {
+                remove(file.c_str());
+            }
+        }
+
+        /**
+         * Write a stereo segment whose samples hold their frame number
+         * within the session, starting at firstFrame, times scale.
+         * FLAC holds samples in [-1, 1) only, so it needs a small scale.
+         */
+        std::string createSegment(const std::string &path, uint64_t firstFrame, size_t frames,
+                                  int format = SF_FORMAT_WAV | SF_FORMAT_FLOAT, float scale = 1.0f)
+        {
+            files.push_back(path);
+
+            SF_INFO info = {0};
+            info.samplerate = HulaAudioSettings::getInstance()->getSampleRate();
+            info.channels = NUM_CHANNELS;
+            info.format = format;
+
+            std::vector<float> samples(frames * NUM_CHANNELS);
+            for (size_t i = 0; i < samples.size(); i++)
+            {
+                samples[i] = (float)(firstFrame + i / NUM_CHANNELS) * scale;
+            }
+
+            SNDFILE *file = sf_open(path.c_str(), SFM_WRITE, &info);
+            EXPECT_NE(nullptr, file);
+            sf_writef_float(file, samples.data(), frames);
+            sf_close(file);
+
+            return path;
+        }
+};
+
+#endif // END HL_TEST_SEGMENT_H
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <hlcontrol/internal/SegmentIndex.h>
+
+#include <vector>
+
+#include <sndfile.h>
+
+#include "TestSegment.h"
+
+using namespace hula;
+
+class TestSegmentIndex : public TestSegment { };
+
+/**
+ * Index three segments and a missing one.
+ *
+ * EXPECTED:
+ *      The missing segment is empty and everything else adds up.
+ *      Frames on either side of each boundary map to the right segment.
+ *      Frames past the end are not found.
+ */
+TEST_F(TestSegmentIndex, locate_across_segments)
+{
+    std::vector<std::string> paths;
+    paths.push_back(createSegment("TestSegmentIndex-0.wav", 0, 1000));
+    paths.push_back("TestSegmentIndex-missing.wav");
+    paths.push_back(createSegment("TestSegmentIndex-2.wav", 1000, 2500));
+    paths.push_back(createSegment("TestSegmentIndex-3.wav", 3500, 700));
+
+    SegmentIndex index(paths);
+    EXPECT_EQ(4, index.getSegmentCount());
+    EXPECT_EQ(4200, index.getTotalFrames());
+    EXPECT_EQ(0, index.getSegmentFrames(1));
+    EXPECT_EQ(3500, index.getSegmentStart(3));
+
+    SegmentPosition position;
+    ASSERT_TRUE(index.locate(999, &position));
+    EXPECT_EQ(0, position.segment);
+    EXPECT_EQ(999, position.frame);
+
+    ASSERT_TRUE(index.locate(1000, &position));
+    EXPECT_EQ(2, position.segment);
+    EXPECT_EQ(0, position.frame);
+
+    ASSERT_TRUE(index.locate(4199, &position));
+    EXPECT_EQ(3, position.segment);
+    EXPECT_EQ(699, position.frame);
+
+    EXPECT_FALSE(index.locate(4200, &position));
+    EXPECT_FALSE(SegmentIndex().locate(0, &position));
+}
+
+/**
+ * Seek to a frame in the middle of the second segment.
+ *
+ * EXPECTED:
+ *      The first frame read after sf_seek() is the one asked for.
+ */
+TEST_F(TestSegmentIndex, seek_is_sample_accurate)
+{
+    std::vector<std::string> paths;
+    paths.push_back(createSegment("TestSegmentIndex-0.wav", 0, 1000));
+    paths.push_back(createSegment("TestSegmentIndex-1.wav", 1000, 1000));
+
+    SegmentIndex index(paths);
+
+    SegmentPosition position;
+    ASSERT_TRUE(index.locate(1234, &position));
+
+    SF_INFO info = {0};
+    SNDFILE *file = sf_open(paths[position.segment].c_str(), SFM_READ, &info);
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(234, sf_seek(file, position.frame, SEEK_SET));
+
+    float frame[NUM_CHANNELS];
+    ASSERT_EQ(1, sf_readf_float(file, frame, 1));
+    sf_close(file);
+
+    EXPECT_EQ(1234.0f, frame[0]);
+    EXPECT_EQ(1234.0f, frame[1]);
+}
+
+/**
+ * Seek into a FLAC segment like the ones Record writes, far enough
+ * in that libFLAC has to look past the first frames.
+ *
+ * EXPECTED:
+ *      The first frame read after sf_seek() is the one asked for.
+ */
+TEST_F(TestSegmentIndex, seek_in_flac_segment)
+{
+    const float scale = 1.0f / (1 << 20);
+
+    std::vector<std::string> paths;
+    paths.push_back(createSegment("TestSegmentIndex-0.flac", 0, 50000, SF_FORMAT_FLAC | SF_FORMAT_PCM_24, scale));
+    paths.push_back(createSegment("TestSegmentIndex-1.flac", 50000, 100000, SF_FORMAT_FLAC | SF_FORMAT_PCM_24, scale));
+
+    SegmentIndex index(paths);
+    EXPECT_EQ(150000, index.getTotalFrames());
+
+    SegmentPosition position;
+    ASSERT_TRUE(index.locate(123457, &position));
+    EXPECT_EQ(1, position.segment);
+    EXPECT_EQ(73457, position.frame);
+
+    SF_INFO info = {0};
+    SNDFILE *file = sf_open(paths[position.segment].c_str(), SFM_READ, &info);
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(73457, sf_seek(file, position.frame, SEEK_SET));
+
+    float frame[NUM_CHANNELS];
+    ASSERT_EQ(1, sf_readf_float(file, frame, 1));
+    sf_close(file);
+
+    EXPECT_NEAR(123457 * scale, frame[0], scale / 4);
+    EXPECT_NEAR(123457 * scale, frame[1], scale / 4);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <hlcontrol/internal/SegmentReader.h>
+
+#include <vector>
+
+#include "TestSegment.h"
+
+using namespace hula;
+
+class TestSegmentReader : public TestSegment { };
+
+/**
+ * Read a session of three segments and a missing one in blocks
+ * that don't line up with the segment boundaries, starting
+ * part way into the first segment.
+ *
+ * The second segment is longer than what is decoded ahead,
+ * so it is read both from the prefetched head and the decoder.
+ *
+ * EXPECTED:
+ *      Every frame from the start position to the end arrives
+ *      exactly once and in order.
+ */
+TEST_F(TestSegmentReader, reads_across_segments)
+{
+    const size_t longSegment = (size_t)HulaAudioSettings::getInstance()->getSampleRate() * HL_SEGMENT_PREFETCH_DURATION + 1000;
+
+    std::vector<std::string> paths;
+    paths.push_back(createSegment("TestSegmentReader-0.wav", 0, 1000));
+    paths.push_back(createSegment("TestSegmentReader-1.wav", 1000, longSegment));
+    paths.push_back("TestSegmentReader-missing.wav");
+    paths.push_back(createSegment("TestSegmentReader-3.wav", 1000 + longSegment, 700));
+    const uint64_t totalFrames = 1700 + longSegment;
+
+    SegmentPosition start;
+    start.segment = 0;
+    start.frame = 500;
+
+    SegmentReader reader(paths, start);
+
+    std::vector<float> block(600);
+    uint64_t next = start.frame;
+    ring_buffer_size_t samplesRead;
+    while ((samplesRead = reader.read(block.data(), (ring_buffer_size_t)block.size())) > 0)
+    {
+        for (ring_buffer_size_t i = 0; i < samplesRead; i++)
+        {
+            ASSERT_EQ((float)(next + i / NUM_CHANNELS), block[i]) << "at frame " << next;
+        }
+        next += samplesRead / NUM_CHANNELS;
+    }
+
+    EXPECT_EQ(totalFrames, next);
+    EXPECT_EQ(paths.size(), reader.getSegment());
+
+    // Stays at the end
+    EXPECT_EQ(0, reader.read(block.data(), (ring_buffer_size_t)block.size()));
+}
+
+/**
+ * Destroy a reader before reading anything.
+ *
+ * EXPECTED:
+ *      The prefetch thread is stopped and the files are closed.
+ */
+TEST_F(TestSegmentReader, destroy_unread)
+{
+    std::vector<std::string> paths;
+    paths.push_back(createSegment("TestSegmentReader-0.wav", 0, 1000));
+    paths.push_back(createSegment("TestSegmentReader-1.wav", 1000, 1000));
+
+    SegmentReader reader(paths, SegmentPosition());
+}
@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+#include <hlcontrol/internal/SessionJournal.h>
+#include <hlcontrol/internal/SpoolFile.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sndfile.h>
+
+using namespace hula;
+
+#define TEST_JOURNAL_PATH "./" HL_JOURNAL_PREFIX "test" HL_JOURNAL_EXTENSION
+
+class TestSessionJournal : public ::testing::Test {
+    public:
+        std::vector<std::string> files;
+
+        virtual void SetUp()
+        {
+            files.push_back(TEST_JOURNAL_PATH);
+        }
+
+        virtual void TearDown()
+        {
+            for (auto const &file : files)
+            {
+                remove(file.c_str());
+            }
+        }
+};
+
+/**
+ * Write a journal, drop it without finishing and read it back.
+ *
+ * EXPECTED:
+ *      Every segment, checkpoint and close survives.
+ */
+TEST_F(TestSessionJournal, write_and_resume)
+{
+    {
+        SessionJournal journal(TEST_JOURNAL_PATH);
+        EXPECT_EQ(0, journal.addSegment("first.flac"));
+        EXPECT_EQ(1, journal.addSegment("path with spaces.flac"));
+        journal.checkpoint(0, 1000, 4096);
+        journal.checkpoint(1, 2000, 4096);
+        journal.checkpoint(1, 3000, 8192);
+        journal.closeSegment(0);
+    }
+
+    SessionJournal journal(TEST_JOURNAL_PATH, true);
+    std::vector<JournalSegment> segments = journal.getSegments();
+    ASSERT_EQ(2, segments.size());
+
+    EXPECT_EQ("first.flac", segments[0].path);
+    EXPECT_EQ(1000, segments[0].checkpointBytes);
+    EXPECT_EQ(4096, segments[0].checkpointSamples);
+    EXPECT_TRUE(segments[0].closed);
+
+    EXPECT_EQ("path with spaces.flac", segments[1].path);
+    EXPECT_EQ(3000, segments[1].checkpointBytes);
+    EXPECT_EQ(8192, segments[1].checkpointSamples);
+    EXPECT_FALSE(segments[1].closed);
+
+    // Resumed journals keep numbering where they left off
+    EXPECT_EQ(2, journal.addSegment("third.flac"));
+}
+
+/**
+ * Read a journal whose last line was cut short by a crash.
+ *
+ * EXPECTED:
+ *      The partial line is ignored.
+ */
+TEST_F(TestSessionJournal, partial_line)
+{
+    {
+        SessionJournal journal(TEST_JOURNAL_PATH);
+        journal.addSegment("first.flac");
+        journal.checkpoint(0, 1000, 4096);
+    }
+
+    std::ofstream(TEST_JOURNAL_PATH, std::ios::app) << "checkpoint 0";
+
+    SessionJournal journal(TEST_JOURNAL_PATH, true);
+    std::vector<JournalSegment> segments = journal.getSegments();
+    ASSERT_EQ(1, segments.size());
+    EXPECT_EQ(1000, segments[0].checkpointBytes);
+}
+
+/**
+ * Recover a session with a closed segment, a missing one and
+ * one that is not a FLAC file.
+ *
+ * EXPECTED:
+ *      Only the closed segment is returned.
+ */
+TEST_F(TestSessionJournal, recover_skips_unusable_segments)
+{
+    files.push_back("TestSessionJournal-closed.flac");
+    files.push_back("TestSessionJournal-broken.flac");
+    std::ofstream("TestSessionJournal-closed.flac") << "fLaC";
+    std::ofstream("TestSessionJournal-broken.flac") << "RIFF";
+
+    SessionJournal journal(TEST_JOURNAL_PATH);
+    journal.addSegment("TestSessionJournal-closed.flac");
+    journal.addSegment("TestSessionJournal-missing.flac");
+    journal.addSegment("TestSessionJournal-broken.flac");
+    journal.closeSegment(0);
+
+    std::vector<std::string> paths = journal.recover();
+    ASSERT_EQ(1, paths.size());
+    EXPECT_EQ("TestSessionJournal-closed.flac", paths[0]);
+}
+
+/**
+ * Recover a session whose encoder never got to the end of its spool,
+ * next to a closed segment that left its spool behind.
+ *
+ * EXPECTED:
+ *      The committed samples are encoded into a tail file that is
+ *      returned and journaled. Both spools are deleted.
+ */
+TEST_F(TestSessionJournal, recover_spool)
+{
+    files.push_back("TestSessionJournal-closed.flac");
+    files.push_back("TestSessionJournal-closed.spool");
+    files.push_back("TestSessionJournal-open.spool");
+    files.push_back("TestSessionJournal-open_spool.flac");
+    std::ofstream("TestSessionJournal-closed.flac") << "fLaC";
+    std::ofstream("TestSessionJournal-closed.spool") << "HLSPOOL";
+
+    std::vector<float> samples(10000 * NUM_CHANNELS);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = (float)(i % 100) / 200.0f;
+    }
+    {
+        SpoolFile spool("TestSessionJournal-open.spool");
+        spool.write(samples.data(), FLOAT_32, samples.size());
+    }
+
+    SessionJournal journal(TEST_JOURNAL_PATH);
+    journal.addSegment("TestSessionJournal-closed.flac");
+    journal.setSpool(0, "TestSessionJournal-closed.spool");
+    journal.closeSegment(0);
+    journal.addSegment("TestSessionJournal-open.flac");
+    journal.setSpool(1, "TestSessionJournal-open.spool");
+
+    std::vector<std::string> paths = journal.recover();
+    ASSERT_EQ(2, paths.size());
+    EXPECT_EQ("TestSessionJournal-closed.flac", paths[0]);
+    EXPECT_EQ("TestSessionJournal-open_spool.flac", paths[1]);
+    EXPECT_FALSE(std::ifstream("TestSessionJournal-closed.spool").good());
+    EXPECT_FALSE(std::ifstream("TestSessionJournal-open.spool").good());
+    EXPECT_EQ("TestSessionJournal-open_spool.flac", journal.getSegments()[1].tailPath);
+
+    SF_INFO info = {0};
+    SNDFILE *tail = sf_open("TestSessionJournal-open_spool.flac", SFM_READ, &info);
+    ASSERT_NE(nullptr, tail);
+    EXPECT_EQ(10000, info.frames);
+    EXPECT_EQ(NUM_CHANNELS, info.channels);
+    sf_close(tail);
+
+    // Discarding the session reaches every file it made
+    std::vector<std::string> filePaths = journal.getFilePaths();
+    EXPECT_NE(filePaths.end(), std::find(filePaths.begin(), filePaths.end(), "TestSessionJournal-open.spool"));
+    EXPECT_NE(filePaths.end(), std::find(filePaths.begin(), filePaths.end(), "TestSessionJournal-open_spool.flac"));
+}
+
+/**
+ * Look for journals in the current directory.
+ *
+ * EXPECTED:
+ *      An open journal is found until it is finished.
+ */
+TEST_F(TestSessionJournal, find_sessions)
+{
+    SessionJournal journal(TEST_JOURNAL_PATH);
+    journal.addSegment("first.flac");
+
+    std::vector<std::string> sessions = SessionJournal::findSessions(".");
+    EXPECT_NE(sessions.end(), std::find(sessions.begin(), sessions.end(), TEST_JOURNAL_PATH));
+
+    journal.finish();
+    sessions = SessionJournal::findSessions(".");
+    EXPECT_EQ(sessions.end(), std::find(sessions.begin(), sessions.end(), TEST_JOURNAL_PATH));
+    EXPECT_TRUE(journal.getSegments().empty());
+}
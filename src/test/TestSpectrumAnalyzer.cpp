@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include <hlaudio/hlaudio.h>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+using namespace hula;
+
+#define TEST_FREQUENCY 1000.0
+
+class TestSpectrumAnalyzer : public ::testing::Test {
+    public:
+        SpectrumAnalyzer *analyzer;
+        uint64_t phase = 0;
+
+        virtual void SetUp()
+        {
+            analyzer = new SpectrumAnalyzer();
+            phase = 0;
+        }
+
+        virtual void TearDown()
+        {
+            delete analyzer;
+        }
+
+        /**
+         * Generate interleaved stereo frames of a sine, or silence if amplitude is 0.
+         */
+        std::vector<float> generate(size_t frames, double amplitude)
+        {
+            double sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+            std::vector<float> block(frames * NUM_CHANNELS);
+            for (size_t i = 0; i < frames; i++, phase++)
+            {
+                float value = (float)(amplitude * std::sin(2 * M_PI * TEST_FREQUENCY * phase / sampleRate));
+                for (int c = 0; c < NUM_CHANNELS; c++)
+                {
+                    block[i * NUM_CHANNELS + c] = value;
+                }
+            }
+            return block;
+        }
+
+        void feed(size_t frames, double amplitude)
+        {
+            std::vector<float> block = generate(frames, amplitude);
+
+            // Odd block sizes split frames across calls
+            size_t pos = 0;
+            while (pos < block.size())
+            {
+                size_t count = std::min<size_t>(333, block.size() - pos);
+                analyzer->handleData(block.data() + pos, count);
+                pos += count;
+            }
+        }
+
+        size_t findBand(double frequency)
+        {
+            for (size_t b = 0; b < analyzer->getBandCount(); b++)
+            {
+                if (frequency < analyzer->getBandFrequency(b + 1))
+                {
+                    return b;
+                }
+            }
+            return analyzer->getBandCount() - 1;
+        }
+};
+
+TEST_F(TestSpectrumAnalyzer, bandsAreLogSpaced)
+{
+    ASSERT_EQ(HL_SPECTRUM_BANDS, analyzer->getBandCount());
+
+    for (size_t b = 0; b < analyzer->getBandCount(); b++)
+    {
+        ASSERT_LT(analyzer->getBandFrequency(b), analyzer->getBandFrequency(b + 1));
+    }
+
+    // Upper bands span more Hz than lower ones
+    double first = analyzer->getBandFrequency(1) - analyzer->getBandFrequency(0);
+    double last = analyzer->getBandFrequency(analyzer->getBandCount()) - analyzer->getBandFrequency(analyzer->getBandCount() - 1);
+    ASSERT_GT(last, first * 10);
+}
+
+TEST_F(TestSpectrumAnalyzer, noFrameBeforeFullWindow)
+{
+    SpectrumFrame frame;
+    feed(HL_SPECTRUM_FFT_SIZE - 1, 1.0);
+    ASSERT_FALSE(analyzer->getLatest(frame));
+
+    feed(1, 1.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_EQ(1, frame.sequence);
+    ASSERT_EQ(HL_SPECTRUM_FFT_SIZE * NUM_CHANNELS, frame.sampleCount);
+    ASSERT_EQ(HL_SPECTRUM_FFT_SIZE, frame.waveform.size());
+
+    // Nothing new until the next hop
+    ASSERT_FALSE(analyzer->getLatest(frame));
+    feed(HL_SPECTRUM_HOP_SIZE, 1.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_EQ(2, frame.sequence);
+}
+
+TEST_F(TestSpectrumAnalyzer, sineLandsInItsBand)
+{
+    SpectrumFrame frame;
+    feed(HL_SPECTRUM_FFT_SIZE * 4, 1.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+
+    size_t band = findBand(TEST_FREQUENCY);
+    ASSERT_NEAR(1.0, frame.bands[band], 0.2);
+
+    for (size_t b = 0; b < frame.bands.size(); b++)
+    {
+        if (b + 2 < band || b > band + 2)
+        {
+            ASSERT_LT(frame.bands[b], 0.1) << "band " << b;
+        }
+    }
+}
+
+TEST_F(TestSpectrumAnalyzer, levelsDecayAndPeaksHold)
+{
+    SpectrumFrame frame;
+    feed(HL_SPECTRUM_FFT_SIZE * 4, 1.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+
+    size_t band = findBand(TEST_FREQUENCY);
+    float level = frame.bands[band];
+    float peak = frame.peaks[band];
+
+    // A short silence lets the level fall but the peak stays
+    feed(HL_SPECTRUM_FFT_SIZE * 2, 0.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_LT(frame.bands[band], level);
+    ASSERT_GT(frame.bands[band], 0);
+    ASSERT_FLOAT_EQ(peak, frame.peaks[band]);
+
+    // After a few seconds both are gone
+    feed(HulaAudioSettings::getInstance()->getSampleRate() * 3, 0.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_LT(frame.bands[band], 0.01);
+    ASSERT_LT(frame.peaks[band], 0.01);
+}
+
+TEST_F(TestSpectrumAnalyzer, concurrentReader)
+{
+    std::atomic<bool> done(false);
+    uint64_t lastSequence = 0;
+    bool ordered = true;
+
+    std::thread reader([&]() {
+        SpectrumFrame frame;
+        while (!done.load())
+        {
+            if (analyzer->getLatest(frame))
+            {
+                ordered = ordered && frame.sequence > lastSequence
+                          && frame.sampleCount == (HL_SPECTRUM_FFT_SIZE + (frame.sequence - 1) * HL_SPECTRUM_HOP_SIZE) * NUM_CHANNELS;
+                lastSequence = frame.sequence;
+            }
+        }
+    });
+
+    for (int i = 0; i < 200; i++)
+    {
+        feed(HL_SPECTRUM_HOP_SIZE, 0.5);
+    }
+
+    done.store(true);
+    reader.join();
+
+    ASSERT_TRUE(ordered);
+    ASSERT_GT(lastSequence, 0);
+}
+
+TEST_F(TestSpectrumAnalyzer, blackmanWindow)
+{
+    delete analyzer;
+    analyzer = new SpectrumAnalyzer(2048, 256, 32, BLACKMAN);
+    ASSERT_EQ(32, analyzer->getBandCount());
+
+    SpectrumFrame frame;
+    feed(2048 * 2, 1.0);
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_NEAR(1.0, frame.bands[findBand(TEST_FREQUENCY)], 0.2);
+}
+
+TEST_F(TestSpectrumAnalyzer, snapshots)
+{
+    SpectrumFrame frame;
+    double sampleRate = HulaAudioSettings::getInstance()->getSampleRate();
+
+    // A partial snapshot does not fill the window yet
+    std::vector<float> block = generate(HL_SPECTRUM_FFT_SIZE / 2, 1.0);
+    ASSERT_FALSE(analyzer->analyzeSnapshot(block.data(), block.size(), block.size()));
+    block = generate(HL_SPECTRUM_FFT_SIZE / 2, 1.0);
+    ASSERT_TRUE(analyzer->analyzeSnapshot(block.data(), block.size(), block.size()));
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_EQ(HL_SPECTRUM_FFT_SIZE * NUM_CHANNELS, frame.sampleCount);
+
+    size_t band = findBand(TEST_FREQUENCY);
+    ASSERT_NEAR(1.0, frame.bands[band], 0.2);
+
+    // Nothing new was captured
+    ASSERT_FALSE(analyzer->analyzeSnapshot(block.data(), block.size(), 0));
+
+    // One snapshot standing in for a long gap decays as much as that time would
+    block = generate(HL_SPECTRUM_FFT_SIZE * 2, 0.0);
+    ASSERT_TRUE(analyzer->analyzeSnapshot(block.data(), block.size(), (uint64_t)sampleRate * 3 * NUM_CHANNELS));
+    ASSERT_TRUE(analyzer->getLatest(frame));
+    ASSERT_LT(frame.bands[band], 0.01);
+    ASSERT_LT(frame.peaks[band], 0.01);
+}
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+#include <hlcontrol/internal/SpoolFile.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+using namespace hula;
+
+#define TEST_SPOOL_PATH "hulaloop_test.spool"
+
+class TestSpoolFile : public ::testing::Test {
+    public:
+        virtual void TearDown()
+        {
+            remove(TEST_SPOOL_PATH);
+        }
+
+        /**
+         * Read everything that is committed and check that it continues
+         * the running index.
+         *
+         * @return Number of samples read.
+         */
+        uint64_t readAndCheck(SpoolFile &spool, uint64_t &next)
+        {
+            uint64_t total = 0;
+            ring_buffer_size_t samplesRead;
+            do
+            {
+                void *ptr[2] = {0};
+                ring_buffer_size_t sizes[2] = {0};
+                samplesRead = spool.directRead(65536, ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+
+                for (int i = 0; i < 2 && ptr[i] != nullptr; i++)
+                {
+                    float *samples = (float *)ptr[i];
+                    for (ring_buffer_size_t s = 0; s < sizes[i]; s++)
+                    {
+                        if (samples[s] != (float)next)
+                        {
+                            ADD_FAILURE() << "Sample " << next << " is " << samples[s];
+                            return total;
+                        }
+                        next++;
+                    }
+                }
+                total += samplesRead;
+            } while (samplesRead > 0);
+
+            return total;
+        }
+};
+
+/**
+ * Create a running index of count samples starting at offset.
+ */
+std::vector<float> createTestSamples(uint64_t offset, size_t count)
+{
+    std::vector<float> samples(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        samples[i] = (float)(offset + i);
+    }
+    return samples;
+}
+
+/**
+ * Write more than two chunks in uneven blocks, then read it all back.
+ *
+ * EXPECTED:
+ *      Every sample comes back in order across chunk boundaries.
+ */
+TEST_F(TestSpoolFile, write_and_read)
+{
+    SpoolFile spool(TEST_SPOOL_PATH);
+
+    uint64_t total = (uint64_t)HulaAudioSettings::getInstance()->getSampleRate() * NUM_CHANNELS * HL_SPOOL_CHUNK_DURATION * 5 / 2;
+    uint64_t written = 0;
+    while (written < total)
+    {
+        std::vector<float> samples = createTestSamples(written, 30002);
+        written += spool.write(samples.data(), FLOAT_32, (ring_buffer_size_t)samples.size());
+    }
+
+    EXPECT_EQ(written, spool.getCommittedSamples());
+    EXPECT_EQ(written, spool.getReadAvailable());
+    EXPECT_EQ(0, spool.getDroppedSamples());
+
+    uint64_t next = 0;
+    EXPECT_EQ(written, readAndCheck(spool, next));
+    EXPECT_EQ(0, spool.getReadAvailable());
+}
+
+/**
+ * Destroy a spool without removing it, then inspect the file.
+ *
+ * EXPECTED:
+ *      The file survives with its header and commit index.
+ *      The samples follow the header.
+ *      remove() deletes the file.
+ */
+TEST_F(TestSpoolFile, file_outlives_spool)
+{
+    const size_t count = 1000;
+    {
+        SpoolFile spool(TEST_SPOOL_PATH);
+        std::vector<float> samples = createTestSamples(0, count);
+        spool.write(samples.data(), FLOAT_32, count);
+    }
+
+    std::ifstream file(TEST_SPOOL_PATH, std::ios::binary);
+    ASSERT_TRUE(file.good());
+
+    char magic[8];
+    uint32_t fields[4];
+    uint64_t committed = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char *)fields, sizeof(fields));
+    file.read((char *)&committed, sizeof(committed));
+
+    EXPECT_STREQ(HL_SPOOL_MAGIC, magic);
+    EXPECT_EQ(HL_SPOOL_VERSION, fields[0]);
+    EXPECT_EQ(HulaAudioSettings::getInstance()->getSampleRate(), fields[1]);
+    EXPECT_EQ(NUM_CHANNELS, fields[2]);
+    EXPECT_EQ(count, committed);
+
+    std::vector<float> samples(count);
+    file.seekg(HL_SPOOL_HEADER_BYTES);
+    file.read((char *)samples.data(), count * sizeof(float));
+    EXPECT_EQ(createTestSamples(0, count), samples);
+    file.close();
+
+    SpoolFile spool(TEST_SPOOL_PATH);
+    spool.remove();
+    EXPECT_FALSE(std::ifstream(TEST_SPOOL_PATH).good());
+}
+
+/**
+ * Write INT_16 samples.
+ *
+ * EXPECTED:
+ *      They are stored as float, the same way convertToFloat() converts them.
+ */
+TEST_F(TestSpoolFile, converts_to_float)
+{
+    SpoolFile spool(TEST_SPOOL_PATH);
+
+    std::vector<int16_t> samples = { 0, 1, -1, 16384, -16384, 32767, -32768, 100 };
+    spool.write(samples.data(), INT_16, (ring_buffer_size_t)samples.size());
+
+    std::vector<float> expected(samples.size());
+    convertToFloat(samples.data(), INT_16, expected.data(), (long)samples.size());
+
+    void *ptr[2] = {0};
+    ring_buffer_size_t sizes[2] = {0};
+    ASSERT_EQ(samples.size(), spool.directRead(1024, ptr + 0, sizes + 0, ptr + 1, sizes + 1));
+    EXPECT_EQ(0, memcmp(expected.data(), ptr[0], expected.size() * sizeof(float)));
+}
+
+/**
+ * Writer appends small blocks while the reader sleeps in waitForData().
+ *
+ * EXPECTED:
+ *      Every sample arrives exactly once and in order.
+ */
+TEST_F(TestSpoolFile, concurrent_writer_reader)
+{
+    SpoolFile spool(TEST_SPOOL_PATH);
+    const uint64_t blocks = 400;
+    const size_t blockSize = 4410;
+
+    std::thread writer([&]() {
+        for (uint64_t b = 0; b < blocks; b++)
+        {
+            std::vector<float> samples = createTestSamples(b * blockSize, blockSize);
+            spool.write(samples.data(), FLOAT_32, blockSize);
+        }
+        spool.wakeReaders();
+    });
+
+    uint64_t next = 0;
+    uint64_t total = 0;
+    while (total < blocks * blockSize && !HasFailure())
+    {
+        spool.waitForData(blockSize, 50);
+        total += readAndCheck(spool, next);
+    }
+
+    writer.join();
+
+    EXPECT_EQ(blocks * blockSize, total);
+    EXPECT_EQ(0, spool.getDroppedSamples());
+}
+
+/**
+ * Check how much of a new spool file is backed by the disk.
+ *
+ * EXPECTED:
+ *      Every byte up to the end of the file is allocated,
+ *      so writing through the mapping can't run out of space.
+ */
+TEST_F(TestSpoolFile, preallocated)
+{
+    SpoolFile spool(TEST_SPOOL_PATH);
+
+    struct stat info;
+    ASSERT_EQ(0, stat(TEST_SPOOL_PATH, &info));
+    EXPECT_GE(info.st_size, HL_SPOOL_HEADER_BYTES);
+
+#ifndef _WIN32
+    EXPECT_GE((uint64_t)info.st_blocks * 512, (uint64_t)info.st_size);
+#endif
+}
@@ -1,8 +1,14 @@
 #include <gtest/gtest.h>
 #include <hlcontrol/hlcontrol.h>
 
+#include <algorithm>
+#include <dirent.h>
+#include <set>
+#include <stdexcept>
 #include <sys/stat.h>
 
+#include <sndfile.h>
+
 using namespace hula;
 
 class TestTransport : public Transport, public ::testing::Test {
@@ -11,6 +17,34 @@ class TestTransport : public Transport, public ::testing::Test {
         TestTransport() : Transport()
         { }
 
+        /**
+         * Get the names of all files in the temp directory
+         * that a recording creates.
+         */
+        std::vector<std::string> getTempFiles()
+        {
+            std::vector<std::string> files;
+
+            DIR *dir = opendir(Export::getTempPath().c_str());
+            if (dir == nullptr)
+            {
+                return files;
+            }
+
+            while (struct dirent *entry = readdir(dir))
+            {
+                std::string name = entry->d_name;
+                if (name.compare(0, 9, "hulaloop_") == 0)
+                {
+                    files.push_back(name);
+                }
+            }
+            closedir(dir);
+
+            std::sort(files.begin(), files.end());
+            return files;
+        }
+
 };
 
 TEST_F(TestTransport, verifyController)
@@ -29,6 +63,8 @@ TEST_F(TestTransport, checkRecord)
 
     ASSERT_TRUE(stop());
     ASSERT_EQ(stateToStr(getState()), "Stopped");
+
+    discard();
 }
 
 TEST_F(TestTransport, checkPausePlay)
@@ -47,6 +83,8 @@ TEST_F(TestTransport, checkPausePlay)
 
     ASSERT_TRUE(stop());
     ASSERT_EQ(stateToStr(getState()), "Stopped");
+
+    discard();
 }
 
 /**
@@ -64,6 +102,197 @@ TEST_F(TestTransport, invalid_controls)
     ASSERT_FALSE(play());
     ASSERT_TRUE(stop());
     ASSERT_FALSE(record());
+
+    discard();
+}
+
+/**
+ * Pause and resume both a recording and its playback.
+ *
+ * EXPECTED:
+ *      PAUSED only resumes to whatever was paused.
+ */
+TEST_F(TestTransport, pause_resumes_what_was_paused)
+{
+    ASSERT_TRUE(record());
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_TRUE(pause());
+    ASSERT_FALSE(play());
+    ASSERT_TRUE(record());
+    ASSERT_EQ(stateToStr(getState()), "Recording");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_TRUE(stop());
+
+    // Resuming within the same second still starts a segment of its own
+    std::vector<std::string> paths = recorder->getExportPaths();
+    ASSERT_EQ(2, paths.size());
+    ASSERT_NE(paths[0], paths[1]);
+    for (const std::string &path : paths)
+    {
+        SF_INFO info = {0};
+        SNDFILE *file = sf_open(path.c_str(), SFM_READ, &info);
+        ASSERT_NE(nullptr, file);
+        sf_close(file);
+        EXPECT_GT(info.frames, 0) << path;
+    }
+
+    ASSERT_TRUE(play());
+    ASSERT_TRUE(pause());
+    ASSERT_FALSE(record());
+    ASSERT_TRUE(play());
+    ASSERT_EQ(stateToStr(getState()), "Playing");
+    ASSERT_TRUE(stop());
+
+    discard();
+    ASSERT_EQ(stateToStr(getState()), "Ready");
+}
+
+/**
+ * Queue commands without waiting for each one.
+ *
+ * EXPECTED:
+ *      The commands run in order and discarding
+ *      reports being done exactly once, at the end.
+ */
+TEST_F(TestTransport, async_commands)
+{
+    std::future<bool> recorded = recordAsync();
+    std::future<bool> stopped = stopAsync();
+
+    std::vector<float> progress;
+    std::future<void> discarded = discardAsync([&progress](float done) {
+        progress.push_back(done);
+    });
+
+    ASSERT_TRUE(recorded.get());
+    ASSERT_TRUE(stopped.get());
+    discarded.get();
+
+    ASSERT_EQ(stateToStr(getState()), "Ready");
+    ASSERT_FALSE(progress.empty());
+    ASSERT_EQ(1, std::count(progress.begin(), progress.end(), 1.0f));
+    ASSERT_EQ(1.0f, progress.back());
+}
+
+/**
+ * Queue commands with a callback for their outcome.
+ *
+ * EXPECTED:
+ *      Each callback gets the result of its command before the future is ready.
+ *      Unsaved audio is reported from the first recording until the discard.
+ */
+TEST_F(TestTransport, async_outcomes)
+{
+    std::vector<bool> outcomes;
+    auto done = [&outcomes](bool success, const std::string &error) {
+        EXPECT_TRUE(error.empty());
+        outcomes.push_back(success);
+    };
+
+    EXPECT_FALSE(hasExportPaths());
+    EXPECT_FALSE(stopAsync(done).get());
+    EXPECT_TRUE(recordAsync(done).get());
+    EXPECT_TRUE(hasExportPaths());
+    EXPECT_TRUE(stopAsync(done).get());
+    EXPECT_TRUE(hasExportPaths());
+
+    std::vector<bool> expected = { false, true, true };
+    EXPECT_EQ(expected, outcomes);
+
+    discard();
+    EXPECT_FALSE(hasExportPaths());
+}
+
+/**
+ * Run a command that throws something other than a ControlException.
+ *
+ * EXPECTED:
+ *      The callback still gets a failure with a message,
+ *      and the exception is passed on.
+ */
+TEST_F(TestTransport, async_failure_is_reported)
+{
+    bool called = false;
+    bool succeeded = true;
+    std::string message;
+    auto done = [&](bool success, const std::string &error) {
+        called = true;
+        succeeded = success;
+        message = error;
+    };
+
+    EXPECT_THROW(runReported([]() -> bool { throw std::runtime_error("broken"); }, done), std::runtime_error);
+    EXPECT_TRUE(called);
+    EXPECT_FALSE(succeeded);
+    EXPECT_EQ("broken", message);
+
+    called = false;
+    EXPECT_ANY_THROW(runReported([]() -> bool { throw 1; }, done));
+    EXPECT_TRUE(called);
+    EXPECT_FALSE(succeeded);
+    EXPECT_FALSE(message.empty());
+}
+
+/**
+ * Discard a recording while it is still running, then record again.
+ *
+ * EXPECTED:
+ *      The recording stops before its files are deleted,
+ *      and the next recording starts a new session.
+ */
+TEST_F(TestTransport, discard_while_recording)
+{
+    std::vector<std::string> before = getTempFiles();
+
+    ASSERT_TRUE(record());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    discard();
+    ASSERT_EQ(stateToStr(getState()), "Ready");
+    ASSERT_EQ(recorder->getExportPaths().size(), 0);
+    ASSERT_EQ(before, getTempFiles());
+
+    ASSERT_TRUE(record());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(stop());
+    ASSERT_EQ(recorder->getExportPaths().size(), 1);
+
+    discard();
+    ASSERT_EQ(before, getTempFiles());
+}
+
+/**
+ * Leave a recording behind and recover it from a Transport started later.
+ *
+ * EXPECTED:
+ *      The later Transport offers the session, and recovering it
+ *      in the background stops in STOPPED with the audio to export.
+ */
+TEST_F(TestTransport, recover_session_async)
+{
+    {
+        // Closed without exporting or discarding
+        Transport earlier;
+        ASSERT_TRUE(earlier.record());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ASSERT_TRUE(earlier.stop());
+    }
+
+    Transport later;
+    std::vector<std::string> sessions = later.getRecoverableSessions();
+    ASSERT_FALSE(sessions.empty());
+
+    bool reported = false;
+    ASSERT_TRUE(later.recoverSessionAsync(sessions.back(), [&reported](bool success, const std::string &error) {
+        reported = success;
+    }).get());
+    EXPECT_TRUE(reported);
+    EXPECT_EQ(later.getState(), STOPPED);
+    EXPECT_TRUE(later.hasExportPaths());
+
+    std::vector<std::string> before = getTempFiles();
+    later.discard();
+    EXPECT_LT(getTempFiles().size(), before.size());
 }
 
 TEST_F(TestTransport, verify_tempfile_deletion)
@@ -71,15 +300,16 @@ TEST_F(TestTransport, verify_tempfile_deletion)
     for (int i = 0; i < 4; i++)
     {
         ASSERT_TRUE(record());
-
-        // Sleep for a second to prevent file name clash during creation
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
         ASSERT_TRUE(pause());
     }
 
-    // Delete temp files and check if vector is empty
+    // Every segment has a file of its own
     std::vector<std::string> dirs = recorder->getExportPaths();
+    ASSERT_EQ(4, dirs.size());
+    ASSERT_EQ(4, std::set<std::string>(dirs.begin(), dirs.end()).size());
+
+    // Delete temp files and check if vector is empty
     discard();
     ASSERT_EQ(recorder->getExportPaths().size(), 0);
 
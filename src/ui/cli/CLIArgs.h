@@ -26,6 +26,8 @@ using namespace hula;
 #define HL_TRIGGER_RECORD_LO  "record"
 #define HL_SAMPLE_RATE_SO     "s"
 #define HL_SAMPLE_RATE_LO     "sample-rate"
+#define HL_BIT_DEPTH_SO       "b"
+#define HL_BIT_DEPTH_LO       "bit-depth"
 #define HL_ENCODING_SO        "e"
 #define HL_ENCODING_LO        "encoding"
 #define HL_INPUT_DEVICE_SO    "i"
@@ -36,6 +38,14 @@ using namespace hula;
 #define HL_LIST_DEVICES_LO    "list"
 #define HL_LANG_SO            "g"
 #define HL_LANG_LO            "lang"
+#define HL_FILE_AUDIO_LO      "file-audio"
+#define HL_FILE_SPEED_LO      "file-audio-speed"
+#define HL_SPOOL_LO           "spool"
+
+/**
+ * Value of --file-audio that generates a tone instead of reading a file.
+ */
+#define HL_FILE_AUDIO_TONE    "tone"
 
 /**
  * Print an error message about the invalid argument and exit.
@@ -73,11 +83,15 @@ bool parseArgsQt(QCoreApplication &app, HulaImmediateArgs &extraArgs)
         {{HL_RECORD_TIME_SO, HL_RECORD_TIME_LO}, CLI::tr("Duration, in seconds, of the record."), CLI::tr("record duration")},
         {{HL_TRIGGER_RECORD_SO, HL_TRIGGER_RECORD_LO}, CLI::tr("Start the countdown/record immediately.")},
         {{HL_SAMPLE_RATE_SO, HL_SAMPLE_RATE_LO}, CLI::tr("Desired sample rate of the output file."), CLI::tr("sample rate")},
+        {{HL_BIT_DEPTH_SO, HL_BIT_DEPTH_LO}, CLI::tr("Bits per sample used for capture and the output file. Valid options are 16, 24 and 32 (float). This will default to 32."), CLI::tr("bit depth")},
         {{HL_ENCODING_SO, HL_ENCODING_LO}, CLI::tr("Encoding format for the output file. Valid options are WAV and MP3. This will default to WAV."), CLI::tr("encoding")},
         {{HL_INPUT_DEVICE_SO, HL_INPUT_DEVICE_LO}, CLI::tr("System name of the input device. This will default if not provided."), CLI::tr("input device name")},
         {{HL_OUTPUT_DEVICE_SO, HL_OUTPUT_DEVICE_LO}, CLI::tr("System name of the output device. This will default if not provided."), CLI::tr("output device name")},
         {{HL_LIST_DEVICES_SO, HL_LIST_DEVICES_LO}, CLI::tr("List available input and output devices.")},
-        {{HL_LANG_SO, HL_LANG_LO}, CLI::tr("Set the language of the application."), CLI::tr("target language")}
+        {{HL_LANG_SO, HL_LANG_LO}, CLI::tr("Set the language of the application."), CLI::tr("target language")},
+        {HL_FILE_AUDIO_LO, CLI::tr("Capture from a WAV file instead of an audio device and play into a silent sink. Use '%1' for a generated tone.").arg(HL_FILE_AUDIO_TONE), CLI::tr("wav file")},
+        {HL_FILE_SPEED_LO, CLI::tr("Speed of --%1 relative to real time. 0 runs as fast as possible. This will default to 1.").arg(HL_FILE_AUDIO_LO), CLI::tr("speed")},
+        {HL_SPOOL_LO, CLI::tr("Spool recordings to a raw file in the temp directory and compress them in the background.")}
     });
 
     // This will exit if any of the args are incorrect
@@ -131,6 +145,28 @@ bool parseArgsQt(QCoreApplication &app, HulaImmediateArgs &extraArgs)
         settings->setSampleRate(rate);
     }
 
+    if (parser.isSet(HL_BIT_DEPTH_LO))
+    {
+        int bits = parser.value(HL_BIT_DEPTH_LO).toInt();
+        if (bits == 16)
+        {
+            settings->setSampleFormat(INT_16);
+        }
+        else if (bits == 24)
+        {
+            settings->setSampleFormat(INT_24);
+        }
+        else if (bits == 32)
+        {
+            settings->setSampleFormat(FLOAT_32);
+        }
+        else
+        {
+            invalidArg(HL_BIT_DEPTH_LO, parser.value(HL_BIT_DEPTH_LO), CLI::tr("Valid options are 16, 24 and 32."));
+            return false;
+        }
+    }
+
     if (parser.isSet(HL_ENCODING_LO))
     {
         std::string encoding = parser.value(HL_ENCODING_LO).toStdString();
@@ -145,6 +181,31 @@ bool parseArgsQt(QCoreApplication &app, HulaImmediateArgs &extraArgs)
         }
     }
 
+    // Must be set before the first Transport is created below
+    if (parser.isSet(HL_FILE_AUDIO_LO))
+    {
+        std::string path = parser.value(HL_FILE_AUDIO_LO).toStdString();
+        settings->setAudioBackend(FILE_AUDIO);
+        settings->setFileAudioPath(path == HL_FILE_AUDIO_TONE ? "" : path);
+    }
+
+    if (parser.isSet(HL_FILE_SPEED_LO))
+    {
+        bool ok = false;
+        double speed = parser.value(HL_FILE_SPEED_LO).toDouble(&ok);
+        if (!ok || speed < 0)
+        {
+            invalidArg(HL_FILE_SPEED_LO, parser.value(HL_FILE_SPEED_LO), CLI::tr("The speed must be 0 or more."));
+            return false;
+        }
+        settings->setFileAudioSpeed(speed);
+    }
+
+    if (parser.isSet(HL_SPOOL_LO))
+    {
+        settings->setRecordSpooling(true);
+    }
+
     if (parser.isSet(HL_INPUT_DEVICE_LO))
     {
         extraArgs.inputDevice = parser.value(HL_INPUT_DEVICE_LO).toStdString();
@@ -41,6 +41,10 @@
 #define HL_DISCARD_LONG  "discard"
 #define HL_DISCARD_ARG1  "-f"
 
+#define HL_RECOVER_SHORT "rc"
+#define HL_RECOVER_LONG  "recover"
+#define HL_RECOVER_ARG1  "-d"
+
 #define HL_LIST_SHORT    "l"
 #define HL_LIST_LONG     "list"
 
@@ -55,6 +59,10 @@
 #define HL_PRINT_SHORT   "p"
 #define HL_PRINT_LONG    "print"
 
+#define HL_METER_SHORT   "m"
+#define HL_METER_LONG    "meter"
+#define HL_METER_ARG1    "seconds"
+
 #define HL_VERSION_SHORT "v"
 #define HL_VERSION_LONG  "version"
 
@@ -85,6 +93,7 @@ inline void printInteractiveHelp()
     cout << C1 << HL_VERSION_SHORT  ", " << C2 << HL_VERSION_LONG << qPrintable(CLI::tr("Display version information.")) << endl;
     cout << C1 << HL_LIST_SHORT     ", " << C2 << HL_LIST_LONG    << qPrintable(CLI::tr("List all devices.")) << endl;
     cout << C1 << HL_PRINT_SHORT    ", " << C2 << HL_PRINT_LONG   << qPrintable(CLI::tr("Print the current configuration.")) << endl;
+    cout << C1 << HL_METER_SHORT    ", " << C2 << HL_METER_LONG   " [" HL_METER_ARG1 "] " << qPrintable(CLI::tr("Show a live spectrum of the captured audio.")) << endl;
     cout << C1 << HL_LANG_SHORT << C2 << "<" HL_LANG_ARG1 "> "    << qPrintable(CLI::tr("Switch the application language.")) << endl;
     cout << C1 << HL_EXIT_LONG  << C2 << " " << qPrintable(CLI::tr("Quit the application.")) << endl;
     cout << endl;
@@ -96,6 +105,7 @@ inline void printInteractiveHelp()
     cout << C1 << HL_PAUSE_SHORT   ", " << C2 << HL_PAUSE_LONG   << qPrintable(CLI::tr("Pause playback or recording.")) << endl;
     cout << C1 << HL_EXPORT_SHORT  ", " << C2 << HL_EXPORT_LONG  " <" HL_EXPORT_ARG1  "> " << qPrintable(CLI::tr("Export captured audio to the specified file.")) << endl;
     cout << C1 << HL_DISCARD_SHORT ", " << C2 << HL_DISCARD_LONG " [" HL_DISCARD_ARG1 "] " << qPrintable(CLI::tr("Discard the current recording.")) << endl;
+    cout << C1 << HL_RECOVER_SHORT ", " << C2 << HL_RECOVER_LONG " [" HL_RECOVER_ARG1 "] " << qPrintable(CLI::tr("Recover the last unfinished recording, or delete all of them with -d.")) << endl;
     cout << endl;
 
     cout << C1 << HL_INPUT_SHORT   ", " << C2 << HL_INPUT_LONG   " <" HL_INPUT_ARG1  "> ";
@@ -6,9 +6,13 @@
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <hlaudio/hlaudio.h>
@@ -33,6 +37,26 @@ using namespace hula;
     "                                         |_|\n" \
     "----------------------------------------------------\n\n" \
 
+/**
+ * Number of bands shown by the spectrum meter.
+ */
+#define HL_METER_BANDS 48
+
+/**
+ * Range in dB covered by the spectrum meter, below full scale.
+ */
+#define HL_METER_RANGE_DB 60.0
+
+/**
+ * Time in milliseconds between redraws of the spectrum meter.
+ */
+#define HL_METER_REFRESH_MS 50
+
+/**
+ * Default time in seconds that the spectrum meter is shown.
+ */
+#define HL_METER_DEFAULT_SECONDS 10.0
+
 /**
  * Print a fixed-width QTextStream column and then return the stream to 0 width.
  */
@@ -284,6 +308,9 @@ namespace hula
         QCOL(cout, colW, CLI::tr("Sample rate:"));
         cout << settings->getSampleRate() << " " << CLI::tr("Hz", "unit") << endl;
 
+        QCOL(cout, colW, CLI::tr("Bit depth:"));
+        cout << settings->getSampleSize() * 8 << endl;
+
         // TODO: Change this once MP3 gets in here
         QCOL(cout, colW, CLI::tr("Encoding:"));
         cout << "WAV" << endl;
@@ -294,6 +321,120 @@ namespace hula
         QCOL(cout, colW, CLI::tr("Output device:"));
         cout << QString::fromStdString(args.outputDevice) << endl;
     }
+
+    /**
+     * Utility function for printing the pipeline statistics,
+     * so that dropouts can be diagnosed without a debug build.
+     *
+     * @param t Transport whose statistics should be printed
+     */
+    inline void printPipelineStats(Transport *t)
+    {
+        int colW = 32;
+
+        QTextStream cout(stdout);
+        cout.setAutoDetectUnicode(true);
+        cout.setRealNumberNotation(QTextStream::FixedNotation);
+        cout.setRealNumberPrecision(2);
+        cout.setFieldAlignment(QTextStream::AlignLeft);
+
+        PipelineStatsSnapshot stats = t->getController()->getStatsSnapshot();
+        QString ms = CLI::tr("ms", "abbreviation for milliseconds");
+
+        cout << endl;
+
+        QCOL(cout, colW, CLI::tr("Capture blocks:"));
+        cout << (qulonglong)stats.captureBlocks << endl;
+
+        //: Median, 99th percentile and longest time between blocks from the audio device
+        QCOL(cout, colW, CLI::tr("Capture interval p50/p99/max:"));
+        cout << stats.getIntervalPercentileUs(50) / 1000 << " / " << stats.getIntervalPercentileUs(99) / 1000 << " / ";
+        cout << stats.maxIntervalUs / 1000.0 << " " << ms << endl;
+
+        QCOL(cout, colW, CLI::tr("Buffer time mean/max:"));
+        cout << stats.bufferTime.getMeanUs() / 1000 << " / " << stats.bufferTime.maxUs / 1000.0 << " " << ms << endl;
+
+        QCOL(cout, colW, CLI::tr("Callback time mean/max:"));
+        cout << stats.callbackTime.getMeanUs() / 1000 << " / " << stats.callbackTime.maxUs / 1000.0 << " " << ms << endl;
+
+        QCOL(cout, colW, CLI::tr("Disk latency mean/max:"));
+        cout << stats.diskLatency.getMeanUs() / 1000 << " / " << stats.diskLatency.maxUs / 1000.0 << " " << ms << endl;
+
+        for (size_t i = 0; i < stats.rings.size(); i++)
+        {
+            const RingStats &ring = stats.rings[i];
+            QString name = ring.name.empty() ? QString("#%1").arg(i) : QString::fromStdString(ring.name);
+
+            cout << endl;
+            QCOL(cout, colW, CLI::tr("Buffer %1:").arg(name));
+            cout << endl;
+
+            QCOL(cout, colW, CLI::tr("  Fill/high-water:"));
+            cout << 100.0 * ring.fill / std::max<ring_buffer_size_t>(ring.capacity, 1) << "% / ";
+            cout << 100.0 * ring.highWater / std::max<ring_buffer_size_t>(ring.capacity, 1) << "%" << endl;
+
+            QCOL(cout, colW, CLI::tr("  Overruns:"));
+            cout << (qulonglong)ring.overruns << " (" << CLI::tr("%1 samples dropped").arg((qulonglong)ring.droppedSamples) << ")" << endl;
+
+            QCOL(cout, colW, CLI::tr("  Underruns:"));
+            cout << (qulonglong)ring.underruns << endl;
+        }
+    }
+
+    /**
+     * Utility function for showing a live text spectrum of the captured audio.
+     *
+     * One character per band, redrawn in place on a single line.
+     *
+     * @param t Transport whose captured audio should be shown
+     * @param seconds How long to show the meter for
+     */
+    inline void printSpectrumMeter(Transport *t, double seconds)
+    {
+        // Levels from quiet to loud, spread over HL_METER_RANGE_DB
+        const char levels[] = " .:-=+*#%@";
+        const int levelCount = sizeof(levels) - 1;
+
+        SpectrumAnalyzer analyzer(HL_SPECTRUM_FFT_SIZE, HL_SPECTRUM_HOP_SIZE, HL_METER_BANDS);
+        SpectrumFrame frame;
+        std::string line(analyzer.getBandCount(), ' ');
+
+        try
+        {
+            t->getController()->addCallback(&analyzer);
+        }
+        catch(const AudioException &ae)
+        {
+            ControlException ce(ae.getErrorCode());
+
+            fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, ce.getErrorMessage().c_str());
+            return;
+        }
+
+        printf("\n%6.0f %s\n", analyzer.getBandFrequency(0), qPrintable(CLI::tr("Hz", "unit")));
+
+        auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            if (analyzer.getLatest(frame))
+            {
+                for (size_t b = 0; b < frame.bands.size(); b++)
+                {
+                    double db = 20 * std::log10(std::max(frame.bands[b], 1e-6f));
+                    int level = (int)((db + HL_METER_RANGE_DB) / HL_METER_RANGE_DB * levelCount);
+                    line[b] = levels[std::max(0, std::min(levelCount - 1, level))];
+                }
+
+                printf("\r[%s]", line.c_str());
+                fflush(stdout);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(HL_METER_REFRESH_MS));
+        }
+
+        t->getController()->removeCallback(&analyzer);
+        printf("\n%6.0f %s\n", analyzer.getBandFrequency(analyzer.getBandCount()), qPrintable(CLI::tr("Hz", "unit")));
+    }
 }
 
 #endif // END HULA_CLI_COMMON_H
\ No newline at end of file
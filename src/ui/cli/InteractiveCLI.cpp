@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -62,6 +63,29 @@ void InteractiveCLI::malformedArg(const std::string &argName, const std::string
     fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, qPrintable(tr("'%1' is not a valid %2.").arg(val.c_str(), type.c_str())));
 }
 
+/**
+ * Export the recording while showing how far along the export is.
+ *
+ * @param path File to export to
+ * @throws ControlException if the file could not be written
+ */
+void InteractiveCLI::exportFile(const std::string &path) const
+{
+    std::atomic<int> lastPercent(-1);
+    std::future<void> done = t->exportFileAsync(path, [&lastPercent](float progress) {
+        int percent = (int)(progress * 100);
+        if (lastPercent.exchange(percent) != percent)
+        {
+            //: Shown while exporting, %1 is the percentage done
+            printf("\r%s", qPrintable(tr("Exporting... %1%").arg(percent)));
+            fflush(stdout);
+        }
+    });
+
+    done.get();
+    printf("\n");
+}
+
 /**
  * Start taking in commands.
  *
@@ -74,6 +98,14 @@ void InteractiveCLI::start()
     std::string arg;
     std::vector<std::string> args;
 
+    // Offer to recover what an earlier run left behind
+    size_t sessions = this->t->getRecoverableSessions().size();
+    if (sessions > 0)
+    {
+        printf("%s\n", qPrintable(CLI::tr("Found %1 unfinished recording(s) from an earlier run. Use '%2' to recover the last one or '%2 %3' to delete them.")
+                                   .arg((int)sessions).arg(HL_RECOVER_LONG).arg(HL_RECOVER_ARG1)));
+    }
+
     // Command loop
     while (1)
     {
@@ -264,6 +296,7 @@ HulaCliStatus InteractiveCLI::processCommand(const std::string &command, const s
     }
     else if (command == HL_STOP_SHORT || command == HL_STOP_LONG)
     {
+        bool wasRecording = t->getState() == RECORDING;
         try
         {
             success = t->stop();
@@ -273,6 +306,12 @@ HulaCliStatus InteractiveCLI::processCommand(const std::string &command, const s
             fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, ce.getErrorMessage().c_str());
             return HulaCliStatus::HULA_CLI_FAILURE;
         }
+
+        if (success && wasRecording && t->hasRecordError())
+        {
+            fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, ControlException(HL_RECORD_WRITE_CODE).getErrorMessage().c_str());
+            return HulaCliStatus::HULA_CLI_FAILURE;
+        }
     }
     else if (command == HL_PLAY_SHORT || command == HL_PLAY_LONG)
     {
@@ -298,6 +337,7 @@ HulaCliStatus InteractiveCLI::processCommand(const std::string &command, const s
     }
     else if (command == HL_PAUSE_SHORT || command == HL_PAUSE_LONG)
     {
+        bool wasRecording = t->getState() == RECORDING;
         try
         {
             success = t->pause();
@@ -307,22 +347,37 @@ HulaCliStatus InteractiveCLI::processCommand(const std::string &command, const s
             fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, ce.getErrorMessage().c_str());
             return HulaCliStatus::HULA_CLI_FAILURE;
         }
+
+        if (success && wasRecording && t->hasRecordError())
+        {
+            fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, ControlException(HL_RECORD_WRITE_CODE).getErrorMessage().c_str());
+            return HulaCliStatus::HULA_CLI_FAILURE;
+        }
     }
     else if (command == HL_EXPORT_SHORT || command == HL_EXPORT_LONG)
     {
         // Make sure the arg exists
-        if (args.size() > 0)
-        {
-            t->exportFile(args[0]);
-            this->outputFilePath = args[0];
-        }
-        else if (this->outputFilePath.size() != 0)
+        try
         {
-            t->exportFile(this->outputFilePath);
+            if (args.size() > 0)
+            {
+                exportFile(args[0]);
+                this->outputFilePath = args[0];
+            }
+            else if (this->outputFilePath.size() != 0)
+            {
+                exportFile(this->outputFilePath);
+            }
+            else
+            {
+                missingArg(HL_EXPORT_ARG1);
+                return HulaCliStatus::HULA_CLI_FAILURE;
+            }
         }
-        else
+        catch(const ControlException &ce)
         {
-            missingArg(HL_EXPORT_ARG1);
+            printf("\n");
+            fprintf(stderr, "%s%s\n", HL_ERROR_PREFIX, ce.getErrorMessage().c_str());
             return HulaCliStatus::HULA_CLI_FAILURE;
         }
     }
@@ -350,6 +405,29 @@ HulaCliStatus InteractiveCLI::processCommand(const std::string &command, const s
             printf("%s\n", qPrintable(CLI::tr("Discard cancelled.")));
         }
     }
+    else if (command == HL_RECOVER_SHORT || command == HL_RECOVER_LONG)
+    {
+        std::vector<std::string> sessions = t->getRecoverableSessions();
+        if (sessions.empty())
+        {
+            printf("%s\n", qPrintable(CLI::tr("There are no unfinished recordings.")));
+        }
+        else if (args.size() >= 1 && args[0] == HL_RECOVER_ARG1)
+        {
+            for (const std::string &session : sessions)
+            {
+                t->discardSession(session);
+            }
+        }
+        else
+        {
+            success = t->recoverSession(sessions.back());
+            if (success)
+            {
+                printf("%s\n", qPrintable(CLI::tr("Recovered the last unfinished recording. It can now be played or exported.")));
+            }
+        }
+    }
     else if (command == HL_LIST_SHORT || command == HL_LIST_LONG)
     {
         printDeviceList(t);
@@ -472,6 +550,27 @@ HulaCliStatus InteractiveCLI::processCommand(const std::string &command, const s
         localSettings.outputDevice = this->lastOutputDevice;
 
         printSettings(localSettings);
+        printPipelineStats(this->t);
+    }
+    else if (command == HL_METER_SHORT || command == HL_METER_LONG)
+    {
+        double seconds = HL_METER_DEFAULT_SECONDS;
+        if (args.size() != 0)
+        {
+            try
+            {
+                seconds = std::stod(args[0], nullptr);
+            }
+            catch (std::invalid_argument &e)
+            {
+                (void)e;
+
+                malformedArg(HL_METER_ARG1, args[0], "double");
+                return HulaCliStatus::HULA_CLI_FAILURE;
+            }
+        }
+
+        printSpectrumMeter(this->t, seconds);
     }
     else if (command == HL_VERSION_SHORT || command == HL_VERSION_LONG)
     {
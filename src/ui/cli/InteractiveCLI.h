@@ -36,6 +36,8 @@ namespace hula
             std::string lastInputDevice = "";
             std::string lastOutputDevice = "";
 
+            void exportFile(const std::string &path) const;
+
         public:
             InteractiveCLI(QCoreApplication *app);
 
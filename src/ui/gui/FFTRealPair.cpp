@@ -86,19 +86,34 @@ void Fft::transformRadix2(vector<double> &real, vector<double> &imag)
         throw std::domain_error("Length is not a power of 2");
     }
 
-    // Trignometric tables
-    vector<double> cosTable(n / 2);
-    vector<double> sinTable(n / 2);
-    for (size_t i = 0; i < n / 2; i++)
+    // Trignometric tables and bit-reversed addressing permutation.
+    // Kept per thread so repeated transforms of the same size don't rebuild them.
+    thread_local size_t cachedSize = 0;
+    thread_local vector<double> cosTable;
+    thread_local vector<double> sinTable;
+    thread_local vector<size_t> reversedTable;
+    if (cachedSize != n)
     {
-        cosTable[i] = std::cos(2 * M_PI * i / n);
-        sinTable[i] = std::sin(2 * M_PI * i / n);
+        cosTable.resize(n / 2);
+        sinTable.resize(n / 2);
+        for (size_t i = 0; i < n / 2; i++)
+        {
+            cosTable[i] = std::cos(2 * M_PI * i / n);
+            sinTable[i] = std::sin(2 * M_PI * i / n);
+        }
+
+        reversedTable.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            reversedTable[i] = reverseBits(i, levels);
+        }
+        cachedSize = n;
     }
 
     // Bit-reversed addressing permutation
     for (size_t i = 0; i < n; i++)
     {
-        size_t j = reverseBits(i, levels);
+        size_t j = reversedTable[i];
         if (j > i)
         {
             std::swap(real[i], real[j]);
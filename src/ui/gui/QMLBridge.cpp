@@ -20,8 +20,6 @@
 #include <random>
 #include <string>
 
-#include "FFTRealPair.h"
-
 using namespace hula;
 
 /**
@@ -66,6 +64,15 @@ QMLBridge::QMLBridge(QObject *parent) : QObject(parent)
             exit(1);
         }
     }
+
+    analyzer = new SpectrumAnalyzer();
+    visSamples.resize(HL_SPECTRUM_FFT_SIZE * NUM_CHANNELS);
+
+    transport->getController()->addDeviceListener(this);
+
+    // Emitted on the Transport's worker thread
+    connect(this, &QMLBridge::commandFinished, this, &QMLBridge::handleCommandFinished, Qt::QueuedConnection);
+
     loadSettings();
 }
 
@@ -161,138 +168,190 @@ QString QMLBridge::getTransportState() const
 }
 
 /**
- * Trigger record in the Transport and update the UI state via signal.
+ * Format a snapshot of the pipeline statistics for the diagnostics panel.
+ *
+ * @return One statistic per line
  */
-bool QMLBridge::record()
+QString QMLBridge::getPipelineStats() const
 {
-    bool success = false;
-    try
-    {
-        success = transport->record();
-    }
-    catch (const ControlException &ce)
-    {
-        QMessageBox msgBox;
-        msgBox.setWindowTitle("HulaLoop Error");
-        msgBox.setText(QString::fromStdString(ce.getErrorMessage()));
-        msgBox.setStandardButtons(QMessageBox::Ok);
-
-        if (msgBox.exec() == QMessageBox::Ok)
-        {
-        }
-
-    }
-    emit stateChanged();
+    PipelineStatsSnapshot stats = transport->getController()->getStatsSnapshot();
+    QString ms = tr("ms", "abbreviation for milliseconds");
+
+    QStringList lines;
+    lines << tr("Capture blocks: %1").arg((qulonglong)stats.captureBlocks);
+
+    //: Median, 99th percentile and longest time between blocks from the audio device
+    lines << tr("Capture interval p50/p99/max: %1 / %2 / %3 %4")
+             .arg(stats.getIntervalPercentileUs(50) / 1000, 0, 'f', 2)
+             .arg(stats.getIntervalPercentileUs(99) / 1000, 0, 'f', 2)
+             .arg(stats.maxIntervalUs / 1000.0, 0, 'f', 2)
+             .arg(ms);
+    lines << tr("Buffer time mean/max: %1 / %2 %3")
+             .arg(stats.bufferTime.getMeanUs() / 1000, 0, 'f', 2)
+             .arg(stats.bufferTime.maxUs / 1000.0, 0, 'f', 2)
+             .arg(ms);
+    lines << tr("Callback time mean/max: %1 / %2 %3")
+             .arg(stats.callbackTime.getMeanUs() / 1000, 0, 'f', 2)
+             .arg(stats.callbackTime.maxUs / 1000.0, 0, 'f', 2)
+             .arg(ms);
+    lines << tr("Disk latency mean/max: %1 / %2 %3")
+             .arg(stats.diskLatency.getMeanUs() / 1000, 0, 'f', 2)
+             .arg(stats.diskLatency.maxUs / 1000.0, 0, 'f', 2)
+             .arg(ms);
+
+    for (size_t i = 0; i < stats.rings.size(); i++)
+    {
+        const RingStats &ring = stats.rings[i];
+        QString name = ring.name.empty() ? QString("#%1").arg(i) : QString::fromStdString(ring.name);
+        double capacity = std::max<ring_buffer_size_t>(ring.capacity, 1);
+
+        //: Fill level and high-water mark in percent, then overrun, dropped sample and underrun counts
+        lines << tr("Buffer %1: fill %2% / %3%, overruns %4 (%5 samples), underruns %6")
+                 .arg(name)
+                 .arg(100 * ring.fill / capacity, 0, 'f', 0)
+                 .arg(100 * ring.highWater / capacity, 0, 'f', 0)
+                 .arg((qulonglong)ring.overruns)
+                 .arg((qulonglong)ring.droppedSamples)
+                 .arg((qulonglong)ring.underruns);
+    }
+
+    return lines.join("\n");
+}
 
-    if (success)
+/**
+ * Get the error that stopped the current recording from being written.
+ * Polled by QML while recording, since capture stops on its own then.
+ *
+ * @return Message to show, empty if the recording is fine
+ */
+QString QMLBridge::getRecordError() const
+{
+    if (transport->hasRecordError())
     {
-        startVisThread();
+        return QString::fromStdString(ControlException(HL_RECORD_WRITE_CODE).getErrorMessage());
     }
 
-    return success;
+    return QString();
+}
 
+/**
+ * Build the callback that reports a queued Transport command.
+ * It runs on the Transport's worker thread, so both signals
+ * are queued over to the GUI thread.
+ *
+ * @param command Name of the command for commandFinished()
+ * @return Callback for one of the Transport's async commands
+ */
+CommandCallback QMLBridge::reportTo(const QString &command)
+{
+    return [this, command](bool success, const std::string &error) {
+        emit commandFinished(command, success, QString::fromStdString(error));
+        emit stateChanged();
+    };
 }
 
 /**
- * Trigger stop in the Transport and update the UI state via signal.
+ * Start the visualizer once recording or playback has actually started.
+ * Runs on the GUI thread.
+ *
+ * @param command Name of the command that finished
+ * @param success True if the command succeeded
  */
-bool QMLBridge::stop()
+void QMLBridge::handleCommandFinished(const QString &command, bool success)
 {
-    bool success = false;
-    try
+    if (success && (command == "record" || command == "play"))
     {
-        success = transport->stop();
+        startVisualizer();
     }
-    catch (const ControlException &ce)
-    {
-        QMessageBox msgBox;
-        msgBox.setWindowTitle("HulaLoop Error");
-        msgBox.setText(QString::fromStdString(ce.getErrorMessage()));
-        msgBox.setStandardButtons(QMessageBox::Ok);
-
-        if (msgBox.exec() == QMessageBox::Ok)
-        {
-        }
+}
 
-    }
-    emit stateChanged();
+/**
+ * Queue record in the Transport. The outcome arrives through commandFinished().
+ */
+void QMLBridge::record()
+{
+    transport->recordAsync(reportTo("record"));
+}
 
-    stopVisThread();
+/**
+ * Queue stop in the Transport. The outcome arrives through commandFinished().
+ */
+void QMLBridge::stop()
+{
+    stopVisualizer();
+    transport->stopAsync(reportTo("stop"));
+}
 
-    return success;
+/**
+ * Queue playback in the Transport. The outcome arrives through commandFinished().
+ */
+void QMLBridge::play()
+{
+    transport->playAsync(reportTo("play"));
 }
 
 /**
- * Trigger playback in the Transport and update the UI state via signal.
+ * Queue pause in the Transport. The outcome arrives through commandFinished().
  */
-bool QMLBridge::play()
+void QMLBridge::pause()
 {
-    bool success = false;
-    try
-    {
-        success = transport->play();
-    }
-    catch (const ControlException &ce)
-    {
-        QMessageBox msgBox;
-        msgBox.setWindowTitle("HulaLoop Error");
-        msgBox.setText(QString::fromStdString(ce.getErrorMessage()));
-        msgBox.setStandardButtons(QMessageBox::Ok);
+    stopVisualizer();
+    transport->pauseAsync(reportTo("pause"));
+}
 
-        if (msgBox.exec() == QMessageBox::Ok)
+/**
+ * Deletes all the temp files that the program has created.
+ * The files are deleted in the background and discarded()
+ * is emitted once they are gone.
+ */
+void QMLBridge::discard()
+{
+    transport->discardAsync([this](float progress) {
+        if (progress >= 1)
         {
+            emit stateChanged();
+            emit discarded();
         }
+    });
+}
 
-    }
-    emit stateChanged();
-
-    if (success)
-    {
-        startVisThread();
-    }
-
-    return success;
-
+/**
+ * Get the number of sessions that an earlier run left behind,
+ * so QML can offer to recover them on startup.
+ *
+ * @return Number of recoverable sessions
+ */
+int QMLBridge::getRecoverableSessionCount() const
+{
+    return (int)transport->getRecoverableSessions().size();
 }
 
 /**
- * Trigger pause in the Transport and update the UI state via signal.
+ * Queue recovery of the newest session an earlier run left behind.
+ * Older ones stay until they are recovered or discarded.
+ * The outcome arrives through commandFinished().
  */
-bool QMLBridge::pause()
+void QMLBridge::recoverSession()
 {
-    bool success = false;
-    try
-    {
-        success = transport->pause();
-    }
-    catch (const ControlException &ce)
+    std::vector<std::string> sessions = transport->getRecoverableSessions();
+    if (sessions.empty())
     {
-        QMessageBox msgBox;
-        msgBox.setWindowTitle("HulaLoop Error");
-        msgBox.setText(QString::fromStdString(ce.getErrorMessage()));
-        msgBox.setStandardButtons(QMessageBox::Ok);
-
-        if (msgBox.exec() == QMessageBox::Ok)
-        {
-        }
-
+        return;
     }
-    emit stateChanged();
 
-    stopVisThread();
-
-    return success;
+    transport->recoverSessionAsync(sessions.back(), reportTo("recover"));
 }
 
 /**
- * Deletes all the temp files that the program has created
+ * Delete every session an earlier run left behind, with all of its
+ * temp files. The files are deleted in the background.
  */
-void QMLBridge::discard()
+void QMLBridge::discardRecoverableSessions()
 {
-    transport->discard();
-
-    emit stateChanged();
-    emit discarded();
+    for (const std::string &session : transport->getRecoverableSessions())
+    {
+        transport->discardSessionAsync(session);
+    }
 }
 
 /**
@@ -504,6 +563,28 @@ QString QMLBridge::getOutputDevices()
     return QString::fromStdString(devices);
 }
 
+/**
+ * Get the generation of the device list so QML can tell
+ * whether the lists it holds are out of date.
+ *
+ * @return Current device generation
+ */
+int QMLBridge::getDeviceGeneration()
+{
+    return (int)transport->getController()->getDeviceGeneration();
+}
+
+/**
+ * Called from the device watcher thread when the device list changes.
+ * The signal is queued over to the GUI thread.
+ *
+ * @param generation Generation of the new device list
+ */
+void QMLBridge::handleDevicesChanged(uint64_t generation)
+{
+    emit devicesChanged();
+}
+
 /**
  * Modifies settings to display record devices.
  *
@@ -556,7 +637,9 @@ QString QMLBridge::getSelectedLanguage()
 }
 
 /**
- * Get the directory the user wants to save to
+ * Export the recording to the directory the user wants to save to.
+ * The export runs in the background and reports through exportProgress(),
+ * then commandFinished().
  *
  * @param QString containing the directory
  *
@@ -572,140 +655,102 @@ void QMLBridge::saveFile(QString dir)
         substrLen = 8;
     }
     directory = directory.substr(substrLen);
-    transport->exportFile(directory);
+    transport->exportFileAsync(directory, [this](float progress) {
+        emit exportProgress(progress);
+    }, reportTo("export"));
 }
 
 /**
- * Start the thread that reads the ring buffer and updates
- * the visualizer.
+ * Start feeding the visualizer. Audio is only pulled
+ * while the window is visible.
  */
-void QMLBridge::startVisThread()
+void QMLBridge::startVisualizer()
 {
-    // Stop the previous thread if present
-    stopVisThread();
+    visRequested = true;
+    updateVisReader();
+}
 
-    // Reset the state
-    endVis.store(false);
+/**
+ * Stop feeding the visualizer.
+ */
+void QMLBridge::stopVisualizer()
+{
+    visRequested = false;
+    updateVisReader();
+}
 
-    // Start the new thread
-    visThreads.emplace_back(std::thread(&updateVisualizer, this));
+/**
+ * Called from QML when the window is shown, hidden to the
+ * tray or minimized. Nothing is drawn while it can't be seen,
+ * so the reader is detached and no audio is analyzed.
+ *
+ * @param visible True if the visualizer can be seen
+ */
+void QMLBridge::setVisualizerVisible(bool visible)
+{
+    visVisible = visible;
+    updateVisReader();
 }
 
 /**
- * Stop the thread that updates the visualizer.
+ * Attach or detach the visualizer reader to match the current state.
  */
-void QMLBridge::stopVisThread()
+void QMLBridge::updateVisReader()
 {
-    endVis.store(true);
+    bool wanted = visRequested && visVisible;
+    if (wanted == readerAttached)
+    {
+        return;
+    }
 
-    for (auto &t : visThreads)
+    if (wanted)
     {
-        if (t.joinable())
-        {
-            t.join();
-        }
+        transport->getController()->addReader(rb);
+        rb->clear();
     }
-    visThreads.clear();
+    else
+    {
+        transport->getController()->removeReader(rb);
+    }
+    readerAttached = wanted;
 }
 
 /**
- * Perform FFT and update the visualizer.
+ * Analyze the latest audio and update the visualizer.
+ *
+ * Called by a QML timer once per frame while the window is visible,
+ * so the work follows the display instead of the capture rate.
+ * Only the newest window is read. Anything older would never be drawn.
  */
-void QMLBridge::updateVisualizer(QMLBridge *_this)
+void QMLBridge::updateVisualizer()
 {
-
-    _this->transport->getController()->addBuffer(_this->rb);
-
-    int maxSize = 512;
-    int accuracy = 8;
-    ring_buffer_size_t samplesProcessed = 0;
-    // float *temp = new float[maxSize];
-
-    while (!_this->endVis.load())
+    if (!readerAttached)
     {
-        std::vector<double> actualoutreal;
-        std::vector<double> actualoutimag;
-        std::vector<double> realData;
-
-        float *data1;
-        float *data2;
-        ring_buffer_size_t size1;
-        ring_buffer_size_t size2;
-        ring_buffer_size_t samplesRead = 0;
-
-        while (!_this->endVis.load() && actualoutreal.size() < maxSize)
-        {
-            // Keep draining the buffer, but only actually
-            // process the drained data every nth cycle
-            samplesRead = _this->rb->directRead(maxSize, (void **)&data1, &size1, (void **)&data2, &size2);
-            // hlDebug() << "Process " << samplesRead << std::endl;
-
-            for (int i = 0; i < size1 && actualoutreal.size() < maxSize; i++)
-            {
-                actualoutimag.push_back(data1[i]);
-                actualoutreal.push_back(data1[i]);
-                realData.push_back(data1[i]);
-            }
-
-            for (int i = 0; i < size2 && actualoutreal.size() < maxSize; i++)
-            {
-                actualoutimag.push_back(data2[i]);
-                actualoutreal.push_back(data2[i]);
-                realData.push_back(data2[i]);
-            }
-
-            samplesProcessed += samplesRead;
-        }
-
-        Fft::transform(actualoutreal, actualoutimag);
-
-        std::vector<double> heights;
-        double sum = 0;
-        for (int i = 0; i < actualoutreal.size(); i++)
-        {
-            if (i % 8 == 0)
-            {
-                sum = fabs(sum);
-
-                #if _WIN32
-                // Adjust the values since WASAPI data comes in screaming loud
-                heights.push_back(sum * 0.3);
-                #else
-                heights.push_back(sum);
-                #endif
-
-                sum = 0;
-            }
-            else
-            {
-                sum += actualoutreal[i];
-            }
-        }
-
-        _this->emit visData(realData, heights, samplesProcessed);
-        samplesProcessed = 0;
+        return;
+    }
 
-        // Accumulate some audio
-        // We have to make sure this delay is shorter than the length of the ring buffer
-        // We approximate it to accuracy * the length (seconds) of our buffer period
-        std::this_thread::sleep_for(std::chrono::milliseconds((maxSize / NUM_CHANNELS * 1000 / SAMPLE_RATE) * accuracy));
+    uint64_t newSamples = 0;
+    ring_buffer_size_t count = rb->readLatest(visSamples.data(), visSamples.size(), &newSamples);
+    if (!analyzer->analyzeSnapshot(visSamples.data(), count, newSamples) || !analyzer->getLatest(visFrame))
+    {
+        return;
+    }
 
-        // Completely drain the rest of the buffer
-        samplesRead = 1;
-        while (samplesRead != 0)
-        {
-            samplesRead = _this->rb->directRead(maxSize * 2, (void **)&data1, &size1, (void **)&data2, &size2);
-            // hlDebug() << "Read " << bytesRead << std::endl;
-            samplesProcessed += samplesRead;
-        }
+    // Number of raw samples passed on for the timeline
+    size_t rawSize = 512;
+    size_t rawStart = visFrame.waveform.size() - std::min(rawSize, visFrame.waveform.size());
+    std::vector<qreal> realData(visFrame.waveform.begin() + rawStart, visFrame.waveform.end());
 
-        // Accumulate more audio
-        // We have to make sure this delay is shorter than the length of the ring buffer
-        // We approximate it to accuracy * the length (seconds) of our buffer period
-        std::this_thread::sleep_for(std::chrono::milliseconds((maxSize / NUM_CHANNELS * 1000 / SAMPLE_RATE)));
+    std::vector<qreal> heights(visFrame.bands.begin(), visFrame.bands.end());
+    #if _WIN32
+    // Adjust the values since WASAPI data comes in screaming loud
+    for (auto &height : heights)
+    {
+        height *= 0.3;
     }
+    #endif
 
-    _this->transport->getController()->removeBuffer(_this->rb);
+    emit visData(realData, heights, (int)newSamples);
 }
 
 /**
@@ -733,6 +778,12 @@ void QMLBridge::launchUpdateProcess()
  */
 bool QMLBridge::wannaClose()
 {
+    // Still discarding for an earlier close request
+    if (waitingForDiscard)
+    {
+        return false;
+    }
+
     // Check if user has unsaved audio
     if (transport->hasExportPaths())
     {
@@ -755,7 +806,7 @@ bool QMLBridge::wannaClose()
         else
         {
             // the user wanted to exit, exit and delete files
-            transport->discard();
+            discardAndWait();
             return true;
         }
     }
@@ -771,7 +822,35 @@ bool QMLBridge::wannaClose()
  */
 void QMLBridge::cleanTempFiles()
 {
-    transport->discard();
+    discardAndWait();
+}
+
+/**
+ * Discard on the Transport's worker thread and wait until it is done.
+ * The window keeps drawing meanwhile, so a command that is still
+ * running, such as an export, can show its progress until it finishes.
+ * Clicks are ignored so that nothing new is queued behind the discard.
+ */
+void QMLBridge::discardAndWait()
+{
+    waitingForDiscard = true;
+
+    std::future<void> done = transport->discardAsync();
+    while (done.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+    {
+        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+    }
+
+    try
+    {
+        done.get();
+    }
+    catch (const ControlException &ce)
+    {
+        hlDebug() << "Discard failed: " << ce.getErrorMessage() << std::endl;
+    }
+
+    waitingForDiscard = false;
 }
 
 /**
@@ -781,8 +860,10 @@ QMLBridge::~QMLBridge()
 {
     hlDebugf("QMLBridge destructor called\n");
 
-    stopVisThread();
+    stopVisualizer();
     saveSettings();
-    delete transport;
+    transport->getController()->removeDeviceListener(this);
     delete rb;
+    delete transport;
+    delete analyzer;
 }
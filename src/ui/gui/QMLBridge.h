@@ -1,11 +1,9 @@
 #ifndef QMLBRIDGE_H
 #define QMLBRIDGE_H
 
-#include <atomic>
 #include <QObject>
 #include <QString>
 #include <QStringList>
-#include <thread>
 #include <vector>
 
 #include <hlaudio/hlaudio.h>
@@ -17,17 +15,37 @@ namespace hula
      * Class for communicating between QML and C++.
      * This is designed to be added as a QML type and used in QML.
      */
-    class QMLBridge : public QObject {
+    class QMLBridge : public QObject, public IDeviceListener {
             Q_OBJECT
             Q_PROPERTY(QString emptyStr READ getEmptyStr NOTIFY languageChanged)
             Q_PROPERTY(QString visType READ getVisualizerType WRITE setVisualizerType)
 
         private:
             Transport *transport;
-            HulaRingBuffer *rb;
+            HulaBroadcastReader *rb;
+            SpectrumAnalyzer *analyzer;
 
-            std::vector<std::thread> visThreads;
-            std::atomic<bool> endVis;
+            /**
+             * Visualizer state. Only touched on the GUI thread.
+             * The reader is only attached while the visualizer is
+             * running and the window can actually be seen.
+             */
+            bool visRequested = false;
+            bool visVisible = true;
+            bool readerAttached = false;
+            std::vector<float> visSamples;
+            SpectrumFrame visFrame;
+
+            void updateVisReader();
+
+            CommandCallback reportTo(const QString &command);
+
+            /**
+             * True while discardAndWait() waits for the Transport.
+             */
+            bool waitingForDiscard = false;
+
+            void discardAndWait();
 
             bool showRecDevices;
             QString visType, language;
@@ -46,6 +64,9 @@ namespace hula
             Q_INVOKABLE bool setActiveOutputDevice(QString QDeviceName);
             Q_INVOKABLE QString getInputDevices();
             Q_INVOKABLE QString getOutputDevices();
+            Q_INVOKABLE int getDeviceGeneration();
+
+            void handleDevicesChanged(uint64_t generation);
 
             Q_INVOKABLE void setShowRecordDevices(bool);
             Q_INVOKABLE bool getShowRecordDevices();
@@ -53,25 +74,34 @@ namespace hula
             Q_INVOKABLE QString getSelectedLanguage();
 
             Q_INVOKABLE QString getTransportState() const;
-            Q_INVOKABLE bool record();
-            Q_INVOKABLE bool stop();
-            Q_INVOKABLE bool play();
-            Q_INVOKABLE bool pause();
+            Q_INVOKABLE QString getPipelineStats() const;
+            Q_INVOKABLE QString getRecordError() const;
+            Q_INVOKABLE void record();
+            Q_INVOKABLE void stop();
+            Q_INVOKABLE void play();
+            Q_INVOKABLE void pause();
             Q_INVOKABLE void discard();
 
+            Q_INVOKABLE int getRecoverableSessionCount() const;
+            Q_INVOKABLE void recoverSession();
+            Q_INVOKABLE void discardRecoverableSessions();
+
             QString getEmptyStr();
 
             Q_INVOKABLE void saveFile(QString dir);
             Q_INVOKABLE void cleanTempFiles();
             Q_INVOKABLE bool wannaClose();
 
-            void startVisThread();
-            void stopVisThread();
-            static void updateVisualizer(QMLBridge *_this);
-            static void reverseBits(size_t x, int n);
+            void startVisualizer();
+            void stopVisualizer();
+            Q_INVOKABLE void setVisualizerVisible(bool visible);
+            Q_INVOKABLE void updateVisualizer();
 
             Q_INVOKABLE void launchUpdateProcess();
 
+        private slots:
+            void handleCommandFinished(const QString &command, bool success);
+
         signals:
             /**
              * Signal emmitted when the Transport changes states.
@@ -84,13 +114,18 @@ namespace hula
              */
             void languageChanged();
 
+            /**
+             * Signal emmitted when an audio device is added, removed or changed.
+             * The device lists only need to be fetched again after this.
+             */
+            void devicesChanged();
+
             /**
              * Signal emitted when the visualizer needs to update.
              *
              * @param rawData Unprocessed time-domain samples
              * @param dataIn FFT proccessed frequency-domain samples
-             * @param samplesProcessed The number of samples passed into the function
-             *          plus the number of samples eaten while ignoring audio
+             * @param samplesProcessed The number of samples captured since the previous update
              */
             void visData(const std::vector<qreal> &rawData, const std::vector<qreal> &dataIn, int samplesProcessed);
 
@@ -98,6 +133,24 @@ namespace hula
              * Signal emmitted when the Transport successfully discards.
              */
             void discarded();
+
+            /**
+             * Signal emitted while the recording is being exported.
+             *
+             * @param progress How much of the export is done, from 0 to 1.
+             *                 1 is emitted once the export is complete.
+             */
+            void exportProgress(qreal progress);
+
+            /**
+             * Signal emitted once a command queued on the Transport has run.
+             * Emitted before the stateChanged() that follows it.
+             *
+             * @param command "record", "stop", "play", "pause", "export" or "recover"
+             * @param success False if the command was not allowed or failed
+             * @param error Message to show if the command failed, empty otherwise
+             */
+            void commandFinished(const QString &command, bool success, const QString &error);
     };
 }
 
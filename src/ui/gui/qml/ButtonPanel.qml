@@ -18,6 +18,105 @@ Rectangle {
 
     property var triggerPlayPause: playpauseBtn.onClicked
 
+    // Commands run in the background, so the buttons follow their outcome
+    Connections {
+        target: qmlbridge
+
+        onCommandFinished: {
+            if (error !== "")
+            {
+                errorDialog.text = error
+                errorDialog.open()
+            }
+
+            if (command === "record")
+            {
+                if(success && (qmlbridge.getTransportState() === qsTr("Recording", "state")))
+                {
+                    // Update stop button
+                    stopBtn.enabled = true
+
+                    // Update play/pause button
+                    playpauseBtn.enabled = true;
+                    playpauseBtn.contentItem.text = MDFont.Icon.pause;
+                    playpauseBtn.contentItem.color = "white";
+                    playpauseBtn.tttext = "Pause audio"
+
+                    // Update record button
+                    recordBtn.enabled = false;
+                }
+            }
+            else if (command === "stop" || command === "recover")
+            {
+                if(success && (qmlbridge.getTransportState() === qsTr("Stopped", "state")))
+                {
+                    stopBtn.enabled = false;
+
+                    recordBtn.enabled = true;
+                    recordBtn.contentItem.text = MDFont.Icon.delete;
+                    stopBtn.isStopped = true;
+
+                    playpauseBtn.enabled = true;
+                    playpauseBtn.contentItem.text = MDFont.Icon.play;
+                    playpauseBtn.contentItem.color = "green";
+
+                    exportBtn.enabled = !exportProgressBar.visible;
+
+                    timeFuncs.time = 0
+                    recordingTimer.stop()
+                }
+            }
+            else if (command === "pause")
+            {
+                if(success && (qmlbridge.getTransportState() === qsTr("Paused", "state")))
+                {
+                    playpauseBtn.contentItem.text = MDFont.Icon.play;
+                    playpauseBtn.contentItem.color = "green";
+                    playpauseBtn.tttext = "Playback audio"
+
+                    if(!stopBtn.isStopped)
+                    {
+                        stopBtn.enabled = true;
+                        recordBtn.enabled = true;
+                    }
+                    recordingTimer.stop()
+                }
+            }
+            else if (command === "play")
+            {
+                if(success && (qmlbridge.getTransportState() === qsTr("Playing", "state")))
+                {
+                    playpauseBtn.contentItem.text = MDFont.Icon.pause;
+                    playpauseBtn.contentItem.color = "white";
+
+                    if(!stopBtn.isStopped)
+                    {
+                        stopBtn.enabled = false;
+                        recordBtn.enabled = false;
+                    }
+                }
+            }
+            else if (command === "export")
+            {
+                // The recording is kept if the export failed, so it can be tried again
+                exportProgressBar.visible = false
+                exportBtn.enabled = !success
+            }
+        }
+
+        onExportProgress: {
+            exportProgressBar.value = progress
+        }
+    }
+
+    MessageDialog {
+        id: errorDialog
+        objectName: "errorDialog"
+
+        title: qsTr("HulaLoop Error")
+        buttons: MessageDialog.Ok
+    }
+
     Timer {
         id: countDownTimer
         objectName: "countDownTimer"
@@ -51,6 +150,16 @@ Rectangle {
         repeat: true
         property bool inf: false
         onTriggered: {
+            // The recording can no longer be written, so stop it
+            var recordError = qmlbridge.getRecordError()
+            if (recordError !== "") {
+                recordingTimer.stop()
+                errorDialog.text = recordError
+                errorDialog.open()
+                stopBtn.onClicked();
+                return
+            }
+
             // Since the timer starts at 0, go to endTime - 1
             if (!recordingTimer.inf && timeFuncs.time >= timeFuncs.time2 - 1) {
                 window.textDisplayed = qsTr("Elapsed: %1").arg(++timeFuncs.time)
@@ -144,24 +253,9 @@ Rectangle {
                         recordingTimer.inf = true
                     }
 
-                    let success = qmlbridge.record()
+                    qmlbridge.record()
 
                     recordingTimer.start()
-
-                    if(success && (qmlbridge.getTransportState() === qsTr("Recording", "state")))
-                    {
-                        // Update stop button
-                        stopBtn.enabled = true
-
-                        // Update play/pause button
-                        playpauseBtn.enabled = true;
-                        playpauseBtn.contentItem.text = MDFont.Icon.pause;
-                        playpauseBtn.contentItem.color = "white";
-                        playpauseBtn.tttext = "Pause audio"
-
-                        // Update self
-                        enabled = false;
-                    }
                 }
             }
 
@@ -196,26 +290,8 @@ Rectangle {
                 }
 
                 onClicked: {
-                    let success = qmlbridge.stop()
-                    console.log("Test: " + success)
+                    qmlbridge.stop()
                     recordBtn.tttext = "Discard recording"
-                    if(success && (qmlbridge.getTransportState() === qsTr("Stopped", "state")))
-                    {
-                        enabled = false;
-
-                        recordBtn.enabled = true;
-                        recordBtn.contentItem.text = MDFont.Icon.delete;
-                        isStopped = true;
-
-                        playpauseBtn.enabled = true;
-                        playpauseBtn.contentItem.text = MDFont.Icon.play;
-                        playpauseBtn.contentItem.color = "green";
-
-                        exportBtn.enabled = true;
-
-                        timeFuncs.time = 0
-                        recordingTimer.stop()
-                    }
                 }
 
             }
@@ -252,44 +328,14 @@ Rectangle {
                 }
 
                 onClicked: {
-
-                    let success;
-
                     if(contentItem.text === MDFont.Icon.pause)
                     {
-                        success = qmlbridge.pause();
-
-                        if(success && (qmlbridge.getTransportState() === qsTr("Paused", "state")))
-                        {
-                            contentItem.text = MDFont.Icon.play;
-                            contentItem.color = "green";
-                            playpauseBtn.tttext = "Playback audio"
-
-                            if(!stopBtn.isStopped)
-                            {
-                                stopBtn.enabled = true;
-                                recordBtn.enabled = true;
-                            }
-                            recordingTimer.stop()
-                        }
+                        qmlbridge.pause();
                     }
                     else
                     {
-                        success = qmlbridge.play();
-
-                        if(success && (qmlbridge.getTransportState() === qsTr("Playing", "state")))
-                        {
-                            contentItem.text = MDFont.Icon.pause;
-                            contentItem.color = "white";
-
-                            if(!stopBtn.isStopped)
-                            {
-                                stopBtn.enabled = false;
-                                recordBtn.enabled = false;
-                            }
-                        }
+                        qmlbridge.play();
                     }
-
                 }
             }
 
@@ -357,6 +403,19 @@ Rectangle {
                 onClicked: saveDialog.open()
             }
 
+            ProgressBar {
+                id: exportProgressBar
+                objectName: "exportProgressBar"
+
+                Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
+                Layout.preferredWidth: Math.round(buttonPanel.width * 0.08)
+                visible: false
+
+                from: 0
+                to: 1
+                value: 0
+            }
+
             RoundButton {
                 id: checkUpdateBtn
                 objectName: "checkUpdateBtn"
@@ -564,6 +623,11 @@ Rectangle {
             nameFilters: ["WAVE Sound (*.wav)", "FLAC (*.flac)", "Core Audio Format (*.caf)", "Audio Interchange File Format (*.aiff)", "RAW Format (*.raw)", "All files (*)"]
             folder: StandardPaths.writableLocation(StandardPaths.DocumentsLocation)
             onAccepted: {
+                // Export stays disabled until the export is done
+                exportBtn.enabled = false
+                exportProgressBar.value = 0
+                exportProgressBar.visible = true
+
                 qmlbridge.saveFile(saveDialog.currentFile);
             }
         }
@@ -591,18 +655,41 @@ Rectangle {
                 ToolTip.visible: hovered
                 ToolTip.text: qsTr("Change input device")
 
+                property int deviceGeneration: -1
+
+                // Rebuild the list only if the devices changed since the last time
+                function reloadDevices() {
+                    var generation = qmlbridge.getDeviceGeneration()
+                    if (generation === deviceGeneration)
+                        return
+                    deviceGeneration = generation
+
+                    if(currentIndex != -1)
+                        selectedInd = currentIndex;
+
+                    model.clear();
+                    var idevices = qmlbridge.getInputDevices().split('%%%%%%')
+                    var i
+                    for (i = 0; i < idevices.length; i++) {
+                        model.append({
+                            "text": idevices[i]
+                        })
+                    }
+
+                    // Keep the previously selected device active
+                    currentIndex = selectedInd
+                }
+
+                Connections {
+                    target: qmlbridge
+                    onDevicesChanged: iDeviceInfoLabel.reloadDevices()
+                }
+
                 model: ListModel {
                     id: iDeviceItems
-                    Component.onCompleted: {
-                        var idevices = qmlbridge.getInputDevices().split('%%%%%%')
-                        var i
-                        for (i = 0; i < idevices.length; i++) {
-                            append({
-                                "text": idevices[i]
-                            })
-                        }
-                    }
                 }
+
+                Component.onCompleted: reloadDevices()
                 onActivated: {
                     console.log("Audio device has been changed to: " + iDeviceInfoLabel.currentText);
                     let success = qmlbridge.setActiveInputDevice(iDeviceInfoLabel.currentText);
@@ -614,23 +701,7 @@ Rectangle {
                     }
                 }
 
-                onPressedChanged: {
-
-                    if(currentIndex != -1)
-                        selectedInd = currentIndex;
-
-                    model.clear();
-                    var idevices = qmlbridge.getInputDevices().split('%%%%%%')
-                        var i
-                        for (i = 0; i < idevices.length; i++) {
-                            model.append({
-                                "text": idevices[i]
-                            })
-                        }
-
-                    // Keep the previously selected device active
-                    currentIndex = selectedInd
-                }
+                onPressedChanged: reloadDevices()
             }
             Label {
                 id: outputDeviceLabel
@@ -651,18 +722,41 @@ Rectangle {
                 ToolTip.visible: hovered
                 ToolTip.text: qsTr("Change output device")
 
+                property int deviceGeneration: -1
+
+                // Rebuild the list only if the devices changed since the last time
+                function reloadDevices() {
+                    var generation = qmlbridge.getDeviceGeneration()
+                    if (generation === deviceGeneration)
+                        return
+                    deviceGeneration = generation
+
+                    if(currentIndex != -1)
+                        selectedInd = currentIndex;
+
+                    model.clear();
+                    var odevices = qmlbridge.getOutputDevices().split('%%%%%%')
+                    var i
+                    for (i = 0; i < odevices.length; i++) {
+                        model.append({
+                            "text": odevices[i]
+                        })
+                    }
+
+                    // Keep the previously selected device active
+                    currentIndex = selectedInd
+                }
+
+                Connections {
+                    target: qmlbridge
+                    onDevicesChanged: oDeviceInfoLabel.reloadDevices()
+                }
+
                 model: ListModel {
                     id: oDeviceItems
-                    Component.onCompleted: {
-                        var odevices = qmlbridge.getOutputDevices().split('%%%%%%')
-                        var i
-                        for (i = 0; i < odevices.length; i++) {
-                            append({
-                                "text": odevices[i]
-                            })
-                        }
-                    }
                 }
+
+                Component.onCompleted: reloadDevices()
                 onActivated: {
                     console.log("Audio device has been changed to: " + oDeviceInfoLabel.currentText);
                     let success = qmlbridge.setActiveOutputDevice(oDeviceInfoLabel.currentText);
@@ -674,23 +768,7 @@ Rectangle {
                     }
                 }
 
-                onPressedChanged: {
-
-                    if(currentIndex != -1)
-                        selectedInd = currentIndex;
-
-                    model.clear();
-                    var odevices = qmlbridge.getOutputDevices().split('%%%%%%')
-                        var i
-                        for (i = 0; i < odevices.length; i++) {
-                            model.append({
-                                "text": odevices[i]
-                            })
-                        }
-
-                    // Keep the previously selected device active
-                    currentIndex = selectedInd
-                }
+                onPressedChanged: reloadDevices()
             }
         }
 
@@ -822,6 +900,30 @@ Rectangle {
 
             }
 
+            Label {
+                font.family: "Roboto"
+                text: qsTr("Diagnostics") + qmlbridge.emptyStr
+                color: "white"
+            }
+
+            Label {
+                id: pipelineStats
+                objectName: "pipelineStats"
+
+                font.family: "monospace"
+                font.pixelSize: 11
+                color: "white"
+
+                // Only polled while the settings are open
+                Timer {
+                    interval: 500
+                    running: settingsPopup.visible
+                    repeat: true
+                    triggeredOnStart: true
+                    onTriggered: pipelineStats.text = qmlbridge.getPipelineStats()
+                }
+            }
+
         }
 
     }
@@ -5,6 +5,8 @@ import QtQuick.Controls 2.3
 import QtQuick.Controls.Material 2.3
 import QtQuick.Layouts 1.3
 
+import Qt.labs.platform 1.0 as Platform
+
 import hulaloop.qmlbridge 1.0
 import hulaloop.systrayicon 1.0
 
@@ -33,6 +35,11 @@ ApplicationWindow {
 
     property bool anim: false
 
+    // False while hidden to the tray or minimized. Nothing is drawn then.
+    property bool visualizerShown: window.visible && window.visibility !== Window.Minimized
+
+    onVisualizerShownChanged: qmlbridge.setVisualizerVisible(visualizerShown)
+
     QMLBridge {
         id: qmlbridge
 
@@ -166,6 +173,30 @@ ApplicationWindow {
         }
     }
 
+    // Pull new visualizer data once per frame while it can be seen
+    Timer {
+        id: visTimer
+        interval: 16
+        running: visualizerShown
+        repeat: true
+
+        onTriggered: qmlbridge.updateVisualizer()
+    }
+
+    // Offered on startup if an earlier run crashed or was closed without exporting
+    Platform.MessageDialog {
+        id: recoveryDialog
+        objectName: "recoveryDialog"
+
+        title: qsTr("Unfinished Recording")
+        text: qsTr("Found %1 unfinished recording(s) from an earlier run.").arg(qmlbridge.getRecoverableSessionCount())
+        informativeText: qsTr("Open recovers the newest one so that it can be played or exported. Discard deletes all of them.")
+        buttons: Platform.MessageDialog.Open | Platform.MessageDialog.Discard | Platform.MessageDialog.Ignore
+
+        onOpenClicked: qmlbridge.recoverSession()
+        onDiscardClicked: qmlbridge.discardRecoverableSessions()
+    }
+
     SystemTrayIcon {
         id: systrayicon
 
@@ -337,6 +368,15 @@ ApplicationWindow {
         id: bottomRectangle
     }
 
+    Component.onCompleted: {
+        qmlbridge.setVisualizerVisible(visualizerShown)
+
+        if (qmlbridge.getRecoverableSessionCount() > 0)
+        {
+            recoveryDialog.open()
+        }
+    }
+
     onClosing: {
         // This gets called when the user presses the exit btn
         var wannaClose = qmlbridge.wannaClose();